@@ -48,6 +48,7 @@
 #include "RouterInfo.h"
 #include "Version.h"
 #include "Streaming.h"
+#include "core/crypto/AES.h"
 #include "core/util/Log.h"
 #include "transport/NTCPSession.h"
 #include "transport/Transports.h"
@@ -73,6 +74,9 @@ bool Daemon_Singleton::IsService() const {
 // TODO(anonimal): find a better way to initialize
 bool Daemon_Singleton::Init() {
   LogPrint(eLogInfo, "Daemon_Singleton: initializing");
+  // Must precede anything that sets AES keys
+  i2p::crypto::SetAESBackend(
+      i2p::util::config::var_map["aes-backend"].as<std::string>());
   i2p::context.Init(
       i2p::util::config::var_map["host"].as<std::string>(),
       i2p::util::config::var_map["port"].as<int>(),
@@ -94,7 +98,19 @@ bool Daemon_Singleton::Init() {
       i2p::context.SetHighBandwidth();
     else
       i2p::context.SetLowBandwidth();
+    i2p::transport::transports.SetBandwidthLimit(
+        i2p::transport::GetBandwidthClassLimit(bandwidth[0]));
   }
+  i2p::tunnel::tunnels.SetNumDataThreads(
+      i2p::util::config::var_map["tunnel-threads"].as<std::size_t>());
+  i2p::tunnel::tunnels.SetNumBuildThreads(
+      i2p::util::config::var_map["tunnel-build-threads"].as<std::size_t>());
+  i2p::transport::transports.SetNumSSUThreads(
+      i2p::util::config::var_map["ssu-threads"].as<std::size_t>());
+  i2p::transport::transports.SetDuplicateFilterSize(
+      i2p::util::config::var_map["ssu-duplicate-filter-size"].as<std::size_t>(),
+      i2p::util::config::var_map["duplicate-filter-size"].as<std::size_t>(),
+      i2p::util::config::var_map["duplicate-filter-fp-rate"].as<double>());
   // Set reseed options
   i2p::context.ReseedFrom(
       i2p::util::config::var_map["reseed-from"].as<std::string>());
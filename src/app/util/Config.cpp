@@ -139,7 +139,35 @@ bool ParseArgs(
 
     ("bandwidth,b", bpo::value<std::string>()->default_value("L"),
      "L if bandwidth is limited to 32Kbs/sec, O if not\n"
-     "Always O if floodfill, otherwise L by default\n");
+     "Always O if floodfill, otherwise L by default\n"
+     "K, M, N, P and X set the limit of that class:\n"
+     "12, 64, 128, 2000 and 4000 KBs/sec\n")
+
+    ("tunnel-threads", bpo::value<std::size_t>()->default_value(1),
+     "Number of threads processing tunnel data\n"
+     "Each thread owns a share of transit and inbound tunnels\n")
+
+    ("tunnel-build-threads", bpo::value<std::size_t>()->default_value(1),
+     "Number of threads handling tunnel build requests from other routers\n"
+     "Each request costs an ElGamal decryption\n")
+
+    ("ssu-threads", bpo::value<std::size_t>()->default_value(1),
+     "Number of threads processing SSU sessions\n"
+     "On Linux each also reads its own socket bound with SO_REUSEPORT\n")
+
+    ("aes-backend", bpo::value<std::string>()->default_value("auto"),
+     "AES implementation, auto selects the fastest supported by the CPU\n"
+     "auto | generic | aesni | aesni-interleaved | vaes-avx2 | vaes-avx512\n")
+
+    ("duplicate-filter-size", bpo::value<std::size_t>()->default_value(20000),
+     "Message IDs remembered router-wide to drop duplicate messages\n")
+
+    ("ssu-duplicate-filter-size",
+     bpo::value<std::size_t>()->default_value(1000),
+     "Message IDs remembered by each SSU session to drop duplicates\n")
+
+    ("duplicate-filter-fp-rate", bpo::value<double>()->default_value(0.001),
+     "Rate of new messages the duplicate filters may wrongly drop\n");
 
   // TODO(unassigned): do we want proxy/i2pcs options in CLI
   // if we can redirect future multiple running instances
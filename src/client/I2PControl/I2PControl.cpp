@@ -45,6 +45,7 @@
 #include "core/NetworkDatabase.h"
 #include "core/RouterContext.h"
 #include "core/Version.h"
+#include "crypto/AES.h"
 #include "crypto/Rand.h"
 #include "transport/Transports.h"
 #include "tunnel/Tunnel.h"
@@ -254,6 +255,9 @@ I2PControlSession::I2PControlSession(
   m_RouterInfoHandlers[constants::ROUTER_INFO_NET_STATUS] =
     &I2PControlSession::HandleNetStatus;
 
+  m_RouterInfoHandlers[constants::ROUTER_INFO_NET_DUPLICATES] =
+    &I2PControlSession::HandleNetDuplicates;
+
   m_RouterInfoHandlers[constants::ROUTER_INFO_TUNNELS_PARTICIPATING] =
     &I2PControlSession::HandleTunnelsParticipating;
 
@@ -266,12 +270,45 @@ I2PControlSession::I2PControlSession(
   m_RouterInfoHandlers[constants::ROUTER_INFO_TUNNELS_OUT_LIST] =
     &I2PControlSession::HandleTunnelsOutList;
 
+  m_RouterInfoHandlers[constants::ROUTER_INFO_TUNNELS_QUEUE_HIGH_WATER_MARK] =
+    &I2PControlSession::HandleTunnelsQueueHighWaterMark;
+
+  m_RouterInfoHandlers[constants::ROUTER_INFO_TUNNELS_QUEUE_DROPPED] =
+    &I2PControlSession::HandleTunnelsQueueDropped;
+
+  m_RouterInfoHandlers[constants::ROUTER_INFO_TUNNELS_BUILD_QUEUE] =
+    &I2PControlSession::HandleTunnelsBuildQueue;
+
+  m_RouterInfoHandlers[constants::ROUTER_INFO_TUNNELS_BUILD_ACCEPTED] =
+    &I2PControlSession::HandleTunnelsBuildAccepted;
+
+  m_RouterInfoHandlers[constants::ROUTER_INFO_TUNNELS_BUILD_REJECTED] =
+    &I2PControlSession::HandleTunnelsBuildRejected;
+
+  m_RouterInfoHandlers[constants::ROUTER_INFO_TUNNELS_BUILD_DROPPED] =
+    &I2PControlSession::HandleTunnelsBuildDropped;
+
+  m_RouterInfoHandlers[constants::ROUTER_INFO_TUNNELS_BUILD_TIME] =
+    &I2PControlSession::HandleTunnelsBuildTime;
+
+  m_RouterInfoHandlers[constants::ROUTER_INFO_TUNNELS_ADMISSION] =
+    &I2PControlSession::HandleTunnelsAdmission;
+
+  m_RouterInfoHandlers[constants::ROUTER_INFO_TUNNELS_TRANSIT_DROPPED] =
+    &I2PControlSession::HandleTunnelsTransitDropped;
+
+  m_RouterInfoHandlers[constants::ROUTER_INFO_TUNNELS_TRANSIT_TOP] =
+    &I2PControlSession::HandleTunnelsTransitTop;
+
   m_RouterInfoHandlers[constants::ROUTER_INFO_BW_IB_1S] =
     &I2PControlSession::HandleInBandwidth1S;
 
   m_RouterInfoHandlers[constants::ROUTER_INFO_BW_OB_1S] =
     &I2PControlSession::HandleOutBandwidth1S;
 
+  m_RouterInfoHandlers[constants::ROUTER_INFO_CRYPTO_AES_BACKEND] =
+    &I2PControlSession::HandleAESBackend;
+
   // RouterManager handlers
   m_RouterManagerHandlers[constants::ROUTER_MANAGER_SHUTDOWN] =
     &I2PControlSession::HandleShutdown;
@@ -512,11 +549,22 @@ void I2PControlSession::HandleNetStatus(
       static_cast<int>(i2p::context.GetStatus()));
 }
 
+void I2PControlSession::HandleNetDuplicates(
+    Response& response) {
+  const auto& transports = i2p::transport::transports;
+  JsonObject obj;
+  obj["dropped"] =
+    JsonObject(static_cast<double>(transports.GetNumDuplicateMessages()));
+  obj["falsepositives"] =
+    JsonObject(transports.GetExpectedDuplicateFalsePositives());
+  response.SetParam(constants::ROUTER_INFO_NET_DUPLICATES, obj);
+}
+
 void I2PControlSession::HandleTunnelsParticipating(
     Response& response) {
   response.SetParam(
       constants::ROUTER_INFO_TUNNELS_PARTICIPATING,
-      static_cast<int>(i2p::tunnel::tunnels.GetTransitTunnels().size()));
+      static_cast<int>(i2p::tunnel::tunnels.GetNumTransitTunnels()));
 }
 
 void I2PControlSession::HandleTunnelsCreationSuccess(
@@ -529,11 +577,11 @@ void I2PControlSession::HandleTunnelsCreationSuccess(
 void I2PControlSession::HandleTunnelsInList(
     Response& response) {
   JsonObject list;
-  for (auto pair : i2p::tunnel::tunnels.GetInboundTunnels()) {
-    const std::string id = std::to_string(pair.first);
-    list[id] = TunnelToJsonObject(pair.second.get());
+  for (auto tunnel : i2p::tunnel::tunnels.GetInboundTunnels()) {
+    const std::string id = std::to_string(tunnel->GetTunnelID());
+    list[id] = TunnelToJsonObject(tunnel.get());
     list[id]["bytes"] = JsonObject(
-      static_cast<int>(pair.second->GetNumReceivedBytes()));
+      static_cast<int>(tunnel->GetNumReceivedBytes()));
   }
   response.SetParam(
       constants::ROUTER_INFO_TUNNELS_IN_LIST,
@@ -555,6 +603,96 @@ void I2PControlSession::HandleTunnelsOutList(
       list);
 }
 
+void I2PControlSession::HandleTunnelsQueueHighWaterMark(
+    Response& response) {
+  response.SetParam(
+      constants::ROUTER_INFO_TUNNELS_QUEUE_HIGH_WATER_MARK,
+      static_cast<int>(i2p::tunnel::tunnels.GetQueueHighWaterMark()));
+}
+
+void I2PControlSession::HandleTunnelsQueueDropped(
+    Response& response) {
+  response.SetParam(
+      constants::ROUTER_INFO_TUNNELS_QUEUE_DROPPED,
+      static_cast<double>(i2p::tunnel::tunnels.GetNumDroppedMessages()));
+}
+
+void I2PControlSession::HandleTunnelsBuildQueue(
+    Response& response) {
+  response.SetParam(
+      constants::ROUTER_INFO_TUNNELS_BUILD_QUEUE,
+      static_cast<int>(
+          i2p::tunnel::tunnels.GetBuildPipeline().GetQueueSize()));
+}
+
+void I2PControlSession::HandleTunnelsBuildAccepted(
+    Response& response) {
+  response.SetParam(
+      constants::ROUTER_INFO_TUNNELS_BUILD_ACCEPTED,
+      static_cast<double>(
+          i2p::tunnel::tunnels.GetBuildPipeline().GetNumAccepted()));
+}
+
+void I2PControlSession::HandleTunnelsBuildRejected(
+    Response& response) {
+  response.SetParam(
+      constants::ROUTER_INFO_TUNNELS_BUILD_REJECTED,
+      static_cast<double>(
+          i2p::tunnel::tunnels.GetBuildPipeline().GetNumRejected()));
+}
+
+void I2PControlSession::HandleTunnelsBuildDropped(
+    Response& response) {
+  response.SetParam(
+      constants::ROUTER_INFO_TUNNELS_BUILD_DROPPED,
+      static_cast<double>(
+          i2p::tunnel::tunnels.GetBuildPipeline().GetNumDropped()));
+}
+
+void I2PControlSession::HandleTunnelsBuildTime(
+    Response& response) {
+  response.SetParam(
+      constants::ROUTER_INFO_TUNNELS_BUILD_TIME,
+      i2p::tunnel::tunnels.GetBuildPipeline().GetProcessingTime());
+}
+
+void I2PControlSession::HandleTunnelsAdmission(
+    Response& response) {
+  const auto& admission = i2p::tunnel::tunnels.GetTransitAdmission();
+  JsonObject obj;
+  for (int i = 0; i < i2p::tunnel::e_NumTransitDecisions; i++) {
+    auto decision = static_cast<i2p::tunnel::TransitDecision>(i);
+    obj[i2p::tunnel::GetTransitDecisionName(decision)] =
+      JsonObject(static_cast<double>(admission.GetNumDecisions(decision)));
+  }
+  obj["peers"] = JsonObject(static_cast<int>(admission.GetNumPeers()));
+  response.SetParam(constants::ROUTER_INFO_TUNNELS_ADMISSION, obj);
+}
+
+void I2PControlSession::HandleTunnelsTransitDropped(
+    Response& response) {
+  response.SetParam(
+      constants::ROUTER_INFO_TUNNELS_TRANSIT_DROPPED,
+      static_cast<double>(
+          i2p::tunnel::tunnels.GetNumDroppedTransitBytes()));
+}
+
+void I2PControlSession::HandleTunnelsTransitTop(
+    Response& response) {
+  JsonObject top;
+  for (const auto& tunnel :
+       i2p::tunnel::tunnels.GetTopTransitTunnels(constants::TRANSIT_TOP_SIZE)) {
+    JsonObject obj;
+    obj["rate"] = JsonObject(static_cast<double>(tunnel->GetRate()));
+    obj["transmitted"] =
+      JsonObject(static_cast<double>(tunnel->GetNumTransmittedBytes()));
+    obj["dropped"] =
+      JsonObject(static_cast<double>(tunnel->GetNumDroppedBytes()));
+    top[std::to_string(tunnel->GetTunnelID())] = obj;
+  }
+  response.SetParam(constants::ROUTER_INFO_TUNNELS_TRANSIT_TOP, top);
+}
+
 void I2PControlSession::HandleInBandwidth1S(
     Response& response) {
   response.SetParam(
@@ -569,6 +707,13 @@ void I2PControlSession::HandleOutBandwidth1S(
       static_cast<double>(i2p::transport::transports.GetOutBandwidth()));
 }
 
+void I2PControlSession::HandleAESBackend(
+    Response& response) {
+  response.SetParam(
+      constants::ROUTER_INFO_CRYPTO_AES_BACKEND,
+      i2p::crypto::GetAESBackendName(i2p::crypto::GetAESBackend()));
+}
+
 void I2PControlSession::HandleShutdown(
     Response& response) {
   LogPrint(eLogInfo, "I2PControlSession: shutdown requested");
@@ -52,6 +52,7 @@ namespace constants {
 const char DEFAULT_PASSWORD[] = "itoopie";
 const uint64_t TOKEN_LIFETIME = 600;  // Token lifetime in seconds
 const std::size_t TOKEN_SIZE = 8;  // Token size in bytes
+const std::size_t TRANSIT_TOP_SIZE = 10;  // Tunnels in the transit top view
 
 const char PROPERTY_ID[] = "id";
 const char PROPERTY_METHOD[] = "method";
@@ -106,6 +107,11 @@ const char ROUTER_INFO_NETDB_LEASESETS[] =
 const char ROUTER_INFO_NET_STATUS[] =
   "i2p.router.net.status";
 
+// Messages dropped by the router-wide duplicate filter, and the estimated
+// number of those that were not duplicates
+const char ROUTER_INFO_NET_DUPLICATES[] =
+  "i2p.router.net.duplicates";
+
 const char ROUTER_INFO_TUNNELS_PARTICIPATING[] =
   "i2p.router.net.tunnels.participating";
 
@@ -119,12 +125,49 @@ const char ROUTER_INFO_TUNNELS_IN_LIST[] =
 const char ROUTER_INFO_TUNNELS_OUT_LIST[] =
   "i2p.router.net.tunnels.outbound.list";
 
+const char ROUTER_INFO_TUNNELS_QUEUE_HIGH_WATER_MARK[] =
+  "i2p.router.net.tunnels.queue.highwatermark";
+
+const char ROUTER_INFO_TUNNELS_QUEUE_DROPPED[] =
+  "i2p.router.net.tunnels.queue.dropped";
+
+const char ROUTER_INFO_TUNNELS_BUILD_QUEUE[] =
+  "i2p.router.net.tunnels.build.queue";
+
+const char ROUTER_INFO_TUNNELS_BUILD_ACCEPTED[] =
+  "i2p.router.net.tunnels.build.accepted";
+
+const char ROUTER_INFO_TUNNELS_BUILD_REJECTED[] =
+  "i2p.router.net.tunnels.build.rejected";
+
+const char ROUTER_INFO_TUNNELS_BUILD_DROPPED[] =
+  "i2p.router.net.tunnels.build.dropped";
+
+// Moving average in milliseconds
+const char ROUTER_INFO_TUNNELS_BUILD_TIME[] =
+  "i2p.router.net.tunnels.build.processingtime";
+
+// Transit requests by admission decision, and previous hops rate limited
+const char ROUTER_INFO_TUNNELS_ADMISSION[] =
+  "i2p.router.net.tunnels.admission";
+
+// Transit traffic dropped by the bandwidth limits, in bytes
+const char ROUTER_INFO_TUNNELS_TRANSIT_DROPPED[] =
+  "i2p.router.net.tunnels.transit.dropped";
+
+// Transit tunnels with the highest rate, by tunnel ID
+const char ROUTER_INFO_TUNNELS_TRANSIT_TOP[] =
+  "i2p.router.net.tunnels.transit.top";
+
 const char ROUTER_INFO_BW_IB_1S[] =
   "i2p.router.net.bw.inbound.1s";
 
 const char ROUTER_INFO_BW_OB_1S[] =
   "i2p.router.net.bw.outbound.1s";
 
+const char ROUTER_INFO_CRYPTO_AES_BACKEND[] =
+  "i2p.router.crypto.aes.backend";
+
 // RouterManager requests
 const char ROUTER_MANAGER_SHUTDOWN[] = "Shutdown";
 const char ROUTER_MANAGER_SHUTDOWN_GRACEFUL[] = "ShutdownGraceful";
@@ -297,15 +340,28 @@ class I2PControlSession
   void HandleNetDbFloodfills(Response& response);
   void HandleNetDbLeaseSets(Response& response);
   void HandleNetStatus(Response& response);
+  void HandleNetDuplicates(Response& response);
 
   void HandleTunnelsParticipating(Response& response);
   void HandleTunnelsCreationSuccess(Response& response);
   void HandleTunnelsInList(Response& response);
   void HandleTunnelsOutList(Response& response);
+  void HandleTunnelsQueueHighWaterMark(Response& response);
+  void HandleTunnelsQueueDropped(Response& response);
+  void HandleTunnelsBuildQueue(Response& response);
+  void HandleTunnelsBuildAccepted(Response& response);
+  void HandleTunnelsBuildRejected(Response& response);
+  void HandleTunnelsBuildDropped(Response& response);
+  void HandleTunnelsBuildTime(Response& response);
+  void HandleTunnelsAdmission(Response& response);
+  void HandleTunnelsTransitDropped(Response& response);
+  void HandleTunnelsTransitTop(Response& response);
 
   void HandleInBandwidth1S(Response& response);
   void HandleOutBandwidth1S(Response& response);
 
+  void HandleAESBackend(Response& response);
+
   // RouterManager handlers
   void HandleShutdown(Response& response);
   void HandleShutdownGraceful(Response& response);
@@ -49,6 +49,7 @@
 #include "tunnel/Tunnel.h"
 #include "util/I2PEndian.h"
 #include "util/Log.h"
+#include "util/MemoryPool.h"
 #include "util/Timestamp.h"
 
 #ifndef NETWORK_ID
@@ -57,16 +58,39 @@
 
 namespace i2p {
 
+namespace {
+
+// header, gateway header and wrapped header a small message may be given
+const size_t I2NP_MESSAGE_HEADROOM =
+  2 + 2 * I2NP_HEADER_SIZE + TUNNEL_GATEWAY_HEADER_SIZE;
+
+typedef I2NPMessageBuffer<I2NP_MAX_TUNNEL_MESSAGE_SIZE> I2NPTunnelMessage;
+typedef I2NPMessageBuffer<I2NP_MAX_SHORT_MESSAGE_SIZE> I2NPShortMessage;
+typedef I2NPMessageBuffer<I2NP_MAX_MESSAGE_SIZE> I2NPFullMessage;
+
+// full size messages are rare, don't let them pin much memory
+typedef i2p::util::MemoryPool<I2NPTunnelMessage, 256, 8192> TunnelMessagePool;
+typedef i2p::util::MemoryPool<I2NPShortMessage, 64, 1024> ShortMessagePool;
+typedef i2p::util::MemoryPool<I2NPFullMessage, 4, 64> FullMessagePool;
+
+}  // namespace
+
 I2NPMessage* NewI2NPMessage() {
-  return new I2NPMessageBuffer<I2NP_MAX_MESSAGE_SIZE>();
+  return FullMessagePool::Instance().Acquire();
 }
 
 I2NPMessage* NewI2NPShortMessage() {
-  return new I2NPMessageBuffer<I2NP_MAX_SHORT_MESSAGE_SIZE>();
+  return ShortMessagePool::Instance().Acquire();
+}
+
+I2NPMessage* NewI2NPTunnelMessage() {
+  return TunnelMessagePool::Instance().Acquire();
 }
 
 I2NPMessage* NewI2NPMessage(
     size_t len) {
+  if (len + I2NP_MESSAGE_HEADROOM <= I2NP_MAX_TUNNEL_MESSAGE_SIZE)
+    return NewI2NPTunnelMessage();
   return (len < I2NP_MAX_SHORT_MESSAGE_SIZE / 2) ?
       NewI2NPShortMessage() :
       NewI2NPMessage();
@@ -74,7 +98,22 @@ I2NPMessage* NewI2NPMessage(
 
 void DeleteI2NPMessage(
     I2NPMessage* msg) {
-  delete msg;
+  switch (msg->maxLen) {
+    case I2NP_MAX_TUNNEL_MESSAGE_SIZE:
+      TunnelMessagePool::Instance().Release(
+          static_cast<I2NPTunnelMessage*>(msg));
+    break;
+    case I2NP_MAX_SHORT_MESSAGE_SIZE:
+      ShortMessagePool::Instance().Release(
+          static_cast<I2NPShortMessage*>(msg));
+    break;
+    case I2NP_MAX_MESSAGE_SIZE:
+      FullMessagePool::Instance().Release(
+          static_cast<I2NPFullMessage*>(msg));
+    break;
+    default:
+      delete msg;
+  }
 }
 
 std::shared_ptr<I2NPMessage> ToSharedI2NPMessage(
@@ -125,7 +164,7 @@ std::shared_ptr<I2NPMessage> CreateI2NPMessage(
     const uint8_t* buf,
     int len,
     std::shared_ptr<i2p::tunnel::InboundTunnel> from) {
-  I2NPMessage* msg = NewI2NPMessage();
+  I2NPMessage* msg = NewI2NPMessage(len);
   if (msg->offset + len < msg->maxLen) {
     memcpy(msg->GetBuffer(), buf, len);
     msg->len = msg->offset + len;
@@ -325,7 +364,8 @@ std::shared_ptr<I2NPMessage> CreateDatabaseStoreMsg(
   return m;
 }
 
-bool HandleBuildRequestRecords(
+int HandleBuildRequestRecords(
+    const i2p::data::IdentHash& previousHop,
     int num,
     uint8_t* records,
     uint8_t* clearText) {
@@ -364,11 +404,10 @@ bool HandleBuildRequestRecords(
        * participate in the tunnel, and higher values meaning
        * higher levels of rejection.
        */
-      if (i2p::context.AcceptsTunnels() &&
-          i2p::tunnel::tunnels.GetTransitTunnels().size() <=
-          MAX_NUM_TRANSIT_TUNNELS &&
-          !i2p::transport::transports.IsBandwidthExceeded()) {
-        i2p::tunnel::TransitTunnel* transitTunnel =
+      uint8_t ret;
+      if (i2p::tunnel::tunnels.AdmitTransitTunnel(previousHop) ==
+          i2p::tunnel::e_TransitAccepted) {
+        auto transitTunnel =
           i2p::tunnel::CreateTransitTunnel(
               bufbe32toh(clearText + BUILD_REQUEST_RECORD_RECEIVE_TUNNEL_OFFSET),
               clearText + BUILD_REQUEST_RECORD_NEXT_IDENT_OFFSET,
@@ -378,24 +417,17 @@ bool HandleBuildRequestRecords(
               clearText[BUILD_REQUEST_RECORD_FLAG_OFFSET] & 0x80,
               clearText[BUILD_REQUEST_RECORD_FLAG_OFFSET] & 0x40);
         i2p::tunnel::tunnels.AddTransitTunnel(transitTunnel);
-        record[BUILD_RESPONSE_RECORD_RET_OFFSET] = 0;
+        ret = TUNNEL_ACCEPT;
       } else {
         /**
-         * The following rejection codes are defined:
-         *
-         * TUNNEL_REJECT_PROBABALISTIC_REJECT = 10
-         * TUNNEL_REJECT_TRANSIENT_OVERLOAD = 20
-         * TUNNEL_REJECT_BANDWIDTH = 30
-         * TUNNEL_REJECT_CRIT = 50
-         *
          * To hide other causes from peers (such as router shutdown),
          * the current implementation uses TUNNEL_REJECT_BANDWIDTH
-         * for *all* rejections.
-         *
-         * TODO(unassigned): review use-case for implementing other rejections
+         * for *all* rejections. The actual reason is counted by the
+         * admission control and shown through I2PControl.
          */
-        record[BUILD_RESPONSE_RECORD_RET_OFFSET] = 30;
+        ret = TUNNEL_REJECT_BANDWIDTH;
       }
+      record[BUILD_RESPONSE_RECORD_RET_OFFSET] = ret;
       /**
        * The reply is encrypted using the AES session key delivered to it in
        * the encrypted block, padded with 495 bytes of random data to reach
@@ -433,10 +465,10 @@ bool HandleBuildRequestRecords(
         uint8_t* reply = records + j * TUNNEL_BUILD_RECORD_SIZE;
         encryption.Encrypt(reply, TUNNEL_BUILD_RECORD_SIZE, reply);
       }
-      return true;
+      return ret;
     }
   }
-  return false;
+  return -1;
 }
 
 void HandleVariableTunnelBuildMsg(
@@ -462,68 +494,65 @@ void HandleVariableTunnelBuildMsg(
       tunnel->SetState(i2p::tunnel::e_TunnelStateBuildFailed);
     }
   } else {
-    uint8_t clearText[BUILD_REQUEST_RECORD_CLEAR_TEXT_SIZE] = {};
-    if (HandleBuildRequestRecords(num, buf + 1, clearText)) {
-      // we are endpoint of outboud tunnel
-      if (clearText[BUILD_REQUEST_RECORD_FLAG_OFFSET] & 0x40) {
-        // So, we send it to reply tunnel
-        i2p::transport::transports.SendMessage(
-            clearText + BUILD_REQUEST_RECORD_NEXT_IDENT_OFFSET,
-            ToSharedI2NPMessage(
-                CreateTunnelGatewayMsg(
-                    bufbe32toh(
-                        clearText + BUILD_REQUEST_RECORD_NEXT_TUNNEL_OFFSET),
-                    e_I2NPVariableTunnelBuildReply,
-                    buf,
-                    len,
-                    bufbe32toh(
-                        clearText + BUILD_REQUEST_RECORD_SEND_MSG_ID_OFFSET))));
-      } else {
-        i2p::transport::transports.SendMessage(
-            clearText + BUILD_REQUEST_RECORD_NEXT_IDENT_OFFSET,
-            ToSharedI2NPMessage(
-                CreateI2NPMessage(
-                    e_I2NPVariableTunnelBuild,
-                    buf,
-                    len,
-                    bufbe32toh(
-                        clearText + BUILD_REQUEST_RECORD_SEND_MSG_ID_OFFSET))));
-      }
-    }
+    HandleTunnelBuildRequest(
+        i2p::data::IdentHash(),
+        e_I2NPVariableTunnelBuild,
+        buf,
+        len);
   }
 }
 
 void HandleTunnelBuildMsg(
     uint8_t* buf,
     size_t len) {
-  uint8_t clearText[BUILD_REQUEST_RECORD_CLEAR_TEXT_SIZE];
-  if (HandleBuildRequestRecords(NUM_TUNNEL_BUILD_RECORDS, buf, clearText)) {
-    // we are endpoint of outbound tunnel
-    if (clearText[BUILD_REQUEST_RECORD_FLAG_OFFSET] & 0x40) {
-      // so we send it to reply tunnel
-      i2p::transport::transports.SendMessage(
-          clearText + BUILD_REQUEST_RECORD_NEXT_IDENT_OFFSET,
-          ToSharedI2NPMessage(
-              CreateTunnelGatewayMsg(
-                  bufbe32toh(
-                      clearText + BUILD_REQUEST_RECORD_NEXT_TUNNEL_OFFSET),
+  HandleTunnelBuildRequest(
+      i2p::data::IdentHash(),
+      e_I2NPTunnelBuild,
+      buf,
+      len);
+}
+
+int HandleTunnelBuildRequest(
+    const i2p::data::IdentHash& previousHop,
+    uint8_t typeID,
+    uint8_t* buf,
+    size_t len) {
+  bool isVariable = typeID == e_I2NPVariableTunnelBuild;
+  uint8_t clearText[BUILD_REQUEST_RECORD_CLEAR_TEXT_SIZE] = {};
+  int ret = isVariable ?
+    HandleBuildRequestRecords(previousHop, buf[0], buf + 1, clearText) :
+    HandleBuildRequestRecords(
+        previousHop, NUM_TUNNEL_BUILD_RECORDS, buf, clearText);
+  if (ret < 0)
+    return ret;
+  // we are endpoint of outbound tunnel
+  if (clearText[BUILD_REQUEST_RECORD_FLAG_OFFSET] & 0x40) {
+    // so we send it to reply tunnel
+    i2p::transport::transports.SendMessage(
+        clearText + BUILD_REQUEST_RECORD_NEXT_IDENT_OFFSET,
+        ToSharedI2NPMessage(
+            CreateTunnelGatewayMsg(
+                bufbe32toh(
+                    clearText + BUILD_REQUEST_RECORD_NEXT_TUNNEL_OFFSET),
+                isVariable ?
+                  e_I2NPVariableTunnelBuildReply :
                   e_I2NPTunnelBuildReply,
-                  buf,
-                  len,
-                  bufbe32toh(
-                      clearText + BUILD_REQUEST_RECORD_SEND_MSG_ID_OFFSET))));
-    } else {
-      i2p::transport::transports.SendMessage(
-          clearText + BUILD_REQUEST_RECORD_NEXT_IDENT_OFFSET,
-          ToSharedI2NPMessage(
-              CreateI2NPMessage(
-                  e_I2NPTunnelBuild,
-                  buf,
-                  len,
-                  bufbe32toh(
-                      clearText + BUILD_REQUEST_RECORD_SEND_MSG_ID_OFFSET))));
-    }
+                buf,
+                len,
+                bufbe32toh(
+                    clearText + BUILD_REQUEST_RECORD_SEND_MSG_ID_OFFSET))));
+  } else {
+    i2p::transport::transports.SendMessage(
+        clearText + BUILD_REQUEST_RECORD_NEXT_IDENT_OFFSET,
+        ToSharedI2NPMessage(
+            CreateI2NPMessage(
+                isVariable ? e_I2NPVariableTunnelBuild : e_I2NPTunnelBuild,
+                buf,
+                len,
+                bufbe32toh(
+                    clearText + BUILD_REQUEST_RECORD_SEND_MSG_ID_OFFSET))));
   }
+  return ret;
 }
 
 void HandleVariableTunnelBuildReplyMsg(
@@ -554,7 +583,7 @@ void HandleVariableTunnelBuildReplyMsg(
 
 I2NPMessage* CreateTunnelDataMsg(
     const uint8_t * buf) {
-  I2NPMessage* msg = NewI2NPShortMessage();
+  I2NPMessage* msg = NewI2NPTunnelMessage();
   memcpy(msg->GetPayload(), buf, i2p::tunnel::TUNNEL_DATA_MSG_SIZE);
   msg->len += i2p::tunnel::TUNNEL_DATA_MSG_SIZE;
   msg->FillI2NPMessageHeader(e_I2NPTunnelData);
@@ -564,7 +593,7 @@ I2NPMessage* CreateTunnelDataMsg(
 I2NPMessage* CreateTunnelDataMsg(
     uint32_t tunnelID,
     const uint8_t* payload) {
-  I2NPMessage* msg = NewI2NPShortMessage();
+  I2NPMessage* msg = NewI2NPTunnelMessage();
   memcpy(msg->GetPayload() + 4, payload, i2p::tunnel::TUNNEL_DATA_MSG_SIZE - 4);
   htobe32buf(msg->GetPayload(), tunnelID);
   msg->len += i2p::tunnel::TUNNEL_DATA_MSG_SIZE;
@@ -573,7 +602,7 @@ I2NPMessage* CreateTunnelDataMsg(
 }
 
 std::shared_ptr<I2NPMessage> CreateEmptyTunnelDataMsg() {
-  I2NPMessage* msg = NewI2NPShortMessage();
+  I2NPMessage* msg = NewI2NPTunnelMessage();
   msg->len += i2p::tunnel::TUNNEL_DATA_MSG_SIZE;
   return ToSharedI2NPMessage(msg);
 }
@@ -734,6 +763,15 @@ I2NPMessagesHandler::~I2NPMessagesHandler() {
 void I2NPMessagesHandler::PutNextMessage(
     std::shared_ptr<I2NPMessage> msg) {
   if (msg) {
+    // tunnel data is most of the traffic and would cycle the filter
+    // too fast to catch anything else
+    if (msg->GetTypeID() != e_I2NPTunnelData &&
+        i2p::transport::transports.IsDuplicateMessage(*msg)) {
+      LogPrint(eLogWarn,
+          "I2NPMessagesHandler: dropping duplicate message ",
+          msg->GetMsgID());
+      return;
+    }
     switch (msg->GetTypeID()) {
       case e_I2NPTunnelData:
         m_TunnelMsgs.push_back(msg);
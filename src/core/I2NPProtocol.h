@@ -64,6 +64,8 @@ const size_t I2NP_HEADER_TYPEID_OFFSET = 0,
 
              I2NP_MAX_MESSAGE_SIZE = 32768,
              I2NP_MAX_SHORT_MESSAGE_SIZE = 4096,
+             // tunnel data message (1028) plus header, NTCP size and IV copy
+             I2NP_MAX_TUNNEL_MESSAGE_SIZE = 1088,
 
              // Tunnel Gateway header
              TUNNEL_GATEWAY_HEADER_TUNNELID_OFFSET = 0,
@@ -123,6 +125,13 @@ const uint8_t DATABASE_LOOKUP_DELIVERY_FLAG = 0x01,
 const int NUM_TUNNEL_BUILD_RECORDS = 8,
           MAX_NUM_TRANSIT_TUNNELS = 2500;
 
+// Build reply codes
+const uint8_t TUNNEL_ACCEPT = 0,
+              TUNNEL_REJECT_PROBABALISTIC_REJECT = 10,
+              TUNNEL_REJECT_TRANSIENT_OVERLOAD = 20,
+              TUNNEL_REJECT_BANDWIDTH = 30,
+              TUNNEL_REJECT_CRIT = 50;
+
 enum I2NPMessageType {
   e_I2NPDatabaseStore = 1,
   e_I2NPDatabaseLookup = 2,
@@ -147,13 +156,15 @@ struct I2NPMessage {
   uint8_t* buf;
   size_t len, offset, maxLen;
   std::shared_ptr<i2p::tunnel::InboundTunnel> from;
+  i2p::data::IdentHash fromIdent;  // transport peer, zero if unknown
 
   I2NPMessage()
       : buf(nullptr),
         len(I2NP_HEADER_SIZE + 2),
-        offset(2),
+        offset(2),  // reserve 2 bytes for NTCP header
         maxLen(0),
-        from(nullptr) {}  // reserve 2 bytes for NTCP header
+        from(nullptr),
+        fromIdent() {}
 
   // header accessors
   uint8_t* GetHeader() {
@@ -241,14 +252,22 @@ struct I2NPMessage {
     }
   }
 
+  // maxLen describes our own buffer and must not be taken from other
   I2NPMessage& operator=(const I2NPMessage& other) {
     memcpy(buf + offset, other.buf + other.offset, other.GetLength());
     len = offset + other.GetLength();
     from = other.from;
-    maxLen = other.maxLen;
+    fromIdent = other.fromIdent;
     return *this;
   }
 
+  void Reset() {
+    len = I2NP_HEADER_SIZE + 2;
+    offset = 2;
+    from = nullptr;
+    fromIdent = i2p::data::IdentHash();
+  }
+
   // for SSU only
   uint8_t* GetSSUHeader() {
     return buf + offset + I2NP_HEADER_SIZE - I2NP_SHORT_HEADER_SIZE;
@@ -296,15 +315,29 @@ struct I2NPMessageBuffer : public I2NPMessage {
     buf = m_Buffer;
     maxLen = SZ;
   }
+
+  // called by the message pool before the buffer is reused.
+  // Payloads are always written before they are read, so only the
+  // header is cleared rather than the whole (up to 32 KiB) buffer
+  void Reset() {
+    I2NPMessage::Reset();
+    memset(m_Buffer, 0, offset + I2NP_HEADER_SIZE);
+  }
+
   uint8_t m_Buffer[SZ + 16] = {};
 };
 
+/// @brief Messages are taken from size-classed pools and returned to them
+///   by DeleteI2NPMessage (the deleter of ToSharedI2NPMessage)
 I2NPMessage* NewI2NPMessage();
 I2NPMessage* NewI2NPMessage(
     size_t len);
 
 I2NPMessage* NewI2NPShortMessage();
 
+/// @brief Smallest size class, fits exactly one tunnel data message
+I2NPMessage* NewI2NPTunnelMessage();
+
 void DeleteI2NPMessage(
     I2NPMessage* msg);
 
@@ -348,11 +381,30 @@ std::shared_ptr<I2NPMessage> CreateDatabaseStoreMsg(
     std::shared_ptr<const i2p::data::LeaseSet> leaseSet,
     uint32_t replyToken = 0);
 
-bool HandleBuildRequestRecords(
+/// @brief Looks for our record, decides on it and writes the reply records
+/// @return Reply code of our record (0 if accepted),
+///   negative if no record is ours
+/// @param previousHop Router the request came from, zero if unknown
+int HandleBuildRequestRecords(
+    const i2p::data::IdentHash& previousHop,
     int num,
     uint8_t* records,
     uint8_t* clearText);
 
+/// @brief Handles a tunnel build request and forwards it to the next hop
+/// @details Thread-safe, called by the tunnel build pipeline workers
+/// @param previousHop Router the request came from, zero if unknown
+/// @param typeID e_I2NPVariableTunnelBuild or e_I2NPTunnelBuild
+/// @param buf Payload of the message
+/// @param len Size of the payload
+/// @return Reply code of our record (0 if accepted),
+///   negative if no record is ours
+int HandleTunnelBuildRequest(
+    const i2p::data::IdentHash& previousHop,
+    uint8_t typeID,
+    uint8_t* buf,
+    size_t len);
+
 void HandleVariableTunnelBuildMsg(
     uint32_t replyMsgID,
     uint8_t* buf,
@@ -0,0 +1,262 @@
+/**
+ * Copyright (c) 2015-2016, The Kovri I2P Router Project
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ *    conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *    of conditions and the following disclaimer in the documentation and/or other
+ *    materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SRC_CORE_KADEMLIAINDEX_H_
+#define SRC_CORE_KADEMLIAINDEX_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "Identity.h"
+
+namespace i2p {
+namespace data {
+
+/// @class KademliaIndex
+/// @brief Elements sorted by ident hash for XOR-closest lookups
+/// @details Sorted hashes form an implicit binary trie: all hashes sharing
+///   a prefix are contiguous, and within such a range the hashes with the
+///   next differing bit equal to the key's bit are closer to the key than
+///   all others. Walking the ranges nearest first yields elements in
+///   increasing XOR distance, so k closest cost O(k log n) binary searches
+///   instead of computing the distance to every element.
+///   Since peers are placed by their ident hash, the order stays valid
+///   across routing key rotation; only the searched key changes.
+///   Like RandomIndex, writers change a tree under a mutex and the first
+///   reader after a change publishes an immutable sorted copy of it, so
+///   a write costs O(log n) and a burst of writes costs one copy.
+/// @param Element Nullable pointer type to an object with GetIdentHash()
+template<typename Element>
+class KademliaIndex {
+  struct Entry {
+    IdentHash hash;
+    Element element;
+  };
+  typedef std::vector<Entry> Entries;
+
+ public:
+  KademliaIndex()
+      : m_IsChanged(false),
+        m_Snapshot(std::make_shared<const Entries>()) {}
+
+  /// @return False if an element with the same ident hash is indexed
+  bool Add(
+      const Element& element) {
+    std::unique_lock<std::mutex> l(m_Mutex);
+    if (!m_Elements.emplace(element->GetIdentHash(), element).second)
+      return false;
+    m_IsChanged = true;
+    return true;
+  }
+
+  /// @return False if element was not in the index
+  bool Remove(
+      const Element& element) {
+    std::unique_lock<std::mutex> l(m_Mutex);
+    auto it = m_Elements.find(element->GetIdentHash());
+    if (it == m_Elements.end() || it->second != element)
+      return false;
+    m_Elements.erase(it);
+    m_IsChanged = true;
+    return true;
+  }
+
+  /// @brief Removes all elements matching predicate
+  /// @return Number of removed elements
+  template<typename Predicate>
+  std::size_t RemoveIf(
+      Predicate predicate) {
+    std::unique_lock<std::mutex> l(m_Mutex);
+    std::size_t num = 0;
+    for (auto it = m_Elements.begin(); it != m_Elements.end();) {
+      if (predicate(it->second)) {
+        it = m_Elements.erase(it);
+        num++;
+      } else {
+        ++it;
+      }
+    }
+    if (num)
+      m_IsChanged = true;
+    return num;
+  }
+
+  /// @brief Replaces the content of the index
+  template<typename Iterator>
+  void Assign(
+      Iterator begin,
+      Iterator end) {
+    std::unique_lock<std::mutex> l(m_Mutex);
+    m_Elements.clear();
+    for (auto it = begin; it != end; ++it)
+      m_Elements.emplace((*it)->GetIdentHash(), *it);
+    m_IsChanged = true;
+  }
+
+  void Clear() {
+    std::unique_lock<std::mutex> l(m_Mutex);
+    m_Elements.clear();
+    m_IsChanged = true;
+  }
+
+  /// @brief Makes pending changes visible to readers, waiting for writers
+  void Publish() {
+    std::unique_lock<std::mutex> l(m_Mutex);
+    if (m_IsChanged)
+      PublishLocked();
+  }
+
+  std::size_t GetSize() const {
+    return GetSnapshot()->size();
+  }
+
+  /// @brief Collects elements accepted by filter, nearest to key first
+  /// @param key Routing key to measure XOR distance from
+  /// @param num Max number of elements to return
+  /// @param filter Callable returning true for acceptable elements
+  template<typename Filter>
+  std::vector<Element> GetClosest(
+      const IdentHash& key,
+      std::size_t num,
+      Filter filter) const {
+    std::vector<Element> closest;
+    auto snapshot = GetSnapshot();
+    const Entries& entries = *snapshot;
+    if (!num || entries.empty())
+      return closest;
+    // ranges still to visit, the nearest one on top
+    std::vector<std::pair<std::size_t, std::size_t>> ranges;
+    ranges.emplace_back(0, entries.size());
+    while (!ranges.empty()) {
+      std::size_t begin = ranges.back().first, end = ranges.back().second;
+      ranges.pop_back();
+      int bit = GetFirstDifferentBit(
+          entries[begin].hash,
+          entries[end - 1].hash);
+      if (bit < 0) {  // single entry
+        if (filter(entries[begin].element)) {
+          closest.push_back(entries[begin].element);
+          if (closest.size() >= num)
+            break;
+        }
+        continue;
+      }
+      // entries with the bit unset come first within a common prefix
+      std::size_t middle = std::partition_point(
+          entries.begin() + begin,
+          entries.begin() + end,
+          [bit](const Entry& entry) {
+            return !GetBit(entry.hash, bit);
+          }) - entries.begin();
+      if (GetBit(key, bit)) {
+        ranges.emplace_back(begin, middle);
+        ranges.emplace_back(middle, end);
+      } else {
+        ranges.emplace_back(middle, end);
+        ranges.emplace_back(begin, middle);
+      }
+    }
+    return closest;
+  }
+
+  /// @return Element nearest to key accepted by filter, null if none
+  template<typename Filter>
+  Element GetClosest(
+      const IdentHash& key,
+      Filter filter) const {
+    auto closest = GetClosest(key, 1, filter);
+    return closest.empty() ? nullptr : closest.front();
+  }
+
+ private:
+  static bool GetBit(
+      const IdentHash& hash,
+      int bit) {
+    return hash()[bit >> 3] & (0x80 >> (bit & 7));
+  }
+
+  /// @return Most significant bit in which the hashes differ, -1 if equal
+  static int GetFirstDifferentBit(
+      const IdentHash& hash1,
+      const IdentHash& hash2) {
+    for (int i = 0; i < 32; i++) {
+      std::uint8_t diff = hash1()[i] ^ hash2()[i];
+      if (diff) {
+        int bit = i << 3;
+        while (!(diff & 0x80)) {
+          diff <<= 1;
+          bit++;
+        }
+        return bit;
+      }
+    }
+    return -1;
+  }
+
+  /// @brief Copies the tree for readers, caller holds the mutex
+  void PublishLocked() const {
+    m_IsChanged = false;
+    auto entries = std::make_shared<Entries>();
+    entries->reserve(m_Elements.size());
+    for (const auto& it : m_Elements)  // already sorted by hash
+      entries->push_back({ it.first, it.second });
+    std::shared_ptr<const Entries> snapshot = std::move(entries);
+    std::atomic_store(&m_Snapshot, snapshot);
+  }
+
+  /// @return Published entries, first publishing pending changes unless
+  ///   a writer holds the mutex
+  std::shared_ptr<const Entries> GetSnapshot() const {
+    if (m_IsChanged) {
+      std::unique_lock<std::mutex> l(m_Mutex, std::try_to_lock);
+      if (l.owns_lock() && m_IsChanged)
+        PublishLocked();
+    }
+    return std::atomic_load(&m_Snapshot);
+  }
+
+ private:
+  mutable std::mutex m_Mutex;
+  std::map<IdentHash, Element> m_Elements;
+  mutable std::atomic<bool> m_IsChanged;
+  mutable std::shared_ptr<const Entries> m_Snapshot;
+};
+
+}  // namespace data
+}  // namespace i2p
+
+#endif  // SRC_CORE_KADEMLIAINDEX_H_
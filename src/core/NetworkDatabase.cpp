@@ -64,6 +64,7 @@ NetDb netdb;
 NetDb::NetDb()
     : m_IsRunning(false),
       m_Thread(nullptr),
+      m_Queue(NETDB_QUEUE_CAPACITY),
       m_Reseed(nullptr) {}
 
 NetDb::~NetDb() {
@@ -91,7 +92,7 @@ void NetDb::Stop() {
       it.second->SaveProfile();
     DeleteObsoleteProfiles();
     m_RouterInfos.clear();
-    m_Floodfills.clear();
+    RebuildRouterIndexes();
     if (m_Thread) {
       m_IsRunning = false;
       m_Queue.WakeUp();
@@ -199,19 +200,21 @@ void NetDb::AddRouterInfo(
   auto r = FindRouter(ident);
   if (r) {
     auto ts = r->GetTimestamp();
+    auto caps = r->GetCaps();
     r->Update(buf, len);
     if (r->GetTimestamp() > ts)
       LogPrint(eLogInfo, "NetDb: RouterInfo updated");
+    if (r->GetCaps() != caps) {
+      UnindexRouter(r);
+      IndexRouter(r);
+    }
   } else {
     LogPrint(eLogDebug, "NetDb: new RouterInfo added");
     r = std::make_shared<RouterInfo> (buf, len); {
       std::unique_lock<std::mutex> l(m_RouterInfosMutex);
       m_RouterInfos[r->GetIdentHash()] = r;
     }
-    if (r->IsFloodfill()) {
-      std::unique_lock<std::mutex> l(m_FloodfillsMutex);
-      m_Floodfills.push_back(r);
-    }
+    IndexRouter(r);
   }
   // take care about requested destination
   m_Requests.RequestComplete(ident, r);
@@ -318,7 +321,6 @@ void NetDb::Load() {
   }
   // make sure we cleanup netDb from previous attempts
   m_RouterInfos.clear();
-  m_Floodfills.clear();
   // load routers now
   uint64_t ts = i2p::util::GetMillisecondsSinceEpoch();
   int num_routers = 0;
@@ -340,8 +342,6 @@ void NetDb::Load() {
           r->DeleteBuffer();
           r->ClearProperties();  // properties are not used for regular routers
           m_RouterInfos[r->GetIdentHash()] = r;
-          if (r->IsFloodfill())
-            m_Floodfills.push_back(r);
           num_routers++;
         } else {
           if (boost::filesystem::exists(fullPath))
@@ -350,8 +350,9 @@ void NetDb::Load() {
       }
     }
   }
+  RebuildRouterIndexes();
   LogPrint(eLogInfo, "NetDb: ", num_routers, " routers loaded");
-  LogPrint(eLogInfo, "NetDb: ", m_Floodfills.size(), " floodfills loaded");
+  LogPrint(eLogInfo, "NetDb: ", m_Floodfills.GetSize(), " floodfills loaded");
 }
 
 void NetDb::SaveUpdated() {
@@ -416,11 +417,6 @@ void NetDb::SaveUpdated() {
                   it.second.get()));
           deletedCount++;
         }
-        // delete from floodfills list
-        if (it.second->IsFloodfill()) {
-          std::unique_lock<std::mutex> l(m_FloodfillsMutex);
-          m_Floodfills.remove(it.second);
-        }
       }
     }
   }
@@ -438,6 +434,17 @@ void NetDb::SaveUpdated() {
         it++;
       }
     }
+    auto is_unreachable = [](std::shared_ptr<const RouterInfo> router) {
+      return router->IsUnreachable();
+    };
+    m_Floodfills.RemoveIf(is_unreachable);
+    m_NonFloodfills.RemoveIf(is_unreachable);
+    for (auto index : {
+          &m_RandomRouters,
+          &m_RandomHighBandwidthRouters,
+          &m_RandomPeerTestRouters,
+          &m_RandomIntroducers})
+      index->RemoveIf(is_unreachable);
   }
 }
 
@@ -676,15 +683,12 @@ void NetDb::HandleDatabaseLookupMsg(
       excluded_routers.insert(excluded);
       excluded += 32;
     }
-    std::vector<IdentHash> routers;
-    for (int i = 0; i < 3; i++) {
-      auto r = GetClosestNonFloodfill(ident, excluded_routers);
-      if (r) {
-        routers.push_back(r->GetIdentHash());
-        excluded_routers.insert(r->GetIdentHash());
-      }
-    }
-    reply_msg = CreateDatabaseSearchReply(ident, routers);
+    reply_msg = CreateDatabaseSearchReply(
+        ident,
+        GetClosestNonFloodfills(
+            ident,
+            3,
+            excluded_routers));
   } else {
     if (lookupType == DATABASE_LOOKUP_TYPE_ROUTERINFO_LOOKUP  ||
         lookupType == DATABASE_LOOKUP_TYPE_NORMAL_LOOKUP) {
@@ -835,6 +839,7 @@ void NetDb::Publish() {
 
 std::shared_ptr<const RouterInfo> NetDb::GetRandomRouter() const {
   return GetRandomRouter(
+      m_RandomRouters,
       [](std::shared_ptr<const RouterInfo> router)->bool {
       return !router->IsHidden();
     });
@@ -843,6 +848,7 @@ std::shared_ptr<const RouterInfo> NetDb::GetRandomRouter() const {
 std::shared_ptr<const RouterInfo> NetDb::GetRandomRouter(
     std::shared_ptr<const RouterInfo> compatible_with) const {
   return GetRandomRouter(
+      m_RandomRouters,
       [compatible_with](std::shared_ptr<const RouterInfo> router)->bool {
       return !router->IsHidden() && router != compatible_with &&
         router->IsCompatible(*compatible_with);
@@ -851,6 +857,7 @@ std::shared_ptr<const RouterInfo> NetDb::GetRandomRouter(
 
 std::shared_ptr<const RouterInfo> NetDb::GetRandomPeerTestRouter() const {
   return GetRandomRouter(
+    m_RandomPeerTestRouters,
     [](std::shared_ptr<const RouterInfo> router)->bool {
       return !router->IsHidden() && router->IsPeerTesting();
     });
@@ -858,6 +865,7 @@ std::shared_ptr<const RouterInfo> NetDb::GetRandomPeerTestRouter() const {
 
 std::shared_ptr<const RouterInfo> NetDb::GetRandomIntroducer() const {
   return GetRandomRouter (
+    m_RandomIntroducers,
     [](std::shared_ptr<const RouterInfo> router)->bool {
       return !router->IsHidden() && router->IsIntroducer();
     });
@@ -866,6 +874,7 @@ std::shared_ptr<const RouterInfo> NetDb::GetRandomIntroducer() const {
 std::shared_ptr<const RouterInfo> NetDb::GetHighBandwidthRandomRouter(
     std::shared_ptr<const RouterInfo> compatible_with) const {
   return GetRandomRouter (
+    m_RandomHighBandwidthRouters,
     [compatible_with](std::shared_ptr<const RouterInfo> router)->bool {
       return !router->IsHidden() &&
       router != compatible_with &&
@@ -876,111 +885,134 @@ std::shared_ptr<const RouterInfo> NetDb::GetHighBandwidthRandomRouter(
 
 template<typename Filter>
 std::shared_ptr<const RouterInfo> NetDb::GetRandomRouter(
+    const RouterIndex& index,
     Filter filter) const {
-  uint32_t ind = i2p::crypto::RandInRange<uint32_t>(0, m_RouterInfos.size() - 1);
-  for (int j = 0; j < 2; j++) {
-    uint32_t i = 0;
-    std::unique_lock<std::mutex> l(m_RouterInfosMutex);
-    for (auto it : m_RouterInfos) {
-      if (i >= ind) {
-        if (!it.second->IsUnreachable() && filter(it.second))
-          return it.second;
-      } else {
-        i++;
-      }
-    }
-    // we couldn't find anything, try second pass
-    ind = 0;
+  // Caps and reachability may change after a router is indexed,
+  // so the filter is always applied to the sampled router
+  return index.GetRandom(
+      []() { return i2p::crypto::Rand<uint32_t>(); },
+      [&filter](const std::shared_ptr<const RouterInfo>& router) {
+        return !router->IsUnreachable() && filter(router);
+      });
+}
+
+void NetDb::IndexRouter(
+    const std::shared_ptr<const RouterInfo>& router) {
+  if (router->IsFloodfill())
+    m_Floodfills.Add(router);
+  else
+    m_NonFloodfills.Add(router);
+  if (router->IsHidden())
+    return;
+  m_RandomRouters.Add(router);
+  if (router->GetCaps() & RouterInfo::eHighBandwidth)
+    m_RandomHighBandwidthRouters.Add(router);
+  if (router->IsPeerTesting())
+    m_RandomPeerTestRouters.Add(router);
+  if (router->IsIntroducer())
+    m_RandomIntroducers.Add(router);
+}
+
+void NetDb::UnindexRouter(
+    const std::shared_ptr<const RouterInfo>& router) {
+  m_Floodfills.Remove(router);
+  m_NonFloodfills.Remove(router);
+  m_RandomRouters.Remove(router);
+  m_RandomHighBandwidthRouters.Remove(router);
+  m_RandomPeerTestRouters.Remove(router);
+  m_RandomIntroducers.Remove(router);
+}
+
+void NetDb::RebuildRouterIndexes() {
+  std::vector<std::shared_ptr<const RouterInfo>>
+    floodfills, non_floodfills, routers, high_bandwidth, peer_test, introducers;
+  for (auto it : m_RouterInfos) {
+    auto& router = it.second;
+    if (router->IsFloodfill())
+      floodfills.push_back(router);
+    else
+      non_floodfills.push_back(router);
+    if (router->IsHidden())
+      continue;
+    routers.push_back(router);
+    if (router->GetCaps() & RouterInfo::eHighBandwidth)
+      high_bandwidth.push_back(router);
+    if (router->IsPeerTesting())
+      peer_test.push_back(router);
+    if (router->IsIntroducer())
+      introducers.push_back(router);
   }
-  return nullptr;  // seems we have too few routers
+  m_Floodfills.Assign(floodfills.begin(), floodfills.end());
+  m_NonFloodfills.Assign(non_floodfills.begin(), non_floodfills.end());
+  m_RandomRouters.Assign(routers.begin(), routers.end());
+  m_RandomHighBandwidthRouters.Assign(
+      high_bandwidth.begin(),
+      high_bandwidth.end());
+  m_RandomPeerTestRouters.Assign(peer_test.begin(), peer_test.end());
+  m_RandomIntroducers.Assign(introducers.begin(), introducers.end());
 }
 
 void NetDb::PostI2NPMsg(
     std::shared_ptr<const I2NPMessage> msg) {
-  if (msg)
-    m_Queue.Put(msg);
+  if (msg && !m_Queue.Put(msg))
+    LogPrint(eLogError,
+        "NetDb: queue full, dropped message of type ",
+        static_cast<int>(msg->GetTypeID()),
+        ", ", m_Queue.GetNumDropped(), " dropped so far");
 }
 
 std::shared_ptr<const RouterInfo> NetDb::GetClosestFloodfill(
     const IdentHash& destination,
     const std::set<IdentHash>& excluded) const {
-  std::shared_ptr<const RouterInfo> r;
-  XORMetric min_metric;
-  IdentHash dest_key = CreateRoutingKey(destination);
-  min_metric.SetMax();
-  std::unique_lock<std::mutex> l(m_FloodfillsMutex);
-  for (auto it : m_Floodfills) {
-    if (!it->IsUnreachable()) {
-      XORMetric m = dest_key ^ it->GetIdentHash();
-      if (m < min_metric && !excluded.count(it->GetIdentHash())) {
-        min_metric = m;
-        r = it;
-      }
-    }
-  }
-  return r;
+  return m_Floodfills.GetClosest(
+      CreateRoutingKey(destination),
+      [&excluded](const std::shared_ptr<const RouterInfo>& router) {
+        return !router->IsUnreachable() &&
+          !excluded.count(router->GetIdentHash());
+      });
 }
 
 std::vector<IdentHash> NetDb::GetClosestFloodfills(
     const IdentHash& destination,
     size_t num,
     std::set<IdentHash>& excluded) const {
-  struct Sorted {
-    std::shared_ptr<const RouterInfo> r;
-    XORMetric metric;
-    bool operator<(const Sorted& other) const {
-      return metric < other.metric;
-    }
-  };
-  std::set<Sorted> sorted;
-  IdentHash dest_key = CreateRoutingKey(destination); {
-    std::unique_lock<std::mutex> l(m_FloodfillsMutex);
-    for (auto it : m_Floodfills) {
-      if (!it->IsUnreachable()) {
-        XORMetric m = dest_key ^ it->GetIdentHash();
-        if (sorted.size() < num) {
-          sorted.insert({it, m});
-        } else if (m < sorted.rbegin()->metric) {
-          sorted.insert({it, m});
-          sorted.erase(std::prev(sorted.end()));
-        }
-      }
-    }
-  }
+  auto floodfills = m_Floodfills.GetClosest(
+      CreateRoutingKey(destination),
+      num,
+      [&excluded](const std::shared_ptr<const RouterInfo>& router) {
+        return !router->IsUnreachable() &&
+          !excluded.count(router->GetIdentHash());
+      });
   std::vector<IdentHash> res;
-  size_t i = 0;
-  for (auto it : sorted) {
-    if (i < num) {
-      auto& ident = it.r->GetIdentHash();
-      if (!excluded.count(ident)) {
-        res.push_back(ident);
-        i++;
-      }
-    } else {
-      break;
-    }
-  }
+  for (auto& floodfill : floodfills)
+    res.push_back(floodfill->GetIdentHash());
   return res;
 }
 
 std::shared_ptr<const RouterInfo> NetDb::GetClosestNonFloodfill(
     const IdentHash& destination,
     const std::set<IdentHash>& excluded) const {
-  std::shared_ptr<const RouterInfo> r;
-  XORMetric min_metric;
-  IdentHash dest_key = CreateRoutingKey(destination);
-  min_metric.SetMax();
-  // must be called from NetDb thread only
-  for (auto it : m_RouterInfos) {
-    if (!it.second->IsFloodfill()) {
-      XORMetric m = dest_key ^ it.first;
-      if (m < min_metric && !excluded.count(it.first)) {
-        min_metric = m;
-        r = it.second;
-      }
-    }
-  }
-  return r;
+  return m_NonFloodfills.GetClosest(
+      CreateRoutingKey(destination),
+      [&excluded](const std::shared_ptr<const RouterInfo>& router) {
+        return !excluded.count(router->GetIdentHash());
+      });
+}
+
+std::vector<IdentHash> NetDb::GetClosestNonFloodfills(
+    const IdentHash& destination,
+    size_t num,
+    const std::set<IdentHash>& excluded) const {
+  auto routers = m_NonFloodfills.GetClosest(
+      CreateRoutingKey(destination),
+      num,
+      [&excluded](const std::shared_ptr<const RouterInfo>& router) {
+        return !excluded.count(router->GetIdentHash());
+      });
+  std::vector<IdentHash> res;
+  for (auto& router : routers)
+    res.push_back(router->GetIdentHash());
+  return res;
 }
 
 void NetDb::ManageLeaseSets() {
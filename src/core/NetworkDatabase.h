@@ -49,17 +49,23 @@
 #include <vector>
 
 #include "I2NPProtocol.h"
+#include "KademliaIndex.h"
 #include "LeaseSet.h"
 #include "NetDbRequests.h"
 #include "Reseed.h"
 #include "RouterInfo.h"
 #include "tunnel/Tunnel.h"
 #include "tunnel/TunnelPool.h"
-#include "util/Queue.h"
+#include "util/MPSCQueue.h"
+#include "util/RandomIndex.h"
 
 namespace i2p {
 namespace data {
 
+// Messages the NetDb thread has yet to handle. Lookups and stores must
+// not be lost, so this is sized for floods far above the data queues.
+const std::size_t NETDB_QUEUE_CAPACITY = 65536;
+
 class NetDb {
  public:
   NetDb();
@@ -128,6 +134,11 @@ class NetDb {
       const IdentHash& destination,
       const std::set<IdentHash>& excluded) const;
 
+  std::vector<IdentHash> GetClosestNonFloodfills(
+      const IdentHash& destination,
+      size_t num,
+      const std::set<IdentHash>& excluded) const;
+
   void SetUnreachable(
       const IdentHash& ident,
       bool unreachable);
@@ -142,7 +153,7 @@ class NetDb {
   }
 
   int GetNumFloodfills() const {
-    return m_Floodfills.size();
+    return m_Floodfills.GetSize();
   }
 
   int GetNumLeaseSets() const {
@@ -159,22 +170,45 @@ class NetDb {
   void ManageLeaseSets();
   void ManageRequests();
 
+  typedef i2p::util::RandomIndex<std::shared_ptr<const RouterInfo>>
+    RouterIndex;
+
   template<typename Filter>
   std::shared_ptr<const RouterInfo> GetRandomRouter(
+      const RouterIndex& index,
       Filter filter) const;
 
+  /// @brief Adds router to the selection indexes it belongs to
+  void IndexRouter(
+      const std::shared_ptr<const RouterInfo>& router);
+
+  void UnindexRouter(
+      const std::shared_ptr<const RouterInfo>& router);
+
+  /// @brief Rebuilds selection indexes from m_RouterInfos
+  /// @note Caller must hold m_RouterInfosMutex if NetDb is running
+  void RebuildRouterIndexes();
+
  private:
   std::map<IdentHash, std::shared_ptr<LeaseSet>> m_LeaseSets;
   mutable std::mutex m_RouterInfosMutex;
   std::map<IdentHash, std::shared_ptr<RouterInfo>> m_RouterInfos;
-  mutable std::mutex m_FloodfillsMutex;
-  std::list<std::shared_ptr<RouterInfo>> m_Floodfills;
+  // Routers sorted by ident hash for closest floodfill/router lookups
+  KademliaIndex<std::shared_ptr<const RouterInfo>> m_Floodfills,
+                                                   m_NonFloodfills;
+
+  // Non-hidden routers for random selection, split by caps so that
+  // selective lookups sample from routers likely to match
+  RouterIndex m_RandomRouters,
+              m_RandomHighBandwidthRouters,
+              m_RandomPeerTestRouters,
+              m_RandomIntroducers;
 
   bool m_IsRunning;
   std::unique_ptr<std::thread> m_Thread;
 
   // of I2NPDatabaseStoreMsg
-  i2p::util::Queue<std::shared_ptr<const I2NPMessage>> m_Queue;
+  i2p::util::MPSCQueue<std::shared_ptr<const I2NPMessage>> m_Queue;
 
   std::unique_ptr<i2p::data::Reseed> m_Reseed;
 
@@ -37,6 +37,7 @@
 
 #include <cstdint>
 #include <memory>
+#include <string>
 
 #include "Identity.h"
 
@@ -93,11 +94,43 @@ class AESAlignedBuffer {  // 16 bytes alignment
 /// @return True if supported, false if not
 bool AESNIExists();
 
-/// @brief Returns result of AESNIExists()
+/// @brief Returns true unless the generic backend is in use
 /// @note Used for runtime AES-NI implementation
 /// @return True we are using AES-NI, false if not
 bool UsingAESNI();
 
+/// @enum AESBackend
+/// @brief AES kernels, from slowest to fastest
+enum AESBackend {
+  e_AESBackendGeneric,  // Library
+  e_AESBackendAESNI,  // AES-NI, one block at a time
+  e_AESBackendAESNIInterleaved,  // AES-NI, 4 blocks or chains at a time
+  e_AESBackendVAESAVX2,  // VAES, 8 blocks per iteration in 256-bit registers
+  e_AESBackendVAESAVX512  // VAES, 16 blocks per iteration in 512-bit registers
+};
+
+/// @brief Checks CPU (and OS) support for AES-NI, AVX2, AVX-512 and VAES
+/// @return Widest backend this host supports
+AESBackend DetectAESBackend();
+
+/// @return Backend in use, detected at startup unless overridden
+/// @note vaes-avx512 is only used if requested
+AESBackend GetAESBackend();
+
+/// @brief Overrides the default backend, e.g. for benchmarking
+/// @note Must be called before any key is set: keys are scheduled for
+///   the backend in use when they are set. Safe to call while other
+///   threads read the backend, but those threads may still hold keys
+///   scheduled for the previous one
+/// @param name Backend name as returned by GetAESBackendName(), or "auto"
+/// @return False if the name is unknown or the CPU lacks support
+bool SetAESBackend(
+    const std::string& name);
+
+/// @return Name of the given backend, used in config and logs
+const char* GetAESBackendName(
+    AESBackend backend);
+
 /**
  *
  * ECB
@@ -183,6 +216,16 @@ class CBCEncryption {
       const uint8_t* in,
       std::uint8_t* out);
 
+  /// @brief Checksums and encrypts a frame in place in a single pass
+  /// @details The last 4 bytes of the frame receive the big-endian
+  ///   Adler-32 of the rest of it, as in NTCP. Each chunk is checksummed
+  ///   right before it is encrypted, while it is still in cache.
+  /// @param buf Frame, a multiple of 16 bytes
+  /// @param len Size of the frame, in bytes
+  void EncryptWithAdler32(
+      std::uint8_t* buf,
+      std::size_t len);
+
  private:
   class CBCEncryptionImpl;
   std::unique_ptr<CBCEncryptionImpl> m_CBCEncryptionPimpl;
@@ -221,6 +264,22 @@ class CBCDecryption {
       const std::uint8_t* in,
       std::uint8_t* out);
 
+  /// @brief Decrypts and checksums the plaintext in a single pass
+  /// @details Each chunk is checksummed right after it is decrypted,
+  ///   while it is still in cache
+  /// @param in Ciphertext, a multiple of 16 bytes
+  /// @param len Size of the ciphertext, in bytes
+  /// @param out Buffer to receive the plaintext
+  /// @param adler Running Adler-32 of the plaintext so far
+  /// @param adler_len Number of leading plaintext bytes to checksum
+  /// @return Running Adler-32 updated with adler_len bytes of plaintext
+  std::uint32_t DecryptWithAdler32(
+      const std::uint8_t* in,
+      std::size_t len,
+      std::uint8_t* out,
+      std::uint32_t adler,
+      std::size_t adler_len);
+
  private:
   class CBCDecryptionImpl;
   std::unique_ptr<CBCDecryptionImpl> m_CBCDecryptionPimpl;
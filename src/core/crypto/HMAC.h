@@ -47,50 +47,161 @@ const uint64_t OPAD = 0x5C5C5C5C5C5C5C5C;
 
 typedef i2p::data::Tag<32> MACKey;
 
+/// @brief Most keys HMACMD5::VerifyAny() checks in one pass
+const size_t HMAC_MD5_MAX_KEYS = 4;
+
+/// @class HMACMD5
+/// @brief HMAC-MD5 as used by SSU, with the key pads hashed once
+/// @details The inner and outer key pad blocks are compressed when the
+///   key is set and the midstates kept, so a MAC only hashes the message,
+///   where it lies, and one outer block. The outer hash covers the inner
+///   digest followed by 16 zero bytes, as I2P assumes a 32-byte digest.
+class HMACMD5 {
+ public:
+  HMACMD5()
+      : m_HasKey(false) {}
+
+  explicit HMACMD5(
+      const MACKey& key)
+      : m_HasKey(false) {
+    SetKey(key);
+  }
+
+  /// @brief Computes the key pad midstates, unless key is already set
+  void SetKey(
+      const MACKey& key) {
+    if (m_HasKey && m_Key == key)
+      return;
+    m_Key = key;
+    m_HasKey = true;
+    uint64_t pad[8];
+    for (int i = 0; i < 4; i++)
+      pad[i] = key.GetLL()[i] ^ IPAD;
+    for (int i = 4; i < 8; i++)
+      pad[i] = IPAD;
+    MD5InitState(m_Inner);
+    MD5Transform(m_Inner, 1, reinterpret_cast<uint8_t *>(pad), 1);
+    for (int i = 0; i < 4; i++)
+      pad[i] = key.GetLL()[i] ^ OPAD;
+    for (int i = 4; i < 8; i++)
+      pad[i] = OPAD;
+    MD5InitState(m_Outer);
+    MD5Transform(m_Outer, 1, reinterpret_cast<uint8_t *>(pad), 1);
+  }
+
+  /// @param digest 16 bytes
+  void CalculateDigest(
+      const uint8_t* msg,
+      size_t len,
+      uint8_t* digest) const {
+    const HMACMD5* key = this;
+    CalculateDigests(&key, 1, msg, len, digest);
+  }
+
+  /// @return True if digest is the MAC of msg
+  bool VerifyDigest(
+      const uint8_t* msg,
+      size_t len,
+      const uint8_t* digest) const {
+    const HMACMD5* key = this;
+    return !VerifyAny(&key, 1, msg, len, digest);
+  }
+
+  /// @brief Computes the MAC of msg under each key in one pass over msg
+  /// @param num At most HMAC_MD5_MAX_KEYS
+  /// @param digests 16 bytes per key
+  static void CalculateDigests(
+      const HMACMD5* const* keys,
+      size_t num,
+      const uint8_t* msg,
+      size_t len,
+      uint8_t* digests) {
+    if (num > HMAC_MD5_MAX_KEYS)
+      num = HMAC_MD5_MAX_KEYS;
+    uint32_t states[HMAC_MD5_MAX_KEYS * 4];
+    for (size_t i = 0; i < num; i++)
+      memcpy(states + 4 * i, keys[i]->m_Inner, 16);
+    // whole blocks of the message
+    size_t num_blocks = len / MD5_BLOCK_SIZE;
+    MD5Transform(states, num, msg, num_blocks);
+    // rest of the message, padding and length of pad block and message
+    uint8_t tail[2 * MD5_BLOCK_SIZE] = {};
+    size_t rest = len - num_blocks * MD5_BLOCK_SIZE;
+    memcpy(tail, msg + num_blocks * MD5_BLOCK_SIZE, rest);
+    tail[rest] = 0x80;
+    size_t tail_size = rest + 9 > MD5_BLOCK_SIZE ?
+      2 * MD5_BLOCK_SIZE : MD5_BLOCK_SIZE;
+    PutLength(tail + tail_size - 8, MD5_BLOCK_SIZE + len);
+    MD5Transform(states, num, tail, tail_size / MD5_BLOCK_SIZE);
+    for (size_t i = 0; i < num; i++) {
+      // inner digest, 16 zero bytes, padding and length of both blocks
+      uint8_t block[MD5_BLOCK_SIZE] = {};
+      PutState(block, states + 4 * i);
+      block[32] = 0x80;
+      PutLength(block + MD5_BLOCK_SIZE - 8, MD5_BLOCK_SIZE + 32);
+      uint32_t state[4];
+      memcpy(state, keys[i]->m_Outer, 16);
+      MD5Transform(state, 1, block, 1);
+      PutState(digests + 16 * i, state);
+    }
+  }
+
+  /// @return Index of the first key digest is the MAC of msg with,
+  ///   -1 if none
+  static int VerifyAny(
+      const HMACMD5* const* keys,
+      size_t num,
+      const uint8_t* msg,
+      size_t len,
+      const uint8_t* digest) {
+    if (num > HMAC_MD5_MAX_KEYS)
+      num = HMAC_MD5_MAX_KEYS;
+    uint8_t digests[HMAC_MD5_MAX_KEYS * 16];
+    CalculateDigests(keys, num, msg, len, digests);
+    for (size_t i = 0; i < num; i++) {
+      // compare in constant time
+      uint8_t diff = 0;
+      for (size_t j = 0; j < 16; j++)
+        diff |= digests[16 * i + j] ^ digest[j];
+      if (!diff)
+        return static_cast<int>(i);
+    }
+    return -1;
+  }
+
+ private:
+  /// @brief Writes MD5 length field for size bytes
+  static void PutLength(
+      uint8_t* buf,
+      uint64_t size) {
+    size <<= 3;  // in bits
+    for (int i = 0; i < 8; i++)
+      buf[i] = static_cast<uint8_t>(size >> (8 * i));
+  }
+
+  /// @brief Writes MD5 state as a digest
+  static void PutState(
+      uint8_t* buf,
+      const uint32_t* state) {
+    for (int i = 0; i < 16; i++)
+      buf[i] = static_cast<uint8_t>(state[i / 4] >> (8 * (i % 4)));
+  }
+
+ private:
+  bool m_HasKey;
+  MACKey m_Key;
+  uint32_t m_Inner[4], m_Outer[4];  // midstates after the key pads
+};
+
+/// @brief Computes HMAC-MD5 of msg, for a key used only once
 inline void HMACMD5Digest(
-    uint8_t* msg,
+    const uint8_t* msg,
     size_t len,
     const MACKey& key,
     uint8_t* digest) {
   // key is 32 bytes
   // digest is 16 bytes
-  // block size is 64 bytes
-  uint64_t buf[256];
-  // ikeypad
-  buf[0] = key.GetLL()[0] ^ IPAD;
-  buf[1] = key.GetLL()[1] ^ IPAD;
-  buf[2] = key.GetLL()[2] ^ IPAD;
-  buf[3] = key.GetLL()[3] ^ IPAD;
-  buf[4] = IPAD;
-  buf[5] = IPAD;
-  buf[6] = IPAD;
-  buf[7] = IPAD;
-  // concatenate with msg
-  memcpy(buf + 8, msg, len);
-  // calculate first hash
-  uint8_t hash[16];  // MD5
-  i2p::crypto::MD5().CalculateDigest(
-      hash,
-      reinterpret_cast<uint8_t *>(buf),
-      len + 64);
-  // okeypad
-  buf[0] = key.GetLL()[0] ^ OPAD;
-  buf[1] = key.GetLL()[1] ^ OPAD;
-  buf[2] = key.GetLL()[2] ^ OPAD;
-  buf[3] = key.GetLL()[3] ^ OPAD;
-  buf[4] = OPAD;
-  buf[5] = OPAD;
-  buf[6] = OPAD;
-  buf[7] = OPAD;
-  // copy first hash after okeypad
-  memcpy(buf + 8, hash, 16);
-  // fill next 16 bytes with zeros (first hash size assumed 32 bytes in I2P)
-  memset(buf + 10, 0, 16);
-  // calculate digest
-  i2p::crypto::MD5().CalculateDigest(
-      digest,
-      reinterpret_cast<uint8_t *>(buf),
-      96);
+  HMACMD5(key).CalculateDigest(msg, len, digest);
 }
 
 }  // namespace crypto
@@ -62,6 +62,26 @@ class MD5 {
   std::unique_ptr<MD5Impl> m_MD5Pimpl;
 };
 
+/// @brief Size of an MD5 block, in bytes
+const std::size_t MD5_BLOCK_SIZE = 64;
+
+/// @brief Sets an MD5 state of 4 words to its initial value
+void MD5InitState(
+    std::uint32_t* state);
+
+/// @brief Runs the MD5 compression function over whole blocks
+/// @details Every state is advanced over the same blocks, so a message
+///   is read once for several keyed midstates (see HMACMD5)
+/// @param states Consecutive MD5 states of 4 words each
+/// @param num_states Number of states
+/// @param blocks Input, num_blocks * MD5_BLOCK_SIZE bytes
+/// @param num_blocks Number of blocks
+void MD5Transform(
+    std::uint32_t* states,
+    std::size_t num_states,
+    const std::uint8_t* blocks,
+    std::size_t num_blocks);
+
 /// @class SHA256
 class SHA256 {
  public:
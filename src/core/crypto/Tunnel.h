@@ -33,6 +33,7 @@
 #ifndef SRC_CORE_CRYPTO_TUNNEL_H_
 #define SRC_CORE_CRYPTO_TUNNEL_H_
 
+#include <cstddef>
 #include <cstdint>
 #include <memory>
 
@@ -55,6 +56,13 @@ class TunnelEncryption {  // with double IV encryption
       const std::uint8_t* in,
       std::uint8_t* out);  // 1024 bytes (16 IV + 1008 data)
 
+  /// @brief Encrypts num messages, interleaving their CBC chains
+  /// @note in[i] may equal out[i], messages must not otherwise overlap
+  void EncryptBatch(
+      std::size_t num,
+      const std::uint8_t* const* in,
+      std::uint8_t* const* out);
+
  private:
   class TunnelEncryptionImpl;
   std::unique_ptr<TunnelEncryptionImpl> m_TunnelEncryptionPimpl;
@@ -74,6 +82,13 @@ class TunnelDecryption {  // with double IV encryption
       const std::uint8_t* in,
       std::uint8_t* out);  // 1024 bytes (16 IV + 1008 data)
 
+  /// @brief Decrypts num messages
+  /// @note in[i] may equal out[i], messages must not otherwise overlap
+  void DecryptBatch(
+      std::size_t num,
+      const std::uint8_t* const* in,
+      std::uint8_t* const* out);
+
  private:
   class TunnelDecryptionImpl;
   std::unique_ptr<TunnelDecryptionImpl> m_TunnelDecryptionPimpl;
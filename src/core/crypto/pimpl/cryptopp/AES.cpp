@@ -37,7 +37,12 @@
 
 #include <stdlib.h>
 
+#include <algorithm>
+#include <atomic>
+
 #include "AESNIMacros.h"
+#include "crypto/util/Checksum.h"
+#include "util/I2PEndian.h"
 #include "util/Log.h"
 
 namespace i2p {
@@ -45,31 +50,130 @@ namespace crypto {
 
 /// TODO(unassigned): if we switch libraries, we should move AES-NI elsewhere.
 /// TODO(unassigned): MSVC x86-64 support?
-bool AESNIExists() {
-  unsigned int eax, ecx;  // We only need ECX
-  const unsigned int flag = (1 << 25);  // ECX bit 25 for AES-NI
-  LogPrint(eLogInfo, "Crypto: checking for AES-NI...");
+namespace {
+
+void CPUID(
+    unsigned int leaf,
+    unsigned int subleaf,
+    unsigned int* regs) {  // eax, ebx, ecx, edx
   __asm__ __volatile__(
       "cpuid"
-      : "=a"(eax), "=c"(ecx)  // 0x2000000;
-      : "a"(1), "c"(0)
-      : "%ebx", "%edx");
-  if ((ecx & flag) == flag) {
-    LogPrint(eLogInfo, "Crypto: AES-NI is available!");
-  } else {
+      : "=a"(regs[0]), "=b"(regs[1]), "=c"(regs[2]), "=d"(regs[3])
+      : "a"(leaf), "c"(subleaf));
+}
+
+// Register state the OS saves on context switch (XCR0)
+unsigned int XGETBV() {
+  unsigned int eax, edx;
+  __asm__ __volatile__(
+      "xgetbv"
+      : "=a"(eax), "=d"(edx)
+      : "c"(0));
+  return eax;
+}
+
+// Bytes decrypted or encrypted before checksumming, small enough to
+// stay in L1 between the two passes
+const std::size_t ADLER32_CHUNK_SIZE = 1024;
+
+const char* const AES_BACKEND_NAMES[] = {
+  "generic",
+  "aesni",
+  "aesni-interleaved",
+  "vaes-avx2",
+  "vaes-avx512"
+};
+
+}  // namespace
+
+bool AESNIExists() {
+  unsigned int regs[4];
+  CPUID(1, 0, regs);
+  return regs[2] & (1 << 25);  // ECX bit 25 for AES-NI
+}
+
+AESBackend DetectAESBackend() {
+  LogPrint(eLogInfo, "Crypto: checking for AES-NI...");
+  if (!AESNIExists()) {
     LogPrint(eLogInfo, "Crypto: AES-NI is not available. Using library.");
-    return false;
+    return e_AESBackendGeneric;
   }
-  return true;
+  LogPrint(eLogInfo, "Crypto: AES-NI is available!");
+  unsigned int regs[4];
+  CPUID(0, 0, regs);
+  const unsigned int max_leaf = regs[0];
+  CPUID(1, 0, regs);
+  const bool osxsave = regs[2] & (1 << 27);
+  const bool avx = regs[2] & (1 << 28);
+  if (max_leaf < 7 || !osxsave || !avx)
+    return e_AESBackendAESNIInterleaved;
+  const unsigned int xcr0 = XGETBV();
+  if ((xcr0 & 0x6) != 0x6)  // XMM and YMM state
+    return e_AESBackendAESNIInterleaved;
+  CPUID(7, 0, regs);
+  const bool avx2 = regs[1] & (1 << 5);
+  const bool avx512f = regs[1] & (1 << 16);
+  const bool vaes = regs[2] & (1 << 9);
+  if (!vaes || !avx2)
+    return e_AESBackendAESNIInterleaved;
+  if (avx512f && (xcr0 & 0xE0) == 0xE0)  // Opmask and ZMM state
+    return e_AESBackendVAESAVX512;
+  return e_AESBackendVAESAVX2;
 }
 
-// Initialize once to avoid repeated tests for AES-NI
+// Initialize once to avoid repeated CPU checks
 // TODO(unassigned): better place to initialize?
-bool aesni(AESNIExists());
+const AESBackend detected_backend(DetectAESBackend());
+
+// 512-bit kernels must be requested explicitly: a tunnel message is only
+// 63 blocks, and they measured slower than the 256-bit ones for it
+AESBackend GetDefaultAESBackend() {
+  return std::min(detected_backend, e_AESBackendVAESAVX2);
+}
+
+// Read by every crypto thread, so atomic even though it is meant to be
+// set once at startup. Nothing is published through it: relaxed is enough
+std::atomic<AESBackend> aes_backend(GetDefaultAESBackend());
+
+AESBackend GetAESBackend() {
+  return aes_backend.load(std::memory_order_relaxed);
+}
+
+bool SetAESBackend(
+    const std::string& name) {
+  AESBackend backend;
+  if (name == "auto") {
+    backend = GetDefaultAESBackend();
+  } else {
+    std::size_t i = 0;
+    while (i <= e_AESBackendVAESAVX512 && name != AES_BACKEND_NAMES[i])
+      i++;
+    if (i > e_AESBackendVAESAVX512) {
+      LogPrint(eLogError, "Crypto: unknown AES backend ", name);
+      return false;
+    }
+    // Backends are ordered, faster ones need all features of slower ones
+    if (i > static_cast<std::size_t>(detected_backend)) {
+      LogPrint(eLogError,
+          "Crypto: AES backend ", name, " is not supported by this CPU");
+      return false;
+    }
+    backend = static_cast<AESBackend>(i);
+  }
+  aes_backend.store(backend, std::memory_order_relaxed);
+  LogPrint(eLogInfo,
+      "Crypto: using AES backend ", GetAESBackendName(backend));
+  return true;
+}
+
+const char* GetAESBackendName(
+    AESBackend backend) {
+  return AES_BACKEND_NAMES[backend];
+}
 
 // For runtime AES-NI
 bool UsingAESNI() {
-  return aesni;
+  return GetAESBackend() != e_AESBackendGeneric;
 }
 
 /// @class ECBCryptoAESNI
@@ -330,7 +434,7 @@ class CBCEncryption::CBCEncryptionImpl {
       const CipherBlock* in,
       CipherBlock* out) {
     if (UsingAESNI()) {
-      __asm__(
+      __asm__ __volatile__(
           "movups (%[iv]), %%xmm1 \n"
           "1: \n"
           "movups (%[in]), %%xmm0 \n"
@@ -343,10 +447,10 @@ class CBCEncryption::CBCEncryptionImpl {
           "dec %[num] \n"
           "jnz 1b \n"
           "movups %%xmm1, (%[iv]) \n"
-          :
+          // in, out and num are advanced, they must not share registers
+          : [in]"+r"(in), [out]"+r"(out), [num]"+r"(num_blocks)
           : [iv]"r"(&m_LastBlock),
-            [sched]"r"(m_ECBEncryption.GetKeySchedule()),
-            [in]"r"(in), [out]"r"(out), [num]"r"(num_blocks)
+            [sched]"r"(m_ECBEncryption.GetKeySchedule())
           : "%xmm0", "%xmm1", "cc", "memory");
     } else {
       for (int i = 0; i < num_blocks; i++) {
@@ -394,6 +498,26 @@ class CBCEncryption::CBCEncryptionImpl {
     }
   }
 
+  void EncryptWithAdler32(
+      std::uint8_t* buf,
+      std::size_t len) {
+    if (len < 16)
+      return;
+    std::uint32_t adler = util::ADLER32_INITIAL;
+    for (std::size_t offset = 0; offset < len;) {
+      std::size_t chunk_len = std::min(ADLER32_CHUNK_SIZE, len - offset);
+      if (offset + chunk_len < len) {
+        adler = util::UpdateAdler32(adler, buf + offset, chunk_len);
+      } else {
+        // Last chunk ends with the checksum itself
+        adler = util::UpdateAdler32(adler, buf + offset, chunk_len - 4);
+        htobe32buf(buf + len - 4, adler);
+      }
+      Encrypt(buf + offset, chunk_len, buf + offset);
+      offset += chunk_len;
+    }
+  }
+
  private:
   CipherBlock m_LastBlock;
   ECBEncryption m_ECBEncryption;
@@ -441,6 +565,12 @@ void CBCEncryption::Encrypt(
   m_CBCEncryptionPimpl->Encrypt(in, out);
 }
 
+void CBCEncryption::EncryptWithAdler32(
+    std::uint8_t* buf,
+    std::size_t len) {
+  m_CBCEncryptionPimpl->EncryptWithAdler32(buf, len);
+}
+
 /**
  *
  * CBC Decryption
@@ -478,24 +608,54 @@ class CBCDecryption::CBCDecryptionImpl {
       const CipherBlock* in,
       CipherBlock* out) {
     if (UsingAESNI()) {
-      __asm__(
-        "movups (%[iv]), %%xmm1 \n"
-        "1: \n"
-        "movups (%[in]), %%xmm0 \n"
-        "movaps %%xmm0, %%xmm2 \n"
-        DecryptAES256(sched)
-        "pxor %%xmm1, %%xmm0 \n"
-        "movups %%xmm0, (%[out]) \n"
-        "movaps %%xmm2, %%xmm1 \n"
-        "add $16, %[in] \n"
-        "add $16, %[out] \n"
-        "dec %[num] \n"
-        "jnz 1b \n"
-        "movups %%xmm1, (%[iv]) \n"
-        :
-        : [iv]"r"(&m_IV), [sched]"r"(m_ECBDecryption.GetKeySchedule ()),
-          [in]"r"(in), [out]"r"(out), [num]"r"(num_blocks)
-        : "%xmm0", "%xmm1", "%xmm2", "cc", "memory");
+      // Widest kernel first, narrower ones finish the remaining blocks
+      switch (GetAESBackend()) {
+        case e_AESBackendVAESAVX512:
+          __asm__ __volatile__(
+            "movups (%[iv]), %%xmm1 \n"
+            CBCDecryptVAES256x16(sched)
+            CBCDecryptVAES256x8(sched)
+            CBCDecryptAES256x4(sched)
+            CBCDecryptAES256(sched)
+            "movups %%xmm1, (%[iv]) \n"
+            : [in]"+r"(in), [out]"+r"(out), [num]"+r"(num_blocks)
+            : [iv]"r"(&m_IV), [sched]"r"(m_ECBDecryption.GetKeySchedule())
+            : "%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm4", "%xmm5", "%xmm6",
+              "%xmm7", "cc", "memory");
+          break;
+        case e_AESBackendVAESAVX2:
+          __asm__ __volatile__(
+            "movups (%[iv]), %%xmm1 \n"
+            CBCDecryptVAES256x8(sched)
+            CBCDecryptAES256x4(sched)
+            CBCDecryptAES256(sched)
+            "movups %%xmm1, (%[iv]) \n"
+            : [in]"+r"(in), [out]"+r"(out), [num]"+r"(num_blocks)
+            : [iv]"r"(&m_IV), [sched]"r"(m_ECBDecryption.GetKeySchedule())
+            : "%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm4", "%xmm5", "%xmm6",
+              "%xmm7", "cc", "memory");
+          break;
+        case e_AESBackendAESNIInterleaved:
+          __asm__ __volatile__(
+            "movups (%[iv]), %%xmm1 \n"
+            CBCDecryptAES256x4(sched)
+            CBCDecryptAES256(sched)
+            "movups %%xmm1, (%[iv]) \n"
+            : [in]"+r"(in), [out]"+r"(out), [num]"+r"(num_blocks)
+            : [iv]"r"(&m_IV), [sched]"r"(m_ECBDecryption.GetKeySchedule())
+            : "%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm4", "%xmm5", "%xmm6",
+              "%xmm7", "cc", "memory");
+          break;
+        default:
+          __asm__ __volatile__(
+            "movups (%[iv]), %%xmm1 \n"
+            CBCDecryptAES256(sched)
+            "movups %%xmm1, (%[iv]) \n"
+            : [in]"+r"(in), [out]"+r"(out), [num]"+r"(num_blocks)
+            : [iv]"r"(&m_IV), [sched]"r"(m_ECBDecryption.GetKeySchedule())
+            : "%xmm0", "%xmm1", "%xmm6", "cc", "memory");
+          break;
+      }
     } else {
       for (int i = 0; i < num_blocks; i++) {
         CipherBlock tmp = in[i];
@@ -542,6 +702,26 @@ class CBCDecryption::CBCDecryptionImpl {
     }
   }
 
+  std::uint32_t DecryptWithAdler32(
+      const std::uint8_t* in,
+      std::size_t len,
+      std::uint8_t* out,
+      std::uint32_t adler,
+      std::size_t adler_len) {
+    adler_len = std::min(adler_len, len);
+    for (std::size_t offset = 0; offset < len;) {
+      std::size_t chunk_len = std::min(ADLER32_CHUNK_SIZE, len - offset);
+      Decrypt(in + offset, chunk_len, out + offset);
+      if (offset < adler_len)
+        adler = util::UpdateAdler32(
+            adler,
+            out + offset,
+            std::min(chunk_len, adler_len - offset));
+      offset += chunk_len;
+    }
+    return adler;
+  }
+
  private:
   CipherBlock m_IV;
   ECBDecryption m_ECBDecryption;
@@ -589,5 +769,15 @@ void CBCDecryption::Decrypt(
   m_CBCDecryptionPimpl->Decrypt(in, out);
 }
 
+std::uint32_t CBCDecryption::DecryptWithAdler32(
+    const std::uint8_t* in,
+    std::size_t len,
+    std::uint8_t* out,
+    std::uint32_t adler,
+    std::size_t adler_len) {
+  return m_CBCDecryptionPimpl->DecryptWithAdler32(
+      in, len, out, adler, adler_len);
+}
+
 }  //  namespace crypto
 }  //  namespace i2p
@@ -90,6 +90,247 @@
   "aesdec 16(%["#sched"]), %%xmm0 \n" \
   "aesdeclast (%["#sched"]), %%xmm0 \n"
 
+// Four independent blocks in xmm0, xmm2, xmm3 and xmm4, round key in xmm5.
+// Used to encrypt several CBC chains (e.g. tunnel messages) side by side
+#define EncryptRoundx4(sched, offset) \
+  "movaps "#offset"(%["#sched"]), %%xmm5 \n" \
+  "aesenc %%xmm5, %%xmm0 \n" \
+  "aesenc %%xmm5, %%xmm2 \n" \
+  "aesenc %%xmm5, %%xmm3 \n" \
+  "aesenc %%xmm5, %%xmm4 \n"
+
+#define EncryptAES256x4(sched) \
+  "movaps (%["#sched"]), %%xmm5 \n" \
+  "pxor %%xmm5, %%xmm0 \n" \
+  "pxor %%xmm5, %%xmm2 \n" \
+  "pxor %%xmm5, %%xmm3 \n" \
+  "pxor %%xmm5, %%xmm4 \n" \
+  EncryptRoundx4(sched, 16) \
+  EncryptRoundx4(sched, 32) \
+  EncryptRoundx4(sched, 48) \
+  EncryptRoundx4(sched, 64) \
+  EncryptRoundx4(sched, 80) \
+  EncryptRoundx4(sched, 96) \
+  EncryptRoundx4(sched, 112) \
+  EncryptRoundx4(sched, 128) \
+  EncryptRoundx4(sched, 144) \
+  EncryptRoundx4(sched, 160) \
+  EncryptRoundx4(sched, 176) \
+  EncryptRoundx4(sched, 192) \
+  EncryptRoundx4(sched, 208) \
+  "movaps 224(%["#sched"]), %%xmm5 \n" \
+  "aesenclast %%xmm5, %%xmm0 \n" \
+  "aesenclast %%xmm5, %%xmm2 \n" \
+  "aesenclast %%xmm5, %%xmm3 \n" \
+  "aesenclast %%xmm5, %%xmm4 \n"
+
+// Same register layout, for decryption.
+// CBC decryption is parallel across blocks, interleaving hides aesdec latency
+#define DecryptRoundx4(sched, offset) \
+  "movaps "#offset"(%["#sched"]), %%xmm5 \n" \
+  "aesdec %%xmm5, %%xmm0 \n" \
+  "aesdec %%xmm5, %%xmm2 \n" \
+  "aesdec %%xmm5, %%xmm3 \n" \
+  "aesdec %%xmm5, %%xmm4 \n"
+
+#define DecryptAES256x4(sched) \
+  "movaps 224(%["#sched"]), %%xmm5 \n" \
+  "pxor %%xmm5, %%xmm0 \n" \
+  "pxor %%xmm5, %%xmm2 \n" \
+  "pxor %%xmm5, %%xmm3 \n" \
+  "pxor %%xmm5, %%xmm4 \n" \
+  DecryptRoundx4(sched, 208) \
+  DecryptRoundx4(sched, 192) \
+  DecryptRoundx4(sched, 176) \
+  DecryptRoundx4(sched, 160) \
+  DecryptRoundx4(sched, 144) \
+  DecryptRoundx4(sched, 128) \
+  DecryptRoundx4(sched, 112) \
+  DecryptRoundx4(sched, 96) \
+  DecryptRoundx4(sched, 80) \
+  DecryptRoundx4(sched, 64) \
+  DecryptRoundx4(sched, 48) \
+  DecryptRoundx4(sched, 32) \
+  DecryptRoundx4(sched, 16) \
+  "movaps (%["#sched"]), %%xmm5 \n" \
+  "aesdeclast %%xmm5, %%xmm0 \n" \
+  "aesdeclast %%xmm5, %%xmm2 \n" \
+  "aesdeclast %%xmm5, %%xmm3 \n" \
+  "aesdeclast %%xmm5, %%xmm4 \n"
+
+// CBC decryption of num blocks from in to out, IV in xmm1.
+// The wide kernels below stop when fewer blocks than their width remain,
+// so they are chained from widest to CBCDecryptAES256 which finishes the tail.
+// All update in, out and num and leave the last ciphertext block in xmm1.
+// All ciphertext of a group is read before its plaintext is written,
+// so in and out may be the same buffer.
+
+// One block at a time. Clobbers xmm0 and xmm6
+#define CBCDecryptAES256(sched) \
+  "test %[num], %[num] \n" \
+  "jz 5f \n" \
+  "4: \n" \
+  "movups (%[in]), %%xmm0 \n" \
+  "movaps %%xmm0, %%xmm6 \n" \
+  DecryptAES256(sched) \
+  "pxor %%xmm1, %%xmm0 \n" \
+  "movups %%xmm0, (%[out]) \n" \
+  "movaps %%xmm6, %%xmm1 \n" \
+  "add $16, %[in] \n" \
+  "add $16, %[out] \n" \
+  "dec %[num] \n" \
+  "jnz 4b \n" \
+  "5: \n"
+
+// Four blocks at a time. Clobbers xmm0 and xmm2 to xmm7
+#define CBCDecryptAES256x4(sched) \
+  "cmp $4, %[num] \n" \
+  "jb 3f \n" \
+  "2: \n" \
+  "movups (%[in]), %%xmm0 \n" \
+  "movups 16(%[in]), %%xmm2 \n" \
+  "movups 32(%[in]), %%xmm3 \n" \
+  "movups 48(%[in]), %%xmm4 \n" \
+  DecryptAES256x4(sched) \
+  "pxor %%xmm1, %%xmm0 \n" \
+  "movups (%[in]), %%xmm7 \n" \
+  "pxor %%xmm7, %%xmm2 \n" \
+  "movups 16(%[in]), %%xmm7 \n" \
+  "pxor %%xmm7, %%xmm3 \n" \
+  "movups 32(%[in]), %%xmm7 \n" \
+  "pxor %%xmm7, %%xmm4 \n" \
+  "movups 48(%[in]), %%xmm1 \n" \
+  "movups %%xmm0, (%[out]) \n" \
+  "movups %%xmm2, 16(%[out]) \n" \
+  "movups %%xmm3, 32(%[out]) \n" \
+  "movups %%xmm4, 48(%[out]) \n" \
+  "add $64, %[in] \n" \
+  "add $64, %[out] \n" \
+  "sub $4, %[num] \n" \
+  "cmp $4, %[num] \n" \
+  "jae 2b \n" \
+  "3: \n"
+
+// VAES: two blocks per ymm register, same register layout as above
+#define VDecryptRoundx8(sched, offset) \
+  "vbroadcasti128 "#offset"(%["#sched"]), %%ymm5 \n" \
+  "vaesdec %%ymm5, %%ymm0, %%ymm0 \n" \
+  "vaesdec %%ymm5, %%ymm2, %%ymm2 \n" \
+  "vaesdec %%ymm5, %%ymm3, %%ymm3 \n" \
+  "vaesdec %%ymm5, %%ymm4, %%ymm4 \n"
+
+// Eight blocks at a time. Requires VAES and AVX2.
+// Clobbers ymm0 and ymm2 to ymm6
+#define CBCDecryptVAES256x8(sched) \
+  "cmp $8, %[num] \n" \
+  "jb 7f \n" \
+  "6: \n" \
+  "vmovdqu (%[in]), %%ymm0 \n" \
+  "vmovdqu 32(%[in]), %%ymm2 \n" \
+  "vmovdqu 64(%[in]), %%ymm3 \n" \
+  "vmovdqu 96(%[in]), %%ymm4 \n" \
+  "vinserti128 $1, (%[in]), %%ymm1, %%ymm6 \n" \
+  "vbroadcasti128 224(%["#sched"]), %%ymm5 \n" \
+  "vpxor %%ymm5, %%ymm0, %%ymm0 \n" \
+  "vpxor %%ymm5, %%ymm2, %%ymm2 \n" \
+  "vpxor %%ymm5, %%ymm3, %%ymm3 \n" \
+  "vpxor %%ymm5, %%ymm4, %%ymm4 \n" \
+  VDecryptRoundx8(sched, 208) \
+  VDecryptRoundx8(sched, 192) \
+  VDecryptRoundx8(sched, 176) \
+  VDecryptRoundx8(sched, 160) \
+  VDecryptRoundx8(sched, 144) \
+  VDecryptRoundx8(sched, 128) \
+  VDecryptRoundx8(sched, 112) \
+  VDecryptRoundx8(sched, 96) \
+  VDecryptRoundx8(sched, 80) \
+  VDecryptRoundx8(sched, 64) \
+  VDecryptRoundx8(sched, 48) \
+  VDecryptRoundx8(sched, 32) \
+  VDecryptRoundx8(sched, 16) \
+  "vbroadcasti128 (%["#sched"]), %%ymm5 \n" \
+  "vaesdeclast %%ymm5, %%ymm0, %%ymm0 \n" \
+  "vaesdeclast %%ymm5, %%ymm2, %%ymm2 \n" \
+  "vaesdeclast %%ymm5, %%ymm3, %%ymm3 \n" \
+  "vaesdeclast %%ymm5, %%ymm4, %%ymm4 \n" \
+  "vpxor %%ymm6, %%ymm0, %%ymm0 \n" \
+  "vpxor 16(%[in]), %%ymm2, %%ymm2 \n" \
+  "vpxor 48(%[in]), %%ymm3, %%ymm3 \n" \
+  "vpxor 80(%[in]), %%ymm4, %%ymm4 \n" \
+  "vmovdqu 112(%[in]), %%xmm1 \n" \
+  "vmovdqu %%ymm0, (%[out]) \n" \
+  "vmovdqu %%ymm2, 32(%[out]) \n" \
+  "vmovdqu %%ymm3, 64(%[out]) \n" \
+  "vmovdqu %%ymm4, 96(%[out]) \n" \
+  "add $128, %[in] \n" \
+  "add $128, %[out] \n" \
+  "sub $8, %[num] \n" \
+  "cmp $8, %[num] \n" \
+  "jae 6b \n" \
+  "vzeroupper \n" \
+  "7: \n"
+
+// VAES: four blocks per zmm register, same register layout as above
+#define VDecryptRoundx16(sched, offset) \
+  "vbroadcasti32x4 "#offset"(%["#sched"]), %%zmm5 \n" \
+  "vaesdec %%zmm5, %%zmm0, %%zmm0 \n" \
+  "vaesdec %%zmm5, %%zmm2, %%zmm2 \n" \
+  "vaesdec %%zmm5, %%zmm3, %%zmm3 \n" \
+  "vaesdec %%zmm5, %%zmm4, %%zmm4 \n"
+
+// Sixteen blocks at a time. Requires VAES and AVX-512F.
+// Clobbers zmm0 and zmm2 to zmm7
+#define CBCDecryptVAES256x16(sched) \
+  "cmp $16, %[num] \n" \
+  "jb 9f \n" \
+  "8: \n" \
+  "vmovdqu64 (%[in]), %%zmm0 \n" \
+  "vmovdqu64 64(%[in]), %%zmm2 \n" \
+  "vmovdqu64 128(%[in]), %%zmm3 \n" \
+  "vmovdqu64 192(%[in]), %%zmm4 \n" \
+  /* IV followed by the first three ciphertext blocks */ \
+  "vshufi32x4 $0, %%zmm1, %%zmm1, %%zmm7 \n" \
+  "valignq $6, %%zmm7, %%zmm0, %%zmm6 \n" \
+  "vbroadcasti32x4 224(%["#sched"]), %%zmm5 \n" \
+  "vpxorq %%zmm5, %%zmm0, %%zmm0 \n" \
+  "vpxorq %%zmm5, %%zmm2, %%zmm2 \n" \
+  "vpxorq %%zmm5, %%zmm3, %%zmm3 \n" \
+  "vpxorq %%zmm5, %%zmm4, %%zmm4 \n" \
+  VDecryptRoundx16(sched, 208) \
+  VDecryptRoundx16(sched, 192) \
+  VDecryptRoundx16(sched, 176) \
+  VDecryptRoundx16(sched, 160) \
+  VDecryptRoundx16(sched, 144) \
+  VDecryptRoundx16(sched, 128) \
+  VDecryptRoundx16(sched, 112) \
+  VDecryptRoundx16(sched, 96) \
+  VDecryptRoundx16(sched, 80) \
+  VDecryptRoundx16(sched, 64) \
+  VDecryptRoundx16(sched, 48) \
+  VDecryptRoundx16(sched, 32) \
+  VDecryptRoundx16(sched, 16) \
+  "vbroadcasti32x4 (%["#sched"]), %%zmm5 \n" \
+  "vaesdeclast %%zmm5, %%zmm0, %%zmm0 \n" \
+  "vaesdeclast %%zmm5, %%zmm2, %%zmm2 \n" \
+  "vaesdeclast %%zmm5, %%zmm3, %%zmm3 \n" \
+  "vaesdeclast %%zmm5, %%zmm4, %%zmm4 \n" \
+  "vpxorq %%zmm6, %%zmm0, %%zmm0 \n" \
+  "vpxorq 48(%[in]), %%zmm2, %%zmm2 \n" \
+  "vpxorq 112(%[in]), %%zmm3, %%zmm3 \n" \
+  "vpxorq 176(%[in]), %%zmm4, %%zmm4 \n" \
+  "vmovdqu 240(%[in]), %%xmm1 \n" \
+  "vmovdqu64 %%zmm0, (%[out]) \n" \
+  "vmovdqu64 %%zmm2, 64(%[out]) \n" \
+  "vmovdqu64 %%zmm3, 128(%[out]) \n" \
+  "vmovdqu64 %%zmm4, 192(%[out]) \n" \
+  "add $256, %[in] \n" \
+  "add $256, %[out] \n" \
+  "sub $16, %[num] \n" \
+  "cmp $16, %[num] \n" \
+  "jae 8b \n" \
+  "vzeroupper \n" \
+  "9: \n"
+
 #define CallAESIMC(offset) \
   "movaps "#offset"(%[shed]), %%xmm0 \n"  \
   "aesimc %%xmm0, %%xmm0 \n" \
@@ -31,9 +31,11 @@
 #include "crypto/Hash.h"
 
 #include <cryptopp/md5.h>
+#include <cryptopp/misc.h>
 #include <cryptopp/sha.h>
 
 #include <cstdint>
+#include <cstring>
 
 #include "util/Log.h"
 
@@ -85,6 +87,38 @@ void MD5::CalculateDigest(
   m_MD5Pimpl->CalculateDigest(digest, input, length);
 }
 
+void MD5InitState(
+    std::uint32_t* state) {
+  CryptoPP::Weak1::MD5::InitState(state);
+}
+
+void MD5Transform(
+    std::uint32_t* states,
+    std::size_t num_states,
+    const std::uint8_t* blocks,
+    std::size_t num_blocks) {
+  CryptoPP::word32 block[MD5_BLOCK_SIZE / 4];
+  for (std::size_t i = 0; i < num_blocks; i++) {
+    const std::uint8_t* input = blocks + i * MD5_BLOCK_SIZE;
+    const CryptoPP::word32* data = block;
+    // MD5 words are little-endian, read them in place when we can
+    if (CryptoPP::NativeByteOrderIs(CryptoPP::LITTLE_ENDIAN_ORDER) &&
+        CryptoPP::IsAligned<CryptoPP::word32>(input)) {
+      data = reinterpret_cast<const CryptoPP::word32 *>(input);
+    } else {
+      memcpy(block, input, MD5_BLOCK_SIZE);
+      CryptoPP::ConditionalByteReverse(
+          CryptoPP::LITTLE_ENDIAN_ORDER,
+          block,
+          block,
+          MD5_BLOCK_SIZE);
+    }
+    // states are independent, so the CPU can overlap their rounds
+    for (std::size_t j = 0; j < num_states; j++)
+      CryptoPP::Weak1::MD5::Transform(states + 4 * j, data);
+  }
+}
+
 /**
  *
  * SHA256
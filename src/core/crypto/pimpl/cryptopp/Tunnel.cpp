@@ -32,6 +32,7 @@
 
 #include "crypto/Tunnel.h"
 
+#include <cstddef>
 #include <cstdint>
 
 #include "AESNIMacros.h"
@@ -101,6 +102,64 @@ class TunnelEncryption::TunnelEncryptionImpl {
     }
   }
 
+  void EncryptBatch(
+      std::size_t num,
+      const std::uint8_t* const* in,
+      std::uint8_t* const* out) {
+    std::size_t i = 0;
+    if (GetAESBackend() >= e_AESBackendAESNIInterleaved) {
+      // CBC is serial within a message but not across messages,
+      // so encrypt four messages side by side
+      for (; i + 4 <= num; i += 4) {
+        CipherBlock iv[4];
+        for (std::size_t j = 0; j < 4; j++)
+          m_IVEncryption.Encrypt(
+              reinterpret_cast<const CipherBlock *>(in[i + j]),
+              &iv[j]);
+        std::size_t offset = 16;
+        int num_blocks = 63;  // 63 blocks = 1008 bytes
+        __asm__ __volatile__(
+            "movups (%[iv]), %%xmm0 \n"
+            "movups 16(%[iv]), %%xmm2 \n"
+            "movups 32(%[iv]), %%xmm3 \n"
+            "movups 48(%[iv]), %%xmm4 \n"
+            // previous ciphertext of each chain is in xmm0, xmm2-4
+            "1: \n"
+            "movups (%[in0], %[offset]), %%xmm6 \n"
+            "pxor %%xmm6, %%xmm0 \n"
+            "movups (%[in1], %[offset]), %%xmm6 \n"
+            "pxor %%xmm6, %%xmm2 \n"
+            "movups (%[in2], %[offset]), %%xmm6 \n"
+            "pxor %%xmm6, %%xmm3 \n"
+            "movups (%[in3], %[offset]), %%xmm6 \n"
+            "pxor %%xmm6, %%xmm4 \n"
+            EncryptAES256x4(sched_l)
+            "movups %%xmm0, (%[out0], %[offset]) \n"
+            "movups %%xmm2, (%[out1], %[offset]) \n"
+            "movups %%xmm3, (%[out2], %[offset]) \n"
+            "movups %%xmm4, (%[out3], %[offset]) \n"
+            "add $16, %[offset] \n"
+            "dec %[num] \n"
+            "jnz 1b \n"
+            : [offset]"+r"(offset), [num]"+r"(num_blocks)
+            : [iv]"r"(iv),
+              [sched_l]"r"(m_ECBLayerEncryption.GetKeySchedule()),
+              [in0]"r"(in[i]), [in1]"r"(in[i + 1]),
+              [in2]"r"(in[i + 2]), [in3]"r"(in[i + 3]),
+              [out0]"r"(out[i]), [out1]"r"(out[i + 1]),
+              [out2]"r"(out[i + 2]), [out3]"r"(out[i + 3])
+            : "%xmm0", "%xmm2", "%xmm3", "%xmm4", "%xmm5", "%xmm6",
+              "cc", "memory");
+        for (std::size_t j = 0; j < 4; j++)
+          m_IVEncryption.Encrypt(  // double iv
+              &iv[j],
+              reinterpret_cast<CipherBlock *>(out[i + j]));
+      }
+    }
+    for (; i < num; i++)
+      Encrypt(in[i], out[i]);
+  }
+
  private:
   ECBEncryption m_IVEncryption;
   ECBEncryption m_ECBLayerEncryption;  // For AES-NI
@@ -125,6 +184,13 @@ void TunnelEncryption::Encrypt(
   m_TunnelEncryptionPimpl->Encrypt(in, out);
 }
 
+void TunnelEncryption::EncryptBatch(
+      std::size_t num,
+      const std::uint8_t* const* in,
+      std::uint8_t* const* out) {
+  m_TunnelEncryptionPimpl->EncryptBatch(num, in, out);
+}
+
 /// @class TunnelDecryptionImpl
 /// @brief Tunnel decryption implementation
 class TunnelDecryption::TunnelDecryptionImpl {
@@ -135,60 +201,39 @@ class TunnelDecryption::TunnelDecryptionImpl {
   void SetKeys(
       const AESKey& layer_key,
       const AESKey& iv_key) {
-    if (UsingAESNI())
-      m_ECBLayerDecryption.SetKey(layer_key);
-    else
-      m_CBCLayerDecryption.SetKey(layer_key);
+    m_CBCLayerDecryption.SetKey(layer_key);
     m_IVDecryption.SetKey(iv_key);
   }
 
+  // Data is decrypted by CBCDecryption, which picks the kernel for this CPU
   void Decrypt(
       const std::uint8_t* in,
       std::uint8_t* out) {
-    if (UsingAESNI()) {
-      __asm__(
-          // decrypt IV
-          "movups (%[in]), %%xmm0 \n"
-          DecryptAES256(sched_iv)
-          "movaps %%xmm0, %%xmm1 \n"
-          // double IV encryption
-          DecryptAES256(sched_iv)
-          "movups %%xmm0, (%[out]) \n"
-          // decrypt data, IV is xmm1
-          "1: \n"
-          "add $16, %[in] \n"
-          "add $16, %[out] \n"
-          "movups (%[in]), %%xmm0 \n"
-          "movaps %%xmm0, %%xmm2 \n"
-          DecryptAES256(sched_l)
-          "pxor %%xmm1, %%xmm0 \n"
-          "movups %%xmm0, (%[out]) \n"
-          "movaps %%xmm2, %%xmm1 \n"
-          "dec %[num] \n"
-          "jnz 1b \n"
-          :
-          : [sched_iv]"r"(m_IVDecryption.GetKeySchedule()),
-            [sched_l]"r"(m_ECBLayerDecryption.GetKeySchedule()),
-            [in]"r"(in), [out]"r"(out), [num]"r"(63)  // 63 blocks = 1008 bytes
-          : "%xmm0", "%xmm1", "%xmm2", "cc", "memory");
-    } else {
-      m_IVDecryption.Decrypt(
-          (const CipherBlock *)in,
-          reinterpret_cast<CipherBlock *>(out));  // iv
-      m_CBCLayerDecryption.SetIV(out);
-      m_CBCLayerDecryption.Decrypt(  // data
-          in + 16,
-          i2p::tunnel::TUNNEL_DATA_ENCRYPTED_SIZE,
-          out + 16);
-      m_IVDecryption.Decrypt(  // double iv
-          reinterpret_cast<CipherBlock *>(out),
-          reinterpret_cast<CipherBlock *>(out));
-    }
+    CipherBlock iv;
+    m_IVDecryption.Decrypt(
+        reinterpret_cast<const CipherBlock *>(in),
+        &iv);
+    m_CBCLayerDecryption.SetIV(iv.buf);
+    m_CBCLayerDecryption.Decrypt(  // data
+        in + 16,
+        i2p::tunnel::TUNNEL_DATA_ENCRYPTED_SIZE,
+        out + 16);
+    m_IVDecryption.Decrypt(  // double iv
+        &iv,
+        reinterpret_cast<CipherBlock *>(out));
+  }
+
+  void DecryptBatch(
+      std::size_t num,
+      const std::uint8_t* const* in,
+      std::uint8_t* const* out) {
+    // Decryption of a single message is already parallel
+    for (std::size_t i = 0; i < num; i++)
+      Decrypt(in[i], out[i]);
   }
 
  private:
   ECBDecryption m_IVDecryption;
-  ECBDecryption m_ECBLayerDecryption;  // For AES-NI
   CBCDecryption m_CBCLayerDecryption;
 };
 
@@ -210,5 +255,12 @@ void TunnelDecryption::Decrypt(
   m_TunnelDecryptionPimpl->Decrypt(in, out);
 }
 
+void TunnelDecryption::DecryptBatch(
+      std::size_t num,
+      const std::uint8_t* const* in,
+      std::uint8_t* const* out) {
+  m_TunnelDecryptionPimpl->DecryptBatch(num, in, out);
+}
+
 }  // namespace crypto
 }  // namespace i2p
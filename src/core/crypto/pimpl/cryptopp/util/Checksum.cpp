@@ -30,16 +30,95 @@
 
 #include "crypto/util/Checksum.h"
 
-#include <cryptopp/adler32.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include <cstdint>
 
-#include "util/Log.h"
+#include "util/I2PEndian.h"
 
 namespace i2p {
 namespace crypto {
 namespace util {
 
+namespace {
+
+const std::uint32_t ADLER32_MOD = 65521;
+
+// Most bytes that can be summed before s2 could overflow 32 bits,
+// 255n(n+1)/2 + (n+1)(ADLER32_MOD-1) <= 2^32-1 (a multiple of 16)
+const std::size_t ADLER32_NMAX = 5552;
+
+#if defined(__SSE2__)
+// Sums of the lanes of a vector of four 32-bit integers
+std::uint32_t HorizontalSum(
+    __m128i v) {
+  v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+  v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(v);
+}
+
+// Sums 16 bytes at a time: s1 gains the byte sums and s2 gains 16 * s1
+// of each previous chunk plus the bytes weighted 16..1
+void UpdateAdler32Blocks(
+    std::uint32_t& s1,
+    std::uint32_t& s2,
+    const std::uint8_t* input,
+    std::size_t num_blocks) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i weights_lo = _mm_setr_epi16(16, 15, 14, 13, 12, 11, 10, 9);
+  const __m128i weights_hi = _mm_setr_epi16(8, 7, 6, 5, 4, 3, 2, 1);
+  __m128i v_s1 = zero, v_s2 = zero, v_ps = zero;
+  for (std::size_t i = 0; i < num_blocks; i++) {
+    const __m128i bytes = _mm_loadu_si128(
+        reinterpret_cast<const __m128i *>(input + i * 16));
+    v_ps = _mm_add_epi32(v_ps, v_s1);
+    v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(bytes, zero));
+    v_s2 = _mm_add_epi32(
+        v_s2,
+        _mm_madd_epi16(_mm_unpacklo_epi8(bytes, zero), weights_lo));
+    v_s2 = _mm_add_epi32(
+        v_s2,
+        _mm_madd_epi16(_mm_unpackhi_epi8(bytes, zero), weights_hi));
+  }
+  v_s2 = _mm_add_epi32(v_s2, _mm_slli_epi32(v_ps, 4));
+  // Lane sums never exceed the true sums, which fit for ADLER32_NMAX
+  std::uint64_t sum2 =
+    s2 + static_cast<std::uint64_t>(s1) * 16 * num_blocks + HorizontalSum(v_s2);
+  s1 = (s1 + HorizontalSum(v_s1)) % ADLER32_MOD;
+  s2 = sum2 % ADLER32_MOD;
+}
+#endif
+
+}  // namespace
+
+std::uint32_t UpdateAdler32(
+    std::uint32_t adler,
+    const std::uint8_t* input,
+    std::size_t length) {
+  std::uint32_t s1 = adler & 0xFFFF, s2 = adler >> 16;
+  while (length > 0) {
+    std::size_t len = length < ADLER32_NMAX ? length : ADLER32_NMAX;
+    length -= len;
+#if defined(__SSE2__)
+    std::size_t num_blocks = len / 16;
+    if (num_blocks) {
+      UpdateAdler32Blocks(s1, s2, input, num_blocks);
+      input += num_blocks * 16;
+      len -= num_blocks * 16;
+    }
+#endif
+    for (; len > 0; len--) {
+      s1 += *input++;
+      s2 += s1;
+    }
+    s1 %= ADLER32_MOD;
+    s2 %= ADLER32_MOD;
+  }
+  return (s2 << 16) | s1;
+}
+
 /// @class Adler32Impl
 /// @brief Adler-32 implementation
 class Adler32::Adler32Impl {
@@ -51,29 +130,16 @@ class Adler32::Adler32Impl {
       std::uint8_t* digest,
       const std::uint8_t* input,
       std::size_t length) {
-    try {
-      m_Adler32.CalculateDigest(
-          digest,
-          input,
-          length);
-    } catch (CryptoPP::Exception e) {
-      LogPrint(eLogError,
-          "Adler32: CalculateDigest() caught exception '", e.what(), "'");
-    }
+    htobe32buf(digest, UpdateAdler32(ADLER32_INITIAL, input, length));
   }
 
   std::size_t VerifyDigest(
       std::uint8_t* digest,
       const std::uint8_t* input,
       std::size_t length) {
-    return m_Adler32.VerifyDigest(
-          digest,
-          input,
-          length);
+    return bufbe32toh(digest) ==
+      UpdateAdler32(ADLER32_INITIAL, input, length);
   }
-
- private:
-  CryptoPP::Adler32 m_Adler32;
 };
 
 Adler32::Adler32()
@@ -38,6 +38,21 @@ namespace i2p {
 namespace crypto {
 namespace util {
 
+/// @brief Adler-32 of empty input, the start of a running checksum
+const std::uint32_t ADLER32_INITIAL = 1;
+
+/// @brief Updates a running Adler-32 checksum with additional input
+/// @details Vectorized with SSE2 where available, usable on pieces of
+///   a message as they become available (e.g., while being decrypted)
+/// @param adler Checksum of the input so far, ADLER32_INITIAL to start
+/// @param input The additional input as a buffer
+/// @param length The size of the buffer, in bytes
+/// @return Checksum of the input so far followed by this buffer
+std::uint32_t UpdateAdler32(
+    std::uint32_t adler,
+    const std::uint8_t* input,
+    std::size_t length);
+
 /// @class Adler32
 /// @brief Adler-32
 class Adler32 {
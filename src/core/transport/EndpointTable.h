@@ -0,0 +1,268 @@
+/**
+ * Copyright (c) 2015-2016, The Kovri I2P Router Project
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ *    conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *    of conditions and the following disclaimer in the documentation and/or other
+ *    materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SRC_CORE_TRANSPORT_ENDPOINTTABLE_H_
+#define SRC_CORE_TRANSPORT_ENDPOINTTABLE_H_
+
+#include <boost/asio.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace i2p {
+namespace transport {
+
+/// @class EndpointTable
+/// @brief Hash table of values keyed by UDP endpoint
+/// @details Endpoints are packed into two words and a port, hashed with
+///   a random seed and found by linear probing in a flat slot array that
+///   is never more than half full. Slots hold the hash and an index into
+///   a dense array of entries, so a lookup touches one cache line of
+///   slots and one entry, and iteration is a linear walk. Removal shifts
+///   back the probe chain, leaving no tombstones, and moves the last
+///   entry into the freed position.
+/// @note Not thread-safe
+template<class Value>
+class EndpointTable {
+ public:
+  EndpointTable()
+      : m_Seed(std::random_device()()),
+        m_Slots(MIN_NUM_SLOTS) {}
+
+  /// @return Value of ep, or a default-constructed value if none
+  Value Find(
+      const boost::asio::ip::udp::endpoint& ep) const {
+    Key key(ep);
+    std::size_t slot = FindSlot(key, Hash(key));
+    return m_Slots[slot].index == EMPTY ?
+      Value() :
+      m_Entries[m_Slots[slot].index].value;
+  }
+
+  /// @return False if ep already has a value, which is left as is
+  bool Insert(
+      const boost::asio::ip::udp::endpoint& ep,
+      const Value& value) {
+    Key key(ep);
+    std::uint32_t hash = Hash(key);
+    std::size_t slot = FindSlot(key, hash);
+    if (m_Slots[slot].index != EMPTY)
+      return false;
+    if (2 * (m_Entries.size() + 1) > m_Slots.size()) {
+      Resize(2 * m_Slots.size());
+      slot = FindSlot(key, hash);
+    }
+    m_Slots[slot].hash = hash;
+    m_Slots[slot].index = static_cast<std::uint32_t>(m_Entries.size());
+    m_Entries.push_back({ key, value });
+    return true;
+  }
+
+  /// @return False if ep was not found
+  bool Erase(
+      const boost::asio::ip::udp::endpoint& ep) {
+    Key key(ep);
+    std::size_t slot = FindSlot(key, Hash(key));
+    std::uint32_t index = m_Slots[slot].index;
+    if (index == EMPTY)
+      return false;
+    RemoveSlot(slot);
+    // fill the hole in the entries with the last one
+    std::uint32_t last = static_cast<std::uint32_t>(m_Entries.size() - 1);
+    if (index != last) {
+      auto& moved = m_Entries[last];
+      m_Slots[FindSlot(moved.key, Hash(moved.key))].index = index;
+      m_Entries[index] = std::move(moved);
+    }
+    m_Entries.pop_back();
+    return true;
+  }
+
+  void Clear() {
+    m_Entries.clear();
+    m_Slots.assign(MIN_NUM_SLOTS, Slot());
+  }
+
+  std::size_t GetSize() const {
+    return m_Entries.size();
+  }
+
+  bool IsEmpty() const {
+    return m_Entries.empty();
+  }
+
+  /// @brief Calls f(value) for every entry
+  template<class Function>
+  void ForEach(
+      Function f) const {
+    for (const auto& entry : m_Entries)
+      f(entry.value);
+  }
+
+ private:
+  static const std::uint32_t EMPTY = 0xFFFFFFFF;
+  static const std::size_t MIN_NUM_SLOTS = 16;
+
+  /// @brief Endpoint packed for hashing and comparison. IPv4 addresses
+  ///   are in the low word and flagged in the port, so an IPv4 endpoint
+  ///   and its IPv4-mapped IPv6 form are different keys.
+  struct Key {
+    Key()
+        : high(0),
+          low(0),
+          port(0) {}
+
+    explicit Key(
+        const boost::asio::ip::udp::endpoint& ep)
+        : high(0),
+          low(0),
+          port(ep.port()) {
+      auto address = ep.address();
+      if (address.is_v4()) {
+        low = address.to_v4().to_ulong();
+        port |= 1 << 16;
+      } else {
+        auto bytes = address.to_v6().to_bytes();
+        for (std::size_t i = 0; i < 8; i++) {
+          high = (high << 8) | bytes[i];
+          low = (low << 8) | bytes[i + 8];
+        }
+      }
+    }
+
+    bool operator==(
+        const Key& other) const {
+      return low == other.low && port == other.port && high == other.high;
+    }
+
+    std::uint64_t high, low;
+    std::uint32_t port;
+  };
+
+  struct Entry {
+    Key key;
+    Value value;
+  };
+
+  struct Slot {
+    Slot()
+        : hash(0),
+          index(EMPTY) {}
+    std::uint32_t hash;
+    std::uint32_t index;  // into m_Entries, EMPTY if unused
+  };
+
+  /// @brief Seeded so remote peers can't pick endpoints that collide
+  std::uint32_t Hash(
+      const Key& key) const {
+    std::uint64_t x = key.high ^ m_Seed;
+    x = Mix(x) ^ key.low;
+    x = Mix(x) ^ key.port;
+    return static_cast<std::uint32_t>(Mix(x) >> 32);
+  }
+
+  /// @brief SplitMix64 finalizer
+  static std::uint64_t Mix(
+      std::uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+  }
+
+  /// @return Slot holding key, or the empty slot ending its probe chain
+  std::size_t FindSlot(
+      const Key& key,
+      std::uint32_t hash) const {
+    std::size_t mask = m_Slots.size() - 1;
+    for (std::size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+      const auto& s = m_Slots[slot];
+      if (s.index == EMPTY ||
+          (s.hash == hash && m_Entries[s.index].key == key))
+        return slot;
+    }
+  }
+
+  /// @brief Empties slot and moves later entries of its chain back
+  void RemoveSlot(
+      std::size_t slot) {
+    std::size_t mask = m_Slots.size() - 1;
+    std::size_t next = slot;
+    for (;;) {
+      next = (next + 1) & mask;
+      if (m_Slots[next].index == EMPTY)
+        break;
+      std::size_t home = m_Slots[next].hash & mask;
+      // leave the entry if its home lies cyclically in (slot, next]
+      bool stays = slot <= next ?
+        (slot < home && home <= next) :
+        (slot < home || home <= next);
+      if (!stays) {
+        m_Slots[slot] = m_Slots[next];
+        slot = next;
+      }
+    }
+    m_Slots[slot] = Slot();
+  }
+
+  void Resize(
+      std::size_t num_slots) {
+    std::vector<Slot> slots(num_slots);
+    std::size_t mask = num_slots - 1;
+    for (const auto& s : m_Slots) {
+      if (s.index == EMPTY)
+        continue;
+      std::size_t slot = s.hash & mask;
+      while (slots[slot].index != EMPTY)
+        slot = (slot + 1) & mask;
+      slots[slot] = s;
+    }
+    m_Slots.swap(slots);
+  }
+
+ private:
+  std::uint64_t m_Seed;
+  std::vector<Slot> m_Slots;  // size is a power of two
+  std::vector<Entry> m_Entries;
+};
+
+template<class Value>
+const std::uint32_t EndpointTable<Value>::EMPTY;
+
+template<class Value>
+const std::size_t EndpointTable<Value>::MIN_NUM_SLOTS;
+
+}  // namespace transport
+}  // namespace i2p
+
+#endif  // SRC_CORE_TRANSPORT_ENDPOINTTABLE_H_
@@ -35,6 +35,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <algorithm>
 #include <cstdint>
 #include <memory>
 #include <vector>
@@ -67,7 +68,9 @@ NTCPSession::NTCPSession(
       m_IsTerminated(false),
       m_ReceiveBufferOffset(0),
       m_NextMessage(nullptr),
-      m_IsSending(false) {
+      m_NextMessageAdler(0),
+      m_IsSending(false),
+      m_SendQueueSize(0) {
   m_DHKeysPair = transports.GetNextDHKeysPair();
   m_Establisher = std::make_unique<Establisher>();
 }
@@ -770,7 +773,7 @@ void NTCPSession::Connected() {
   m_DHKeysPair.reset(nullptr);
   SendTimeSyncMessage();
   // We tell immediately who we are
-  m_SendQueue.push_back(CreateDatabaseStoreMsg());
+  EnqueueMessage(CreateDatabaseStoreMsg());
   transports.PeerConnected(shared_from_this());
 }
 
@@ -819,12 +822,15 @@ void NTCPSession::HandleReceivedPayload(
       do {
         std::uint8_t* next_block = m_ReceiveBuffer;
         while (m_ReceiveBufferOffset >= static_cast<std::size_t>(NTCPSize::iv)) {
-          if (!DecryptNextBlock(next_block)) {  // 16 bytes
+          std::size_t len = DecryptNextBlocks(
+              next_block,
+              m_ReceiveBufferOffset & ~0x0F);  // whole blocks only
+          if (!len) {
             Terminate();
             return;
           }
-          next_block += static_cast<std::size_t>(NTCPSize::iv);
-          m_ReceiveBufferOffset -= static_cast<std::size_t>(NTCPSize::iv);
+          next_block += len;
+          m_ReceiveBufferOffset -= len;
         }
         if (m_ReceiveBufferOffset > 0)
           memcpy(m_ReceiveBuffer, next_block, m_ReceiveBufferOffset);
@@ -863,8 +869,10 @@ void NTCPSession::HandleReceivedPayload(
   }
 }
 
-bool NTCPSession::DecryptNextBlock(
-    const std::uint8_t* encrypted) {  // 16 bytes
+std::size_t NTCPSession::DecryptNextBlocks(
+    const std::uint8_t* encrypted,
+    std::size_t len) {
+  std::size_t consumed;
   // New message, header expected
   if (!m_NextMessage) {
     // Decrypt header and extract length
@@ -877,14 +885,20 @@ bool NTCPSession::DecryptNextBlock(
         LogPrint(eLogError,
             "NTCPSession:", GetFormattedSessionInfo(),
             "!!! data block size '", data_size, "' exceeds max size");
-        return false;
+        return 0;
       }
-      auto msg =
-        data_size <=
+      // most messages are tunnel data, take the smallest fitting buffer
+      I2NPMessage* msg;
+      if (data_size <=
+          I2NP_MAX_TUNNEL_MESSAGE_SIZE -
+          static_cast<std::size_t>(NTCPSize::phase3_alice_ri))
+        msg = NewI2NPTunnelMessage();
+      else if (data_size <=
           I2NP_MAX_SHORT_MESSAGE_SIZE -
-          static_cast<std::size_t>(NTCPSize::phase3_alice_ri) ?
-            NewI2NPShortMessage() :
-            NewI2NPMessage();
+          static_cast<std::size_t>(NTCPSize::phase3_alice_ri))
+        msg = NewI2NPShortMessage();
+      else
+        msg = NewI2NPMessage();
       m_NextMessage = ToSharedI2NPMessage(msg);
       memcpy(
           m_NextMessage->buf,
@@ -896,124 +910,188 @@ bool NTCPSession::DecryptNextBlock(
         static_cast<std::size_t>(NTCPSize::phase3_alice_ri);  // size field
       m_NextMessage->len =
         data_size + static_cast<std::size_t>(NTCPSize::phase3_alice_ri);
+      m_NextMessageAdler = i2p::crypto::util::UpdateAdler32(
+          i2p::crypto::util::ADLER32_INITIAL,
+          buf.data(),
+          std::min(
+              m_NextMessageOffset,
+              GetFrameSize(m_NextMessage) -
+                static_cast<std::size_t>(NTCPSize::adler32)));
+      consumed = static_cast<std::size_t>(NTCPSize::iv);
     } else {
       // Timestamp
       LogPrint(eLogDebug,
           "NTCPSession:", GetFormattedSessionInfo(), "*** timestamp");
-      return true;
+      return static_cast<std::size_t>(NTCPSize::iv);
     }
   } else {  // Message continues
-    m_Decryption.Decrypt(
+    std::size_t frame_len = GetFrameSize(m_NextMessage);
+    consumed = std::min(len, frame_len - m_NextMessageOffset);
+    m_NextMessageAdler = m_Decryption.DecryptWithAdler32(
         encrypted,
-        m_NextMessage->buf + m_NextMessageOffset);
-    m_NextMessageOffset += static_cast<std::size_t>(NTCPSize::iv);
+        consumed,
+        m_NextMessage->buf + m_NextMessageOffset,
+        m_NextMessageAdler,
+        frame_len - static_cast<std::size_t>(NTCPSize::adler32) -
+          m_NextMessageOffset);
+    m_NextMessageOffset += consumed;
   }
-  if (m_NextMessageOffset >=
-      m_NextMessage->len + static_cast<std::size_t>(NTCPSize::adler32)) {
+  std::size_t frame_len = GetFrameSize(m_NextMessage);
+  if (m_NextMessageOffset >= frame_len) {
     // We have a complete I2NP message
-    if (i2p::crypto::util::Adler32().VerifyDigest(
+    if (bufbe32toh(
           m_NextMessage->buf +
-            m_NextMessageOffset - static_cast<std::size_t>(NTCPSize::adler32),
-          m_NextMessage->buf,
-          m_NextMessageOffset - static_cast<std::size_t>(NTCPSize::adler32)))
+            frame_len - static_cast<std::size_t>(NTCPSize::adler32)) ==
+        m_NextMessageAdler) {
+      m_NextMessage->fromIdent = GetRemoteIdentity().GetIdentHash();
       m_Handler.PutNextMessage(m_NextMessage);
-    else
+    } else {
       LogPrint(eLogWarn,
           "NTCPSession:", GetFormattedSessionInfo(),
           "!!! incorrect Adler checksum of NTCP message, dropped");
+    }
     m_NextMessage = nullptr;
   }
-  return true;
+  return consumed;
 }
 
-void NTCPSession::SendPayload(
-    std::shared_ptr<i2p::I2NPMessage> msg) {
-  LogPrint(eLogDebug,
-      "NTCPSession:", GetFormattedSessionInfo(), "<-- sending I2NP message");
-  m_IsSending = true;
-  boost::asio::async_write(
-      m_Socket,
-      CreateMsgBuffer(msg),
-      boost::asio::transfer_all(),
-      std::bind(
-          &NTCPSession::HandleSentPayload,
-          shared_from_this(),
-          std::placeholders::_1,
-          std::placeholders::_2,
-          std::vector<std::shared_ptr<I2NPMessage> >{ msg }));
+std::size_t NTCPSession::GetFrameSize(
+    const std::shared_ptr<I2NPMessage>& msg) {
+  std::size_t len = msg ?
+    msg->GetLength() : static_cast<std::size_t>(NTCPSize::phase3_alice_ts);
+  len += static_cast<std::size_t>(NTCPSize::frame_overhead);
+  std::size_t rem = len & 0x0F;  // %16
+  if (rem > 0)
+    len += static_cast<std::size_t>(NTCPSize::iv) - rem;
+  return len;
 }
 
-boost::asio::const_buffers_1 NTCPSession::CreateMsgBuffer(
-    std::shared_ptr<I2NPMessage> msg) {
-  std::uint8_t* send_buffer;
-  int len;
+std::size_t NTCPSession::CreateMsgFrame(
+    std::shared_ptr<I2NPMessage> msg,
+    std::uint8_t* buf) {
+  std::size_t len;
   if (msg) {
     // Regular I2NP
-    if (msg->offset < static_cast<std::size_t>(NTCPSize::phase3_alice_ri))
-      LogPrint(eLogError,
-          "NTCPSession:", GetFormattedSessionInfo(),
-          "!!! malformed I2NP message");  // TODO(unassigned): Error handling
-    send_buffer =
-      msg->GetBuffer() - static_cast<std::size_t>(NTCPSize::phase3_alice_ri);
     len = msg->GetLength();
-    htobe16buf(send_buffer, len);
+    htobe16buf(buf, len);
+    memcpy(
+        buf + static_cast<std::size_t>(NTCPSize::phase3_alice_ri),
+        msg->GetBuffer(),
+        len);
   } else {
-    // Prepare timestamp
-    send_buffer = m_TimeSyncBuffer;
+    // Timestamp, size field is zero
     len = static_cast<std::size_t>(NTCPSize::phase3_alice_ts);
-    htobuf16(send_buffer, 0);
+    htobuf16(buf, 0);
     htobe32buf(
-        send_buffer + static_cast<std::size_t>(NTCPSize::phase3_alice_ts),
+        buf + static_cast<std::size_t>(NTCPSize::phase3_alice_ri),
         time(0));
   }
-  int rem = (len + 6) & 0x0F;  // %16
-  int padding = 0;
-  if (rem > 0) {
-    padding = static_cast<std::size_t>(NTCPSize::iv) - rem;
+  std::size_t frame_len = GetFrameSize(msg);
+  std::size_t padding =
+    frame_len - len - static_cast<std::size_t>(NTCPSize::frame_overhead);
+  if (padding > 0)
     i2p::crypto::RandBytes(
-        send_buffer + len + static_cast<std::size_t>(NTCPSize::phase3_alice_ts),
+        buf + static_cast<std::size_t>(NTCPSize::phase3_alice_ri) + len,
         padding);
-  }
-  i2p::crypto::util::Adler32().CalculateDigest(
-      send_buffer + len +
-        static_cast<std::size_t>(NTCPSize::phase3_alice_ri) + padding,
-      send_buffer,
-      len + static_cast<std::size_t>(NTCPSize::phase3_alice_ri) + padding);
-  int l = len + padding + 6;
-  m_Encryption.Encrypt(send_buffer, l, send_buffer);
-  return boost::asio::buffer(static_cast<const std::uint8_t *>(send_buffer), l);
+  // Adler-32 is filled in by the encryption pass
+  return frame_len;
 }
 
 void NTCPSession::SendTimeSyncMessage() {
   LogPrint(eLogDebug,
       "NTCPSession:", GetFormattedSessionInfo(), "<-- sending TimeSyncMessage");
-  SendPayload(nullptr);
+  EnqueueMessage(nullptr);
+  if (!m_IsSending)
+    SendQueuedMessages();
 }
 
-void NTCPSession::SendPayload(
-    const std::vector<std::shared_ptr<I2NPMessage>>& msgs) {
+bool NTCPSession::EnqueueMessage(
+    std::shared_ptr<I2NPMessage> msg) {
+  std::size_t size = GetFrameSize(msg);
+  auto max_size = static_cast<std::size_t>(NTCPSize::max_send_queue);
+  if (m_SendQueueSize + size > max_size) {
+    DropExpiredMessages();
+    if (m_SendQueueSize + size > max_size) {
+      LogPrint(eLogWarn,
+          "NTCPSession:", GetFormattedSessionInfo(),
+          "!!! send queue is full, dropping I2NP message");
+      return false;
+    }
+  }
+  m_SendQueue.push_back(msg);
+  m_SendQueueSize += size;
+  return true;
+}
+
+void NTCPSession::DropExpiredMessages() {
+  auto ts = i2p::util::GetMillisecondsSinceEpoch();
+  std::size_t num_dropped = 0;
+  auto it = std::remove_if(
+      m_SendQueue.begin(),
+      m_SendQueue.end(),
+      [this, ts, &num_dropped](const std::shared_ptr<I2NPMessage>& msg) {
+        // Time sync messages are created fresh and never expire
+        if (!msg || msg->GetExpiration() >= ts)
+          return false;
+        m_SendQueueSize -= GetFrameSize(msg);
+        num_dropped++;
+        return true;
+      });
+  m_SendQueue.erase(it, m_SendQueue.end());
+  if (num_dropped)
+    LogPrint(eLogDebug,
+        "NTCPSession:", GetFormattedSessionInfo(),
+        "dropped ", num_dropped, " expired I2NP messages");
+}
+
+void NTCPSession::SendQueuedMessages() {
+  auto ts = i2p::util::GetMillisecondsSinceEpoch();
+  auto max_len = static_cast<std::size_t>(NTCPSize::max_send);
+  std::size_t len = 0, num_msgs = 0;
+  while (!m_SendQueue.empty()) {
+    auto msg = m_SendQueue.front();
+    std::size_t size = GetFrameSize(msg);
+    // A single message always fits, NTCPSize::max_message < max_send
+    if (len > 0 && len + size > max_len)
+      break;
+    m_SendQueue.pop_front();
+    m_SendQueueSize -= size;
+    if (msg && msg->GetExpiration() < ts)
+      continue;  // no point in sending what the peer will drop
+    if (m_SendBuffer.size() < len + size)
+      m_SendBuffer.resize(std::min(std::max(len + size, len * 2), max_len));
+    std::uint8_t* frame = m_SendBuffer.data() + len;
+    std::size_t frame_len = CreateMsgFrame(msg, frame);
+    // Checksum and encrypt the frame while it is still in cache,
+    // the CBC chain continues from the previous frame
+    m_Encryption.EncryptWithAdler32(frame, frame_len);
+    len += frame_len;
+    num_msgs++;
+  }
+  if (!len) {
+    ScheduleTermination();  // Reset termination timer
+    return;
+  }
   LogPrint(eLogDebug,
-      "NTCPSession:", GetFormattedSessionInfo(), "<-- sending I2NP messages");
+      "NTCPSession:", GetFormattedSessionInfo(),
+      "<-- sending ", num_msgs, " I2NP messages");
   m_IsSending = true;
-  std::vector<boost::asio::const_buffer> bufs;
-  for (auto it : msgs)
-    bufs.push_back(CreateMsgBuffer(it));
   boost::asio::async_write(
       m_Socket,
-      bufs,
+      boost::asio::buffer(
+          static_cast<const std::uint8_t *>(m_SendBuffer.data()),
+          len),
       boost::asio::transfer_all(),
       std::bind(
           &NTCPSession::HandleSentPayload,
           shared_from_this(),
           std::placeholders::_1,
-          std::placeholders::_2,
-          msgs));
+          std::placeholders::_2));
 }
 
 void NTCPSession::HandleSentPayload(
     const boost::system::error_code& ecode,
-    std::size_t bytes_transferred,
-    std::vector<std::shared_ptr<I2NPMessage>> /*msgs*/) {
+    std::size_t bytes_transferred) {
   m_IsSending = false;
   if (ecode) {
     LogPrint(eLogWarn,
@@ -1030,12 +1108,8 @@ void NTCPSession::HandleSentPayload(
         "<-- ", bytes_transferred, " bytes transferred, ",
         GetNumSentBytes(), " total bytes sent");
     i2p::transport::transports.UpdateSentBytes(bytes_transferred);
-    if (!m_SendQueue.empty()) {
-      SendPayload(m_SendQueue);
-      m_SendQueue.clear();
-    } else {
-      ScheduleTermination();  // Reset termination timer
-    }
+    // Sends whatever was queued during the write, or resets the timer
+    SendQueuedMessages();
   }
 }
 
@@ -1052,12 +1126,11 @@ void NTCPSession::PostI2NPMessages(
     std::vector<std::shared_ptr<I2NPMessage>> msgs) {
   if (m_IsTerminated)
     return;
-  if (m_IsSending) {
-    for (auto it : msgs)
-      m_SendQueue.push_back(it);
-  } else {
-    SendPayload(msgs);
-  }
+  for (auto it : msgs)
+    EnqueueMessage(it);
+  // Otherwise HandleSentPayload picks them up with the next write
+  if (!m_IsSending)
+    SendQueuedMessages();
 }
 
 /**
@@ -1114,6 +1187,7 @@ void NTCPSession::Terminate() {
     transports.PeerDisconnected(shared_from_this());
     m_Server.RemoveNTCPSession(shared_from_this());
     m_SendQueue.clear();
+    m_SendQueueSize = 0;
     m_NextMessage = nullptr;
     m_TerminationTimer.cancel();
     LogPrint(eLogInfo,
@@ -36,6 +36,7 @@
 #include <boost/asio.hpp>
 
 #include <cstdint>
+#include <deque>
 #include <map>
 #include <memory>
 #include <mutex>
@@ -78,6 +79,9 @@ enum struct NTCPSize : const std::size_t {
     phase3_signature,  // Total = 448
   max_message = 16384,
   buffer = 4160,  // fits 4 tunnel messages (4 * 1028)
+  frame_overhead = 6,  // size + adler32
+  max_send = 65536,  // bytes coalesced into one write
+  max_send_queue = 1048576,  // bytes queued while a write is in flight
 };
 
 enum struct NTCPTimeoutLength : const std::size_t {
@@ -253,26 +257,49 @@ class NTCPSession
       const boost::system::error_code& ecode,
       std::size_t bytes_transferred);
 
-  bool DecryptNextBlock(
-      const std::uint8_t* encrypted);
-
-  /// @brief Send payload (I2NP message)
-  /// @param msg shared pointer to payload (I2NPMessage)
-  void SendPayload(
-      std::shared_ptr<i2p::I2NPMessage> msg);
-
-  /// @brief Send payload (I2NP messages)
-  /// @param msg shared pointer to payload (I2NPMessages)
-  void SendPayload(
-      const std::vector<std::shared_ptr<I2NPMessage>>& msgs);
-
-  boost::asio::const_buffers_1 CreateMsgBuffer(
+  /// @brief Decrypts received blocks of the next message
+  /// @details Decrypts either the header block of a new message or as
+  ///   much of the current message as is available, verifying the
+  ///   Adler-32 on the same pass
+  /// @param encrypted Received blocks
+  /// @param len Number of received bytes, a multiple of 16
+  /// @return Number of bytes consumed, 0 if the stream is malformed
+  std::size_t DecryptNextBlocks(
+      const std::uint8_t* encrypted,
+      std::size_t len);
+
+  /// @brief Queues payload (I2NP message) for the next write
+  /// @param msg shared pointer to payload, nullptr for time sync
+  /// @return False if the message was dropped because the queue is full
+  bool EnqueueMessage(
       std::shared_ptr<I2NPMessage> msg);
 
+  /// @brief Removes expired I2NP messages from the send queue
+  void DropExpiredMessages();
+
+  /// @brief Coalesces queued messages into one encrypted write
+  /// @details Frames as many messages as fit into NTCPSize::max_send,
+  ///   checksums and encrypts each frame in one pass as it is written
+  ///   and sends them all with one write
+  void SendQueuedMessages();
+
+  /// @brief Writes the unencrypted NTCP frame of a message
+  /// @details Leaves the Adler-32 at the end of the frame to the
+  ///   encryption, see CBCEncryption::EncryptWithAdler32
+  /// @param msg shared pointer to payload, nullptr for time sync
+  /// @param buf buffer of at least GetFrameSize(msg) bytes
+  /// @return Size of the frame
+  std::size_t CreateMsgFrame(
+      std::shared_ptr<I2NPMessage> msg,
+      std::uint8_t* buf);
+
+  /// @return Size of the NTCP frame of a message, padding included
+  static std::size_t GetFrameSize(
+      const std::shared_ptr<I2NPMessage>& msg);
+
   void HandleSentPayload(
       const boost::system::error_code& ecode,
-      std::size_t bytes_transferred,
-      std::vector<std::shared_ptr<I2NPMessage>> msgs);
+      std::size_t bytes_transferred);
 
   // Timer
   void ScheduleTermination();
@@ -303,17 +330,17 @@ class NTCPSession
     static_cast<std::size_t>(NTCPSize::buffer) +
     static_cast<std::size_t>(NTCPSize::iv)> m_ReceiveBuffer;
 
-  i2p::crypto::AESAlignedBuffer<
-    static_cast<std::size_t>(NTCPSize::iv)> m_TimeSyncBuffer;
-
   std::size_t m_ReceiveBufferOffset;
 
   std::shared_ptr<I2NPMessage> m_NextMessage;
   std::size_t m_NextMessageOffset;
+  std::uint32_t m_NextMessageAdler;  // of the decrypted part
   i2p::I2NPMessagesHandler m_Handler;
 
   bool m_IsSending;
-  std::vector<std::shared_ptr<I2NPMessage>> m_SendQueue;
+  std::deque<std::shared_ptr<I2NPMessage>> m_SendQueue;
+  std::size_t m_SendQueueSize;  // in bytes, framing included
+  std::vector<std::uint8_t> m_SendBuffer;
 };
 
 }  // namespace transport
@@ -36,6 +36,12 @@
 
 #include <string.h>
 
+#ifdef __linux__
+#include <errno.h>
+#include <sys/socket.h>
+#endif
+
+#include <algorithm>
 #include <cstdint>
 #include <list>
 #include <memory>
@@ -47,66 +53,120 @@
 #include "NetworkDatabase.h"
 #include "RouterContext.h"
 #include "util/Log.h"
+#include "util/MemoryPool.h"
 #include "util/Timestamp.h"
 
 namespace i2p {
 namespace transport {
 
+namespace {
+
+// packets are received on one thread and released on another
+typedef i2p::util::MemoryPool<SSUPacket, 128, 2048> SSUPacketPool;
+
+}  // namespace
+
 SSUServer::SSUServer(
-    std::size_t port)
-    : m_Thread(nullptr),
-      m_ThreadV6(nullptr),
-      m_ReceiversThread(nullptr),
-      m_Work(m_Service),
-      m_WorkV6(m_ServiceV6),
-      m_ReceiversWork(m_ReceiversService),
+    std::size_t port,
+    std::size_t numThreads)
+    : m_IsRunning(false),
+      m_Shards(CreateShards(numThreads)),
       m_Endpoint(boost::asio::ip::udp::v4(), port),
       m_EndpointV6(boost::asio::ip::udp::v6(), port),
-      m_Socket(m_ReceiversService, m_Endpoint),
-      m_SocketV6(m_ReceiversService),
-      m_IntroducersUpdateTimer(m_Service),
-      m_PeerTestsCleanupTimer(m_Service) {
-  m_Socket.set_option(boost::asio::socket_base::receive_buffer_size(65535));
-  m_Socket.set_option(boost::asio::socket_base::send_buffer_size(65535));
-  if (context.SupportsV6()) {
-    m_SocketV6.open(boost::asio::ip::udp::v6());
-    m_SocketV6.set_option(boost::asio::ip::v6_only(true));
-    m_SocketV6.set_option(boost::asio::socket_base::receive_buffer_size(65535));
-    m_SocketV6.set_option(boost::asio::socket_base::send_buffer_size(65535));
-    m_SocketV6.bind(m_EndpointV6);
+      m_IntroducersUpdateTimer(m_Shards[0]->service),
+      m_PeerTestsCleanupTimer(m_Shards[0]->service),
+      m_IsBatchIOEnabled(true) {
+  // the kernel spreads datagrams over sockets sharing a port by 4-tuple
+  // hash, every one of them can send from the port
+  std::size_t numReceivers = 1;
+#if defined(__linux__) && defined(SO_REUSEPORT)
+  numReceivers = m_Shards.size();
+#endif
+  while (m_Receivers.size() < numReceivers) {
+    auto receiver = std::make_unique<Receiver>();
+    bool reuse = numReceivers > 1;
+    try {
+      OpenSocket(&receiver->socket, m_Endpoint, reuse);
+      if (context.SupportsV6())
+        OpenSocket(&receiver->socketV6, m_EndpointV6, reuse);
+    } catch (const std::exception& ex) {
+      if (m_Receivers.empty())
+        throw;
+      LogPrint(eLogWarn,
+          "SSUServer: can't share port: '", ex.what(), "', using ",
+          m_Receivers.size(), " receiving sockets");
+      break;
+    }
+    m_Receivers.push_back(std::move(receiver));
   }
 }
 
-SSUServer::~SSUServer() {}
+SSUServer::~SSUServer() {
+  for (auto& shard : m_Shards)
+    for (auto queue : { &shard->sendQueue, &shard->sendQueueV6 })
+      for (auto packet : queue->packets)
+        SSUPacketPool::Instance().Release(packet);
+}
+
+std::vector<std::unique_ptr<SSUServer::Shard>> SSUServer::CreateShards(
+    std::size_t num) {
+  num = std::max<std::size_t>(1, std::min(num, SSU_MAX_NUM_THREADS));
+  std::vector<std::unique_ptr<Shard>> shards;
+  for (std::size_t i = 0; i < num; i++)
+    shards.push_back(std::make_unique<Shard>(i));
+  return shards;
+}
+
+void SSUServer::OpenSocket(
+    boost::asio::ip::udp::socket* socket,
+    const boost::asio::ip::udp::endpoint& endpoint,
+    bool reusePort) {
+  socket->open(endpoint.protocol());
+  if (endpoint.address().is_v6())
+    socket->set_option(boost::asio::ip::v6_only(true));
+#ifdef SO_REUSEPORT
+  if (reusePort)
+    socket->set_option(
+        boost::asio::detail::socket_option::boolean<
+          SOL_SOCKET, SO_REUSEPORT>(true));
+#endif
+  socket->set_option(boost::asio::socket_base::receive_buffer_size(65535));
+  socket->set_option(boost::asio::socket_base::send_buffer_size(65535));
+  socket->bind(endpoint);
+}
 
 void SSUServer::Start() {
   LogPrint(eLogDebug, "SSUServer: starting");
   m_IsRunning = true;
-  m_ReceiversThread =
-    std::make_unique<std::thread>(
-        std::bind(
-          &SSUServer::RunReceivers,
-          this));
-  m_Thread =
-    std::make_unique<std::thread>(
-        std::bind(
-            &SSUServer::Run,
-            this));
-  m_ReceiversService.post(
-      std::bind(
-          &SSUServer::Receive,
-          this));
-  if (context.SupportsV6()) {
-    m_ThreadV6 =
+  for (auto& shard : m_Shards)
+    shard->thread =
       std::make_unique<std::thread>(
           std::bind(
-              &SSUServer::RunV6,
-              this));
-    m_ReceiversService.post(
+              &SSUServer::Run,
+              this,
+              shard.get()));
+  for (auto& receiver : m_Receivers) {
+    receiver->thread =
+      std::make_unique<std::thread>(
+          std::bind(
+              &SSUServer::RunReceiver,
+              this,
+              receiver.get()));
+    receiver->service.post(
         std::bind(
-            &SSUServer::ReceiveV6,
-            this));
+            &SSUServer::Receive,
+            this,
+            receiver.get()));
+    if (context.SupportsV6())
+      receiver->service.post(
+          std::bind(
+              &SSUServer::ReceiveV6,
+              this,
+              receiver.get()));
   }
+  LogPrint(eLogInfo,
+      "SSUServer: ", m_Shards.size(), " session threads, ",
+      m_Receivers.size(), " receiving sockets");
   SchedulePeerTestsCleanupTimer();
   // wait for 30 seconds and decide if we need introducers
   ScheduleIntroducersUpdateTimer();
@@ -115,31 +175,39 @@ void SSUServer::Start() {
 void SSUServer::Stop() {
   LogPrint(eLogDebug, "SSUServer: stopping");
   DeleteAllSessions();
+  // session destroyed messages may still be queued
+  for (auto& shard : m_Shards) {
+    FlushSendQueue(shard.get(), true);
+    FlushSendQueue(shard.get(), false);
+  }
   m_IsRunning = false;
-  m_Service.stop();
-  m_Socket.close();
-  m_ServiceV6.stop();
-  m_SocketV6.close();
-  m_ReceiversService.stop();
-  if (m_ReceiversThread) {
-    m_ReceiversThread->join();
-    m_ReceiversThread.reset(nullptr);
+  for (auto& shard : m_Shards)
+    shard->service.stop();
+  for (auto& receiver : m_Receivers) {
+    receiver->socket.close();
+    receiver->socketV6.close();
+    receiver->service.stop();
   }
-  if (m_Thread) {
-    m_Thread->join();
-    m_Thread.reset(nullptr);
+  for (auto& receiver : m_Receivers) {
+    if (receiver->thread) {
+      receiver->thread->join();
+      receiver->thread.reset(nullptr);
+    }
   }
-  if (m_ThreadV6) {
-    m_ThreadV6->join();
-    m_ThreadV6.reset(nullptr);
+  for (auto& shard : m_Shards) {
+    if (shard->thread) {
+      shard->thread->join();
+      shard->thread.reset(nullptr);
+    }
   }
 }
 
-void SSUServer::Run() {
+void SSUServer::Run(
+    Shard* shard) {
   while (m_IsRunning) {
     try {
       LogPrint(eLogDebug, "SSUServer: running ioservice");
-      m_Service.run();
+      shard->service.run();
     }
     catch (std::exception& ex) {
       LogPrint(eLogError,
@@ -148,46 +216,62 @@ void SSUServer::Run() {
   }
 }
 
-void SSUServer::RunV6() {
+void SSUServer::RunReceiver(
+    Receiver* receiver) {
   while (m_IsRunning) {
     try {
-      LogPrint(eLogDebug, "SSUServer: running V6 ioservice");
-      m_ServiceV6.run();
+      LogPrint(eLogDebug, "SSUServer: running receivers ioservice");
+      receiver->service.run();
     }
     catch (std::exception& ex) {
       LogPrint(eLogError,
-          "SSUServer: RunV6() ioservice error: '", ex.what(), "'");
+          "SSUServer: RunReceiver() ioservice error: '", ex.what(), "'");
     }
   }
 }
 
-void SSUServer::RunReceivers() {
-  while (m_IsRunning) {
-    try {
-      LogPrint(eLogDebug, "SSUServer: running receivers ioservice");
-      m_ReceiversService.run();
-    }
-    catch (std::exception& ex) {
-      LogPrint(eLogError,
-          "SSUServer: RunReceivers() ioservice error: '", ex.what(), "'");
-    }
+std::size_t SSUServer::GetShardIndex(
+    const boost::asio::ip::udp::endpoint& ep) const {
+  if (m_Shards.size() == 1)
+    return 0;
+  // remote address and port are chosen by the peer, mix them so
+  // neighbouring addresses or ports don't land on the same shard
+  std::uint64_t hash = ep.port();
+  auto address = ep.address();
+  if (address.is_v4()) {
+    hash ^= static_cast<std::uint64_t>(address.to_v4().to_ulong()) << 16;
+  } else {
+    for (auto byte : address.to_v6().to_bytes())
+      hash = (hash ^ byte) * 0x100000001B3ULL;  // FNV-1a
   }
+  hash *= 0x9E3779B97F4A7C15ULL;
+  return (hash >> 32) % m_Shards.size();
+}
+
+std::size_t SSUServer::GetNumSessions() const {
+  return m_RandomSessions.GetSize();
 }
 
 void SSUServer::AddRelay(
     uint32_t tag,
     const boost::asio::ip::udp::endpoint& relay) {
   LogPrint(eLogDebug, "SSUServer: adding relay");
+  std::unique_lock<std::mutex> l(m_RelaysMutex);
   m_Relays[tag] = relay;
 }
 
 std::shared_ptr<SSUSession> SSUServer::FindRelaySession(
     uint32_t tag) {
   LogPrint(eLogDebug, "SSUServer: finding relay session");
-  auto it = m_Relays.find(tag);
-  if (it != m_Relays.end())
-    return FindSession(it->second);
-  return nullptr;
+  boost::asio::ip::udp::endpoint relay;
+  {
+    std::unique_lock<std::mutex> l(m_RelaysMutex);
+    auto it = m_Relays.find(tag);
+    if (it == m_Relays.end())
+      return nullptr;
+    relay = it->second;
+  }
+  return FindSession(relay);
 }
 
 void SSUServer::Send(
@@ -195,33 +279,99 @@ void SSUServer::Send(
     size_t len,
     const boost::asio::ip::udp::endpoint& to) {
   LogPrint(eLogDebug, "SSUServer: sending data");
-  if (to.protocol() == boost::asio::ip::udp::v4()) {
+  bool v4 = to.protocol() == boost::asio::ip::udp::v4();
+  if (len > sizeof(SSUPacket().buf)) {
+    LogPrint(eLogError, "SSUServer: packet of ", len, " bytes is too long");
+    return;
+  }
+  auto packet = SSUPacketPool::Instance().Acquire();
+  memcpy(packet->buf, buf, len);
+  packet->len = len;
+  packet->from = to;
+  auto& shard = GetShard(to);
+  auto& queue = v4 ? shard.sendQueue : shard.sendQueueV6;
+  bool is_first;
+  {
+    std::unique_lock<std::mutex> l(queue.mutex);
+    is_first = queue.packets.empty();
+    queue.packets.push_back(packet);
+  }
+  // packets queued until the flush runs go out together
+  if (is_first)
+    shard.service.post(
+        std::bind(
+            &SSUServer::FlushSendQueue,
+            this,
+            &shard,
+            v4));
+}
+
+void SSUServer::FlushSendQueue(
+    Shard* shard,
+    bool v4) {
+  auto& queue = v4 ? shard->sendQueue : shard->sendQueueV6;
+  // any socket bound to the port will do, spread the shards over them
+  auto& receiver = *m_Receivers[shard->index % m_Receivers.size()];
+  auto& socket = v4 ? receiver.socket : receiver.socketV6;
+  std::vector<SSUPacket *> packets;
+  {
+    std::unique_lock<std::mutex> l(queue.mutex);
+    packets.swap(queue.packets);
+  }
+  std::size_t sent = 0;
+#ifdef __linux__
+  while (m_IsBatchIOEnabled && sent < packets.size()) {
+    mmsghdr msgs[SSU_SEND_BATCH_SIZE];
+    iovec iovecs[SSU_SEND_BATCH_SIZE];
+    std::size_t num = std::min(packets.size() - sent, SSU_SEND_BATCH_SIZE);
+    memset(msgs, 0, sizeof(msgs));
+    for (std::size_t i = 0; i < num; i++) {
+      auto packet = packets[sent + i];
+      iovecs[i].iov_base = packet->buf;
+      iovecs[i].iov_len = packet->len;
+      msgs[i].msg_hdr.msg_name = packet->from.data();
+      msgs[i].msg_hdr.msg_namelen = packet->from.size();
+      msgs[i].msg_hdr.msg_iov = &iovecs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    int ret = sendmmsg(socket.native_handle(), msgs, num, 0);
+    if (ret < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        break;  // the blocking send below waits for buffer space
+      } else if (errno == ENOSYS) {
+        LogPrint(eLogWarn, "SSUServer: sendmmsg unavailable, not batching");
+        m_IsBatchIOEnabled = false;
+        break;
+      }
+      // failed on the first packet, drop it like send_to would
+      LogPrint(eLogError, "SSUServer: send error: '", strerror(errno), "'");
+      ret = 1;
+    }
+    sent += ret;
+  }
+#endif
+  for (; sent < packets.size(); sent++) {
+    auto packet = packets[sent];
     try {
-      m_Socket.send_to(
+      socket.send_to(
           boost::asio::buffer(
-              buf,
-              len),
-          to);
+              packet->buf,
+              packet->len),
+          packet->from);
     } catch (const std::exception& ex) {
-      LogPrint(eLogError, "SSUServer: send error: '", ex.what(), "'");
-    }
-  } else {
-      try {
-        m_SocketV6.send_to(
-            boost::asio::buffer(
-                buf,
-                len),
-            to);
-      } catch (const std::exception& ex) {
-        LogPrint(eLogError, "SSUServer: V6 send error: '", ex.what(), "'");
-      }
+      LogPrint(eLogError,
+          "SSUServer: ", v4 ? "" : "V6 ", "send error: '", ex.what(), "'");
     }
+  }
+  for (auto packet : packets)
+    SSUPacketPool::Instance().Release(packet);
 }
 
-void SSUServer::Receive() {
+void SSUServer::Receive(
+    Receiver* receiver) {
   LogPrint(eLogDebug, "SSUServer: receiving data");
-  SSUPacket* packet = new SSUPacket();
-  m_Socket.async_receive_from(
+  SSUPacket* packet = SSUPacketPool::Instance().Acquire();
+  receiver->socket.async_receive_from(
       boost::asio::buffer(
           packet->buf,
           SSU_MTU_V4),
@@ -229,15 +379,17 @@ void SSUServer::Receive() {
       std::bind(
           &SSUServer::HandleReceivedFrom,
           this,
+          receiver,
           std::placeholders::_1,
           std::placeholders::_2,
           packet));
 }
 
-void SSUServer::ReceiveV6() {
+void SSUServer::ReceiveV6(
+    Receiver* receiver) {
   LogPrint(eLogDebug, "SSUServer: V6: receiving data");
-  SSUPacket* packet = new SSUPacket();
-  m_SocketV6.async_receive_from(
+  SSUPacket* packet = SSUPacketPool::Instance().Acquire();
+  receiver->socketV6.async_receive_from(
       boost::asio::buffer(
           packet->buf,
           SSU_MTU_V6),
@@ -245,12 +397,14 @@ void SSUServer::ReceiveV6() {
       std::bind(
           &SSUServer::HandleReceivedFromV6,
           this,
+          receiver,
           std::placeholders::_1,
           std::placeholders::_2,
           packet));
 }
 
 void SSUServer::HandleReceivedFrom(
+    Receiver* receiver,
     const boost::system::error_code& ecode,
     std::size_t bytes_transferred,
     SSUPacket* packet) {
@@ -259,31 +413,17 @@ void SSUServer::HandleReceivedFrom(
     packet->len = bytes_transferred;
     std::vector<SSUPacket *> packets;
     packets.push_back(packet);
-    boost::system::error_code ec;
-    size_t moreBytes = m_Socket.available(ec);
-    while (moreBytes && packets.size() < 25) {
-      packet = new SSUPacket();
-      packet->len = m_Socket.receive_from(
-          boost::asio::buffer(
-              packet->buf,
-              SSU_MTU_V4),
-          packet->from);
-      packets.push_back(packet);
-      moreBytes = m_Socket.available();
-    }
-    m_Service.post(
-        std::bind(
-            &SSUServer::HandleReceivedPackets,
-            this,
-            packets));
-    Receive();
+    ReceiveMore(&receiver->socket, SSU_MTU_V4, &packets);
+    DispatchReceivedPackets(std::move(packets));
+    Receive(receiver);
   } else {
     LogPrint("SSUServer: receive error: ", ecode.message());
-    delete packet;
+    SSUPacketPool::Instance().Release(packet);
   }
 }
 
 void SSUServer::HandleReceivedFromV6(
+    Receiver* receiver,
     const boost::system::error_code& ecode,
     std::size_t bytes_transferred,
     SSUPacket* packet) {
@@ -292,26 +432,94 @@ void SSUServer::HandleReceivedFromV6(
     packet->len = bytes_transferred;
     std::vector<SSUPacket *> packets;
     packets.push_back(packet);
-    size_t moreBytes = m_SocketV6.available();
-    while (moreBytes && packets.size() < 25) {
-      packet = new SSUPacket();
-      packet->len = m_SocketV6.receive_from(
-          boost::asio::buffer(
-              packet->buf,
-              SSU_MTU_V6),
-          packet->from);
-      packets.push_back(packet);
-      moreBytes = m_SocketV6.available();
-    }
-    m_ServiceV6.post(
+    ReceiveMore(&receiver->socketV6, SSU_MTU_V6, &packets);
+    DispatchReceivedPackets(std::move(packets));
+    ReceiveV6(receiver);
+  } else {
+    LogPrint("SSUServer: V6 receive error: ", ecode.message());
+    SSUPacketPool::Instance().Release(packet);
+  }
+}
+
+void SSUServer::DispatchReceivedPackets(
+    std::vector<SSUPacket *> packets) {
+  if (m_Shards.size() == 1) {
+    m_Shards[0]->service.post(
         std::bind(
             &SSUServer::HandleReceivedPackets,
             this,
-            packets));
-    ReceiveV6();
-  } else {
-    LogPrint("SSUServer: V6 receive error: ", ecode.message());
-    delete packet;
+            std::move(packets)));
+    return;
+  }
+  // the kernel picks the socket by its own hash, so a batch can hold
+  // packets of any shard. Order within a shard is kept.
+  std::vector<std::vector<SSUPacket *>> batches(m_Shards.size());
+  for (auto packet : packets)
+    batches[GetShardIndex(packet->from)].push_back(packet);
+  for (std::size_t i = 0; i < batches.size(); i++)
+    if (!batches[i].empty())
+      m_Shards[i]->service.post(
+          std::bind(
+              &SSUServer::HandleReceivedPackets,
+              this,
+              std::move(batches[i])));
+}
+
+void SSUServer::ReceiveMore(
+    boost::asio::ip::udp::socket* socket,
+    std::size_t mtu,
+    std::vector<SSUPacket *>* packets) {
+  if (packets->size() >= SSU_RECEIVE_BATCH_SIZE)
+    return;
+#ifdef __linux__
+  if (m_IsBatchIOEnabled) {
+    SSUPacket* batch[SSU_RECEIVE_BATCH_SIZE];
+    mmsghdr msgs[SSU_RECEIVE_BATCH_SIZE];
+    iovec iovecs[SSU_RECEIVE_BATCH_SIZE];
+    std::size_t num = SSU_RECEIVE_BATCH_SIZE - packets->size();
+    memset(msgs, 0, sizeof(msgs));
+    for (std::size_t i = 0; i < num; i++) {
+      batch[i] = SSUPacketPool::Instance().Acquire();
+      iovecs[i].iov_base = batch[i]->buf;
+      iovecs[i].iov_len = mtu;
+      msgs[i].msg_hdr.msg_name = batch[i]->from.data();
+      msgs[i].msg_hdr.msg_namelen = batch[i]->from.capacity();
+      msgs[i].msg_hdr.msg_iov = &iovecs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    int ret = recvmmsg(
+        socket->native_handle(),
+        msgs,
+        num,
+        MSG_DONTWAIT,
+        nullptr);
+    if (ret < 0 && errno == ENOSYS) {
+      LogPrint(eLogWarn, "SSUServer: recvmmsg unavailable, not batching");
+      m_IsBatchIOEnabled = false;
+    }
+    std::size_t received = std::max(ret, 0);
+    for (std::size_t i = 0; i < received; i++) {
+      batch[i]->len = msgs[i].msg_len;
+      batch[i]->from.resize(msgs[i].msg_hdr.msg_namelen);
+      packets->push_back(batch[i]);
+    }
+    for (std::size_t i = received; i < num; i++)
+      SSUPacketPool::Instance().Release(batch[i]);
+    if (m_IsBatchIOEnabled)
+      return;
+  }
+#endif
+  boost::system::error_code ec;
+  size_t moreBytes = socket->available(ec);
+  while (moreBytes && packets->size() < SSU_RECEIVE_BATCH_SIZE) {
+    auto packet = SSUPacketPool::Instance().Acquire();
+    packet->len = socket->receive_from(
+        boost::asio::buffer(
+            packet->buf,
+            mtu),
+        packet->from);
+    packets->push_back(packet);
+    moreBytes = socket->available(ec);
   }
 }
 
@@ -326,18 +534,18 @@ void SSUServer::HandleReceivedPackets(
       if (!session || session->GetRemoteEndpoint() != packet->from) {
         if (session)
           session->FlushData();
-        auto session_it = m_Sessions.find(packet->from);
-        if (session_it != m_Sessions.end())
-          session = session_it->second;
+        // all packets of a batch belong to this thread's shard
+        session = FindSession(packet->from);
         if (!session) {
           session = std::make_shared<SSUSession>(*this, packet->from);
-          session->WaitForConnect(); {
-            std::unique_lock<std::mutex> l(m_SessionsMutex);
-            m_Sessions[packet->from] = session;
+          if (AddSession(session)) {
+            session->WaitForConnect();
+            LogPrint(eLogInfo,
+                "SSUServer: created new SSU session from ",
+                session->GetRemoteEndpoint());
+          } else {
+            session = FindSession(packet->from);  // created by GetSession()
           }
-          LogPrint(eLogInfo,
-              "SSUServer: created new SSU session from ",
-              session->GetRemoteEndpoint());
         }
       }
       session->ProcessNextMessage(packet->buf, packet->len, packet->from);
@@ -348,7 +556,7 @@ void SSUServer::HandleReceivedPackets(
         session->FlushData();
       session = nullptr;
     }
-    delete packet;
+    SSUPacketPool::Instance().Release(packet);
   }
   if (session)
     session->FlushData();
@@ -381,11 +589,33 @@ std::shared_ptr<SSUSession> SSUServer::FindSession(
 std::shared_ptr<SSUSession> SSUServer::FindSession(
     const boost::asio::ip::udp::endpoint& ep) const {
   LogPrint(eLogDebug, "SSUServer: finding session from endpoint");
-  auto it = m_Sessions.find(ep);
-  if (it != m_Sessions.end())
-    return it->second;
-  else
-    return nullptr;
+  auto& shard = GetShard(ep);
+  std::shared_lock<std::shared_timed_mutex> l(shard.sessionsMutex);
+  return shard.sessions.Find(ep);
+}
+
+bool SSUServer::AddSession(
+    std::shared_ptr<SSUSession> session) {
+  auto& shard = GetShard(session->GetRemoteEndpoint());
+  {
+    std::unique_lock<std::shared_timed_mutex> l(shard.sessionsMutex);
+    if (!shard.sessions.Insert(session->GetRemoteEndpoint(), session))
+      return false;
+  }
+  m_RandomSessions.Add(session);
+  return true;
+}
+
+void SSUServer::RemoveSession(
+    std::shared_ptr<SSUSession> session) {
+  auto& shard = GetShard(session->GetRemoteEndpoint());
+  {
+    std::unique_lock<std::shared_timed_mutex> l(shard.sessionsMutex);
+    if (shard.sessions.Find(session->GetRemoteEndpoint()) != session)
+      return;
+    shard.sessions.Erase(session->GetRemoteEndpoint());
+  }
+  m_RandomSessions.Remove(session);
 }
 
 std::shared_ptr<SSUSession> SSUServer::GetSession(
@@ -399,19 +629,16 @@ std::shared_ptr<SSUSession> SSUServer::GetSession(
       boost::asio::ip::udp::endpoint remoteEndpoint(
           address->host,
           address->port);
-      auto it = m_Sessions.find(remoteEndpoint);
-      if (it != m_Sessions.end()) {
-        session = it->second;
-      } else {
+      session = FindSession(remoteEndpoint);
+      if (!session) {
         // otherwise create new session
         session = std::make_shared<SSUSession>(
             *this,
             remoteEndpoint,
             router,
-            peerTest); {
-          std::unique_lock<std::mutex> l(m_SessionsMutex);
-          m_Sessions[remoteEndpoint] = session;
-        }
+            peerTest);
+        if (!AddSession(session))
+          return FindSession(remoteEndpoint);  // a packet came first
         session->SetRemoteIdentHashAbbreviation();
         if (!router->UsesIntroducer()) {
           // connect directly
@@ -428,14 +655,12 @@ std::shared_ptr<SSUSession> SSUServer::GetSession(
             // we might have a session to introducer already
             for (int i = 0; i < numIntroducers; i++) {
               introducer = &(address->introducers[i]);
-              it = m_Sessions.find(
+              introducerSession = FindSession(
                   boost::asio::ip::udp::endpoint(
                       introducer->host,
                       introducer->port));
-              if (it != m_Sessions.end()) {
-                introducerSession = it->second;
+              if (introducerSession)
                 break;
-              }
             }
             if (introducerSession) {  // session found
               LogPrint(eLogInfo,
@@ -452,8 +677,8 @@ std::shared_ptr<SSUSession> SSUServer::GetSession(
                   *this,
                   introducerEndpoint,
                   router);
-              std::unique_lock<std::mutex> l(m_SessionsMutex);
-              m_Sessions[introducerEndpoint] = introducerSession;
+              if (!AddSession(introducerSession))
+                introducerSession = FindSession(introducerEndpoint);
             }
             // introduce
             LogPrint("SSUServer: introducing new SSU session to [",
@@ -472,8 +697,7 @@ std::shared_ptr<SSUSession> SSUServer::GetSession(
             LogPrint(eLogWarn,
                 "SSUServer: can't connect to unreachable router."
                 "No introducers presented");
-            std::unique_lock<std::mutex> l(m_SessionsMutex);
-            m_Sessions.erase(remoteEndpoint);
+            RemoveSession(session);
             session.reset();
           }
         }
@@ -492,34 +716,30 @@ void SSUServer::DeleteSession(
   LogPrint(eLogDebug, "SSUServer: deleting session");
   if (session) {
     session->Close();
-    std::unique_lock<std::mutex> l(m_SessionsMutex);
-    m_Sessions.erase(session->GetRemoteEndpoint());
+    RemoveSession(session);
   }
 }
 
 void SSUServer::DeleteAllSessions() {
   LogPrint(eLogDebug, "SSUServer: deleting all sessions");
-  std::unique_lock<std::mutex> l(m_SessionsMutex);
-  for (auto it : m_Sessions)
-    it.second->Close();
-  m_Sessions.clear();
+  for (auto& shard : m_Shards) {
+    std::unique_lock<std::shared_timed_mutex> l(shard->sessionsMutex);
+    shard->sessions.ForEach(
+        [](const std::shared_ptr<SSUSession>& session) {
+          session->Close();
+        });
+    shard->sessions.Clear();
+  }
+  m_RandomSessions.Clear();
 }
 
 template<typename Filter>
 std::shared_ptr<SSUSession> SSUServer::GetRandomSession(
     Filter filter) {
   LogPrint(eLogDebug, "SSUServer: getting random session");
-  std::vector<std::shared_ptr<SSUSession>> filteredSessions;
-  for (auto s : m_Sessions)
-    if (filter (s.second))
-      filteredSessions.push_back(s.second);
-  if (filteredSessions.size() > 0) {
-    size_t s = filteredSessions.size();
-    size_t ind =
-      i2p::crypto::RandInRange<size_t>(0, s - 1);
-    return filteredSessions[ind];
-  }
-  return nullptr;
+  return m_RandomSessions.GetRandom(
+      []() { return i2p::crypto::Rand<uint32_t>(); },
+      filter);
 }
 
 std::shared_ptr<SSUSession> SSUServer::GetRandomEstablishedSession(
@@ -589,7 +809,11 @@ void SSUServer::HandleIntroducersUpdateTimer(
       auto session = FindSession(it);
       if (session &&
           ts < session->GetCreationTime() + SSU_TO_INTRODUCER_SESSION_DURATION) {
-        session->SendKeepAlive();
+        // sessions of other shards are run by other threads
+        GetService(it).post(
+            std::bind(
+                &SSUSession::SendKeepAlive,
+                session));
         newList.push_back(it);
         numIntroducers++;
       } else {
@@ -626,6 +850,7 @@ void SSUServer::NewPeerTest(
     PeerTestParticipant role,
     std::shared_ptr<SSUSession> session) {
   LogPrint(eLogDebug, "SSUServer: new peer test");
+  std::unique_lock<std::mutex> l(m_PeerTestsMutex);
   m_PeerTests[nonce] = {
     i2p::util::GetMillisecondsSinceEpoch(),
     role,
@@ -636,6 +861,7 @@ void SSUServer::NewPeerTest(
 PeerTestParticipant SSUServer::GetPeerTestParticipant(
     uint32_t nonce) {
   LogPrint(eLogDebug, "SSUServer: getting PeerTest participant");
+  std::unique_lock<std::mutex> l(m_PeerTestsMutex);
   auto it = m_PeerTests.find(nonce);
   if (it != m_PeerTests.end())
     return it->second.role;
@@ -646,6 +872,7 @@ PeerTestParticipant SSUServer::GetPeerTestParticipant(
 std::shared_ptr<SSUSession> SSUServer::GetPeerTestSession(
     uint32_t nonce) {
   LogPrint(eLogDebug, "SSUServer: getting PeerTest session");
+  std::unique_lock<std::mutex> l(m_PeerTestsMutex);
   auto it = m_PeerTests.find(nonce);
   if (it != m_PeerTests.end())
     return it->second.session;
@@ -657,6 +884,7 @@ void SSUServer::UpdatePeerTest(
     uint32_t nonce,
     PeerTestParticipant role) {
   LogPrint(eLogDebug, "SSUServer: updating PeerTest");
+  std::unique_lock<std::mutex> l(m_PeerTestsMutex);
   auto it = m_PeerTests.find(nonce);
   if (it != m_PeerTests.end())
     it->second.role = role;
@@ -665,6 +893,7 @@ void SSUServer::UpdatePeerTest(
 void SSUServer::RemovePeerTest(
     uint32_t nonce) {
   LogPrint(eLogDebug, "SSUServer: removing PeerTest");
+  std::unique_lock<std::mutex> l(m_PeerTestsMutex);
   m_PeerTests.erase(nonce);
 }
 
@@ -686,12 +915,15 @@ void SSUServer::HandlePeerTestsCleanupTimer(
   if (ecode != boost::asio::error::operation_aborted) {
     int numDeleted = 0;
     uint64_t ts = i2p::util::GetMillisecondsSinceEpoch();
-    for (auto it = m_PeerTests.begin(); it != m_PeerTests.end();) {
-      if (ts > it->second.creationTime + SSU_PEER_TEST_TIMEOUT * 1000LL) {
-        numDeleted++;
-        it = m_PeerTests.erase(it);
-      } else {
-        it++;
+    {
+      std::unique_lock<std::mutex> l(m_PeerTestsMutex);
+      for (auto it = m_PeerTests.begin(); it != m_PeerTests.end();) {
+        if (ts > it->second.creationTime + SSU_PEER_TEST_TIMEOUT * 1000LL) {
+          numDeleted++;
+          it = m_PeerTests.erase(it);
+        } else {
+          it++;
+        }
       }
     }
     if (numDeleted > 0)
@@ -38,21 +38,26 @@
 #include <inttypes.h>
 #include <string.h>
 
+#include <atomic>
 #include <cstdint>
 #include <list>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <set>
+#include <shared_mutex>
 #include <thread>
 #include <vector>
 
+#include "EndpointTable.h"
 #include "I2NPProtocol.h"
 #include "Identity.h"
 #include "RouterInfo.h"
+#include "SSUKeyCache.h"
 #include "SSUSession.h"
 #include "crypto/AES.h"
 #include "util/I2PEndian.h"
+#include "util/RandomIndex.h"
 
 namespace i2p {
 namespace transport {
@@ -61,17 +66,27 @@ const int SSU_KEEP_ALIVE_INTERVAL = 30;  // 30 seconds
 const int SSU_PEER_TEST_TIMEOUT = 60;  // 60 seconds
 const int SSU_TO_INTRODUCER_SESSION_DURATION = 3600;  // 1 hour
 const size_t SSU_MAX_NUM_INTRODUCERS = 3;
+const size_t SSU_RECEIVE_BATCH_SIZE = 32;  // max datagrams per receive
+const size_t SSU_SEND_BATCH_SIZE = 32;  // max datagrams per send syscall
+const size_t SSU_MAX_NUM_THREADS = 64;
 
 struct SSUPacket {
+  void Reset() {
+    len = 0;
+  }
   i2p::crypto::AESAlignedBuffer<1500> buf;
-  boost::asio::ip::udp::endpoint from;
+  boost::asio::ip::udp::endpoint from;  // remote endpoint, also for sending
   size_t len;
 };
 
 class SSUServer {
  public:
+  /// @param numThreads Number of session shards, each processed by its own
+  ///   thread. Where SO_REUSEPORT is available, as many sockets are bound
+  ///   to the port, each read by its own receiving thread
   SSUServer(
-      std::size_t port);
+      std::size_t port,
+      std::size_t numThreads = 1);
 
   ~SSUServer();
 
@@ -97,12 +112,17 @@ class SSUServer {
 
   void DeleteAllSessions();
 
-  boost::asio::io_service& GetService() {
-    return m_Service;
+  /// @return Service of the thread owning sessions with this endpoint
+  boost::asio::io_service& GetService(
+      const boost::asio::ip::udp::endpoint& ep) {
+    return GetShard(ep).service;
   }
 
-  boost::asio::io_service& GetServiceV6() {
-    return m_ServiceV6;
+  /// @return Key schedules for intro keys and relayed session keys, of
+  ///   the shard owning sessions with this endpoint
+  SSUKeyCache& GetKeyCache(
+      const boost::asio::ip::udp::endpoint& ep) {
+    return GetShard(ep).keyCache;
   }
 
   const boost::asio::ip::udp::endpoint& GetEndpoint() const {
@@ -140,29 +160,79 @@ class SSUServer {
       uint32_t nonce);
 
  private:
-  void Run();
+  struct Shard;
+  struct Receiver;
 
-  void RunV6();
+  void Run(
+      Shard* shard);
 
-  void RunReceivers();
+  void RunReceiver(
+      Receiver* receiver);
 
-  void Receive();
+  void Receive(
+      Receiver* receiver);
 
-  void ReceiveV6();
+  void ReceiveV6(
+      Receiver* receiver);
 
   void HandleReceivedFrom(
+      Receiver* receiver,
       const boost::system::error_code& ecode,
       std::size_t bytes_transferred,
       SSUPacket* packet);
 
   void HandleReceivedFromV6(
+      Receiver* receiver,
       const boost::system::error_code& ecode,
       std::size_t bytes_transferred,
       SSUPacket* packet);
 
+  /// @brief Hands received packets over to the threads owning their senders
+  void DispatchReceivedPackets(
+      std::vector<SSUPacket *> packets);
+
+  /// @brief Reads datagrams already queued on socket without blocking,
+  ///   until packets holds SSU_RECEIVE_BATCH_SIZE packets
+  void ReceiveMore(
+      boost::asio::ip::udp::socket* socket,
+      std::size_t mtu,
+      std::vector<SSUPacket *>* packets);
+
   void HandleReceivedPackets(
       std::vector<SSUPacket *> packets);
 
+  /// @brief Sends all packets queued by Send() on a shard for the v4 or
+  ///   v6 socket
+  void FlushSendQueue(
+      Shard* shard,
+      bool v4);
+
+  static std::vector<std::unique_ptr<Shard>> CreateShards(
+      std::size_t num);
+
+  static void OpenSocket(
+      boost::asio::ip::udp::socket* socket,
+      const boost::asio::ip::udp::endpoint& endpoint,
+      bool reusePort);
+
+  /// @return Index of the shard owning sessions with this endpoint
+  std::size_t GetShardIndex(
+      const boost::asio::ip::udp::endpoint& ep) const;
+
+  Shard& GetShard(
+      const boost::asio::ip::udp::endpoint& ep) const {
+    return *m_Shards[GetShardIndex(ep)];
+  }
+
+  /// @brief Registers session under its remote endpoint
+  /// @return False if the endpoint already has a session
+  bool AddSession(
+      std::shared_ptr<SSUSession> session);
+
+  /// @brief Unregisters session, if still registered
+  void RemoveSession(
+      std::shared_ptr<SSUSession> session);
+
   template<typename Filter>
   std::shared_ptr<SSUSession> GetRandomSession(
       Filter filter);
@@ -189,34 +259,69 @@ class SSUServer {
 
   bool m_IsRunning;
 
-  std::unique_ptr<std::thread> m_Thread, m_ThreadV6, m_ReceiversThread;
+  // Outgoing packets of one event loop turn, sent together on flush
+  struct SendQueue {
+    std::mutex mutex;
+    std::vector<SSUPacket *> packets;
+  };
+
+  /// @brief Sessions whose endpoints hash to one shard, with the thread
+  ///   that runs them. Lookups share the mutex, only session creation
+  ///   and removal take it exclusively.
+  struct Shard {
+    explicit Shard(
+        std::size_t index)
+        : index(index),
+          work(service) {}
+    std::size_t index;
+    boost::asio::io_service service;
+    boost::asio::io_service::work work;
+    std::unique_ptr<std::thread> thread;
+    SendQueue sendQueue, sendQueueV6;
+    mutable std::shared_timed_mutex sessionsMutex;
+    EndpointTable<std::shared_ptr<SSUSession>> sessions;
+    SSUKeyCache keyCache;
+  };
+
+  /// @brief Sockets read by one receiving thread
+  struct Receiver {
+    Receiver()
+        : work(service),
+          socket(service),
+          socketV6(service) {}
+    boost::asio::io_service service;
+    boost::asio::io_service::work work;
+    std::unique_ptr<std::thread> thread;
+    boost::asio::ip::udp::socket socket, socketV6;
+  };
+
+  std::vector<std::unique_ptr<Shard>> m_Shards;
+  std::vector<std::unique_ptr<Receiver>> m_Receivers;
 
-  boost::asio::io_service m_Service, m_ServiceV6, m_ReceiversService;
-  boost::asio::io_service::work m_Work, m_WorkV6, m_ReceiversWork;
+  // sessions of all shards, for random picks without locking
+  i2p::util::RandomIndex<std::shared_ptr<SSUSession>> m_RandomSessions;
 
   boost::asio::ip::udp::endpoint m_Endpoint, m_EndpointV6;
-  boost::asio::ip::udp::socket m_Socket, m_SocketV6;
 
+  // run on the first shard
   boost::asio::deadline_timer m_IntroducersUpdateTimer, m_PeerTestsCleanupTimer;
 
+  // recvmmsg/sendmmsg are used until the kernel reports them missing
+  std::atomic<bool> m_IsBatchIOEnabled;
+
   // introducers we are connected to
   std::list<boost::asio::ip::udp::endpoint> m_Introducers;
 
-  mutable std::mutex m_SessionsMutex;
-
-  std::map<boost::asio::ip::udp::endpoint, std::shared_ptr<SSUSession>> m_Sessions;
-
   // we are introducer
+  std::mutex m_RelaysMutex;
   std::map<uint32_t, boost::asio::ip::udp::endpoint> m_Relays;
 
   // nonce -> creation time in milliseconds
+  std::mutex m_PeerTestsMutex;
   std::map<uint32_t, PeerTest> m_PeerTests;
 
  public:
-  // for HTTP only
-  const decltype(m_Sessions)& GetSessions() const {
-    return m_Sessions;
-  }
+  std::size_t GetNumSessions() const;
 };
 
 }  // namespace transport
@@ -0,0 +1,179 @@
+/**
+ * Copyright (c) 2015-2016, The Kovri I2P Router Project
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ *    conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *    of conditions and the following disclaimer in the documentation and/or other
+ *    materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "SSUCongestion.h"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace i2p {
+namespace transport {
+
+SSUDelayBasedCongestionControl::SSUDelayBasedCongestionControl(
+    std::size_t packet_size)
+    : m_PacketSize(packet_size ? packet_size : 1),
+      m_Window(SSU_INITIAL_WINDOW * m_PacketSize),
+      m_SlowStartThreshold(SSU_MAX_WINDOW * m_PacketSize),
+      m_SmoothedRTT(0),
+      m_RTTVariance(0),
+      m_RTO(SSU_INITIAL_RTO),
+      m_LatestRTT(0),
+      m_BaseDelay(0),
+      m_BaseDelayIndex(0),
+      m_BaseDelayTime(0),
+      m_RecoveryEndTime(0) {
+  m_BaseDelays.fill(0);
+}
+
+void SSUDelayBasedCongestionControl::OnAck(
+    std::size_t acked_bytes,
+    std::uint64_t rtt,
+    std::uint64_t now) {
+  if (rtt)
+    UpdateRTT(rtt, now);
+  if (!acked_bytes)
+    return;
+  std::uint64_t queuing_delay =
+    m_LatestRTT > m_BaseDelay ? m_LatestRTT - m_BaseDelay : 0;
+  if (m_Window < m_SlowStartThreshold) {
+    if (queuing_delay < SSU_TARGET_QUEUING_DELAY) {
+      m_Window += acked_bytes;
+    } else {
+      // queue is building up, leave slow start
+      m_SlowStartThreshold = m_Window;
+    }
+  } else {
+    // grow by up to a packet per window of ACKs, in proportion to how
+    // far queuing delay is from the target; shrink above it
+    double off_target =
+      (static_cast<double>(SSU_TARGET_QUEUING_DELAY) -
+       static_cast<double>(queuing_delay)) / SSU_TARGET_QUEUING_DELAY;
+    off_target = std::max(off_target, -1.0);
+    double change =
+      off_target * acked_bytes * m_PacketSize / m_Window;
+    if (change < 0 && static_cast<std::size_t>(-change) >= m_Window)
+      m_Window = 0;
+    else
+      m_Window = static_cast<std::size_t>(m_Window + change);
+  }
+  m_Window = std::max(m_Window, SSU_MIN_WINDOW * m_PacketSize);
+  m_Window = std::min(m_Window, SSU_MAX_WINDOW * m_PacketSize);
+}
+
+void SSUDelayBasedCongestionControl::OnLoss(
+    std::uint64_t now) {
+  // with no queue at the bottleneck the loss is unlikely to be congestion
+  bool is_queuing =
+    m_LatestRTT > m_BaseDelay + SSU_TARGET_QUEUING_DELAY / 2;
+  Reduce(now, is_queuing ? 2 : 8);
+}
+
+void SSUDelayBasedCongestionControl::OnCongestionNotification(
+    std::uint64_t now) {
+  Reduce(now, 2);
+}
+
+void SSUDelayBasedCongestionControl::OnTimeout(
+    std::uint64_t now) {
+  m_SlowStartThreshold =
+    std::max(m_Window / 2, SSU_MIN_WINDOW * m_PacketSize);
+  m_Window = SSU_MIN_WINDOW * m_PacketSize;
+  m_RTO = std::min(m_RTO * 2, SSU_MAX_RTO);
+  m_RecoveryEndTime = now + m_RTO;
+}
+
+std::uint64_t SSUDelayBasedCongestionControl::GetPacingRate() const {
+  if (!m_SmoothedRTT)
+    return 0;
+  // spread a window over an RTT, faster in slow start to let it grow
+  std::uint64_t gain = m_Window < m_SlowStartThreshold ? 8 : 5;  // in 1/4
+  return gain * m_Window * 1000 / (4 * m_SmoothedRTT);
+}
+
+void SSUDelayBasedCongestionControl::UpdateRTT(
+    std::uint64_t rtt,
+    std::uint64_t now) {
+  m_LatestRTT = rtt;
+  if (!m_SmoothedRTT) {
+    m_SmoothedRTT = rtt;
+    m_RTTVariance = rtt / 2;
+  } else {
+    std::uint64_t delta =
+      m_SmoothedRTT > rtt ? m_SmoothedRTT - rtt : rtt - m_SmoothedRTT;
+    m_RTTVariance = (3 * m_RTTVariance + delta) / 4;
+    m_SmoothedRTT = (7 * m_SmoothedRTT + rtt) / 8;
+  }
+  m_RTO = m_SmoothedRTT + std::max<std::uint64_t>(4 * m_RTTVariance, 1);
+  m_RTO = std::max(m_RTO, SSU_MIN_RTO);
+  m_RTO = std::min(m_RTO, SSU_MAX_RTO);
+  UpdateBaseDelay(rtt, now);
+}
+
+void SSUDelayBasedCongestionControl::UpdateBaseDelay(
+    std::uint64_t rtt,
+    std::uint64_t now) {
+  if (!m_BaseDelay) {
+    m_BaseDelayTime = now;
+  } else {
+    // start a new interval for each one elapsed, forgetting the oldest
+    for (std::size_t i = 0;
+         i < SSU_BASE_DELAY_HISTORY &&
+         now >= m_BaseDelayTime + SSU_BASE_DELAY_INTERVAL;
+         i++) {
+      m_BaseDelayIndex = (m_BaseDelayIndex + 1) % SSU_BASE_DELAY_HISTORY;
+      m_BaseDelays[m_BaseDelayIndex] = 0;
+      m_BaseDelayTime += SSU_BASE_DELAY_INTERVAL;
+    }
+    if (now >= m_BaseDelayTime + SSU_BASE_DELAY_INTERVAL)
+      m_BaseDelayTime = now;  // idle for longer than the whole history
+  }
+  std::uint64_t& current = m_BaseDelays[m_BaseDelayIndex];
+  if (!current || rtt < current)
+    current = rtt;
+  m_BaseDelay = 0;
+  for (auto delay : m_BaseDelays)
+    if (delay && (!m_BaseDelay || delay < m_BaseDelay))
+      m_BaseDelay = delay;
+}
+
+void SSUDelayBasedCongestionControl::Reduce(
+    std::uint64_t now,
+    std::size_t fraction) {
+  if (now < m_RecoveryEndTime)
+    return;
+  m_Window = std::max(
+      m_Window - m_Window / fraction,
+      SSU_MIN_WINDOW * m_PacketSize);
+  m_SlowStartThreshold = m_Window;
+  m_RecoveryEndTime = now + (m_SmoothedRTT ? m_SmoothedRTT : m_RTO);
+}
+
+}  // namespace transport
+}  // namespace i2p
@@ -0,0 +1,178 @@
+/**
+ * Copyright (c) 2015-2016, The Kovri I2P Router Project
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ *    conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *    of conditions and the following disclaimer in the documentation and/or other
+ *    materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SRC_CORE_TRANSPORT_SSUCONGESTION_H_
+#define SRC_CORE_TRANSPORT_SSUCONGESTION_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace i2p {
+namespace transport {
+
+// all times are in milliseconds
+const std::uint64_t SSU_INITIAL_RTO = 3000;
+const std::uint64_t SSU_MIN_RTO = 200;
+const std::uint64_t SSU_MAX_RTO = 15000;
+// delay queued at the bottleneck the delay-based controller aims for
+const std::uint64_t SSU_TARGET_QUEUING_DELAY = 50;
+// base delay is the smallest RTT of the last SSU_BASE_DELAY_HISTORY
+// intervals, so it follows route changes without taking a queue for it
+const std::uint64_t SSU_BASE_DELAY_INTERVAL = 60000;
+const std::size_t SSU_BASE_DELAY_HISTORY = 10;
+// windows in packets
+const std::size_t SSU_MIN_WINDOW = 2;
+const std::size_t SSU_INITIAL_WINDOW = 8;
+const std::size_t SSU_MAX_WINDOW = 1024;
+
+/// @class SSUCongestionControl
+/// @brief Congestion window, RTT estimate and pacing rate of a session
+/// @details SSUData tracks the bytes in flight and reports ACKs, losses
+///   and timeouts; the controller decides how much may be in flight and
+///   how fast it may be sent. Times are passed in by the caller so an
+///   implementation can be driven by a simulated link.
+class SSUCongestionControl {
+ public:
+  virtual ~SSUCongestionControl() {}
+
+  /// @param acked_bytes Bytes newly acknowledged
+  /// @param rtt Round-trip time sample, 0 if the data was retransmitted
+  virtual void OnAck(
+      std::size_t acked_bytes,
+      std::uint64_t rtt,
+      std::uint64_t now) = 0;
+
+  /// @brief Data was detected lost from a gap in ACK bitfields
+  virtual void OnLoss(
+      std::uint64_t now) = 0;
+
+  /// @brief Peer set the explicit congestion notification flag
+  virtual void OnCongestionNotification(
+      std::uint64_t now) = 0;
+
+  /// @brief Retransmission timer expired
+  virtual void OnTimeout(
+      std::uint64_t now) = 0;
+
+  /// @return Bytes allowed in flight
+  virtual std::size_t GetWindow() const = 0;
+
+  /// @return Retransmission timeout
+  virtual std::uint64_t GetRTO() const = 0;
+
+  /// @return Smoothed RTT, 0 before the first sample
+  virtual std::uint64_t GetSmoothedRTT() const = 0;
+
+  /// @return Bytes per second to pace packets at, 0 for no pacing
+  virtual std::uint64_t GetPacingRate() const = 0;
+};
+
+/// @class SSUDelayBasedCongestionControl
+/// @brief Grows the window while queuing delay stays below a target
+/// @details Queuing delay is the latest RTT less the base delay, the
+///   smallest of the per-minute minimum RTTs of the last minutes. Below
+///   the target the window grows, above it the window shrinks in
+///   proportion (both as in LEDBAT), so the controller backs off
+///   before the bottleneck queue overflows. Congestion notifications,
+///   and losses while a queue has built up, halve the window; losses
+///   with no queue are taken as random and cut it by 1/8. Either happens
+///   at most once per RTT. RTT and RTO are estimated as in RFC 6298.
+class SSUDelayBasedCongestionControl : public SSUCongestionControl {
+ public:
+  /// @param packet_size Bytes of data in a full packet
+  explicit SSUDelayBasedCongestionControl(
+      std::size_t packet_size);
+
+  void OnAck(
+      std::size_t acked_bytes,
+      std::uint64_t rtt,
+      std::uint64_t now);
+
+  void OnLoss(
+      std::uint64_t now);
+
+  void OnCongestionNotification(
+      std::uint64_t now);
+
+  void OnTimeout(
+      std::uint64_t now);
+
+  std::size_t GetWindow() const {
+    return m_Window;
+  }
+
+  std::uint64_t GetRTO() const {
+    return m_RTO;
+  }
+
+  std::uint64_t GetSmoothedRTT() const {
+    return m_SmoothedRTT;
+  }
+
+  std::uint64_t GetPacingRate() const;
+
+  /// @return Smallest RTT over the base delay history, 0 before the
+  ///   first sample
+  std::uint64_t GetBaseDelay() const {
+    return m_BaseDelay;
+  }
+
+ private:
+  void UpdateRTT(
+      std::uint64_t rtt,
+      std::uint64_t now);
+
+  /// @brief Shrinks the window by 1/fraction unless it was reduced
+  ///   within the last RTT
+  void Reduce(
+      std::uint64_t now,
+      std::size_t fraction);
+
+  void UpdateBaseDelay(
+      std::uint64_t rtt,
+      std::uint64_t now);
+
+ private:
+  std::size_t m_PacketSize;
+  std::size_t m_Window, m_SlowStartThreshold;
+  std::uint64_t m_SmoothedRTT, m_RTTVariance, m_RTO, m_LatestRTT;
+  std::uint64_t m_BaseDelay;
+  // smallest RTT per interval, the current one at m_BaseDelayIndex
+  std::array<std::uint64_t, SSU_BASE_DELAY_HISTORY> m_BaseDelays;
+  std::size_t m_BaseDelayIndex;
+  std::uint64_t m_BaseDelayTime;  // start of the current interval
+  std::uint64_t m_RecoveryEndTime;
+};
+
+}  // namespace transport
+}  // namespace i2p
+
+#endif  // SRC_CORE_TRANSPORT_SSUCONGESTION_H_
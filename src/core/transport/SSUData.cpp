@@ -36,37 +36,153 @@
 
 #include <stdlib.h>
 
+#include <algorithm>
 #include <cstdint>
+#include <limits>
 #include <memory>
 
 #include "NetworkDatabase.h"
 #include "SSU.h"
+#include "Transports.h"
 #include "util/Log.h"
 #include "util/Timestamp.h"
 
 namespace i2p {
 namespace transport {
 
-void IncompleteMessage::AttachNextFragment(
+IncompleteMessage::IncompleteMessage(
+    std::shared_ptr<I2NPMessage> msg)
+    : m_Msg(msg),
+      m_DataOffset(msg->len),
+      m_FragmentSize(0),
+      m_LastFragmentNum(-1),
+      m_MaxFragmentNum(-1),
+      m_LastFragmentSize(0),
+      m_ParkedOffset(0),
+      m_LastFragmentInsertTime(0) {}
+
+bool IncompleteMessage::AddFragment(
+    std::size_t fragmentNum,
     const uint8_t* fragment,
-    size_t fragmentSize) {
-  if (msg->len + fragmentSize > msg->maxLen) {
-    LogPrint(eLogInfo,
-        "Transport: SSU I2NP message size ", msg->maxLen, " is not enough");
-    auto newMsg = ToSharedI2NPMessage(NewI2NPMessage());
-    *newMsg = *msg;
-    msg = newMsg;
+    std::size_t fragmentSize,
+    bool isLast) {
+  if (fragmentNum >= SSU_MAX_NUM_FRAGMENTS_PER_MESSAGE)
+    return false;
+  int num = static_cast<int>(fragmentNum);
+  std::size_t offset;
+  if (isLast) {
+    if (m_LastFragmentNum >= 0 || num < m_MaxFragmentNum)
+      return false;
+    if (!num) {
+      offset = 0;
+    } else if (m_FragmentSize) {
+      offset = fragmentNum * m_FragmentSize;
+    } else {
+      // size of preceding fragments is not known yet
+      if (fragmentSize >= m_Msg->maxLen - m_DataOffset)
+        return false;
+      m_ParkedOffset = m_Msg->maxLen - fragmentSize;
+      memcpy(m_Msg->buf + m_ParkedOffset, fragment, fragmentSize);
+      offset = m_ParkedOffset - m_DataOffset;
+    }
+    m_LastFragmentNum = num;
+    m_LastFragmentSize = fragmentSize;
+  } else {
+    if (m_LastFragmentNum >= 0 && num >= m_LastFragmentNum)
+      return false;
+    if (!fragmentSize)
+      return false;
+    if (!m_FragmentSize) {
+      m_FragmentSize = fragmentSize;
+      if (m_ParkedOffset) {
+        // move parked last fragment to its place
+        std::size_t lastOffset = m_LastFragmentNum * m_FragmentSize;
+        if (!Reserve(lastOffset + m_LastFragmentSize))
+          return false;
+        memmove(
+            m_Msg->buf + m_DataOffset + lastOffset,
+            m_Msg->buf + m_ParkedOffset,
+            m_LastFragmentSize);
+        m_ParkedOffset = 0;
+      }
+    } else if (fragmentSize != m_FragmentSize) {
+      return false;
+    }
+    offset = fragmentNum * m_FragmentSize;
+  }
+  if (!m_ParkedOffset || !isLast) {
+    if (!Reserve(offset + fragmentSize))
+      return false;
+    memcpy(m_Msg->buf + m_DataOffset + offset, fragment, fragmentSize);
+  }
+  m_ReceivedFragments.set(fragmentNum);
+  if (num > m_MaxFragmentNum)
+    m_MaxFragmentNum = num;
+  return true;
+}
+
+bool IncompleteMessage::Reserve(
+    std::size_t size) {
+  if (m_DataOffset + size <= m_Msg->maxLen)
+    return true;
+  auto newMsg = ToSharedI2NPMessage(NewI2NPMessage());
+  if (m_DataOffset + size > newMsg->maxLen)
+    return false;
+  LogPrint(eLogInfo,
+      "Transport: SSU I2NP message size ", m_Msg->maxLen, " is not enough");
+  memcpy(newMsg->buf, m_Msg->buf, m_Msg->maxLen);
+  newMsg->offset = m_Msg->offset;
+  newMsg->len = m_Msg->len;
+  newMsg->from = m_Msg->from;
+  if (m_ParkedOffset) {
+    // keep parked fragment at the end of the new buffer
+    std::size_t parkedOffset = newMsg->maxLen - m_LastFragmentSize;
+    memmove(
+        newMsg->buf + parkedOffset,
+        newMsg->buf + m_ParkedOffset,
+        m_LastFragmentSize);
+    m_ParkedOffset = parkedOffset;
+  }
+  m_Msg = newMsg;
+  return true;
+}
+
+std::shared_ptr<I2NPMessage> IncompleteMessage::GetMessage() {
+  m_Msg->len = m_DataOffset + m_LastFragmentNum * m_FragmentSize +
+    m_LastFragmentSize;
+  return m_Msg;
+}
+
+std::size_t IncompleteMessage::FillAckBitfields(
+    uint8_t* buf) const {
+  std::size_t num_bytes = m_MaxFragmentNum / 7 + 1;
+  for (std::size_t i = 0; i < num_bytes; i++) {
+    uint8_t bitfield = 0;
+    for (std::size_t j = 0; j < 7; j++)
+      if (i * 7 + j < SSU_MAX_NUM_FRAGMENTS_PER_MESSAGE &&
+          m_ReceivedFragments.test(i * 7 + j))
+        bitfield |= 0x01 << j;
+    if (i + 1 < num_bytes)
+      bitfield |= 0x80;  // 0x80 means non-last
+    buf[i] = bitfield;
   }
-  memcpy(msg->buf + msg->len, fragment, fragmentSize);
-  msg->len += fragmentSize;
-  nextFragmentNum++;
+  return num_bytes;
 }
 
 SSUData::SSUData(
     SSUSession& session)
     : m_Session(session),
+      m_ReceivedMessages(
+          transports.GetSessionDuplicateFilterSize(),
+          transports.GetDuplicateFilterFalsePositiveRate(),
+          DECAY_INTERVAL),
+      m_IsFlushScheduled(false),
+      m_BytesInFlight(0),
+      m_Pacer(0, 0),
+      m_IsPacingScheduled(false),
+      m_ResendTime(0),
       m_ResendTimer(session.GetService()),
-      m_DecayTimer(session.GetService()),
+      m_PacingTimer(session.GetService()),
       m_IncompleteMessagesCleanupTimer(session.GetService()) {
   m_MaxPacketSize = session.IsV6() ?
     SSU_V6_MAX_PACKET_SIZE :
@@ -75,6 +191,9 @@ SSUData::SSUData(
   auto remoteRouter = session.GetRemoteRouter();
   if (remoteRouter)
     AdjustPacketSize(*remoteRouter);
+  m_CongestionControl =
+    std::make_unique<SSUDelayBasedCongestionControl>(m_PacketSize);
+  m_Pacer.SetBurst(SSU_PACING_BURST * m_PacketSize);
 }
 
 SSUData::~SSUData() {}
@@ -87,8 +206,11 @@ void SSUData::Start() {
 void SSUData::Stop() {
   LogPrint(eLogDebug, "SSUData: stopping");
   m_ResendTimer.cancel();
-  m_DecayTimer.cancel();
+  m_ResendTime = 0;
+  m_PacingTimer.cancel();
   m_IncompleteMessagesCleanupTimer.cancel();
+  m_PendingFragments.clear();
+  m_PendingAcks.clear();
 }
 
 void SSUData::AdjustPacketSize(
@@ -128,17 +250,44 @@ void SSUData::UpdatePacketSize(
 }
 
 void SSUData::ProcessSentMessageAck(
-    uint32_t msgID) {
+    uint32_t msgID,
+    uint64_t ts,
+    std::size_t* ackedBytes,
+    uint64_t* rtt) {
   // TODO(unassigned): too spammy? keep?
   //LogPrint(eLogDebug,
       //"SSUData:", m_Session.GetFormattedSessionInfo(),
       //"processing sent message ACK");
   auto it = m_SentMessages.find(msgID);
   if (it != m_SentMessages.end()) {
+    for (auto& fragment : it->second->fragments) {
+      if (fragment && fragment->isInFlight) {
+        m_BytesInFlight -= fragment->len;
+        *ackedBytes += fragment->len;
+      }
+    }
+    // Karn's algorithm: an ACK of retransmitted data is ambiguous
+    if (!it->second->isRetransmitted && it->second->lastSendTime)
+      *rtt = ts - it->second->lastSendTime;
     m_SentMessages.erase(it);
-    if (m_SentMessages.empty())
+    if (m_SentMessages.empty()) {
       m_ResendTimer.cancel();
+      m_ResendTime = 0;
+    }
+  }
+}
+
+void SSUData::Retransmit(
+    uint32_t msgID,
+    SentMessage* message,
+    std::size_t fragmentNum) {
+  auto& fragment = message->fragments[fragmentNum];
+  if (fragment->isInFlight) {
+    m_BytesInFlight -= fragment->len;
+    fragment->isInFlight = false;
   }
+  message->isRetransmitted = true;
+  m_PendingFragments.push_back(std::make_pair(msgID, fragmentNum));
 }
 
 void SSUData::ProcessAcks(
@@ -146,12 +295,16 @@ void SSUData::ProcessAcks(
     uint8_t flag) {
   LogPrint(eLogDebug,
       "SSUData:", m_Session.GetFormattedSessionInfo(), "processing ACKs");
+  uint64_t ts = i2p::util::GetMillisecondsSinceEpoch();
+  std::size_t ackedBytes = 0;
+  uint64_t rtt = 0;
+  bool isLost = false;
   if (flag & DATA_FLAG_EXPLICIT_ACKS_INCLUDED) {
     // explicit ACKs
     uint8_t numAcks =*buf;
     buf++;
     for (int i = 0; i < numAcks; i++)
-      ProcessSentMessageAck(bufbe32toh(buf+i*4));
+      ProcessSentMessageAck(bufbe32toh(buf+i*4), ts, &ackedBytes, &rtt);
     buf += numAcks*4;
   }
   if (flag & DATA_FLAG_ACK_BITFIELDS_INCLUDED) {
@@ -164,29 +317,75 @@ void SSUData::ProcessAcks(
       auto it = m_SentMessages.find(msgID);
       // process individual Ack bitfields
       bool isNonLast = false;
-      int fragment = 0;
+      std::size_t fragment = 0;
+      int highestAcked = -1;
+      uint64_t latestAckedSendTime = 0;
       do {
         uint8_t bitfield = *buf;
         isNonLast = bitfield & 0x80;
         bitfield &= 0x7F;  // clear MSB
         if (bitfield && it != m_SentMessages.end()) {
-          int numSentFragments = it->second->fragments.size();
+          auto& fragments = it->second->fragments;
           // process bits
-          uint8_t mask = 0x01;
-          for (int j = 0; j < 7; j++) {
-            if (bitfield & mask) {
-              if (fragment < numSentFragments)
-                it->second->fragments[fragment].reset(nullptr);
+          for (std::size_t j = 0; j < 7; j++) {
+            if (!(bitfield & (0x01 << j)) ||
+                fragment + j >= fragments.size())
+              continue;
+            highestAcked = fragment + j;
+            auto& sentFragment = fragments[fragment + j];
+            if (!sentFragment)
+              continue;  // ACKed before
+            if (sentFragment->isInFlight) {
+              m_BytesInFlight -= sentFragment->len;
+              ackedBytes += sentFragment->len;
             }
-            fragment++;
-            mask <<= 1;
+            if (sentFragment->numSends == 1)
+              rtt = ts - sentFragment->sendTime;
+            latestAckedSendTime =
+              std::max(latestAckedSendTime, sentFragment->sendTime);
+            sentFragment.reset(nullptr);
           }
         }
+        fragment += 7;
         buf++;
       }
       while (isNonLast);
+      if (!latestAckedSendTime)
+        continue;
+      // fast retransmit of fragments overtaken by enough later ones
+      auto& fragments = it->second->fragments;
+      for (int j = 0;
+          j + static_cast<int>(SSU_FAST_RETRANSMIT_THRESHOLD) <= highestAcked;
+          j++) {
+        if (fragments[j] && fragments[j]->isInFlight &&
+            fragments[j]->sendTime < latestAckedSendTime) {
+          Retransmit(msgID, it->second.get(), j);
+          isLost = true;
+        }
+      }
+      // an explicit ACK may never come once every fragment is ACKed
+      bool isAcked = true;
+      for (const auto& sentFragment : fragments)
+        if (sentFragment)
+          isAcked = false;
+      if (isAcked) {
+        m_SentMessages.erase(it);
+        if (m_SentMessages.empty()) {
+          m_ResendTimer.cancel();
+          m_ResendTime = 0;
+        }
+      }
     }
   }
+  if (isLost)
+    m_CongestionControl->OnLoss(ts);
+  if (ackedBytes || rtt) {
+    m_CongestionControl->OnAck(ackedBytes, rtt, ts);
+    m_Pacer.SetRate(m_CongestionControl->GetPacingRate());
+  }
+  // window may have opened
+  if (!m_PendingFragments.empty())
+    ScheduleFlush();
 }
 
 void SSUData::ProcessFragments(
@@ -227,73 +426,35 @@ void SSUData::ProcessFragments(
     }
     std::unique_ptr<IncompleteMessage>& incompleteMessage = it->second;
     // handle current fragment
-    if (fragmentNum == incompleteMessage->nextFragmentNum) {
-      // expected fragment
-      incompleteMessage->AttachNextFragment(buf, fragmentSize);
-      if (!isLast && !incompleteMessage->savedFragments.empty()) {
-        // try saved fragments
-        for (auto it1 = incompleteMessage->savedFragments.begin();
-            it1 != incompleteMessage->savedFragments.end();) {
-          auto& savedFragment = *it1;
-          if (savedFragment->fragmentNum ==
-              incompleteMessage->nextFragmentNum) {
-            incompleteMessage->AttachNextFragment(
-                savedFragment->buf,
-                savedFragment->len);
-            isLast = savedFragment->isLast;
-            incompleteMessage->savedFragments.erase(it1++);
-          } else {
-            break;
-          }
-        }
-        if (isLast)
-          LogPrint(eLogDebug,
-              "SSUData:", m_Session.GetFormattedSessionInfo(),
-              "message ", msgID, " is complete");
-      }
+    if (incompleteMessage->HasFragment(fragmentNum)) {
+      LogPrint(eLogWarn,
+          "SSUData:", m_Session.GetFormattedSessionInfo(),
+          " ignoring duplicate fragment ", static_cast<int>(fragmentNum),
+          " of message ", msgID);
+    } else if (!incompleteMessage->AddFragment(
+          fragmentNum, buf, fragmentSize, isLast)) {
+      LogPrint(eLogWarn,
+          "SSUData:", m_Session.GetFormattedSessionInfo(),
+          " ignoring inconsistent fragment ", static_cast<int>(fragmentNum),
+          " of message ", msgID);
     } else {
-      if (fragmentNum < incompleteMessage->nextFragmentNum) {
-        // duplicate fragment
-        LogPrint(eLogWarn,
-            "SSUData:", m_Session.GetFormattedSessionInfo(),
-            " ignoring duplicate fragment ", static_cast<int>(fragmentNum),
-            " of message ", msgID);
-      } else {
-        // missing fragment
-        LogPrint(eLogWarn,
-            "SSUData:", m_Session.GetFormattedSessionInfo(),
-            " missing fragments from ",
-            static_cast<int>(incompleteMessage->nextFragmentNum),
-            " to ", fragmentNum - 1, " of message ", msgID);
-        auto savedFragment =
-          std::make_unique<Fragment>(fragmentNum, buf, fragmentSize, isLast);
-        if (incompleteMessage->savedFragments.insert(
-              std::unique_ptr<Fragment>(std::move(savedFragment))).second)
-          incompleteMessage->lastFragmentInsertTime =
-            i2p::util::GetSecondsSinceEpoch();
-        else
-          LogPrint(eLogWarn,
-              "SSUData:", m_Session.GetFormattedSessionInfo(),
-              "fragment ", static_cast<int>(fragmentNum),
-              " of message ", msgID, " is already saved");
-      }
-      isLast = false;
+      incompleteMessage->SetLastFragmentInsertTime(
+          i2p::util::GetSecondsSinceEpoch());
     }
-    if (isLast) {
+    if (incompleteMessage->IsComplete()) {
+      LogPrint(eLogDebug,
+          "SSUData:", m_Session.GetFormattedSessionInfo(),
+          "message ", msgID, " is complete");
       // delete incomplete message
-      auto msg = incompleteMessage->msg;
-      incompleteMessage->msg = nullptr;
-      m_IncompleteMessages.erase(msgID);
+      auto msg = incompleteMessage->GetMessage();
+      m_IncompleteMessages.erase(it);
       // process message
       SendMsgAck(msgID);
       msg->FromSSU(msgID);
       if (m_Session.GetState() == eSessionStateEstablished) {
-        if (!m_ReceivedMessages.count(msgID)) {
-          if (m_ReceivedMessages.size() > MAX_NUM_RECEIVED_MESSAGES)
-            m_ReceivedMessages.clear();
-          else
-            ScheduleDecay();
-          m_ReceivedMessages.insert(msgID);
+        if (!m_ReceivedMessages.IsDuplicate(
+              msgID, i2p::util::GetSecondsSinceEpoch())) {
+          msg->fromIdent = m_Session.GetRemoteIdentity().GetIdentHash();
           m_Handler.PutNextMessage(msg);
         } else {
           LogPrint(eLogWarn,
@@ -313,7 +474,9 @@ void SSUData::ProcessFragments(
           LogPrint(eLogInfo,
               "SSUData:", m_Session.GetFormattedSessionInfo(),
               "Got DSM From SSU");
-          m_ReceivedMessages.insert(msgID);
+          // remember msgID
+          m_ReceivedMessages.IsDuplicate(
+              msgID, i2p::util::GetSecondsSinceEpoch());
           m_Handler.PutNextMessage(msg);
         } else {
           LogPrint(eLogError,
@@ -323,7 +486,7 @@ void SSUData::ProcessFragments(
         }
       }
     } else {
-      SendFragmentAck(msgID, fragmentNum);
+      SendFragmentAck(msgID, *incompleteMessage);
     }
     buf += fragmentSize;
   }
@@ -346,6 +509,14 @@ void SSUData::ProcessMessage(
       "SSUData:", m_Session.GetFormattedSessionInfo(),
       "processing message: flags=", static_cast<std::size_t>(flag),
       " len=", len);
+  if (flag & DATA_FLAG_EXPLICIT_CONGESTION_NOTIFICATION) {
+    LogPrint(eLogDebug,
+        "SSUData:", m_Session.GetFormattedSessionInfo(),
+        "congestion notification received");
+    m_CongestionControl->OnCongestionNotification(
+        i2p::util::GetMillisecondsSinceEpoch());
+    m_Pacer.SetRate(m_CongestionControl->GetPacingRate());
+  }
   // process acks if presented
   if (flag & (DATA_FLAG_ACK_BITFIELDS_INCLUDED | DATA_FLAG_EXPLICIT_ACKS_INCLUDED))
     ProcessAcks(buf, flag);
@@ -375,17 +546,17 @@ void SSUData::Send(
         "message ", msgID, " was already sent");
     return;
   }
-  if (m_SentMessages.empty())  // schedule resend at first message only
-    ScheduleResend();
   auto ret = m_SentMessages.insert(
       std::make_pair(
         msgID,
         std::unique_ptr<SentMessage>(std::make_unique<SentMessage>())));
   std::unique_ptr<SentMessage>& sentMessage = ret.first->second;
   if (ret.second) {
-    sentMessage->nextResendTime =
-      i2p::util::GetSecondsSinceEpoch() + RESEND_INTERVAL;
+    // resend time is set once a fragment is sent
+    sentMessage->nextResendTime = std::numeric_limits<uint64_t>::max();
+    sentMessage->lastSendTime = 0;
     sentMessage->numResends = 0;
+    sentMessage->isRetransmitted = false;
   }
   auto& fragments = sentMessage->fragments;
   // 9  =  flag + #frg(1) + messageID(4) + frag info (3)
@@ -396,12 +567,7 @@ void SSUData::Send(
   while (len > 0) {
     auto fragment = std::make_unique<Fragment>();
     fragment->fragmentNum = fragmentNum;
-    uint8_t* buf = fragment->buf;
-    uint8_t* payload = buf + SSU_HEADER_SIZE_MIN;
-    *payload = DATA_FLAG_WANT_REPLY;  // for compatibility
-    payload++;
-    *payload = 1;  // always 1 message fragment per message
-    payload++;
+    uint8_t* payload = fragment->buf;
     htobe32buf(payload, msgID);
     payload += 4;
     bool isLast = (len <= payloadSize);
@@ -414,20 +580,13 @@ void SSUData::Send(
     memcpy(payload, reinterpret_cast<uint8_t *>((&fragmentInfo)) + 1, 3);
     payload += 3;
     memcpy(payload, msgBuf, size);
-    size += payload - buf;
-    if (size & 0x0F)  // make sure 16 bytes boundary
-      size = ((size >> 4) + 1) << 4;  // (/16 + 1)*16
-    fragment->len = size;
+    fragment->len = size + (payload - fragment->buf);
+    fragment->isLast = isLast;
+    fragment->sendTime = 0;
+    fragment->numSends = 0;
+    fragment->isInFlight = false;
     fragments.push_back(std::unique_ptr<Fragment>(std::move(fragment)));
-    // encrypt message with session key
-    m_Session.FillHeaderAndEncrypt(PAYLOAD_TYPE_DATA, buf, size);
-    try {
-      m_Session.Send(buf, size);
-    } catch (boost::system::system_error& ec) {
-      LogPrint(eLogError,
-          "SSUData:", m_Session.GetFormattedSessionInfo(),
-          "can't send SSU fragment: '", ec.what(), "'");
-    }
+    m_PendingFragments.push_back(std::make_pair(msgID, fragmentNum));
     if (!isLast) {
       len -= payloadSize;
       msgBuf += payloadSize;
@@ -436,40 +595,153 @@ void SSUData::Send(
     }
     fragmentNum++;
   }
+  ScheduleFlush();
 }
 
 void SSUData::SendMsgAck(
     uint32_t msgID) {
   LogPrint(eLogDebug,
       "SSUData:", m_Session.GetFormattedSessionInfo(),
-      "sending message ACK");
-  // actual length is 44 = 37 + 7 but pad it to multiple of 16
-  uint8_t buf[48 + 18];
-  uint8_t * payload = buf + SSU_HEADER_SIZE_MIN;
-  *payload = DATA_FLAG_EXPLICIT_ACKS_INCLUDED;  // flag
-  payload++;
-  *payload = 1;  // number of ACKs
-  payload++;
-  *(reinterpret_cast<uint32_t *>(payload)) = htobe32(msgID);  // msgID
-  payload += 4;
-  *payload = 0;  // number of fragments
-  // encrypt message with session key
-  m_Session.FillHeaderAndEncrypt(PAYLOAD_TYPE_DATA, buf, 48);
-  m_Session.Send(buf, 48);
+      "queueing message ACK");
+  m_PendingAcks.push_back(msgID);
+  ScheduleFlush();
+}
+
+void SSUData::ScheduleFlush() {
+  if (m_IsFlushScheduled)
+    return;
+  m_IsFlushScheduled = true;
+  auto s = m_Session.shared_from_this();
+  m_Session.GetService().post(
+      [s]() {
+      s->m_Data.Flush();
+      });
+}
+
+void SSUData::SchedulePacing(
+    uint64_t delay) {
+  if (m_IsPacingScheduled)
+    return;
+  m_IsPacingScheduled = true;
+  m_PacingTimer.expires_from_now(
+      boost::posix_time::milliseconds(
+        delay));
+  auto s = m_Session.shared_from_this();
+  m_PacingTimer.async_wait(
+      [s](
+        const boost::system::error_code& ecode) {
+      s->m_Data.m_IsPacingScheduled = false;
+      if (ecode != boost::asio::error::operation_aborted)
+        s->m_Data.Flush();
+      });
+}
+
+void SSUData::Flush() {
+  m_IsFlushScheduled = false;
+  if (m_PendingAcks.empty() && m_PendingFragments.empty())
+    return;
+  LogPrint(eLogDebug,
+      "SSUData:", m_Session.GetFormattedSessionInfo(),
+      "flushing ", m_PendingFragments.size(), " fragments and ",
+      m_PendingAcks.size(), " ACKs");
+  uint64_t ts = i2p::util::GetMillisecondsSinceEpoch();
+  uint64_t resendTime = std::numeric_limits<uint64_t>::max();
+  uint64_t pacingDelay = 0;
+  bool isBlocked = false;  // by congestion window or pacing
+  auto ack = m_PendingAcks.begin();
+  auto pending = m_PendingFragments.begin();
+  uint8_t buf[SSU_V4_MAX_PACKET_SIZE + 18];
+  while (ack != m_PendingAcks.end() ||
+      (pending != m_PendingFragments.end() && !isBlocked)) {
+    uint8_t* payload = buf + SSU_HEADER_SIZE_MIN;
+    const uint8_t* end = buf + m_PacketSize;
+    uint8_t* flag = payload++;
+    *flag = 0;
+    std::size_t numAcks = 0, numFragments = 0;
+    if (ack != m_PendingAcks.end()) {
+      *flag |= DATA_FLAG_EXPLICIT_ACKS_INCLUDED;
+      uint8_t* numAcksBuf = payload++;
+      // leave room for the number of fragments
+      while (ack != m_PendingAcks.end() &&
+          numAcks < SSU_MAX_NUM_ACKS_PER_PACKET &&
+          payload + 4 < end) {
+        htobe32buf(payload, *ack);
+        payload += 4;
+        ack++;
+        numAcks++;
+      }
+      *numAcksBuf = numAcks;
+    }
+    uint8_t* numFragmentsBuf = payload++;
+    if (!isBlocked && pending != m_PendingFragments.end()) {
+      // ACKs are not paced
+      pacingDelay = m_Pacer.GetWaitTime(m_PacketSize, ts);
+      isBlocked = pacingDelay > 0;
+    }
+    for (; !isBlocked && pending != m_PendingFragments.end() &&
+        numFragments < SSU_MAX_NUM_FRAGMENTS_PER_PACKET; pending++) {
+      auto it = m_SentMessages.find(pending->first);
+      if (it == m_SentMessages.end() ||
+          pending->second >= it->second->fragments.size())
+        continue;
+      auto& message = it->second;
+      auto& fragment = message->fragments[pending->second];
+      if (!fragment || fragment->isInFlight)
+        continue;  // ACKed or sent again in the meantime
+      // a fragment made for a larger packet size still goes out alone
+      if (payload + fragment->len > end && (numAcks || numFragments))
+        break;
+      if (m_BytesInFlight &&
+          m_BytesInFlight + fragment->len > m_CongestionControl->GetWindow()) {
+        isBlocked = true;  // until ACKs open the window
+        break;
+      }
+      memcpy(payload, fragment->buf, fragment->len);
+      payload += fragment->len;
+      numFragments++;
+      fragment->sendTime = ts;
+      fragment->numSends++;
+      fragment->isInFlight = true;
+      m_BytesInFlight += fragment->len;
+      message->lastSendTime = ts;
+      // backed off by the controller on each timeout
+      message->nextResendTime = ts + m_CongestionControl->GetRTO();
+      resendTime = std::min(resendTime, message->nextResendTime);
+    }
+    *numFragmentsBuf = numFragments;
+    if (!numAcks && !numFragments)
+      break;
+    if (numFragments)
+      *flag |= DATA_FLAG_WANT_REPLY;  // for compatibility
+    size_t len = payload - buf;
+    if (len & 0x0F)  // make sure 16 bytes boundary
+      len = ((len >> 4) + 1) << 4;  // (/16 + 1)*16
+    if (numFragments)
+      m_Pacer.Consume(len, ts);
+    // encrypt message with session key
+    m_Session.FillHeaderAndEncrypt(PAYLOAD_TYPE_DATA, buf, len);
+    try {
+      m_Session.Send(buf, len);
+    } catch (boost::system::system_error& ec) {
+      LogPrint(eLogError,
+          "SSUData:", m_Session.GetFormattedSessionInfo(),
+          "can't send SSU packet: '", ec.what(), "'");
+    }
+  }
+  m_PendingAcks.clear();
+  m_PendingFragments.erase(m_PendingFragments.begin(), pending);
+  if (pacingDelay && !m_PendingFragments.empty())
+    SchedulePacing(pacingDelay);
+  if (resendTime != std::numeric_limits<uint64_t>::max())
+    ScheduleResend(resendTime);
 }
 
 void SSUData::SendFragmentAck(
     uint32_t msgID,
-    int fragmentNum) {
+    const IncompleteMessage& message) {
   LogPrint(eLogDebug,
       "SSUData:", m_Session.GetFormattedSessionInfo(),
       "sending fragment ACK");
-  if (fragmentNum > 64) {
-    LogPrint(eLogWarn,
-        "SSUData:", m_Session.GetFormattedSessionInfo(),
-        "fragment number ", fragmentNum, " exceeds 64");
-    return;
-  }
   uint8_t buf[64 + 18];
   uint8_t* payload = buf + SSU_HEADER_SIZE_MIN;
   *payload = DATA_FLAG_ACK_BITFIELDS_INCLUDED;  // flag
@@ -479,26 +751,31 @@ void SSUData::SendFragmentAck(
   // one ack
   *(reinterpret_cast<uint32_t *>(payload)) = htobe32(msgID);  // msgID
   payload += 4;
-  div_t d = div(fragmentNum, 7);
-  memset(payload, 0x80, d.quot);  // 0x80 means non-last
-  payload += d.quot;
-  *payload = 0x01 << d.rem;  // set corresponding bit
-  payload++;
+  payload += message.FillAckBitfields(payload);
   *payload = 0;  // number of fragments
-  size_t len = d.quot < 4 ? 48 : 64;  // 48 = 37 + 7 + 4 (3+1)
+  payload++;
+  size_t len = payload - buf;
+  // pad to multiple of 16 bytes
+  if (len % 16)
+    len += 16 - len % 16;
   // encrypt message with session key
   m_Session.FillHeaderAndEncrypt(PAYLOAD_TYPE_DATA, buf, len);
   m_Session.Send(buf, len);
 }
 
-void SSUData::ScheduleResend() {
+void SSUData::ScheduleResend(
+    uint64_t ts) {
+  if (m_ResendTime && m_ResendTime <= ts)
+    return;  // expires before
   LogPrint(eLogDebug,
       "SSUData:", m_Session.GetFormattedSessionInfo(),
       "scheduling resend");
+  m_ResendTime = ts;
+  uint64_t now = i2p::util::GetMillisecondsSinceEpoch();
   m_ResendTimer.cancel();
   m_ResendTimer.expires_from_now(
-      boost::posix_time::seconds(
-        RESEND_INTERVAL));
+      boost::posix_time::milliseconds(
+        ts > now ? ts - now : 0));
   auto s = m_Session.shared_from_this();
   m_ResendTimer.async_wait(
       [s](
@@ -513,63 +790,57 @@ void SSUData::HandleResendTimer(
       "SSUData:", m_Session.GetFormattedSessionInfo(),
       "handling resend timer");
   if (ecode != boost::asio::error::operation_aborted) {
-    uint32_t ts = i2p::util::GetSecondsSinceEpoch();
+    m_ResendTime = 0;
+    uint64_t ts = i2p::util::GetMillisecondsSinceEpoch();
+    bool isTimeout = false;
     for (auto it = m_SentMessages.begin(); it != m_SentMessages.end();) {
-      if (ts >= it->second->nextResendTime) {
-        if (it->second->numResends < MAX_NUM_RESENDS) {
-          for (auto& f : it->second->fragments)
-            if (f) {
-              try {
-                m_Session.Send(f->buf, f->len);  // resend
-              } catch (boost::system::system_error& ec) {
-                LogPrint(eLogError,
-                    "SSUData:", m_Session.GetFormattedSessionInfo(),
-                    "can't resend SSU fragment: '", ec.what(), "'");
-              }
-            }
-          it->second->numResends++;
-          it->second->nextResendTime += it->second->numResends*RESEND_INTERVAL;
-          it++;
-        } else {
-          LogPrint(eLogError,
-              "SSUData:", m_Session.GetFormattedSessionInfo(),
-              "SSU message has not been ACKed after ",
-              MAX_NUM_RESENDS, " attempts. Deleted");
-          it = m_SentMessages.erase(it);
-        }
-      } else {
+      auto& message = it->second;
+      if (ts < message->nextResendTime) {
         it++;
+        continue;
       }
+      // resend time is set again once the fragments are sent
+      message->nextResendTime = std::numeric_limits<uint64_t>::max();
+      auto& fragments = message->fragments;
+      bool isInFlight = false;
+      for (auto& fragment : fragments)
+        if (fragment && fragment->isInFlight)
+          isInFlight = true;
+      if (!isInFlight) {
+        it++;  // rest waits to be sent again
+      } else if (message->numResends < MAX_NUM_RESENDS) {
+        // unacknowledged fragments are packed again
+        for (std::size_t i = 0; i < fragments.size(); i++)
+          if (fragments[i] && fragments[i]->isInFlight)
+            Retransmit(it->first, message.get(), i);
+        message->numResends++;
+        isTimeout = true;
+        it++;
+      } else {
+        LogPrint(eLogError,
+            "SSUData:", m_Session.GetFormattedSessionInfo(),
+            "SSU message has not been ACKed after ",
+            MAX_NUM_RESENDS, " attempts. Deleted");
+        for (auto& fragment : fragments)
+          if (fragment && fragment->isInFlight)
+            m_BytesInFlight -= fragment->len;
+        it = m_SentMessages.erase(it);
+      }
+    }
+    if (isTimeout) {
+      m_CongestionControl->OnTimeout(ts);
+      m_Pacer.SetRate(m_CongestionControl->GetPacingRate());
     }
-    ScheduleResend();
+    Flush();
+    // arm for fragments still in flight from earlier flushes
+    uint64_t resendTime = std::numeric_limits<uint64_t>::max();
+    for (auto& it : m_SentMessages)
+      resendTime = std::min(resendTime, it.second->nextResendTime);
+    if (resendTime != std::numeric_limits<uint64_t>::max())
+      ScheduleResend(resendTime);
   }
 }
 
-void SSUData::ScheduleDecay() {
-  LogPrint(eLogDebug,
-      "SSUData:", m_Session.GetFormattedSessionInfo(),
-      "scheduling decay");
-  m_DecayTimer.cancel();
-  m_DecayTimer.expires_from_now(
-      boost::posix_time::seconds(
-        DECAY_INTERVAL));
-  auto s = m_Session.shared_from_this();
-  m_ResendTimer.async_wait(
-      [s](
-        const boost::system::error_code& ecode) {
-      s->m_Data.HandleDecayTimer(ecode);
-      });
-}
-
-void SSUData::HandleDecayTimer(
-    const boost::system::error_code& ecode) {
-  LogPrint(eLogDebug,
-      "SSUData:", m_Session.GetFormattedSessionInfo(),
-      "handling decay");
-  if (ecode != boost::asio::error::operation_aborted)
-    m_ReceivedMessages.clear();
-}
-
 void SSUData::ScheduleIncompleteMessagesCleanup() {
   LogPrint(eLogDebug,
       "SSUData:", m_Session.GetFormattedSessionInfo(),
@@ -595,7 +866,7 @@ void SSUData::HandleIncompleteMessagesCleanupTimer(
     uint32_t ts = i2p::util::GetSecondsSinceEpoch();
     for (auto it = m_IncompleteMessages.begin ();
         it != m_IncompleteMessages.end();) {
-      if (ts > it->second->lastFragmentInsertTime +
+      if (ts > it->second->GetLastFragmentInsertTime() +
           INCOMPLETE_MESSAGES_CLEANUP_TIMEOUT) {
         LogPrint(eLogError,
             "SSUData:", m_Session.GetFormattedSessionInfo(),
@@ -38,14 +38,18 @@
 #include <inttypes.h>
 #include <string.h>
 
+#include <bitset>
 #include <map>
 #include <memory>
-#include <set>
+#include <utility>
 #include <vector>
 
 #include "I2NPProtocol.h"
 #include "Identity.h"
 #include "RouterInfo.h"
+#include "SSUCongestion.h"
+#include "util/DuplicateFilter.h"
+#include "util/TokenBucket.h"
 
 namespace i2p {
 namespace transport {
@@ -63,12 +67,19 @@ const size_t SSU_V6_MAX_PACKET_SIZE =
   SSU_MTU_V6 -
   IPV6_HEADER_SIZE -
   UDP_HEADER_SIZE;  // Total: 1424
-const int RESEND_INTERVAL = 3;  // in seconds
 const int MAX_NUM_RESENDS = 5;
+// later fragments ACKed before a missing one is sent again
+const std::size_t SSU_FAST_RETRANSMIT_THRESHOLD = 3;
+// packets that may be sent back to back when pacing
+const std::size_t SSU_PACING_BURST = 4;
+// how long a generation of received msgIDs is kept for duplicates check
 const int DECAY_INTERVAL = 20;  // in seconds
-// how many msgID we store for duplicates check
-const int MAX_NUM_RECEIVED_MESSAGES = 1000;
 const int INCOMPLETE_MESSAGES_CLEANUP_TIMEOUT = 30;  // in seconds
+// counts of ACKs and fragments in a data packet are single bytes
+const size_t SSU_MAX_NUM_ACKS_PER_PACKET = 255;
+const size_t SSU_MAX_NUM_FRAGMENTS_PER_PACKET = 255;
+// fragment number has 7 bits
+const size_t SSU_MAX_NUM_FRAGMENTS_PER_MESSAGE = 128;
 // data flags
 const uint8_t DATA_FLAG_EXTENDED_DATA_INCLUDED = 0x02;
 const uint8_t DATA_FLAG_WANT_REPLY = 0x04;
@@ -82,6 +93,9 @@ struct Fragment {
   size_t len;
   bool isLast;
   uint8_t buf[SSU_V4_MAX_PACKET_SIZE + 18];  // use biggest
+  uint64_t sendTime;  // of the latest transmission, in milliseconds
+  int numSends;
+  bool isInFlight;  // sent and neither ACKed nor considered lost
   Fragment() = default;
   Fragment(
       int n,
@@ -90,40 +104,87 @@ struct Fragment {
       bool last)
       : fragmentNum(n),
         len(l),
-        isLast(last) {
+        isLast(last),
+        sendTime(0),
+        numSends(0),
+        isInFlight(false) {
           memcpy(buf, b, len);
         }
 };
 
-struct FragmentCmp {
-  bool operator() (
-      const std::unique_ptr<Fragment>& f1,
-      const std::unique_ptr<Fragment>& f2) const {
-    return f1->fragmentNum < f2->fragmentNum;
+/// @class IncompleteMessage
+/// @brief Message being reassembled from its fragments
+/// @details Every fragment but the last has the same size, so each one is
+///   written straight to its final offset in the message buffer and
+///   recorded in a bitmap. A last fragment arriving before that size is
+///   known is parked at the end of the buffer and moved once.
+class IncompleteMessage {
+ public:
+  IncompleteMessage(
+      std::shared_ptr<I2NPMessage> msg);
+
+  /// @brief Writes fragment data at its place in the message
+  /// @return False if the fragment does not fit this message
+  bool AddFragment(
+      std::size_t fragmentNum,
+      const uint8_t* fragment,
+      std::size_t fragmentSize,
+      bool isLast);
+
+  bool HasFragment(
+      std::size_t fragmentNum) const {
+    return m_ReceivedFragments.test(fragmentNum);
   }
-};
 
-struct IncompleteMessage {
-  std::shared_ptr<I2NPMessage> msg;
-  int nextFragmentNum;
-  uint32_t lastFragmentInsertTime;  // in seconds
-  std::set<std::unique_ptr<Fragment>, FragmentCmp> savedFragments;
+  bool IsComplete() const {
+    return m_LastFragmentNum >= 0 &&
+      m_ReceivedFragments.count() ==
+        static_cast<std::size_t>(m_LastFragmentNum + 1);
+  }
 
-  IncompleteMessage(
-      std::shared_ptr<I2NPMessage> m)
-      : msg(m),
-        nextFragmentNum(0),
-        lastFragmentInsertTime(0) {}
+  /// @return Reassembled message
+  /// @note Call once the message is complete
+  std::shared_ptr<I2NPMessage> GetMessage();
 
-  void AttachNextFragment(
-      const uint8_t* fragment,
-      size_t fragmentSize);
+  /// @brief Writes ACK bitfields of the received fragments
+  /// @return Number of bytes written, at most
+  ///   SSU_MAX_NUM_FRAGMENTS_PER_MESSAGE / 7 + 1
+  std::size_t FillAckBitfields(
+      uint8_t* buf) const;
+
+  uint32_t GetLastFragmentInsertTime() const {
+    return m_LastFragmentInsertTime;
+  }
+
+  void SetLastFragmentInsertTime(
+      uint32_t ts) {
+    m_LastFragmentInsertTime = ts;
+  }
+
+ private:
+  /// @brief Makes sure the buffer holds size bytes of fragment data,
+  ///   moving to a larger message if needed
+  bool Reserve(
+      std::size_t size);
+
+ private:
+  std::shared_ptr<I2NPMessage> m_Msg;
+  std::bitset<SSU_MAX_NUM_FRAGMENTS_PER_MESSAGE> m_ReceivedFragments;
+  std::size_t m_DataOffset;  // start of fragment data in message buffer
+  std::size_t m_FragmentSize;  // size of non-last fragments, 0 if unknown
+  int m_LastFragmentNum, m_MaxFragmentNum;  // -1 if none
+  std::size_t m_LastFragmentSize;
+  std::size_t m_ParkedOffset;  // last fragment waiting for m_FragmentSize
+  uint32_t m_LastFragmentInsertTime;  // in seconds
 };
 
 struct SentMessage {
+  // msgID, fragment info and data of each fragment, ready to be packed
   std::vector<std::unique_ptr<Fragment> > fragments;
-  uint32_t nextResendTime;  // in seconds
+  uint64_t nextResendTime;  // in milliseconds, max if nothing in flight
+  uint64_t lastSendTime;  // in milliseconds
   int numResends;
+  bool isRetransmitted;  // its ACK gives no RTT sample
 };
 
 class SSUSession;
@@ -149,13 +210,23 @@ class SSUData {
   void UpdatePacketSize(
       const i2p::data::IdentHash& remoteIdent);
 
+  const SSUCongestionControl& GetCongestionControl() const {
+    return *m_CongestionControl;
+  }
+
+  std::size_t GetBytesInFlight() const {
+    return m_BytesInFlight;
+  }
+
  private:
+  /// @brief Queues an explicit ACK for the next flush
   void SendMsgAck(
       uint32_t msgID);
 
+  /// @brief Acknowledges all fragments of message received so far
   void SendFragmentAck(
       uint32_t msgID,
-      int fragmentNum);
+      const IncompleteMessage& message);
 
   void ProcessAcks(
       uint8_t *& buf,
@@ -164,17 +235,38 @@ class SSUData {
   void ProcessFragments(
       uint8_t * buf);
 
+  /// @brief Drops an ACKed message
+  /// @param ackedBytes Incremented by bytes of the message still in flight
+  /// @param rtt Set to the RTT sample of the message, if it has one
   void ProcessSentMessageAck(
-      uint32_t msgID);
+      uint32_t msgID,
+      uint64_t ts,
+      std::size_t* ackedBytes,
+      uint64_t* rtt);
 
-  void ScheduleResend();
+  /// @brief Takes fragment out of flight and queues it to be sent again
+  void Retransmit(
+      uint32_t msgID,
+      SentMessage* message,
+      std::size_t fragmentNum);
 
-  void HandleResendTimer(
-      const boost::system::error_code& ecode);
+  /// @brief Flushes queued fragments and ACKs once the current
+  ///   event loop turn is done
+  void ScheduleFlush();
 
-  void ScheduleDecay();
+  /// @brief Packs queued ACKs and fragments of as many messages as fit
+  ///   into each packet and sends the packets
+  void Flush();
 
-  void HandleDecayTimer(
+  /// @brief Flushes once the pacer has tokens for a packet again
+  void SchedulePacing(
+      uint64_t delay);
+
+  /// @brief Arms the resend timer unless it expires before ts
+  void ScheduleResend(
+      uint64_t ts);
+
+  void HandleResendTimer(
       const boost::system::error_code& ecode);
 
   void ScheduleIncompleteMessagesCleanup();
@@ -189,9 +281,18 @@ class SSUData {
   SSUSession& m_Session;
   std::map<uint32_t, std::unique_ptr<IncompleteMessage> > m_IncompleteMessages;
   std::map<uint32_t, std::unique_ptr<SentMessage> > m_SentMessages;
-  std::set<uint32_t> m_ReceivedMessages;
+  i2p::util::DuplicateFilter m_ReceivedMessages;
+  // msgID and fragment number of fragments to send on flush
+  std::vector<std::pair<uint32_t, std::size_t> > m_PendingFragments;
+  std::vector<uint32_t> m_PendingAcks;
+  bool m_IsFlushScheduled;
+  std::unique_ptr<SSUCongestionControl> m_CongestionControl;
+  std::size_t m_BytesInFlight;
+  i2p::util::TokenBucket m_Pacer;
+  bool m_IsPacingScheduled;
+  uint64_t m_ResendTime;  // expiry of resend timer, 0 if not armed
   boost::asio::deadline_timer m_ResendTimer,
-                              m_DecayTimer,
+                              m_PacingTimer,
                               m_IncompleteMessagesCleanupTimer;
   int m_MaxPacketSize, m_PacketSize;
   i2p::I2NPMessagesHandler m_Handler;
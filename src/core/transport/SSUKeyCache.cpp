@@ -0,0 +1,119 @@
+/**
+ * Copyright (c) 2015-2016, The Kovri I2P Router Project
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ *    conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *    of conditions and the following disclaimer in the documentation and/or other
+ *    materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "SSUKeyCache.h"
+
+namespace i2p {
+namespace transport {
+
+SSUKeyCache::SSUKeyCache(
+    std::size_t capacity)
+    : m_Capacity(capacity ? capacity : 1),
+      m_NumHits(0),
+      m_NumMisses(0) {}
+
+SSUKeyCache::~SSUKeyCache() {}
+
+void SSUKeyCache::Encrypt(
+    const i2p::crypto::AESKey& key,
+    const std::uint8_t* iv,
+    const std::uint8_t* in,
+    std::size_t len,
+    std::uint8_t* out) {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  auto& entry = Get(key);
+  if (!entry.hasEncryption) {
+    entry.encryption.SetKey(key);
+    entry.hasEncryption = true;
+  }
+  entry.encryption.SetIV(iv);
+  entry.encryption.Encrypt(in, len, out);
+}
+
+void SSUKeyCache::Decrypt(
+    const i2p::crypto::AESKey& key,
+    const std::uint8_t* iv,
+    const std::uint8_t* in,
+    std::size_t len,
+    std::uint8_t* out) {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  auto& entry = Get(key);
+  if (!entry.hasDecryption) {
+    entry.decryption.SetKey(key);
+    entry.hasDecryption = true;
+  }
+  entry.decryption.SetIV(iv);
+  entry.decryption.Decrypt(in, len, out);
+}
+
+void SSUKeyCache::Clear() {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Index.clear();
+  m_Entries.clear();
+}
+
+std::size_t SSUKeyCache::GetSize() const {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_Entries.size();
+}
+
+std::uint64_t SSUKeyCache::GetNumHits() const {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_NumHits;
+}
+
+std::uint64_t SSUKeyCache::GetNumMisses() const {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_NumMisses;
+}
+
+SSUKeyCache::Entry& SSUKeyCache::Get(
+    const i2p::crypto::AESKey& key) {
+  auto it = m_Index.find(key);
+  if (it != m_Index.end()) {
+    m_NumHits++;
+    // move to front, iterators stay valid
+    m_Entries.splice(m_Entries.begin(), m_Entries, it->second);
+    return *it->second;
+  }
+  m_NumMisses++;
+  if (m_Entries.size() >= m_Capacity) {
+    m_Index.erase(m_Entries.back().key);
+    m_Entries.pop_back();
+  }
+  m_Entries.emplace_front();
+  auto& entry = m_Entries.front();
+  entry.key = key;
+  m_Index[key] = m_Entries.begin();
+  return entry;
+}
+
+}  // namespace transport
+}  // namespace i2p
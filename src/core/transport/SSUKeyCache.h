@@ -0,0 +1,131 @@
+/**
+ * Copyright (c) 2015-2016, The Kovri I2P Router Project
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ *    conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *    of conditions and the following disclaimer in the documentation and/or other
+ *    materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SRC_CORE_TRANSPORT_SSUKEYCACHE_H_
+#define SRC_CORE_TRANSPORT_SSUKEYCACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+#include "crypto/AES.h"
+
+namespace i2p {
+namespace transport {
+
+// intro keys of peers we handshake, relay or peer test with at one time
+const std::size_t SSU_KEY_CACHE_SIZE = 64;
+
+/// @class SSUKeyCache
+/// @brief AES-256 key schedules of the long-lived keys SSU uses outside
+///   of established sessions, i.e. intro keys (ours and peers') and the
+///   session keys of other sessions when relaying
+/// @details Keys are evicted least recently used first. Encryption and
+///   decryption schedules are expanded separately, on first use.
+///   Each SSU shard keeps its own, so the lock held across the CBC is
+///   normally taken by that shard's thread only.
+class SSUKeyCache {
+ public:
+  explicit SSUKeyCache(
+      std::size_t capacity = SSU_KEY_CACHE_SIZE);
+
+  ~SSUKeyCache();
+
+  /// @brief CBC-encrypts len bytes (a multiple of 16), in may equal out
+  void Encrypt(
+      const i2p::crypto::AESKey& key,
+      const std::uint8_t* iv,
+      const std::uint8_t* in,
+      std::size_t len,
+      std::uint8_t* out);
+
+  /// @brief CBC-decrypts len bytes (a multiple of 16), in may equal out
+  void Decrypt(
+      const i2p::crypto::AESKey& key,
+      const std::uint8_t* iv,
+      const std::uint8_t* in,
+      std::size_t len,
+      std::uint8_t* out);
+
+  void Clear();
+
+  std::size_t GetSize() const;
+
+  std::size_t GetCapacity() const {
+    return m_Capacity;
+  }
+
+  /// @return Number of lookups that found the key schedule cached
+  std::uint64_t GetNumHits() const;
+
+  /// @return Number of lookups that had to expand a key schedule
+  std::uint64_t GetNumMisses() const;
+
+ private:
+  struct Entry {
+    Entry()
+        : hasEncryption(false),
+          hasDecryption(false) {}
+    i2p::crypto::AESKey key;
+    i2p::crypto::CBCEncryption encryption;
+    i2p::crypto::CBCDecryption decryption;
+    bool hasEncryption, hasDecryption;
+  };
+
+  struct KeyHash {
+    std::size_t operator()(
+        const i2p::crypto::AESKey& key) const {
+      return static_cast<std::size_t>(key.GetLL()[0]);  // random bytes
+    }
+  };
+
+  /// @brief Finds the entry for key, creating it if missing, and marks it
+  ///   as most recently used
+  /// @note Caller must hold m_Mutex
+  Entry& Get(
+      const i2p::crypto::AESKey& key);
+
+ private:
+  std::size_t m_Capacity;
+  std::uint64_t m_NumHits, m_NumMisses;
+  mutable std::mutex m_Mutex;
+  std::list<Entry> m_Entries;  // most recently used first
+  std::unordered_map<
+      i2p::crypto::AESKey,
+      std::list<Entry>::iterator,
+      KeyHash> m_Index;
+};
+
+}  // namespace transport
+}  // namespace i2p
+
+#endif  // SRC_CORE_TRANSPORT_SSUKEYCACHE_H_
@@ -164,9 +164,7 @@ SSUSession::SSUSession(
 SSUSession::~SSUSession() {}
 
 boost::asio::io_service& SSUSession::GetService() {
-  return IsV6() ?
-    m_Server.GetServiceV6() :
-    m_Server.GetService();
+  return m_Server.GetService(m_RemoteEndpoint);
 }
 
 void SSUSession::CreateAESandMacKey(
@@ -205,6 +203,7 @@ void SSUSession::CreateAESandMacKey(
         nonZero,
         64 - (nonZero - sharedKey));
   }
+  m_MAC.SetKey(m_MacKey);
   m_IsSessionKey = true;
   m_SessionKeyEncryption.SetKey(m_SessionKey);
   m_SessionKeyDecryption.SetKey(m_SessionKey);
@@ -236,36 +235,40 @@ void SSUSession::ProcessNextMessage(
       return;  // ignore zero-length packets
     if (m_State == eSessionStateEstablished)
       ScheduleTermination();
-    if (m_IsSessionKey) {
-      if (Validate(buf, len, m_MacKey)) {  // try session key first
-        DecryptSessionKey(buf, len);
-      }
-    } else {
-      // try intro key depending on side
-      auto introKey = GetIntroKey();
-      if (introKey) {
-        if (Validate(buf, len, introKey)) {
-          Decrypt(buf, len, introKey);
-        }
-      } else {
-        // try own intro key
-        auto address = i2p::context.GetRouterInfo().GetSSUAddress();
-        if (!address) {
-          LogPrint(eLogError,
-              "SSUSession: ProcessNextMessage(): SSU is not supported");
-          return;
-        }
-        if (Validate(buf, len, address->key)) {
-          Decrypt(buf, len, address->key);
-        } else {
-          LogPrint(eLogError,
-              "SSUSession: MAC verification failed ",
-              len, " bytes from ", senderEndpoint);
-          m_Server.DeleteSession(shared_from_this());
-          return;
-        }
+    // candidate keys: session key first, then intro key depending on side
+    const i2p::crypto::HMACMD5* keys[2];
+    std::size_t numKeys = 0;
+    if (m_IsSessionKey)
+      keys[numKeys++] = &m_MAC;
+    auto introKey = GetIntroKey();
+    if (!introKey) {
+      // try own intro key
+      auto address = i2p::context.GetRouterInfo().GetSSUAddress();
+      if (address)
+        introKey = (const uint8_t *)address->key;
+      else if (!numKeys) {
+        LogPrint(eLogError,
+            "SSUSession: ProcessNextMessage(): SSU is not supported");
+        return;
       }
     }
+    if (introKey) {
+      m_IntroMAC.SetKey(introKey);
+      keys[numKeys++] = &m_IntroMAC;
+    }
+    int index = Validate(buf, len, keys, numKeys);
+    if (index < 0) {
+      LogPrint(eLogError,
+          "SSUSession: MAC verification failed ",
+          len, " bytes from ", senderEndpoint);
+      if (!m_IsSessionKey && !GetIntroKey())
+        m_Server.DeleteSession(shared_from_this());
+      return;
+    }
+    if (keys[index] == &m_MAC)
+      DecryptSessionKey(buf, len);
+    else
+      Decrypt(buf, len, introKey);
     // successfully decrypted
     ProcessDecryptedMessage(buf, len, senderEndpoint);
   }
@@ -1035,11 +1038,17 @@ void SSUSession::ProcessPeerTest(
           "PeerTest from Charlie. We are Bob");
       // session with Alice from PeerTest
       auto session = m_Server.GetPeerTestSession(nonce);
-      if (session && session->m_State == eSessionStateEstablished)
-        session->Send(  // back to Alice
-            PAYLOAD_TYPE_PEER_TEST,
-            buf,
-            len);
+      if (session && session->m_State == eSessionStateEstablished) {
+        // Alice's session may be run by another SSU thread
+        std::vector<uint8_t> payload(buf, buf + len);
+        session->GetService().post(
+            [session, payload]() {
+              session->Send(  // back to Alice
+                  PAYLOAD_TYPE_PEER_TEST,
+                  payload.data(),
+                  payload.size());
+            });
+      }
       m_Server.RemovePeerTest(nonce);  // nonce has been used
       break;
     }
@@ -1085,12 +1094,19 @@ void SSUSession::ProcessPeerTest(
                 nonce,
                 ePeerTestParticipantBob,
                 shared_from_this());
-            session->SendPeerTest(
-                nonce,
-                senderEndpoint.address().to_v4().to_ulong(),
-                senderEndpoint.port(),
-                introKey,
-                false);  // to Charlie with Alice's actual address
+            // Charlie's session may be run by another SSU thread
+            i2p::crypto::AESKey key(introKey);
+            uint32_t aliceAddress = senderEndpoint.address().to_v4().to_ulong();
+            uint16_t alicePort = senderEndpoint.port();
+            session->GetService().post(
+                [session, nonce, aliceAddress, alicePort, key]() {
+                  session->SendPeerTest(
+                      nonce,
+                      aliceAddress,
+                      alicePort,
+                      key(),
+                      false);  // to Charlie with Alice's actual address
+                });
           }
         }
       } else {
@@ -1247,19 +1263,29 @@ void SSUSession::FillHeaderAndEncrypt(
   pkt.PutTime(i2p::util::GetSecondsSinceEpoch());
   uint8_t* encrypted = pkt.Encrypted();
   uint16_t encryptedLen = len - (encrypted - buf);
-  i2p::crypto::CBCEncryption encryption(aesKey, iv);
-  encryption.Encrypt(
-      encrypted,
-      encryptedLen,
-      encrypted);
+  if (m_IsSessionKey && aesKey == m_SessionKey()) {
+    m_SessionKeyEncryption.SetIV(iv);
+    m_SessionKeyEncryption.Encrypt(
+        encrypted,
+        encryptedLen,
+        encrypted);
+  } else {
+    m_Server.GetKeyCache(m_RemoteEndpoint).Encrypt(
+        aesKey,
+        iv,
+        encrypted,
+        encryptedLen,
+        encrypted);
+  }
   // assume actual buffer size is 18 (16 + 2) bytes more
   memcpy(buf + len, iv, 16);
   htobe16buf(buf + len + 16, encryptedLen);
-  i2p::crypto::HMACMD5Digest(
-      encrypted,
-      encryptedLen + 18,
-      macKey,
-      pkt.MAC());
+  if (m_IsSessionKey && macKey == m_MacKey()) {
+    m_MAC.CalculateDigest(encrypted, encryptedLen + 18, pkt.MAC());
+  } else {
+    m_IntroMAC.SetKey(macKey);  // no-op for the usual intro key
+    m_IntroMAC.CalculateDigest(encrypted, encryptedLen + 18, pkt.MAC());
+  }
 }
 
 void SSUSession::FillHeaderAndEncrypt(
@@ -1286,10 +1312,9 @@ void SSUSession::FillHeaderAndEncrypt(
   // assume actual buffer size is 18 (16 + 2) bytes more
   memcpy(buf + len, pkt.IV(), 16);
   htobe16buf(buf + len + 16, encryptedLen);
-  i2p::crypto::HMACMD5Digest(
+  m_MAC.CalculateDigest(
       encrypted,
       encryptedLen + 18,
-      m_MacKey,
       pkt.MAC());
 }
 
@@ -1306,10 +1331,9 @@ void SSUSession::Decrypt(
   SSUSessionPacket pkt(buf, len);
   uint8_t* encrypted = pkt.Encrypted();
   uint16_t encryptedLen = len - (encrypted - buf);
-  i2p::crypto::CBCDecryption decryption;
-  decryption.SetKey(aesKey);
-  decryption.SetIV(pkt.IV());
-  decryption.Decrypt(
+  m_Server.GetKeyCache(m_RemoteEndpoint).Decrypt(
+      aesKey,
+      pkt.IV(),
       encrypted,
       encryptedLen,
       encrypted);
@@ -1336,15 +1360,16 @@ void SSUSession::DecryptSessionKey(
   }
 }
 
-bool SSUSession::Validate(
+int SSUSession::Validate(
     uint8_t* buf,
     size_t len,
-    const uint8_t* macKey) {
+    const i2p::crypto::HMACMD5* const* keys,
+    size_t numKeys) {
   if (len < SSU_HEADER_SIZE_MIN) {
     LogPrint(eLogError,
         "SSUSession:", GetFormattedSessionInfo(),
         "Validate(): unexpected SSU packet length ", len);
-    return false;
+    return -1;
   }
   SSUSessionPacket pkt(buf, len);
   uint8_t * encrypted = pkt.Encrypted();
@@ -1352,13 +1377,12 @@ bool SSUSession::Validate(
   // assume actual buffer size is 18 (16 + 2) bytes more
   memcpy(buf + len, pkt.IV(), 16);
   htobe16buf(buf + len + 16, encryptedLen);
-  uint8_t digest[16];
-  i2p::crypto::HMACMD5Digest(
+  return i2p::crypto::HMACMD5::VerifyAny(
+      keys,
+      numKeys,
       encrypted,
       encryptedLen + 18,
-      macKey,
-      digest);
-  return !memcmp(pkt.MAC(), digest, 16);
+      pkt.MAC());
 }
 
 void SSUSession::Connect() {
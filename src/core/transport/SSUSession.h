@@ -400,10 +400,13 @@ class SSUSession
       uint8_t* buf,
       size_t len);
 
-  bool Validate(
+  /// @brief Checks packet MAC against each of the keys in one pass
+  /// @return Index of the key that validates, -1 if none does
+  int Validate(
       uint8_t* buf,
       size_t len,
-      const uint8_t* macKey);
+      const i2p::crypto::HMACMD5* const* keys,
+      size_t numKeys);
 
   const uint8_t* GetIntroKey() const;
 
@@ -426,6 +429,8 @@ class SSUSession
   i2p::crypto::CBCDecryption m_SessionKeyDecryption;
   i2p::crypto::AESKey m_SessionKey;
   i2p::crypto::MACKey m_MacKey;
+  i2p::crypto::HMACMD5 m_MAC;  // keyed with m_MacKey
+  i2p::crypto::HMACMD5 m_IntroMAC;  // keyed with the last intro key used
   uint32_t m_CreationTime;  // seconds since epoch
   SSUData m_Data;
   std::unique_ptr<SignedData> m_SessionConfirmData;
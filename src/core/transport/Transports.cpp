@@ -44,6 +44,7 @@
 #include "crypto/DiffieHellman.h"
 #include "crypto/Rand.h"
 #include "util/Log.h"
+#include "util/Timestamp.h"
 
 namespace i2p {
 namespace transport {
@@ -144,7 +145,12 @@ Transports::Transports()
       m_OutBandwidth(0),
       m_LastInBandwidthUpdateBytes(0),
       m_LastOutBandwidthUpdateBytes(0),
-      m_LastBandwidthUpdateTime(0) {}
+      m_LastBandwidthUpdateTime(0),
+      m_BandwidthLimit(0),
+      m_NumSSUThreads(1),
+      m_SessionDuplicateFilterSize(SESSION_DUPLICATE_FILTER_SIZE),
+      m_DuplicateFilterFalsePositiveRate(
+          DUPLICATE_FILTER_FALSE_POSITIVE_RATE) {}
 
 Transports::~Transports() {
   Stop();
@@ -177,7 +183,8 @@ void Transports::Start() {
         i2p::data::RouterInfo::eTransportSSU && address.host.is_v4()) {
       if (!m_SSUServer) {
         LogPrint(eLogInfo, "Transports: UDP listening on port ", address.port);
-        m_SSUServer = std::make_unique<SSUServer>(address.port);
+        m_SSUServer =
+          std::make_unique<SSUServer>(address.port, m_NumSSUThreads);
         m_SSUServer->Start();
         DetectExternalIP();
       } else {
@@ -246,8 +253,39 @@ void Transports::UpdateBandwidth() {
   m_LastOutBandwidthUpdateBytes = m_TotalSentBytes;
 }
 
+std::uint32_t GetBandwidthClassLimit(
+    char bandwidthClass) {
+  switch (bandwidthClass) {
+    case 'K':
+      return 12 * 1024;
+    case 'L':
+      return LOW_BANDWIDTH_LIMIT;
+    case 'M':
+      return 64 * 1024;
+    case 'N':
+      return 128 * 1024;
+    case 'O':
+      return HIGH_BANDWIDTH_LIMIT;
+    case 'P':
+      return 2000 * 1024;
+    case 'X':
+      return 4000 * 1024;
+    default:
+      return 0;
+  }
+}
+
+std::uint32_t Transports::GetBandwidthLimit() const {
+  std::uint32_t limit = m_BandwidthLimit;
+  if (limit)
+    return limit;
+  return i2p::context.GetRouterInfo().IsHighBandwidth() ?
+    HIGH_BANDWIDTH_LIMIT :
+    LOW_BANDWIDTH_LIMIT;
+}
+
 bool Transports::IsBandwidthExceeded() const {
-  if (std::max(m_InBandwidth, m_OutBandwidth) > LOW_BANDWIDTH_LIMIT) {
+  if (std::max(m_InBandwidth, m_OutBandwidth) > GetBandwidthLimit()) {
     LogPrint(eLogDebug, "Transports: bandwidth has been exceeded");
     return true;
   }
@@ -613,6 +651,72 @@ std::shared_ptr<const i2p::data::RouterInfo> Transports::GetRandomPeer() const {
   return it->second.router;
 }
 
+void Transports::SetNumSSUThreads(
+    std::size_t num) {
+  if (m_IsRunning) {
+    LogPrint(eLogError,
+        "Transports: can't change number of SSU threads while running");
+    return;
+  }
+  m_NumSSUThreads = num;
+}
+
+void Transports::SetDuplicateFilterSize(
+    std::size_t session_size,
+    std::size_t router_size,
+    double false_positive_rate) {
+  if (m_IsRunning) {
+    LogPrint(eLogError,
+        "Transports: can't change duplicate filter size while running");
+    return;
+  }
+  m_SessionDuplicateFilterSize = session_size;
+  m_DuplicateFilterFalsePositiveRate = false_positive_rate;
+  // a shard sees its share of the msgIDs, at the same false-positive rate
+  std::size_t shard_size =
+    (router_size + ROUTER_DUPLICATE_FILTER_SHARDS - 1)
+    / ROUTER_DUPLICATE_FILTER_SHARDS;
+  for (auto& shard : m_DuplicateFilters) {
+    std::unique_lock<std::mutex> l(shard.mutex);
+    shard.filter = i2p::util::DuplicateFilter(
+        shard_size,
+        false_positive_rate,
+        ROUTER_DUPLICATE_FILTER_WINDOW);
+  }
+}
+
+bool Transports::IsDuplicateMessage(
+    const i2p::I2NPMessage& msg) {
+  // SSU carries expiration in seconds
+  std::uint64_t key =
+    (static_cast<std::uint64_t>(msg.GetMsgID()) << 32) |
+    ((msg.GetExpiration() / 1000) & 0xFFFFFFFF);
+  auto ts = i2p::util::GetSecondsSinceEpoch();
+  // msgIDs are random, so they spread evenly over the shards
+  auto& shard =
+    m_DuplicateFilters[msg.GetMsgID() % ROUTER_DUPLICATE_FILTER_SHARDS];
+  std::unique_lock<std::mutex> l(shard.mutex);
+  return shard.filter.IsDuplicate(key, ts);
+}
+
+std::uint64_t Transports::GetNumDuplicateMessages() const {
+  std::uint64_t num = 0;
+  for (const auto& shard : m_DuplicateFilters) {
+    std::unique_lock<std::mutex> l(shard.mutex);
+    num += shard.filter.GetNumHits();
+  }
+  return num;
+}
+
+double Transports::GetExpectedDuplicateFalsePositives() const {
+  double num = 0.0;
+  for (const auto& shard : m_DuplicateFilters) {
+    std::unique_lock<std::mutex> l(shard.mutex);
+    num += shard.filter.GetExpectedFalsePositives();
+  }
+  return num;
+}
+
 }  // namespace transport
 }  // namespace i2p
 
@@ -35,6 +35,7 @@
 
 #include <boost/asio.hpp>
 
+#include <array>
 #include <atomic>
 #include <condition_variable>
 #include <cstdint>
@@ -56,6 +57,7 @@
 #include "RouterInfo.h"
 #include "SSU.h"
 #include "TransportSession.h"
+#include "util/DuplicateFilter.h"
 
 #ifdef USE_UPNP
 #include "UPnP.h"
@@ -109,6 +111,22 @@ struct Peer {
 
 const std::size_t SESSION_CREATION_TIMEOUT = 10;  // in seconds
 const std::uint32_t LOW_BANDWIDTH_LIMIT = 32 * 1024;  // 32KBs
+const std::uint32_t HIGH_BANDWIDTH_LIMIT = 256 * 1024;  // 256KBs
+
+/// @return Upper bound of a bandwidth class (router caps K to X), in
+///   bytes per second, 0 if unknown. X has no upper bound and is taken
+///   as twice the bound of P.
+std::uint32_t GetBandwidthClassLimit(
+    char bandwidthClass);
+
+// msgIDs remembered per generation of the duplicate message filters
+const std::size_t SESSION_DUPLICATE_FILTER_SIZE = 1000;
+const std::size_t ROUTER_DUPLICATE_FILTER_SIZE = 20000;
+const double DUPLICATE_FILTER_FALSE_POSITIVE_RATE = 0.001;
+const std::uint64_t ROUTER_DUPLICATE_FILTER_WINDOW = 60;  // in seconds
+// Every NTCP and SSU thread checks each message it receives against the
+// router-wide filter, so it is split by msgID into shards with own locks
+const std::size_t ROUTER_DUPLICATE_FILTER_SHARDS = 16;
 
 class Transports {
  public:
@@ -176,6 +194,16 @@ class Transports {
     return m_OutBandwidth;
   }
 
+  /// @brief Sets the configured bandwidth, 0 to use the limit of the
+  ///   low or high bandwidth caps
+  void SetBandwidthLimit(
+      std::uint32_t limit) {
+    m_BandwidthLimit = limit;
+  }
+
+  /// @return Configured bandwidth, in bytes per second
+  std::uint32_t GetBandwidthLimit() const;
+
   bool IsBandwidthExceeded() const;
 
   std::size_t GetNumPeers() const {
@@ -184,6 +212,39 @@ class Transports {
 
   std::shared_ptr<const i2p::data::RouterInfo> GetRandomPeer() const;
 
+  /// @brief Sets number of SSU session threads and receiving sockets,
+  ///   must precede Start()
+  void SetNumSSUThreads(
+      std::size_t num);
+
+  /// @brief Sizes the duplicate message filters, must precede Start()
+  /// @param session_size msgIDs per generation of each SSU session filter
+  /// @param router_size msgIDs per generation of the router-wide filter
+  void SetDuplicateFilterSize(
+      std::size_t session_size,
+      std::size_t router_size,
+      double false_positive_rate);
+
+  std::size_t GetSessionDuplicateFilterSize() const {
+    return m_SessionDuplicateFilterSize;
+  }
+
+  double GetDuplicateFilterFalsePositiveRate() const {
+    return m_DuplicateFilterFalsePositiveRate;
+  }
+
+  /// @brief Router-wide check of a message received by any transport
+  /// @return True if message with the same msgID and expiration was
+  ///   received recently
+  bool IsDuplicateMessage(
+      const i2p::I2NPMessage& msg);
+
+  /// @return Number of messages dropped by the router-wide filter
+  std::uint64_t GetNumDuplicateMessages() const;
+
+  /// @return Estimated number of those that were not duplicates
+  double GetExpectedDuplicateFalsePositives() const;
+
   /// @return Log-formatted string of session info
   const std::string GetFormattedSessionInfo(
       std::shared_ptr<const i2p::data::RouterInfo>& router) {
@@ -253,6 +314,22 @@ class Transports {
   std::uint32_t m_InBandwidth, m_OutBandwidth;
   std::uint64_t m_LastInBandwidthUpdateBytes, m_LastOutBandwidthUpdateBytes;
   std::uint64_t m_LastBandwidthUpdateTime;
+  std::atomic<std::uint32_t> m_BandwidthLimit;
+
+  std::size_t m_NumSSUThreads;
+  std::size_t m_SessionDuplicateFilterSize;
+  double m_DuplicateFilterFalsePositiveRate;
+  struct DuplicateFilterShard {
+    DuplicateFilterShard()
+        : filter(
+              ROUTER_DUPLICATE_FILTER_SIZE / ROUTER_DUPLICATE_FILTER_SHARDS,
+              DUPLICATE_FILTER_FALSE_POSITIVE_RATE,
+              ROUTER_DUPLICATE_FILTER_WINDOW) {}
+    i2p::util::DuplicateFilter filter;
+    mutable std::mutex mutex;
+  };
+  std::array<DuplicateFilterShard, ROUTER_DUPLICATE_FILTER_SHARDS>
+    m_DuplicateFilters;
 
 #ifdef USE_UPNP
   UPnP m_UPnP;
@@ -0,0 +1,162 @@
+/**
+ * Copyright (c) 2015-2016, The Kovri I2P Router Project
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ *    conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *    of conditions and the following disclaimer in the documentation and/or other
+ *    materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "TransitAdmission.h"
+
+#include <algorithm>
+
+#include "crypto/Rand.h"
+#include "util/Log.h"
+
+namespace i2p {
+namespace tunnel {
+
+// A request costs a minute worth of tokens so the per second bucket
+// can refill at a per minute rate
+TransitAdmission::Peer::Peer(
+    std::uint64_t scale)
+    : requests(
+          TRANSIT_ADMISSION_PEER_RATE * scale,
+          TRANSIT_ADMISSION_PEER_BURST * scale * 60),
+      last_request(0) {}
+
+TransitAdmission::TransitAdmission()
+    : m_Accepts(
+          TRANSIT_ADMISSION_ACCEPT_RATE,
+          TRANSIT_ADMISSION_ACCEPT_BURST) {
+  for (auto& num : m_NumDecisions)
+    num = 0;
+}
+
+TransitDecision TransitAdmission::Admit(
+    const i2p::data::IdentHash& previousHop,
+    const TransitLoad& load,
+    std::uint64_t now) {
+  std::unique_lock<std::mutex> l(m_Mutex);
+  bool peer_limited = false;
+  if (!previousHop.IsZero()) {
+    // every request counts against the previous hop, accepted or not
+    std::uint64_t scale = GetPeerRateScale(load.bandwidthLimit);
+    auto& peer = m_Peers.emplace(previousHop, Peer(scale)).first->second;
+    if (peer.requests.GetRate() != TRANSIT_ADMISSION_PEER_RATE * scale) {
+      // bandwidth class changed
+      peer.requests.SetRate(TRANSIT_ADMISSION_PEER_RATE * scale);
+      peer.requests.SetBurst(TRANSIT_ADMISSION_PEER_BURST * scale * 60);
+    }
+    peer.last_request = now;
+    peer_limited = !peer.requests.TryConsume(60, now);
+  }
+  TransitDecision decision;
+  if (!load.acceptsTunnels)
+    decision = e_TransitRejectedNotAccepting;
+  else if (peer_limited)
+    decision = e_TransitRejectedPeerRate;
+  else if (load.maxNumTransitTunnels &&
+           IsOverloaded(
+               static_cast<double>(load.numTransitTunnels) /
+               load.maxNumTransitTunnels))
+    decision = e_TransitRejectedTunnelLimit;
+  else if (IsOverloaded(load.queueLoad))
+    decision = e_TransitRejectedQueue;
+  else if (load.bandwidthLimit &&
+           IsOverloaded(
+               static_cast<double>(load.bandwidth) / load.bandwidthLimit))
+    decision = e_TransitRejectedBandwidth;
+  else if (!m_Accepts.TryConsume(1, now))
+    decision = e_TransitRejectedAcceptRate;
+  else
+    decision = e_TransitAccepted;
+  l.unlock();
+  m_NumDecisions[decision]++;
+  if (decision != e_TransitAccepted)
+    LogPrint(eLogDebug,
+        "TransitAdmission: rejecting transit tunnel, ",
+        GetTransitDecisionName(decision));
+  return decision;
+}
+
+void TransitAdmission::CleanupPeers(
+    std::uint64_t now) {
+  std::unique_lock<std::mutex> l(m_Mutex);
+  for (auto it = m_Peers.begin(); it != m_Peers.end();) {
+    if (now > it->second.last_request + TRANSIT_ADMISSION_PEER_TIMEOUT)
+      it = m_Peers.erase(it);
+    else
+      it++;
+  }
+}
+
+std::size_t TransitAdmission::GetNumPeers() const {
+  std::unique_lock<std::mutex> l(m_Mutex);
+  return m_Peers.size();
+}
+
+std::uint64_t TransitAdmission::GetPeerRateScale(
+    std::uint32_t bandwidthLimit) {
+  return std::max<std::uint64_t>(
+      bandwidthLimit / TRANSIT_ADMISSION_PEER_BANDWIDTH,
+      1);
+}
+
+bool TransitAdmission::IsOverloaded(
+    double load) const {
+  if (load >= 1.0)
+    return true;
+  if (load <= TRANSIT_ADMISSION_SOFT_LOAD)
+    return false;
+  double probability =
+    (load - TRANSIT_ADMISSION_SOFT_LOAD) / (1.0 - TRANSIT_ADMISSION_SOFT_LOAD);
+  return i2p::crypto::Rand<std::uint32_t>() % 1000 < probability * 1000;
+}
+
+const char* GetTransitDecisionName(
+    TransitDecision decision) {
+  switch (decision) {
+    case e_TransitAccepted:
+      return "accepted";
+    case e_TransitRejectedNotAccepting:
+      return "notaccepting";
+    case e_TransitRejectedTunnelLimit:
+      return "tunnellimit";
+    case e_TransitRejectedPeerRate:
+      return "peerrate";
+    case e_TransitRejectedQueue:
+      return "queue";
+    case e_TransitRejectedBandwidth:
+      return "bandwidth";
+    case e_TransitRejectedAcceptRate:
+      return "acceptrate";
+    default:
+      return "unknown";
+  }
+}
+
+}  // namespace tunnel
+}  // namespace i2p
@@ -0,0 +1,156 @@
+/**
+ * Copyright (c) 2015-2016, The Kovri I2P Router Project
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ *    conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *    of conditions and the following disclaimer in the documentation and/or other
+ *    materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SRC_CORE_TUNNEL_TRANSITADMISSION_H_
+#define SRC_CORE_TUNNEL_TRANSITADMISSION_H_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+
+#include "Identity.h"
+#include "util/TokenBucket.h"
+
+namespace i2p {
+namespace tunnel {
+
+// Past this fraction of a limit requests are rejected with a probability
+// rising linearly to 1 at the limit, so load levels off instead of
+// overshooting and then rejecting everything
+const double TRANSIT_ADMISSION_SOFT_LOAD = 0.75;
+
+// Traffic of a new tunnel only shows up in the bandwidth some seconds
+// after accepting it, so accepts are also paced. The steady state rate
+// for the maximum number of transit tunnels is about 4 per second.
+const std::uint64_t TRANSIT_ADMISSION_ACCEPT_RATE = 8;  // per second
+const std::uint64_t TRANSIT_ADMISSION_ACCEPT_BURST = 40;
+
+// Requests from one previous hop, per TRANSIT_ADMISSION_PEER_BANDWIDTH
+// of our bandwidth limit: fast routers carry more tunnels, so their busy
+// neighbours (floodfills, routers with many tunnels) send more requests.
+// That is 30 per minute for the low and 240 for the high bandwidth class.
+const std::uint32_t TRANSIT_ADMISSION_PEER_BANDWIDTH = 32 * 1024;  // 32KBs
+const std::uint64_t TRANSIT_ADMISSION_PEER_RATE = 30;  // per minute
+const std::uint64_t TRANSIT_ADMISSION_PEER_BURST = 20;
+const std::uint64_t TRANSIT_ADMISSION_PEER_TIMEOUT = 600000;  // in ms
+
+/// @brief What the router is carrying when a build request arrives
+struct TransitLoad {
+  TransitLoad()
+      : acceptsTunnels(true),
+        numTransitTunnels(0),
+        maxNumTransitTunnels(0),
+        queueLoad(0.0),
+        bandwidth(0),
+        bandwidthLimit(0) {}
+
+  bool acceptsTunnels;
+  std::size_t numTransitTunnels, maxNumTransitTunnels;
+  double queueLoad;  // fill ratio of the fullest tunnel queue
+  std::uint32_t bandwidth, bandwidthLimit;  // in bytes per second
+};
+
+enum TransitDecision {
+  e_TransitAccepted = 0,
+  e_TransitRejectedNotAccepting,
+  e_TransitRejectedTunnelLimit,
+  e_TransitRejectedPeerRate,
+  e_TransitRejectedQueue,
+  e_TransitRejectedBandwidth,
+  e_TransitRejectedAcceptRate,
+  e_NumTransitDecisions
+};
+
+/// @class TransitAdmission
+/// @brief Decides whether to accept a transit tunnel from live load
+/// @details Rejects outright at the hard limits (transit tunnel count,
+///   tunnel queue full, bandwidth class exceeded), rejects with rising
+///   probability past TRANSIT_ADMISSION_SOFT_LOAD of a limit, and rate
+///   limits requests per previous hop, in proportion to the bandwidth
+///   limit, and accepts overall.
+///   Time is passed in by the caller, in milliseconds.
+/// @note Thread-safe
+class TransitAdmission {
+ public:
+  TransitAdmission();
+
+  /// @param previousHop Router the request came from, zero if unknown
+  TransitDecision Admit(
+      const i2p::data::IdentHash& previousHop,
+      const TransitLoad& load,
+      std::uint64_t now);
+
+  /// @brief Forgets previous hops not heard from for a while
+  void CleanupPeers(
+      std::uint64_t now);
+
+  std::uint64_t GetNumDecisions(
+      TransitDecision decision) const {
+    return m_NumDecisions.at(decision);
+  }
+
+  /// @return Number of previous hops being rate limited
+  std::size_t GetNumPeers() const;
+
+  /// @return Multiple of the per previous hop rate and burst allowed at
+  ///   this bandwidth limit (0 for no limit counts as one)
+  static std::uint64_t GetPeerRateScale(
+      std::uint32_t bandwidthLimit);
+
+ private:
+  /// @return True if a request should be rejected at this fraction of
+  ///   a limit
+  bool IsOverloaded(
+      double load) const;
+
+ private:
+  mutable std::mutex m_Mutex;
+  i2p::util::TokenBucket m_Accepts;
+  struct Peer {
+    explicit Peer(
+        std::uint64_t scale);
+    i2p::util::TokenBucket requests;
+    std::uint64_t last_request;
+  };
+  std::map<i2p::data::IdentHash, Peer> m_Peers;
+  std::array<std::atomic<std::uint64_t>, e_NumTransitDecisions>
+    m_NumDecisions;
+};
+
+/// @return Human readable name of the decision, for logs and I2PControl
+const char* GetTransitDecisionName(
+    TransitDecision decision);
+
+}  // namespace tunnel
+}  // namespace i2p
+
+#endif  // SRC_CORE_TUNNEL_TRANSITADMISSION_H_
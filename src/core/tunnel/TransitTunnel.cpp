@@ -34,12 +34,15 @@
 
 #include <string.h>
 
+#include <algorithm>
+
 #include "I2NPProtocol.h"
 #include "RouterContext.h"
 #include "Tunnel.h"
 #include "transport/Transports.h"
 #include "util/I2PEndian.h"
 #include "util/Log.h"
+#include "util/Timestamp.h"
 
 namespace i2p {
 namespace tunnel {
@@ -52,10 +55,50 @@ TransitTunnel::TransitTunnel(
     const uint8_t* ivKey)
     : m_TunnelID(receiveTunnelID),
       m_NextTunnelID(nextTunnelID),
-      m_NextIdent(nextIdent) {
+      m_NextIdent(nextIdent),
+      m_Bandwidth(TRANSIT_TUNNEL_MIN_RATE, TRANSIT_TUNNEL_MIN_RATE),
+      m_RateWindowStart(i2p::util::GetMillisecondsSinceEpoch()),
+      m_RateWindowBytes(0),
+      m_Rate(0),
+      m_NumDroppedBytes(0) {
   m_Encryption.SetKeys(layerKey, ivKey);
 }
 
+bool TransitTunnel::ConsumeBandwidth(
+    std::size_t len) {
+  auto now = i2p::util::GetMillisecondsSinceEpoch();
+  UpdateRate(now);
+  if (!m_Bandwidth.TryConsume(len, now) ||
+      !tunnels.ConsumeTransitBudget(m_TunnelID, len, now)) {
+    m_NumDroppedBytes += len;
+    tunnels.AddDroppedTransitBytes(len);
+    return false;
+  }
+  m_RateWindowBytes += len;
+  return true;
+}
+
+void TransitTunnel::UpdateRate(
+    std::uint64_t now) {
+  if (now < m_RateWindowStart + TRANSIT_TUNNEL_RATE_WINDOW)
+    return;
+  std::uint64_t rate = m_RateWindowBytes * 1000 / (now - m_RateWindowStart);
+  m_Rate = (3 * static_cast<std::uint64_t>(m_Rate) + rate) / 4;
+  m_RateWindowStart = now;
+  m_RateWindowBytes = 0;
+  // follow the observed rate with headroom, within our share of the
+  // budget, but never below the minimum a tunnel needs to be usable
+  std::uint64_t limit =
+    TRANSIT_TUNNEL_RATE_FACTOR * static_cast<std::uint64_t>(m_Rate);
+  std::uint64_t max_limit =
+    tunnels.GetTransitBudget() * TRANSIT_TUNNEL_MAX_SHARE;
+  if (max_limit && limit > max_limit)
+    limit = max_limit;
+  limit = std::max<std::uint64_t>(limit, TRANSIT_TUNNEL_MIN_RATE);
+  m_Bandwidth.SetRate(limit);
+  m_Bandwidth.SetBurst(limit);
+}
+
 void TransitTunnel::EncryptTunnelMsg(
     std::shared_ptr<const I2NPMessage> in,
     std::shared_ptr<I2NPMessage> out) {
@@ -64,21 +107,56 @@ void TransitTunnel::EncryptTunnelMsg(
       out->GetPayload() + 4);
 }
 
+void TransitTunnel::EncryptTunnelMsgs(
+    const std::vector<std::shared_ptr<I2NPMessage> >& msgs) {
+  std::vector<std::uint8_t*> payloads;
+  payloads.reserve(msgs.size());
+  for (auto msg : msgs)
+    payloads.push_back(msg->GetPayload() + 4);
+  m_Encryption.EncryptBatch(
+      payloads.size(),
+      payloads.data(),
+      payloads.data());
+}
+
+void TransitTunnel::EncryptTunnelMsgs(
+    const std::vector<std::shared_ptr<const I2NPMessage> >& in,
+    const std::vector<std::shared_ptr<I2NPMessage> >& out) {
+  std::vector<const std::uint8_t*> in_payloads;
+  std::vector<std::uint8_t*> out_payloads;
+  in_payloads.reserve(in.size());
+  out_payloads.reserve(out.size());
+  for (std::size_t i = 0; i < in.size(); i++) {
+    in_payloads.push_back(in[i]->GetPayload() + 4);
+    out_payloads.push_back(out[i]->GetPayload() + 4);
+  }
+  m_Encryption.EncryptBatch(
+      in_payloads.size(),
+      in_payloads.data(),
+      out_payloads.data());
+}
+
 TransitTunnelParticipant::~TransitTunnelParticipant() {}
 
 void TransitTunnelParticipant::HandleTunnelDataMsg(
     std::shared_ptr<const i2p::I2NPMessage> tunnelMsg) {
+  if (!ConsumeBandwidth(tunnelMsg->GetLength()))
+    return;
+  // Encrypted as a batch in FlushTunnelDataMsgs
   auto newMsg = CreateEmptyTunnelDataMsg();
-  EncryptTunnelMsg(tunnelMsg, newMsg);
   m_NumTransmittedBytes += tunnelMsg->GetLength();
   htobe32buf(newMsg->GetPayload(), GetNextTunnelID());
-  newMsg->FillI2NPMessageHeader(e_I2NPTunnelData);
+  m_ReceivedTunnelDataMsgs.push_back(tunnelMsg);
   m_TunnelDataMsgs.push_back(newMsg);
 }
 
 void TransitTunnelParticipant::FlushTunnelDataMsgs() {
   if (!m_TunnelDataMsgs.empty()) {
     auto num = m_TunnelDataMsgs.size();
+    EncryptTunnelMsgs(m_ReceivedTunnelDataMsgs, m_TunnelDataMsgs);
+    m_ReceivedTunnelDataMsgs.clear();
+    for (auto msg : m_TunnelDataMsgs)
+      msg->FillI2NPMessageHeader(e_I2NPTunnelData);
     if (num > 1)
       LogPrint(eLogDebug,
           "TransitTunnelParticipant: ", GetTunnelID(),
@@ -107,6 +185,8 @@ void TransitTunnel::HandleTunnelDataMsg(
 
 void TransitTunnelGateway::SendTunnelDataMsg(
     std::shared_ptr<i2p::I2NPMessage> msg) {
+  if (!ConsumeBandwidth(msg->GetLength()))
+    return;
   TunnelMessageBlock block;
   block.deliveryType = e_DeliveryTypeLocal;
   block.data = msg;
@@ -121,6 +201,8 @@ void TransitTunnelGateway::FlushTunnelDataMsgs() {
 
 void TransitTunnelEndpoint::HandleTunnelDataMsg(
     std::shared_ptr<const i2p::I2NPMessage> tunnelMsg) {
+  if (!ConsumeBandwidth(tunnelMsg->GetLength()))
+    return;
   auto newMsg = CreateEmptyTunnelDataMsg();
   EncryptTunnelMsg(tunnelMsg, newMsg);
   LogPrint(eLogDebug,
@@ -128,7 +210,7 @@ void TransitTunnelEndpoint::HandleTunnelDataMsg(
   m_Endpoint.HandleDecryptedTunnelDataMsg(newMsg);
 }
 
-TransitTunnel* CreateTransitTunnel(
+std::shared_ptr<TransitTunnel> CreateTransitTunnel(
     uint32_t receiveTunnelID,
     const uint8_t* nextIdent,
     uint32_t nextTunnelID,
@@ -139,7 +221,7 @@ TransitTunnel* CreateTransitTunnel(
   if (isEndpoint) {
     LogPrint(eLogInfo,
         "TransitTunnel: endpoint ", receiveTunnelID, " created");
-    return new TransitTunnelEndpoint(
+    return std::make_shared<TransitTunnelEndpoint>(
         receiveTunnelID,
         nextIdent,
         nextTunnelID,
@@ -148,7 +230,7 @@ TransitTunnel* CreateTransitTunnel(
   } else if (isGateway) {
     LogPrint(eLogInfo,
         "TransitTunnel: gateway: ", receiveTunnelID, " created");
-    return new TransitTunnelGateway(
+    return std::make_shared<TransitTunnelGateway>(
         receiveTunnelID,
         nextIdent,
         nextTunnelID,
@@ -157,7 +239,7 @@ TransitTunnel* CreateTransitTunnel(
   } else {
     LogPrint(eLogInfo,
         "TransitTunnel: ", receiveTunnelID, "->", nextTunnelID, " created");
-    return new TransitTunnelParticipant(
+    return std::make_shared<TransitTunnelParticipant>(
         receiveTunnelID,
         nextIdent,
         nextTunnelID,
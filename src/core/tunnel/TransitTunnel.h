@@ -35,6 +35,8 @@
 
 #include <inttypes.h>
 
+#include <atomic>
+#include <cstdint>
 #include <memory>
 #include <mutex>
 #include <vector>
@@ -44,11 +46,32 @@
 #include "TunnelEndpoint.h"
 #include "TunnelGateway.h"
 #include "crypto/Tunnel.h"
+#include "util/TokenBucket.h"
 
 namespace i2p {
 namespace tunnel {
 
-class TransitTunnel : public TunnelBase {
+// Rate a transit tunnel may always use, so new tunnels can ramp up
+const std::uint32_t TRANSIT_TUNNEL_MIN_RATE = 16 * 1024;  // bytes per second
+
+// Headroom over the observed rate before traffic is dropped
+const std::uint32_t TRANSIT_TUNNEL_RATE_FACTOR = 2;
+
+// Most of the transit budget a single tunnel may use
+const double TRANSIT_TUNNEL_MAX_SHARE = 0.25;
+
+const std::uint64_t TRANSIT_TUNNEL_RATE_WINDOW = 1000;  // in milliseconds
+
+/// @class TransitTunnel
+/// @brief Tunnel we take part in for other routers
+/// @details Bandwidth is limited per tunnel by a token bucket following
+///   its observed rate, and overall by the transit budget of Tunnels.
+///   Traffic over the limits is dropped before it is encrypted.
+///   All traffic of a tunnel is handled by the data plane thread owning
+///   its ID, so only the counters are read by other threads.
+class TransitTunnel
+    : public TunnelBase,
+      public std::enable_shared_from_this<TransitTunnel> {
  public:
   TransitTunnel(
       uint32_t receiveTunnelID,
@@ -76,6 +99,9 @@ class TransitTunnel : public TunnelBase {
       std::shared_ptr<const I2NPMessage> in,
       std::shared_ptr<I2NPMessage> out);
 
+  void EncryptTunnelMsgs(
+      const std::vector<std::shared_ptr<I2NPMessage> >& msgs);
+
   uint32_t GetNextTunnelID() const {
     return m_NextTunnelID;
   }
@@ -84,11 +110,39 @@ class TransitTunnel : public TunnelBase {
     return m_NextIdent;
   }
 
+  /// @return Moving average of the accepted traffic, in bytes per second
+  std::uint32_t GetRate() const {
+    return m_Rate;
+  }
+
+  std::uint64_t GetNumDroppedBytes() const {
+    return m_NumDroppedBytes;
+  }
+
+ protected:
+  /// @brief Charges a message to this tunnel and the transit budget
+  /// @return False if the message is over the limits and must be dropped
+  bool ConsumeBandwidth(
+      std::size_t len);
+
+  /// @brief Encrypts in[i] into out[i], as one batch
+  void EncryptTunnelMsgs(
+      const std::vector<std::shared_ptr<const I2NPMessage> >& in,
+      const std::vector<std::shared_ptr<I2NPMessage> >& out);
+
+ private:
+  void UpdateRate(
+      std::uint64_t now);
+
  private:
   uint32_t m_TunnelID,
            m_NextTunnelID;
   i2p::data::IdentHash m_NextIdent;
   i2p::crypto::TunnelEncryption m_Encryption;
+  i2p::util::TokenBucket m_Bandwidth;
+  std::uint64_t m_RateWindowStart, m_RateWindowBytes;
+  std::atomic<std::uint32_t> m_Rate;
+  std::atomic<std::uint64_t> m_NumDroppedBytes;
 };
 
 class TransitTunnelParticipant : public TransitTunnel {
@@ -119,6 +173,9 @@ class TransitTunnelParticipant : public TransitTunnel {
 
  private:
   size_t m_NumTransmittedBytes;
+  // Received messages, encrypted into m_TunnelDataMsgs as a batch on flush
+  std::vector<std::shared_ptr<const i2p::I2NPMessage> >
+    m_ReceivedTunnelDataMsgs;
   std::vector<std::shared_ptr<i2p::I2NPMessage> > m_TunnelDataMsgs;
 };
 
@@ -179,7 +236,7 @@ class TransitTunnelEndpoint : public TransitTunnel {
   TunnelEndpoint m_Endpoint;
 };
 
-TransitTunnel* CreateTransitTunnel(
+std::shared_ptr<TransitTunnel> CreateTransitTunnel(
     uint32_t receiveTunnelID,
     const uint8_t* nextIdent,
     uint32_t nextTunnelID,
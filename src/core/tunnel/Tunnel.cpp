@@ -38,6 +38,7 @@
 #include <map>
 #include <memory>
 #include <thread>
+#include <utility>
 #include <vector>
 
 #include "crypto/Rand.h"
@@ -192,6 +193,23 @@ void Tunnel::EncryptTunnelMsg(
   }
 }
 
+void Tunnel::EncryptTunnelMsgs(
+    const std::vector<std::shared_ptr<I2NPMessage> >& msgs) {
+  std::vector<std::uint8_t*> payloads;
+  payloads.reserve(msgs.size());
+  for (auto msg : msgs)
+    payloads.push_back(msg->GetPayload() + 4);
+  // Hop by hop over the whole batch rather than message by message
+  TunnelHopConfig* hop = m_Config->GetLastHop();
+  while (hop) {
+    hop->decryption.DecryptBatch(
+        payloads.size(),
+        payloads.data(),
+        payloads.data());
+    hop = hop->prev;
+  }
+}
+
 void Tunnel::SendTunnelDataMsg(
     std::shared_ptr<i2p::I2NPMessage>) {
   // TODO(unassigned): review for missing code
@@ -251,29 +269,63 @@ Tunnels tunnels;
 Tunnels::Tunnels()
     : m_IsRunning(false),
       m_Thread(nullptr),
+      m_InboundTunnels(m_TunnelEpoch),
+      m_TransitTunnels(m_TunnelEpoch),
+      m_TransitTimers(i2p::util::GetSecondsSinceEpoch()),
+      m_TunnelTimers(i2p::util::GetSecondsSinceEpoch()),
+      m_Queue(TUNNEL_CONTROL_QUEUE_CAPACITY),
+      m_BuildPipeline(
+          [](std::shared_ptr<I2NPMessage> msg) {
+            return HandleTunnelBuildRequest(
+                msg->fromIdent,
+                msg->GetTypeID(),
+                msg->GetPayload(),
+                msg->GetPayloadLength());
+          }),
+      m_TransitBudget(0),
+      m_NumDroppedTransitBytes(0),
       m_NumSuccesiveTunnelCreations(0),
-      m_NumFailedTunnelCreations(0) {}
+      m_NumFailedTunnelCreations(0) {
+  SetNumDataThreads(1);
+}
 
 Tunnels::~Tunnels() {
-  for (auto& it : m_TransitTunnels)
-    delete it.second;
-  m_TransitTunnels.clear();
+  m_TransitTunnels.Clear();
+}
+
+void Tunnels::SetNumDataThreads(
+    std::size_t num) {
+  if (m_IsRunning) {
+    LogPrint(eLogError,
+        "Tunnels: can't change number of data threads while running");
+    return;
+  }
+  if (!num)
+    num = 1;
+  m_DataQueues.clear();
+  m_TransitBudgets.clear();
+  for (std::size_t i = 0; i < num; i++) {
+    m_DataQueues.push_back(
+        std::make_unique<
+          i2p::util::MPSCQueue<std::shared_ptr<I2NPMessage> > >());
+    m_TransitBudgets.push_back(
+        std::make_unique<i2p::util::TokenBucket>(0, 0));  // no limit
+  }
+}
+
+void Tunnels::SetNumBuildThreads(
+    std::size_t num) {
+  m_BuildPipeline.SetNumThreads(num);
 }
 
 std::shared_ptr<InboundTunnel> Tunnels::GetInboundTunnel(
     uint32_t tunnelID) {
-  auto it = m_InboundTunnels.find(tunnelID);
-  if (it != m_InboundTunnels.end())
-    return it->second;
-  return nullptr;
+  return m_InboundTunnels.Get(tunnelID);
 }
 
-TransitTunnel* Tunnels::GetTransitTunnel(
+std::shared_ptr<TransitTunnel> Tunnels::GetTransitTunnel(
     uint32_t tunnelID) {
-  auto it = m_TransitTunnels.find(tunnelID);
-  if (it != m_TransitTunnels.end())
-    return it->second;
-  return nullptr;
+  return m_TransitTunnels.Get(tunnelID);
 }
 
 std::shared_ptr<InboundTunnel> Tunnels::GetPendingInboundTunnel(
@@ -307,12 +359,12 @@ std::shared_ptr<TTunnel> Tunnels::GetPendingTunnel(
 std::shared_ptr<InboundTunnel> Tunnels::GetNextInboundTunnel() {
   std::shared_ptr<InboundTunnel> tunnel;
   size_t minReceived = 0;
-  for (auto it : m_InboundTunnels) {
-    if (!it.second->IsEstablished ())
+  for (const auto& it : m_InboundTunnels.GetValues()) {
+    if (!it->IsEstablished ())
       continue;
-    if (!tunnel || it.second->GetNumReceivedBytes() < minReceived) {
-      tunnel = it.second;
-      minReceived = it.second->GetNumReceivedBytes();
+    if (!tunnel || it->GetNumReceivedBytes() < minReceived) {
+      tunnel = it;
+      minReceived = it->GetNumReceivedBytes();
     }
   }
   return tunnel;
@@ -372,30 +424,47 @@ void Tunnels::StopTunnelPool(
 }
 
 void Tunnels::AddTransitTunnel(
-    TransitTunnel* tunnel) {
-  std::unique_lock<std::mutex> l(m_TransitTunnelsMutex);
-  if (!m_TransitTunnels.insert(
-        std::make_pair(
-          tunnel->GetTunnelID(),
-          tunnel)).second) {
+    std::shared_ptr<TransitTunnel> tunnel) {
+  std::unique_lock<std::mutex> l(m_TransitTimersMutex);
+  if (!m_TransitTunnels.Insert(tunnel->GetTunnelID(), tunnel)) {
     LogPrint(eLogError,
         "Tunnels: transit tunnel ", tunnel->GetTunnelID(), " already exists");
-    delete tunnel;
+    return;
   }
+  m_TransitTimers.Schedule(
+      tunnel->GetCreationTime() + TUNNEL_EXPIRATION_TIMEOUT + 1,
+      tunnel->GetTunnelID());
 }
 
 void Tunnels::Start() {
+  UpdateTransitBudget();
   m_IsRunning = true;
   m_Thread =
     std::make_unique<std::thread>(
         std::bind(
           &Tunnels::Run,
           this));
+  for (std::size_t i = 0; i < m_DataQueues.size(); i++)
+    m_DataThreads.push_back(
+        std::make_unique<std::thread>(
+            std::bind(
+              &Tunnels::RunDataShard,
+              this,
+              i)));
+  LogPrint(eLogInfo,
+      "Tunnels: started ", m_DataThreads.size(), " data plane thread(s)");
+  m_BuildPipeline.Start();
 }
 
 void Tunnels::Stop() {
+  m_BuildPipeline.Stop();
   m_IsRunning = false;
   m_Queue.WakeUp();
+  for (auto& queue : m_DataQueues)
+    queue->WakeUp();
+  for (auto& thread : m_DataThreads)
+    thread->join();
+  m_DataThreads.clear();
   if (m_Thread) {
     m_Thread->join();
     m_Thread.reset(nullptr);
@@ -409,58 +478,32 @@ void Tunnels::Run() {
   while (m_IsRunning) {
     try {
       auto msg = m_Queue.GetNextWithTimeout(1000);  // 1 sec
-      if (msg) {
-        uint32_t prevTunnelID = 0,
-                 tunnelID = 0;
-        TunnelBase* prevTunnel = nullptr;
-        do {
-          TunnelBase* tunnel = nullptr;
-          uint8_t typeID = msg->GetTypeID();
-          switch (typeID) {
-            case e_I2NPTunnelData:
-            case e_I2NPTunnelGateway: {
-              tunnelID = bufbe32toh(msg->GetPayload());
-              if (tunnelID == prevTunnelID)
-                tunnel = prevTunnel;
-              else if (prevTunnel)
-                prevTunnel->FlushTunnelDataMsgs();
-              if (!tunnel && typeID == e_I2NPTunnelData)
-                tunnel = GetInboundTunnel(tunnelID).get();
-              if (!tunnel)
-                tunnel = GetTransitTunnel(tunnelID);
-              if (tunnel) {
-                if (typeID == e_I2NPTunnelData)
-                  tunnel->HandleTunnelDataMsg(msg);
-                else  // tunnel gateway assumed
-                  HandleTunnelGatewayMsg(tunnel, msg);
-              } else {
-                LogPrint(eLogWarn,
-                    "Tunnels: tunnel ", tunnelID, " not found");
-              }
-              break;
-            }
-            case e_I2NPVariableTunnelBuild:
-            case e_I2NPVariableTunnelBuildReply:
-            case e_I2NPTunnelBuild:
-            case e_I2NPTunnelBuildReply:
+      while (msg) {
+        uint8_t typeID = msg->GetTypeID();
+        switch (typeID) {
+          case e_I2NPVariableTunnelBuild:
+            // inbound tunnels we build get their reply as a build message
+            if (m_PendingInboundTunnels.count(msg->GetMsgID()))
               HandleI2NPMessage(msg->GetBuffer(), msg->GetLength());
-            break;
-            default:
-              LogPrint(eLogError,
-                  "Tunnels: unexpected messsage type ",
-                  static_cast<int>(typeID));
-          }
-          msg = m_Queue.Get();
-          if (msg) {
-            prevTunnelID = tunnelID;
-            prevTunnel = tunnel;
-          } else if (tunnel) {
-            tunnel->FlushTunnelDataMsgs();
-          }
+            else
+              m_BuildPipeline.Put(msg);
+          break;
+          case e_I2NPTunnelBuild:
+            m_BuildPipeline.Put(msg);
+          break;
+          case e_I2NPVariableTunnelBuildReply:
+          case e_I2NPTunnelBuildReply:
+            HandleI2NPMessage(msg->GetBuffer(), msg->GetLength());
+          break;
+          default:
+            LogPrint(eLogError,
+                "Tunnels: unexpected messsage type ",
+                static_cast<int>(typeID));
         }
-        while (msg);
+        msg = m_Queue.Get();
       }
       uint64_t ts = i2p::util::GetSecondsSinceEpoch();
+      HandleTunnelTimers(ts);
       if (ts - lastTs >= 15) {  // manage tunnels every 15 seconds
         ManageTunnels();
         lastTs = ts;
@@ -471,6 +514,61 @@ void Tunnels::Run() {
   }
 }
 
+void Tunnels::RunDataShard(
+    std::size_t shard) {
+  auto& queue = *m_DataQueues[shard];
+  std::vector<std::shared_ptr<I2NPMessage> > msgs;
+  msgs.reserve(TUNNEL_DATA_BATCH_SIZE);
+  while (m_IsRunning) {
+    try {
+      msgs.clear();
+      queue.GetBatchWithTimeout(msgs, TUNNEL_DATA_BATCH_SIZE, 1000);  // 1 sec
+      if (msgs.empty())
+        continue;
+      // tunnels found stay alive until the whole batch is handled,
+      // even if the control thread removes them meanwhile
+      i2p::util::EpochDomain::Guard guard(m_TunnelEpoch);
+      uint32_t prevTunnelID = 0;
+      TunnelBase* prevTunnel = nullptr;
+      for (auto& msg : msgs) {
+        TunnelBase* tunnel = nullptr;
+        uint8_t typeID = msg->GetTypeID();
+        uint32_t tunnelID = bufbe32toh(msg->GetPayload());
+        if (tunnelID == prevTunnelID)
+          tunnel = prevTunnel;
+        else if (prevTunnel)
+          prevTunnel->FlushTunnelDataMsgs();
+        if (!tunnel && typeID == e_I2NPTunnelData)
+          tunnel = m_InboundTunnels.Find(tunnelID);
+        if (!tunnel)
+          tunnel = m_TransitTunnels.Find(tunnelID);
+        if (tunnel) {
+          if (typeID == e_I2NPTunnelData)
+            tunnel->HandleTunnelDataMsg(msg);
+          else  // tunnel gateway assumed
+            HandleTunnelGatewayMsg(tunnel, msg);
+        } else {
+          LogPrint(eLogWarn,
+              "Tunnels: tunnel ", tunnelID, " not found");
+        }
+        prevTunnelID = tunnelID;
+        prevTunnel = tunnel;
+      }
+      if (prevTunnel)
+        prevTunnel->FlushTunnelDataMsgs();
+    } catch (std::exception& ex) {
+      LogPrint("Tunnels::RunDataShard() exception: ", ex.what());
+    }
+  }
+}
+
+std::size_t Tunnels::GetDataShard(
+    std::shared_ptr<const I2NPMessage> msg) const {
+  // tunnel IDs are random, so messages of a tunnel always go to the same
+  // thread and tunnels spread evenly
+  return bufbe32toh(msg->GetPayload()) % m_DataQueues.size();
+}
+
 void Tunnels::HandleTunnelGatewayMsg(
     TunnelBase* tunnel,
     std::shared_ptr<I2NPMessage> msg) {
@@ -496,96 +594,191 @@ void Tunnels::HandleTunnelGatewayMsg(
 }
 
 void Tunnels::ManageTunnels() {
-  ManagePendingTunnels();
   ManageInboundTunnels();
   ManageOutboundTunnels();
   ManageTransitTunnels();
   ManageTunnelPools();
+  // free tunnels removed while data plane threads still held them
+  m_TunnelEpoch.Reclaim();
 }
 
-void Tunnels::ManagePendingTunnels() {
-  ManagePendingTunnels(m_PendingInboundTunnels);
-  ManagePendingTunnels(m_PendingOutboundTunnels);
+void Tunnels::HandleTunnelTimers(
+    uint64_t ts) {
+  ExpireTransitTunnels(ts);
+  std::vector<TunnelTimer> timers;
+  m_TunnelTimers.Advance(ts, timers);
+  for (const auto& timer : timers)
+    HandleTunnelTimer(timer, ts);
+}
+
+void Tunnels::HandleTunnelTimer(
+    const TunnelTimer& timer,
+    uint64_t ts) {
+  if (timer.type == e_TunnelTimerBuildTimeout) {
+    if (timer.isInbound)
+      HandleBuildTimeout(m_PendingInboundTunnels, timer, ts);
+    else
+      HandleBuildTimeout(m_PendingOutboundTunnels, timer, ts);
+    return;
+  }
+  auto tunnel = timer.tunnel.lock();
+  if (!tunnel)
+    return;
+  switch (timer.type) {
+    case e_TunnelTimerRecreate:
+      if (tunnel->IsRecreated())
+        break;
+      if (!tunnel->IsEstablished()) {
+        // may be established again by a tunnel test
+        if (ts + TUNNEL_TIMER_RETRY <=
+            tunnel->GetCreationTime() + TUNNEL_EXPIRATION_TIMEOUT)
+          m_TunnelTimers.Schedule(ts + TUNNEL_TIMER_RETRY, timer);
+        break;
+      }
+      tunnel->SetIsRecreated();
+      if (tunnel->GetTunnelPool()) {
+        if (timer.isInbound)
+          tunnel->GetTunnelPool()->RecreateInboundTunnel(
+              std::static_pointer_cast<InboundTunnel>(tunnel));
+        else
+          tunnel->GetTunnelPool()->RecreateOutboundTunnel(
+              std::static_pointer_cast<OutboundTunnel>(tunnel));
+      }
+    break;
+    case e_TunnelTimerExpiring:
+      if (!tunnel->IsEstablished()) {
+        if (ts + TUNNEL_TIMER_RETRY <=
+            tunnel->GetCreationTime() + TUNNEL_EXPIRATION_TIMEOUT)
+          m_TunnelTimers.Schedule(ts + TUNNEL_TIMER_RETRY, timer);
+        break;
+      }
+      tunnel->SetState(e_TunnelStateExpiring);
+    break;
+    case e_TunnelTimerExpire:
+      RemoveExpiredTunnel(tunnel, timer.isInbound);
+    break;
+    default:
+    break;
+  }
 }
 
 template<class PendingTunnels>
-void Tunnels::ManagePendingTunnels(
-    PendingTunnels& pendingTunnels) {
-  // check pending tunnel. delete failed or timeout
-  uint64_t ts = i2p::util::GetSecondsSinceEpoch();
-  for (auto it = pendingTunnels.begin(); it != pendingTunnels.end();) {
-    auto tunnel = it->second;
-    switch (tunnel->GetState()) {
-      case e_TunnelStatePending:
-        if (ts > tunnel->GetCreationTime() + TUNNEL_CREATION_TIMEOUT) {
-          LogPrint(eLogInfo,
-              "Tunnels: pending tunnel build request ",
-              it->first, " timeout. Deleted");
-          // update stats
-          auto config = tunnel->GetTunnelConfig();
-          if (config) {
-            auto hop = config->GetFirstHop();
-            while (hop) {
-              if (hop->router)
-                hop->router->GetProfile()->TunnelNonReplied();
-              hop = hop->next;
-            }
-          }
-          // delete
-          it = pendingTunnels.erase(it);
-          m_NumFailedTunnelCreations++;
-        } else {
-          it++;
+void Tunnels::HandleBuildTimeout(
+    PendingTunnels& pendingTunnels,
+    const TunnelTimer& timer,
+    uint64_t ts) {
+  auto it = pendingTunnels.find(timer.replyMsgID);
+  if (it == pendingTunnels.end())
+    return;
+  auto tunnel = it->second;
+  switch (tunnel->GetState()) {
+    case e_TunnelStatePending: {
+      LogPrint(eLogInfo,
+          "Tunnels: pending tunnel build request ",
+          it->first, " timeout. Deleted");
+      // update stats
+      auto config = tunnel->GetTunnelConfig();
+      if (config) {
+        auto hop = config->GetFirstHop();
+        while (hop) {
+          if (hop->router)
+            hop->router->GetProfile()->TunnelNonReplied();
+          hop = hop->next;
         }
+      }
+      // delete
+      pendingTunnels.erase(it);
+      m_NumFailedTunnelCreations++;
       break;
-      case e_TunnelStateBuildFailed:
-        LogPrint(eLogInfo,
-            "Tunnels: pending tunnel build request ",
-            it->first, " failed. Deleted");
-        it = pendingTunnels.erase(it);
-        m_NumFailedTunnelCreations++;
-      break;
-      case e_TunnelStateBuildReplyReceived:
-        // intermediate state, will be either established of build failed
-        it++;
-      break;
-      default:
-        // success
-        it = pendingTunnels.erase(it);
-        m_NumSuccesiveTunnelCreations++;
     }
+    case e_TunnelStateBuildFailed:
+      LogPrint(eLogInfo,
+          "Tunnels: pending tunnel build request ",
+          it->first, " failed. Deleted");
+      pendingTunnels.erase(it);
+      m_NumFailedTunnelCreations++;
+    break;
+    case e_TunnelStateBuildReplyReceived:
+      // intermediate state, will be either established of build failed
+      m_TunnelTimers.Schedule(ts + 1, timer);
+    break;
+    default:
+      // success
+      pendingTunnels.erase(it);
+      m_NumSuccesiveTunnelCreations++;
   }
 }
 
-void Tunnels::ManageOutboundTunnels() {
-  uint64_t ts = i2p::util::GetSecondsSinceEpoch(); {
-    for (auto it = m_OutboundTunnels.begin(); it != m_OutboundTunnels.end();) {
-      auto tunnel = *it;
-      if (ts > tunnel->GetCreationTime() + TUNNEL_EXPIRATION_TIMEOUT) {
-        LogPrint(eLogInfo,
-            "Tunnels: tunnel ", tunnel->GetTunnelID(), " expired");
-        auto pool = tunnel->GetTunnelPool();
-        if (pool)
-          pool->TunnelExpired(tunnel);
-        it = m_OutboundTunnels.erase(it);
-      } else {
-        if (tunnel->IsEstablished()) {
-          if (!tunnel->IsRecreated () &&
-              ts + TUNNEL_RECREATION_THRESHOLD >
-              tunnel->GetCreationTime() + TUNNEL_EXPIRATION_TIMEOUT) {
-            tunnel->SetIsRecreated();
-            auto pool = tunnel->GetTunnelPool();
-            if (pool)
-              pool->RecreateOutboundTunnel(tunnel);
-          }
-          if (ts + TUNNEL_EXPIRATION_THRESHOLD >
-              tunnel->GetCreationTime() + TUNNEL_EXPIRATION_TIMEOUT)
-            tunnel->SetState(e_TunnelStateExpiring);
-        }
-        it++;
-      }
-    }
+void Tunnels::ScheduleTunnelTimers(
+    std::shared_ptr<Tunnel> tunnel,
+    bool isInbound) {
+  // same deadlines as the periodic checks had, which were strict
+  uint64_t expiration = tunnel->GetCreationTime() + TUNNEL_EXPIRATION_TIMEOUT;
+  TunnelTimer timer;
+  timer.isInbound = isInbound;
+  timer.replyMsgID = 0;
+  timer.tunnel = tunnel;
+  timer.type = e_TunnelTimerRecreate;
+  m_TunnelTimers.Schedule(
+      expiration - TUNNEL_RECREATION_THRESHOLD + 1,
+      timer);
+  timer.type = e_TunnelTimerExpiring;
+  m_TunnelTimers.Schedule(
+      expiration - TUNNEL_EXPIRATION_THRESHOLD + 1,
+      timer);
+  timer.type = e_TunnelTimerExpire;
+  m_TunnelTimers.Schedule(expiration + 1, timer);
+}
+
+void Tunnels::RemoveExpiredTunnel(
+    std::shared_ptr<Tunnel> tunnel,
+    bool isInbound) {
+  if (isInbound) {
+    auto inboundTunnel = std::static_pointer_cast<InboundTunnel>(tunnel);
+    if (!m_InboundTunnels.Remove(tunnel->GetTunnelID(), inboundTunnel.get()))
+      return;
+    LogPrint(eLogInfo,
+        "Tunnels: tunnel ", tunnel->GetTunnelID(), " expired");
+    auto pool = tunnel->GetTunnelPool();
+    if (pool)
+      pool->TunnelExpired(inboundTunnel);
+  } else {
+    auto outboundTunnel = std::static_pointer_cast<OutboundTunnel>(tunnel);
+    auto it = std::find(
+        m_OutboundTunnels.begin(),
+        m_OutboundTunnels.end(),
+        outboundTunnel);
+    if (it == m_OutboundTunnels.end())
+      return;
+    m_OutboundTunnels.erase(it);
+    LogPrint(eLogInfo,
+        "Tunnels: tunnel ", tunnel->GetTunnelID(), " expired");
+    auto pool = tunnel->GetTunnelPool();
+    if (pool)
+      pool->TunnelExpired(outboundTunnel);
   }
+}
+
+void Tunnels::ExpireTransitTunnels(
+    uint64_t ts) {
+  std::vector<uint32_t> expired;
+  // build pipeline threads add transit tunnels concurrently
+  std::unique_lock<std::mutex> l(m_TransitTimersMutex);
+  m_TransitTimers.Advance(ts, expired);
+  for (auto tunnelID : expired) {
+    auto tunnel = m_TransitTunnels.Get(tunnelID);
+    if (!tunnel ||
+        ts <= tunnel->GetCreationTime() + TUNNEL_EXPIRATION_TIMEOUT)
+      continue;
+    LogPrint(eLogInfo,
+        "Tunnels: transit tunnel ", tunnelID, " expired");
+    // data plane threads may still hold it, freed once they are done
+    m_TransitTunnels.Remove(tunnelID, tunnel.get());
+  }
+}
+
+void Tunnels::ManageOutboundTunnels() {
+  // expiration is handled by the tunnel timers
   if (m_OutboundTunnels.size() < 5) {
     // trying to create one more outbound tunnel
     auto inboundTunnel = GetNextInboundTunnel();
@@ -601,35 +794,8 @@ void Tunnels::ManageOutboundTunnels() {
 }
 
 void Tunnels::ManageInboundTunnels() {
-  uint64_t ts = i2p::util::GetSecondsSinceEpoch(); {
-    for (auto it = m_InboundTunnels.begin(); it != m_InboundTunnels.end();) {
-      auto tunnel = it->second;
-      if (ts > tunnel->GetCreationTime() + TUNNEL_EXPIRATION_TIMEOUT) {
-        LogPrint(eLogInfo,
-            "Tunnels: tunnel ", tunnel->GetTunnelID(), " expired");
-        auto pool = tunnel->GetTunnelPool();
-        if (pool)
-          pool->TunnelExpired(tunnel);
-        it = m_InboundTunnels.erase(it);
-      } else {
-        if (tunnel->IsEstablished()) {
-          if (!tunnel->IsRecreated() &&
-              ts + TUNNEL_RECREATION_THRESHOLD >
-              tunnel->GetCreationTime() + TUNNEL_EXPIRATION_TIMEOUT) {
-            tunnel->SetIsRecreated();
-            auto pool = tunnel->GetTunnelPool();
-            if (pool)
-              pool->RecreateInboundTunnel(tunnel);
-          }
-          if (ts + TUNNEL_EXPIRATION_THRESHOLD >
-              tunnel->GetCreationTime() + TUNNEL_EXPIRATION_TIMEOUT)
-            tunnel->SetState(e_TunnelStateExpiring);
-        }
-        it++;
-      }
-    }
-  }
-  if (m_InboundTunnels.empty()) {
+  // expiration is handled by the tunnel timers
+  if (m_InboundTunnels.IsEmpty()) {
     LogPrint(eLogInfo,
         "Tunnels: creating zero hops inbound tunnel");
     CreateZeroHopsInboundTunnel();
@@ -639,7 +805,7 @@ void Tunnels::ManageInboundTunnels() {
         CreateTunnelPool(&i2p::context, 2, 2, 5, 5);
     return;
   }
-  if (m_OutboundTunnels.empty() || m_InboundTunnels.size() < 5) {
+  if (m_OutboundTunnels.empty() || m_InboundTunnels.GetSize() < 5) {
     // trying to create one more inbound tunnel
     auto router = i2p::data::netdb.GetRandomRouter();
     LogPrint(eLogInfo, "Tunnels: creating one hop inbound tunnel");
@@ -650,20 +816,29 @@ void Tunnels::ManageInboundTunnels() {
 }
 
 void Tunnels::ManageTransitTunnels() {
-  uint32_t ts = i2p::util::GetSecondsSinceEpoch();
-  for (auto it = m_TransitTunnels.begin(); it != m_TransitTunnels.end();) {
-    if (ts > it->second->GetCreationTime() + TUNNEL_EXPIRATION_TIMEOUT) {
-      auto tmp = it->second;
-      LogPrint(eLogInfo,
-          "Tunnels: transit tunnel ", tmp->GetTunnelID(), " expired"); {
-        std::unique_lock<std::mutex> l(m_TransitTunnelsMutex);
-        it = m_TransitTunnels.erase(it);
-      }
-      delete tmp;
-    } else {
-      it++;
-    }
+  // expiration is handled by the transit timers
+  m_TransitAdmission.CleanupPeers(i2p::util::GetMillisecondsSinceEpoch());
+  UpdateTransitBudget();
+}
+
+void Tunnels::UpdateTransitBudget() {
+  // follows the configured bandwidth, or the caps if none
+  m_TransitBudget =
+    i2p::transport::transports.GetBandwidthLimit() * TRANSIT_BANDWIDTH_SHARE;
+}
+
+bool Tunnels::ConsumeTransitBudget(
+    uint32_t tunnelID,
+    std::size_t len,
+    std::uint64_t now) {
+  // same sharding as GetDataShard, tunnels spread evenly over threads
+  auto& budget = *m_TransitBudgets[tunnelID % m_TransitBudgets.size()];
+  std::uint64_t rate = m_TransitBudget / m_TransitBudgets.size();
+  if (budget.GetRate() != rate) {
+    budget.SetRate(rate);
+    budget.SetBurst(rate);  // one second worth
   }
+  return budget.TryConsume(len, now);
 }
 
 void Tunnels::ManageTunnelPools() {
@@ -679,13 +854,37 @@ void Tunnels::ManageTunnelPools() {
 
 void Tunnels::PostTunnelData(
     std::shared_ptr<I2NPMessage> msg) {
-  if (msg)
-    m_Queue.Put(msg);
+  if (!msg)
+    return;
+  auto typeID = msg->GetTypeID();
+  if (typeID == e_I2NPTunnelData || typeID == e_I2NPTunnelGateway)
+    m_DataQueues[GetDataShard(msg)]->Put(msg);
+  else
+    PostControlMsg(msg);
 }
 
 void Tunnels::PostTunnelData(
     const std::vector<std::shared_ptr<I2NPMessage> >& msgs) {
-  m_Queue.Put(msgs);
+  std::vector<std::vector<std::shared_ptr<I2NPMessage> > > shards(
+      m_DataQueues.size());
+  for (auto& msg : msgs) {
+    auto typeID = msg->GetTypeID();
+    if (typeID == e_I2NPTunnelData || typeID == e_I2NPTunnelGateway)
+      shards[GetDataShard(msg)].push_back(msg);
+    else
+      PostControlMsg(msg);
+  }
+  for (std::size_t i = 0; i < shards.size(); i++)
+    m_DataQueues[i]->Put(shards[i]);
+}
+
+void Tunnels::PostControlMsg(
+    std::shared_ptr<I2NPMessage> msg) {
+  if (!m_Queue.Put(msg))
+    LogPrint(eLogError,
+        "Tunnels: control queue full, dropped message of type ",
+        static_cast<int>(msg->GetTypeID()),
+        ", ", m_Queue.GetNumDropped(), " dropped so far");
 }
 
 template<class TTunnel>
@@ -703,17 +902,32 @@ void Tunnels::AddPendingTunnel(
     uint32_t replyMsgID,
     std::shared_ptr<InboundTunnel> tunnel) {
   m_PendingInboundTunnels[replyMsgID] = tunnel;
+  TunnelTimer timer;
+  timer.type = e_TunnelTimerBuildTimeout;
+  timer.isInbound = true;
+  timer.replyMsgID = replyMsgID;
+  m_TunnelTimers.Schedule(
+      tunnel->GetCreationTime() + TUNNEL_CREATION_TIMEOUT + 1,
+      timer);
 }
 
 void Tunnels::AddPendingTunnel(
     uint32_t replyMsgID,
     std::shared_ptr<OutboundTunnel> tunnel) {
   m_PendingOutboundTunnels[replyMsgID] = tunnel;
+  TunnelTimer timer;
+  timer.type = e_TunnelTimerBuildTimeout;
+  timer.isInbound = false;
+  timer.replyMsgID = replyMsgID;
+  m_TunnelTimers.Schedule(
+      tunnel->GetCreationTime() + TUNNEL_CREATION_TIMEOUT + 1,
+      timer);
 }
 
 void Tunnels::AddOutboundTunnel(
     std::shared_ptr<OutboundTunnel> newTunnel) {
   m_OutboundTunnels.push_back(newTunnel);
+  ScheduleTunnelTimers(newTunnel, false);
   auto pool = newTunnel->GetTunnelPool();
   if (pool && pool->IsActive())
     pool->TunnelCreated(newTunnel);
@@ -723,7 +937,8 @@ void Tunnels::AddOutboundTunnel(
 
 void Tunnels::AddInboundTunnel(
     std::shared_ptr<InboundTunnel> newTunnel) {
-  m_InboundTunnels[newTunnel->GetTunnelID()] = newTunnel;
+  m_InboundTunnels.Set(newTunnel->GetTunnelID(), newTunnel);
+  ScheduleTunnelTimers(newTunnel, true);
   auto pool = newTunnel->GetTunnelPool();
   if (!pool) {
     // build symmetric outbound tunnel
@@ -746,12 +961,54 @@ void Tunnels::CreateZeroHopsInboundTunnel() {
       }));
 }
 
+std::size_t Tunnels::GetNumTransitTunnels() {
+  return m_TransitTunnels.GetSize();
+}
+
+std::vector<std::shared_ptr<TransitTunnel> > Tunnels::GetTopTransitTunnels(
+    std::size_t num) {
+  // rates change while sorting, so sort a snapshot
+  std::vector<std::pair<std::uint32_t, std::shared_ptr<TransitTunnel> > >
+    rates;
+  for (auto& it : m_TransitTunnels.GetValues())
+    rates.push_back(std::make_pair(it->GetRate(), std::move(it)));
+  num = std::min(num, rates.size());
+  std::partial_sort(
+      rates.begin(),
+      rates.begin() + num,
+      rates.end(),
+      [](const decltype(rates)::value_type& r1,
+         const decltype(rates)::value_type& r2) {
+        return r1.first > r2.first;
+      });
+  std::vector<std::shared_ptr<TransitTunnel> > top;
+  for (std::size_t i = 0; i < num; i++)
+    top.push_back(rates[i].second);
+  return top;
+}
+
+TransitDecision Tunnels::AdmitTransitTunnel(
+    const i2p::data::IdentHash& previousHop) {
+  TransitLoad load;
+  load.acceptsTunnels = i2p::context.AcceptsTunnels();
+  load.numTransitTunnels = GetNumTransitTunnels();
+  load.maxNumTransitTunnels = MAX_NUM_TRANSIT_TUNNELS;
+  load.queueLoad = GetQueueLoad();
+  load.bandwidth = std::max(
+      i2p::transport::transports.GetInBandwidth(),
+      i2p::transport::transports.GetOutBandwidth());
+  load.bandwidthLimit = i2p::transport::transports.GetBandwidthLimit();
+  return m_TransitAdmission.Admit(
+      previousHop,
+      load,
+      i2p::util::GetMillisecondsSinceEpoch());
+}
+
 int Tunnels::GetTransitTunnelsExpirationTimeout() {
   int timeout = 0;
   uint32_t ts = i2p::util::GetSecondsSinceEpoch();
-  std::unique_lock<std::mutex> l(m_TransitTunnelsMutex);
-  for (auto it : m_TransitTunnels) {
-    int t = it.second->GetCreationTime() + TUNNEL_EXPIRATION_TIMEOUT - ts;
+  for (const auto& it : m_TransitTunnels.GetValues()) {
+    int t = it->GetCreationTime() + TUNNEL_EXPIRATION_TIMEOUT - ts;
     if (t > timeout)
       timeout = t;
   }
@@ -35,6 +35,9 @@
 
 #include <inttypes.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <list>
 #include <map>
 #include <memory>
@@ -44,13 +47,19 @@
 #include <vector>
 
 #include "I2NPProtocol.h"
+#include "TransitAdmission.h"
 #include "TransitTunnel.h"
 #include "TunnelBase.h"
+#include "TunnelBuildPipeline.h"
 #include "TunnelConfig.h"
 #include "TunnelEndpoint.h"
 #include "TunnelGateway.h"
 #include "TunnelPool.h"
-#include "util/Queue.h"
+#include "util/ConcurrentIDMap.h"
+#include "util/Epoch.h"
+#include "util/MPSCQueue.h"
+#include "util/TimerWheel.h"
+#include "util/TokenBucket.h"
 
 namespace i2p {
 namespace tunnel {
@@ -59,7 +68,19 @@ const int TUNNEL_EXPIRATION_TIMEOUT = 660,    // 11 minutes
           TUNNEL_EXPIRATION_THRESHOLD = 60,   // 1 minute
           TUNNEL_RECREATION_THRESHOLD = 90,   // 1.5 minutes
           TUNNEL_CREATION_TIMEOUT = 30,       // 30 seconds
-          STANDARD_NUM_RECORDS = 5;           // in VariableTunnelBuild message
+          STANDARD_NUM_RECORDS = 5,           // in VariableTunnelBuild message
+          // tunnel not ready for a timer is checked again after
+          TUNNEL_TIMER_RETRY = 15;            // 15 seconds
+
+// Build messages for the control thread. Unlike tunnel data, these must
+// not be lost, so the queue has room for floods far above the data queues.
+const std::size_t TUNNEL_CONTROL_QUEUE_CAPACITY = 65536;
+
+// max messages a data plane thread takes from its queue at once
+const std::size_t TUNNEL_DATA_BATCH_SIZE = 64;
+
+// Share of the bandwidth of our bandwidth class given to transit tunnels
+const double TRANSIT_BANDWIDTH_SHARE = 0.8;
 
 enum TunnelState {
   e_TunnelStatePending,
@@ -133,6 +154,9 @@ class Tunnel : public TunnelBase {
       std::shared_ptr<const I2NPMessage> in,
       std::shared_ptr<I2NPMessage> out);
 
+  void EncryptTunnelMsgs(
+      const std::vector<std::shared_ptr<I2NPMessage> >& msgs);
+
   uint32_t GetNextTunnelID() const {
     return m_Config->GetFirstHop()->tunnelID;
   }
@@ -219,6 +243,16 @@ class Tunnels {
   void Start();
   void Stop();
 
+  /// @brief Sets number of data plane threads, each owning a shard of
+  ///   tunnel IDs. Must be called before Start()
+  void SetNumDataThreads(
+      std::size_t num);
+
+  /// @brief Sets number of threads handling tunnel build requests.
+  ///   Must be called before Start()
+  void SetNumBuildThreads(
+      std::size_t num);
+
   std::shared_ptr<InboundTunnel> GetInboundTunnel(
       uint32_t tunnelID);
 
@@ -236,13 +270,50 @@ class Tunnels {
     return m_ExploratoryPool;
   }
 
-  TransitTunnel* GetTransitTunnel(
+  std::shared_ptr<TransitTunnel> GetTransitTunnel(
       uint32_t tunnelID);
 
   int GetTransitTunnelsExpirationTimeout();
 
+  std::size_t GetNumTransitTunnels();
+
+  /// @brief Decides on a transit tunnel request from the current load
+  /// @details Thread-safe, called by the tunnel build pipeline workers
+  /// @param previousHop Router the request came from, zero if unknown
+  TransitDecision AdmitTransitTunnel(
+      const i2p::data::IdentHash& previousHop);
+
   void AddTransitTunnel(
-      TransitTunnel* tunnel);
+      std::shared_ptr<TransitTunnel> tunnel);
+
+  /// @return Transit tunnels with the highest rate, highest first
+  std::vector<std::shared_ptr<TransitTunnel> > GetTopTransitTunnels(
+      std::size_t num);
+
+  /// @brief Charges transit traffic to the transit budget
+  /// @details Each data plane thread spends its share of the budget,
+  ///   so must be called by the thread owning the tunnel ID
+  /// @return False if the budget is spent
+  bool ConsumeTransitBudget(
+      uint32_t tunnelID,
+      std::size_t len,
+      std::uint64_t now);
+
+  void AddDroppedTransitBytes(
+      std::size_t len) {
+    m_NumDroppedTransitBytes += len;
+  }
+
+  /// @return Bandwidth for all transit tunnels, in bytes per second.
+  ///   0 until started
+  std::uint32_t GetTransitBudget() const {
+    return m_TransitBudget;
+  }
+
+  /// @return Transit traffic dropped for being over the limits
+  std::uint64_t GetNumDroppedTransitBytes() const {
+    return m_NumDroppedTransitBytes;
+  }
 
   void AddOutboundTunnel(
       std::shared_ptr<OutboundTunnel> newTunnel);
@@ -282,6 +353,21 @@ class Tunnels {
       std::shared_ptr<TunnelPool> pool);
 
  private:
+  /// @brief Timers of tunnels we build
+  enum TunnelTimerType {
+    e_TunnelTimerBuildTimeout,
+    e_TunnelTimerRecreate,
+    e_TunnelTimerExpiring,
+    e_TunnelTimerExpire
+  };
+
+  struct TunnelTimer {
+    TunnelTimerType type;
+    bool isInbound;
+    uint32_t replyMsgID;  // of pending tunnels
+    std::weak_ptr<Tunnel> tunnel;
+  };
+
   template<class TTunnel>
   std::shared_ptr<TTunnel> GetPendingTunnel(
       uint32_t replyMsgID,
@@ -292,8 +378,22 @@ class Tunnels {
       TunnelBase* tunnel,
       std::shared_ptr<I2NPMessage> msg);
 
+  /// @brief Control thread: build replies and periodic management,
+  ///   build requests are handed to m_BuildPipeline
   void Run();
 
+  /// @brief Data plane thread: tunnel data and gateway messages of one shard
+  void RunDataShard(
+      std::size_t shard);
+
+  std::size_t GetDataShard(
+      std::shared_ptr<const I2NPMessage> msg) const;
+
+  /// @brief Queues a build message for the control thread, logging if
+  ///   it has to be dropped
+  void PostControlMsg(
+      std::shared_ptr<I2NPMessage> msg);
+
   void ManageTunnels();
 
   void ManageOutboundTunnels();
@@ -302,11 +402,33 @@ class Tunnels {
 
   void ManageTransitTunnels();
 
-  void ManagePendingTunnels();
+  void UpdateTransitBudget();
+
+  /// @brief Handles the tunnel timers due by ts, in seconds
+  void HandleTunnelTimers(
+      uint64_t ts);
+
+  void HandleTunnelTimer(
+      const TunnelTimer& timer,
+      uint64_t ts);
 
   template<class PendingTunnels>
-  void ManagePendingTunnels(
-      PendingTunnels& pendingTunnels);
+  void HandleBuildTimeout(
+      PendingTunnels& pendingTunnels,
+      const TunnelTimer& timer,
+      uint64_t ts);
+
+  /// @brief Schedules recreation and expiry of an established tunnel
+  void ScheduleTunnelTimers(
+      std::shared_ptr<Tunnel> tunnel,
+      bool isInbound);
+
+  void RemoveExpiredTunnel(
+      std::shared_ptr<Tunnel> tunnel,
+      bool isInbound);
+
+  void ExpireTransitTunnels(
+      uint64_t ts);
 
   void ManageTunnelPools();
 
@@ -315,20 +437,41 @@ class Tunnels {
  private:
   bool m_IsRunning;
   std::unique_ptr<std::thread> m_Thread;
+  std::vector<std::unique_ptr<std::thread> > m_DataThreads;
 
   // by replyMsgID
   std::map<uint32_t, std::shared_ptr<InboundTunnel> > m_PendingInboundTunnels;
   // by replyMsgID
   std::map<uint32_t, std::shared_ptr<OutboundTunnel> > m_PendingOutboundTunnels;
 
-  std::map<uint32_t, std::shared_ptr<InboundTunnel> > m_InboundTunnels;
+  // tunnels removed while data plane threads may still use them
+  i2p::util::EpochDomain m_TunnelEpoch;
+  // modified by control thread only, looked up by data plane threads
+  i2p::util::ConcurrentIDMap<InboundTunnel> m_InboundTunnels;
   std::list<std::shared_ptr<OutboundTunnel> > m_OutboundTunnels;
-  std::mutex m_TransitTunnelsMutex;
-  std::map<uint32_t, TransitTunnel *> m_TransitTunnels;
+  // added by build pipeline threads, looked up by data plane threads
+  i2p::util::ConcurrentIDMap<TransitTunnel> m_TransitTunnels;
+  std::mutex m_TransitTimersMutex;
+  // transit tunnel IDs by expiration, guarded by m_TransitTimersMutex
+  i2p::util::TimerWheel<uint32_t> m_TransitTimers;
+  // timers of tunnels we build, control thread only
+  i2p::util::TimerWheel<TunnelTimer> m_TunnelTimers;
   std::mutex m_PoolsMutex;
   std::list<std::shared_ptr<TunnelPool>> m_Pools;
   std::shared_ptr<TunnelPool> m_ExploratoryPool;
-  i2p::util::Queue<std::shared_ptr<I2NPMessage> > m_Queue;
+  // build messages for control thread
+  i2p::util::MPSCQueue<std::shared_ptr<I2NPMessage> > m_Queue;
+  // build requests from other routers
+  TunnelBuildPipeline m_BuildPipeline;
+  TransitAdmission m_TransitAdmission;
+  // tunnel data and gateway messages, one queue per data plane thread
+  std::vector<
+    std::unique_ptr<i2p::util::MPSCQueue<std::shared_ptr<I2NPMessage> > > >
+      m_DataQueues;
+  // transit budget, one bucket per data plane thread
+  std::vector<std::unique_ptr<i2p::util::TokenBucket> > m_TransitBudgets;
+  std::atomic<std::uint32_t> m_TransitBudget;
+  std::atomic<std::uint64_t> m_NumDroppedTransitBytes;
 
   // some stats
   int m_NumSuccesiveTunnelCreations,
@@ -340,16 +483,54 @@ class Tunnels {
     return m_OutboundTunnels;
   }
 
-  const decltype(m_InboundTunnels)& GetInboundTunnels() const {
-    return m_InboundTunnels;
+  std::vector<std::shared_ptr<InboundTunnel> > GetInboundTunnels() const {
+    return m_InboundTunnels.GetValues();
   }
 
-  const decltype(m_TransitTunnels)& GetTransitTunnels() const {
-    return m_TransitTunnels;
+  std::vector<std::shared_ptr<TransitTunnel> > GetTransitTunnels() const {
+    return m_TransitTunnels.GetValues();
   }
 
   int GetQueueSize() {
-    return m_Queue.GetSize();
+    std::size_t size = m_Queue.GetSize();
+    for (auto& queue : m_DataQueues)
+      size += queue->GetSize();
+    return size;
+  }
+
+  /// @return Largest backlog seen by any of the tunnel queues
+  std::size_t GetQueueHighWaterMark() {
+    std::size_t mark = m_Queue.GetHighWaterMark();
+    for (auto& queue : m_DataQueues)
+      mark = std::max(mark, queue->GetHighWaterMark());
+    return mark;
+  }
+
+  /// @return Number of messages dropped because a tunnel queue was full
+  std::uint64_t GetNumDroppedMessages() {
+    std::uint64_t num = m_Queue.GetNumDropped();
+    for (auto& queue : m_DataQueues)
+      num += queue->GetNumDropped();
+    return num;
+  }
+
+  /// @return Fill ratio of the fullest tunnel queue
+  double GetQueueLoad() {
+    double load =
+      static_cast<double>(m_Queue.GetSize()) / m_Queue.GetCapacity();
+    for (auto& queue : m_DataQueues)
+      load = std::max(
+          load,
+          static_cast<double>(queue->GetSize()) / queue->GetCapacity());
+    return load;
+  }
+
+  const TunnelBuildPipeline& GetBuildPipeline() const {
+    return m_BuildPipeline;
+  }
+
+  const TransitAdmission& GetTransitAdmission() const {
+    return m_TransitAdmission;
   }
 
   int GetTunnelCreationSuccessRate() const {  // in percents
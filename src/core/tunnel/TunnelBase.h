@@ -36,6 +36,7 @@
 #include <inttypes.h>
 
 #include <memory>
+#include <vector>
 
 #include "I2NPProtocol.h"
 #include "Identity.h"
@@ -81,6 +82,14 @@ class TunnelBase {
       std::shared_ptr<const I2NPMessage> in,
       std::shared_ptr<I2NPMessage> out) = 0;
 
+  /// @brief Encrypts tunnel data messages in place
+  /// @note Override to batch messages through the cipher
+  virtual void EncryptTunnelMsgs(
+      const std::vector<std::shared_ptr<I2NPMessage> >& msgs) {
+    for (auto msg : msgs)
+      EncryptTunnelMsg(msg, msg);
+  }
+
   virtual uint32_t GetNextTunnelID() const = 0;
 
   virtual const i2p::data::IdentHash& GetNextIdentHash() const = 0;
@@ -0,0 +1,175 @@
+/**
+ * Copyright (c) 2015-2016, The Kovri I2P Router Project
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ *    conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *    of conditions and the following disclaimer in the documentation and/or other
+ *    materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "TunnelBuildPipeline.h"
+
+#include <algorithm>
+#include <exception>
+
+#include "crypto/Rand.h"
+#include "util/Log.h"
+
+namespace i2p {
+namespace tunnel {
+
+TunnelBuildPipeline::TunnelBuildPipeline(
+    Handler handler)
+    : m_Handler(handler),
+      m_NumThreads(1),
+      m_IsRunning(false),
+      m_NumAccepted(0),
+      m_NumRejected(0),
+      m_NumDropped(0),
+      m_ProcessingTime(0.0) {}
+
+TunnelBuildPipeline::~TunnelBuildPipeline() {
+  Stop();
+}
+
+void TunnelBuildPipeline::SetNumThreads(
+    std::size_t num) {
+  if (m_IsRunning) {
+    LogPrint(eLogError,
+        "TunnelBuildPipeline: can't change number of threads while running");
+    return;
+  }
+  if (!num)
+    num = 1;
+  m_NumThreads = std::min(num, TUNNEL_BUILD_MAX_NUM_THREADS);
+}
+
+void TunnelBuildPipeline::Start() {
+  m_IsRunning = true;
+  for (std::size_t i = 0; i < m_NumThreads; i++)
+    m_Threads.push_back(
+        std::make_unique<std::thread>(
+            std::bind(
+              &TunnelBuildPipeline::Run,
+              this)));
+  LogPrint(eLogInfo,
+      "TunnelBuildPipeline: started ", m_Threads.size(), " thread(s)");
+}
+
+void TunnelBuildPipeline::Stop() {
+  {
+    std::unique_lock<std::mutex> l(m_QueueMutex);
+    m_IsRunning = false;
+    m_Queue.clear();
+  }
+  m_NonEmpty.notify_all();
+  for (auto& thread : m_Threads)
+    thread->join();
+  m_Threads.clear();
+}
+
+bool TunnelBuildPipeline::Put(
+    std::shared_ptr<I2NPMessage> msg) {
+  std::unique_lock<std::mutex> l(m_QueueMutex);
+  std::size_t size = m_Queue.size();
+  if (size >= TUNNEL_BUILD_QUEUE_EARLY_DROP) {
+    // Drop probability rises linearly from 0 to 1 at the full queue,
+    // so peers see a gradual slowdown instead of a wall
+    if (size >= TUNNEL_BUILD_QUEUE_SIZE ||
+        i2p::crypto::Rand<std::uint32_t>() %
+          (TUNNEL_BUILD_QUEUE_SIZE - TUNNEL_BUILD_QUEUE_EARLY_DROP) <
+          size - TUNNEL_BUILD_QUEUE_EARLY_DROP) {
+      m_NumDropped++;
+      LogPrint(eLogWarn,
+          "TunnelBuildPipeline: ", size,
+          " requests queued, dropping build request");
+      return false;
+    }
+  }
+  m_Queue.push_back({ msg, std::chrono::steady_clock::now() });
+  l.unlock();
+  m_NonEmpty.notify_one();
+  return true;
+}
+
+std::size_t TunnelBuildPipeline::GetQueueSize() const {
+  std::unique_lock<std::mutex> l(m_QueueMutex);
+  return m_Queue.size();
+}
+
+double TunnelBuildPipeline::GetProcessingTime() const {
+  std::unique_lock<std::mutex> l(m_QueueMutex);
+  return m_ProcessingTime;
+}
+
+void TunnelBuildPipeline::Run() {
+  const auto timeout =
+    std::chrono::milliseconds(TUNNEL_BUILD_REQUEST_TIMEOUT);
+  std::unique_lock<std::mutex> l(m_QueueMutex);
+  while (true) {
+    m_NonEmpty.wait(l, [this]() { return !m_IsRunning || !m_Queue.empty(); });
+    if (!m_IsRunning)
+      break;
+    auto now = std::chrono::steady_clock::now();
+    // Oldest requests are at the front
+    while (!m_Queue.empty() && now - m_Queue.front().time > timeout) {
+      m_Queue.pop_front();
+      m_NumDropped++;
+    }
+    if (m_Queue.empty())
+      continue;
+    Request request;
+    if (m_Queue.size() > TUNNEL_BUILD_QUEUE_EARLY_DROP) {
+      request = m_Queue.back();
+      m_Queue.pop_back();
+    } else {
+      request = m_Queue.front();
+      m_Queue.pop_front();
+    }
+    l.unlock();
+    int ret = -1;
+    try {
+      ret = m_Handler(request.msg);
+    } catch (std::exception& ex) {
+      LogPrint(eLogError,
+          "TunnelBuildPipeline: Run() exception: ", ex.what());
+    }
+    auto end = std::chrono::steady_clock::now();
+    if (!ret)
+      m_NumAccepted++;
+    else if (ret > 0)
+      m_NumRejected++;
+    l.lock();
+    double elapsed =
+      std::chrono::duration<double, std::milli>(end - now).count();
+    // Weighs about the last 16 requests
+    if (m_ProcessingTime > 0.0)
+      m_ProcessingTime += (elapsed - m_ProcessingTime) / 16;
+    else
+      m_ProcessingTime = elapsed;
+  }
+}
+
+}  // namespace tunnel
+}  // namespace i2p
@@ -0,0 +1,138 @@
+/**
+ * Copyright (c) 2015-2016, The Kovri I2P Router Project
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ *    conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *    of conditions and the following disclaimer in the documentation and/or other
+ *    materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SRC_CORE_TUNNEL_TUNNELBUILDPIPELINE_H_
+#define SRC_CORE_TUNNEL_TUNNELBUILDPIPELINE_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "I2NPProtocol.h"
+
+namespace i2p {
+namespace tunnel {
+
+// Requests queued beyond this are dropped
+const std::size_t TUNNEL_BUILD_QUEUE_SIZE = 256;
+
+// Past this backlog new requests are dropped with rising probability
+// and the newest queued requests are served first
+const std::size_t TUNNEL_BUILD_QUEUE_EARLY_DROP = 64;
+
+// Requesters give up on a hop after about 10 seconds,
+// so there is no point in answering older requests
+const int TUNNEL_BUILD_REQUEST_TIMEOUT = 10000;  // in milliseconds
+
+const std::size_t TUNNEL_BUILD_MAX_NUM_THREADS = 16;
+
+/// @class TunnelBuildPipeline
+/// @brief Handles tunnel build requests on a pool of worker threads
+/// @details Keeps the ElGamal decryption of build records off the tunnel
+///   control and data plane threads. Requests wait in a bounded queue,
+///   served in arrival order until it backs up, then newest first since
+///   the oldest are the likeliest to have timed out at the requester.
+class TunnelBuildPipeline {
+ public:
+  /// @brief Processes one build request message
+  /// @return Reply code of our record (0 if accepted),
+  ///   negative if no record is ours
+  typedef std::function<int(std::shared_ptr<I2NPMessage>)> Handler;
+
+  explicit TunnelBuildPipeline(
+      Handler handler);
+
+  ~TunnelBuildPipeline();
+
+  /// @brief Sets number of worker threads. Must be called before Start()
+  void SetNumThreads(
+      std::size_t num);
+
+  void Start();
+
+  void Stop();
+
+  /// @brief Queues a build request for the workers
+  /// @return False if the request was dropped because of the backlog
+  bool Put(
+      std::shared_ptr<I2NPMessage> msg);
+
+  std::size_t GetQueueSize() const;
+
+  std::uint64_t GetNumAccepted() const {
+    return m_NumAccepted;
+  }
+
+  std::uint64_t GetNumRejected() const {
+    return m_NumRejected;
+  }
+
+  /// @return Number of requests dropped unanswered, because of the
+  ///   backlog or because they waited too long
+  std::uint64_t GetNumDropped() const {
+    return m_NumDropped;
+  }
+
+  /// @return Moving average of the time to handle a request, in
+  ///   milliseconds. Dominated by the ElGamal decryption.
+  double GetProcessingTime() const;
+
+ private:
+  void Run();
+
+  struct Request {
+    std::shared_ptr<I2NPMessage> msg;
+    std::chrono::steady_clock::time_point time;
+  };
+
+ private:
+  Handler m_Handler;
+  std::size_t m_NumThreads;
+  bool m_IsRunning;
+  std::vector<std::unique_ptr<std::thread> > m_Threads;
+  mutable std::mutex m_QueueMutex;
+  std::condition_variable m_NonEmpty;
+  std::deque<Request> m_Queue;
+  std::atomic<std::uint64_t>
+    m_NumAccepted, m_NumRejected, m_NumDropped;
+  double m_ProcessingTime;  // guarded by m_QueueMutex
+};
+
+}  // namespace tunnel
+}  // namespace i2p
+
+#endif  // SRC_CORE_TUNNEL_TUNNELBUILDPIPELINE_H_
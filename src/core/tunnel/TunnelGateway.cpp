@@ -236,8 +236,8 @@ void TunnelGateway::PutTunnelDataMsg(
 void TunnelGateway::SendBuffer() {
   m_Buffer.CompleteCurrentTunnelDataMessage();
   auto tunnelMsgs = m_Buffer.GetTunnelDataMsgs();
+  m_Tunnel->EncryptTunnelMsgs(tunnelMsgs);
   for (auto tunnelMsg : tunnelMsgs) {
-    m_Tunnel->EncryptTunnelMsg(tunnelMsg, tunnelMsg);
     tunnelMsg->FillI2NPMessageHeader(e_I2NPTunnelData);
     m_NumSentBytes += TUNNEL_DATA_MSG_SIZE;
   }
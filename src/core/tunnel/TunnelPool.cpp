@@ -241,7 +241,11 @@ void TunnelPool::CreateTunnels() {
 }
 
 void TunnelPool::TestTunnels() {
-  for (auto it : m_Tests) {
+  decltype(m_Tests) tests; {
+    std::unique_lock<std::mutex> l(m_TestsMutex);
+    tests.swap(m_Tests);
+  }
+  for (auto it : tests) {
     LogPrint(eLogWarn,
         "TunnelPool: tunnel test ", static_cast<int>(it.first), " failed");
     // if test failed again with another tunnel we consider it failed
@@ -268,7 +272,6 @@ void TunnelPool::TestTunnels() {
       }
     }
   }
-  m_Tests.clear();
   // new tests
   auto it1 = m_OutboundTunnels.begin();
   auto it2 = m_InboundTunnels.begin();
@@ -283,8 +286,10 @@ void TunnelPool::TestTunnels() {
       it2++;
     }
     if (!failed) {
-      uint32_t msgID = i2p::crypto::Rand<uint32_t>();
-      m_Tests[msgID] = std::make_pair(*it1, *it2);
+      uint32_t msgID = i2p::crypto::Rand<uint32_t>(); {
+        std::unique_lock<std::mutex> l(m_TestsMutex);
+        m_Tests[msgID] = std::make_pair(*it1, *it2);
+      }
       (*it1)->SendTunnelDataMsg(
           (*it2)->GetNextIdentHash(),
           (*it2)->GetNextTunnelID(),
@@ -310,6 +315,7 @@ void TunnelPool::ProcessDeliveryStatus(
   uint32_t msgID = bufbe32toh(buf);
   buf += 4;
   uint64_t timestamp = bufbe64toh(buf);
+  std::unique_lock<std::mutex> l(m_TestsMutex);
   auto it = m_Tests.find(msgID);
   if (it != m_Tests.end()) {
     // restore from test failed state if any
@@ -323,6 +329,7 @@ void TunnelPool::ProcessDeliveryStatus(
         " milliseconds");
     m_Tests.erase(it);
   } else {
+    l.unlock();
     if (m_LocalDestination)
       m_LocalDestination->ProcessDeliveryStatusMessage(msg);
     else
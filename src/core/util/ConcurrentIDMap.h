@@ -0,0 +1,335 @@
+/**
+ * Copyright (c) 2015-2016, The Kovri I2P Router Project
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ *    conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *    of conditions and the following disclaimer in the documentation and/or other
+ *    materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SRC_CORE_UTIL_CONCURRENTIDMAP_H_
+#define SRC_CORE_UTIL_CONCURRENTIDMAP_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "util/Epoch.h"
+
+namespace i2p {
+namespace util {
+
+/// @class ConcurrentIDMap
+/// @brief Flat hash table from 32-bit IDs to shared objects, read without
+///   locks
+/// @details Open addressing with linear probing over one array of
+///   {key, pointer} slots, so a lookup touches a line or two instead of
+///   chasing tree nodes. Reads never lock nor wait: they may run during
+///   a write, and see the map either before or after it. Writers are
+///   serialized by a mutex. Removed objects and the tables left behind
+///   when the map grows are retired to an epoch domain, so a reader in
+///   a critical section of that domain can keep using what it found.
+/// @note Value must derive from std::enable_shared_from_this<Value>
+/// @note Thread-safe
+template<typename Value>
+class ConcurrentIDMap {
+ public:
+  explicit ConcurrentIDMap(
+      EpochDomain& epoch)
+      : m_Epoch(epoch),
+        m_Seed(std::random_device()()),
+        m_Table(new Table(MIN_CAPACITY)),
+        m_Size(0) {}
+
+  /// @note No reader may be left
+  ~ConcurrentIDMap() {
+    delete m_Table.load();
+  }
+
+  ConcurrentIDMap(const ConcurrentIDMap&) = delete;
+  ConcurrentIDMap& operator=(const ConcurrentIDMap&) = delete;
+
+  /// @brief Looks up an ID without locking
+  /// @note Must be called in a critical section of the epoch domain, the
+  ///   object stays alive until the section ends
+  /// @return Object or nullptr if none
+  Value* Find(
+      std::uint32_t id) const {
+    const Table* table = m_Table.load();
+    const std::uint64_t key = GetKey(id);
+    for (std::size_t i = GetIndex(id, *table); ; i = (i + 1) & table->mask) {
+      const Slot& slot = table->slots[i];
+      std::uint64_t slot_key = slot.key.load();
+      if (slot_key == EMPTY_KEY)
+        return nullptr;
+      if (slot_key != key)
+        continue;
+      Value* value = slot.value.load();
+      // A writer may have removed the ID and reused the slot since
+      if (slot.key.load() == key && value)
+        return value;
+    }
+  }
+
+  /// @brief Looks up an ID and shares ownership of the object
+  /// @return Object or nullptr if none
+  std::shared_ptr<Value> Get(
+      std::uint32_t id) const {
+    EpochDomain::Guard guard(m_Epoch);
+    Value* value = Find(id);
+    return value ? value->shared_from_this() : nullptr;
+  }
+
+  /// @brief Adds an object unless the ID is taken
+  /// @return True if added
+  bool Insert(
+      std::uint32_t id,
+      std::shared_ptr<Value> value) {
+    std::unique_lock<std::mutex> l(m_WriteMutex);
+    Table* table = m_Table.load();
+    if (Lookup(id, *table) != NOT_FOUND)
+      return false;
+    Add(id, std::move(value));
+    Reclaim();
+    return true;
+  }
+
+  /// @brief Adds an object, replacing the one with the same ID
+  void Set(
+      std::uint32_t id,
+      std::shared_ptr<Value> value) {
+    std::unique_lock<std::mutex> l(m_WriteMutex);
+    Table* table = m_Table.load();
+    std::size_t i = Lookup(id, *table);
+    if (i == NOT_FOUND) {
+      Add(id, std::move(value));
+    } else {
+      table->slots[i].value.store(value.get());
+      std::swap(table->owners[i], value);
+      m_Epoch.Retire(std::move(value));
+    }
+    Reclaim();
+  }
+
+  /// @brief Removes an ID
+  /// @param value If not nullptr, remove only if the ID maps to this object
+  /// @return True if removed
+  bool Remove(
+      std::uint32_t id,
+      const Value* value = nullptr) {
+    std::unique_lock<std::mutex> l(m_WriteMutex);
+    Table* table = m_Table.load();
+    std::size_t i = Lookup(id, *table);
+    if (i == NOT_FOUND)
+      return false;
+    Slot& slot = table->slots[i];
+    if (value && slot.value.load() != value)
+      return false;
+    // The slot stays used: probes for other IDs must go past it
+    slot.key.store(TOMBSTONE_KEY);
+    slot.value.store(nullptr);
+    m_Epoch.Retire(std::move(table->owners[i]));
+    m_Size--;
+    Reclaim();
+    return true;
+  }
+
+  /// @brief Removes all IDs
+  void Clear() {
+    std::unique_lock<std::mutex> l(m_WriteMutex);
+    Replace(new Table(MIN_CAPACITY));
+    m_Size = 0;
+    Reclaim();
+  }
+
+  /// @return Copy of the objects, to iterate over without holding up
+  ///   writers
+  std::vector<std::shared_ptr<Value> > GetValues() const {
+    std::vector<std::shared_ptr<Value> > values;
+    std::unique_lock<std::mutex> l(m_WriteMutex);
+    const Table* table = m_Table.load();
+    values.reserve(m_Size);
+    for (std::size_t i = 0; i <= table->mask; i++)
+      if (table->owners[i])
+        values.push_back(table->owners[i]);
+    return values;
+  }
+
+  /// @return Number of IDs
+  std::size_t GetSize() const {
+    return m_Size;
+  }
+
+  /// @return True if there are no IDs
+  bool IsEmpty() const {
+    return !m_Size;
+  }
+
+  /// @return Number of slots of the current table
+  std::size_t GetCapacity() const {
+    return m_Table.load()->mask + 1;
+  }
+
+ private:
+  static const std::uint64_t EMPTY_KEY = 0;
+  static const std::uint64_t TOMBSTONE_KEY = 1;
+  static const std::size_t MIN_CAPACITY = 64;
+  static const std::size_t NOT_FOUND = ~static_cast<std::size_t>(0);
+
+  // 16 bytes, four to a cache line
+  struct Slot {
+    std::atomic<std::uint64_t> key;
+    std::atomic<Value*> value;
+  };
+
+  struct Table {
+    explicit Table(
+        std::size_t capacity)
+        : mask(capacity - 1),
+          num_used(0),
+          slots(new Slot[capacity]),
+          owners(new std::shared_ptr<Value>[capacity]) {
+      for (std::size_t i = 0; i < capacity; i++) {
+        slots[i].key.store(EMPTY_KEY, std::memory_order_relaxed);
+        slots[i].value.store(nullptr, std::memory_order_relaxed);
+      }
+    }
+
+    const std::size_t mask;
+    std::size_t num_used;  // Live and removed, only used by writers
+    std::unique_ptr<Slot[]> slots;
+    // Only used by writers, keep slots dense for readers
+    std::unique_ptr<std::shared_ptr<Value>[]> owners;
+  };
+
+  // Live keys have a bit above the ID set, so no ID collides with the
+  // empty or removed markers
+  static std::uint64_t GetKey(
+      std::uint32_t id) {
+    return (static_cast<std::uint64_t>(1) << 32) | id;
+  }
+
+  // IDs of transit tunnels are picked by remote routers, so they are
+  // mixed with a secret seed before probing
+  std::size_t GetIndex(
+      std::uint32_t id,
+      const Table& table) const {
+    std::uint64_t hash = (id ^ m_Seed) * 0x9E3779B97F4A7C15ULL;
+    return static_cast<std::size_t>(hash >> 32) & table.mask;
+  }
+
+  // Called with the write lock
+  std::size_t Lookup(
+      std::uint32_t id,
+      const Table& table) const {
+    const std::uint64_t key = GetKey(id);
+    for (std::size_t i = GetIndex(id, table); ; i = (i + 1) & table.mask) {
+      std::uint64_t slot_key = table.slots[i].key.load();
+      if (slot_key == EMPTY_KEY)
+        return NOT_FOUND;
+      if (slot_key == key)
+        return i;
+    }
+  }
+
+  // Called with the write lock, the ID must not be in the map
+  void Add(
+      std::uint32_t id,
+      std::shared_ptr<Value> value) {
+    Table* table = m_Table.load();
+    // Keep at least half of the slots empty so probes stay short
+    if ((table->num_used + 1) * 2 > table->mask + 1) {
+      std::size_t capacity = MIN_CAPACITY;
+      while (capacity < (m_Size + 1) * 4)
+        capacity *= 2;
+      table = Rebuild(capacity);
+    }
+    std::size_t i = GetIndex(id, *table);
+    // Reuse the first removed slot on the probe
+    while (table->slots[i].key.load() > TOMBSTONE_KEY)
+      i = (i + 1) & table->mask;
+    Slot& slot = table->slots[i];
+    if (slot.key.load() == EMPTY_KEY)
+      table->num_used++;
+    // Readers match the key first, so publish the value before it
+    slot.value.store(value.get());
+    slot.key.store(GetKey(id));
+    table->owners[i] = std::move(value);
+    m_Size++;
+  }
+
+  // Called with the write lock, moves the live IDs into a new table
+  // without the removed ones
+  Table* Rebuild(
+      std::size_t capacity) {
+    Table* old_table = m_Table.load();
+    Table* table = new Table(capacity);
+    for (std::size_t i = 0; i <= old_table->mask; i++) {
+      if (!old_table->owners[i])
+        continue;
+      std::uint64_t key = old_table->slots[i].key.load();
+      std::size_t j = GetIndex(static_cast<std::uint32_t>(key), *table);
+      while (table->slots[j].key.load(std::memory_order_relaxed) != EMPTY_KEY)
+        j = (j + 1) & table->mask;
+      table->slots[j].key.store(key, std::memory_order_relaxed);
+      table->slots[j].value.store(
+          old_table->slots[i].value.load(),
+          std::memory_order_relaxed);
+      // Readers of the old table still reach the objects through the
+      // new one, which owns them from now on
+      table->owners[j] = std::move(old_table->owners[i]);
+      table->num_used++;
+    }
+    Replace(table);
+    return table;
+  }
+
+  // Called with the write lock, publishes a table and retires the old one
+  void Replace(
+      Table* table) {
+    std::shared_ptr<Table> old_table(m_Table.exchange(table));
+    m_Epoch.Retire(std::move(old_table));
+  }
+
+  void Reclaim() {
+    m_Epoch.Reclaim();
+  }
+
+ private:
+  EpochDomain& m_Epoch;
+  const std::uint32_t m_Seed;
+  std::atomic<Table*> m_Table;
+  std::atomic<std::size_t> m_Size;
+  mutable std::mutex m_WriteMutex;
+};
+
+}  // namespace util
+}  // namespace i2p
+
+#endif  // SRC_CORE_UTIL_CONCURRENTIDMAP_H_
@@ -0,0 +1,225 @@
+/**
+ * Copyright (c) 2015-2016, The Kovri I2P Router Project
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ *    conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *    of conditions and the following disclaimer in the documentation and/or other
+ *    materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SRC_CORE_UTIL_DUPLICATEFILTER_H_
+#define SRC_CORE_UTIL_DUPLICATEFILTER_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace i2p {
+namespace util {
+
+/// @class DuplicateFilter
+/// @brief Time-windowed filter of recently seen keys
+/// @details Two generations of Bloom filter: keys are inserted into the
+///   current one and looked up in both. The current generation becomes
+///   the previous one once it holds capacity keys or window has elapsed,
+///   so a key is remembered for at least one window (or capacity keys)
+///   and there is no moment at which the filter forgets everything.
+///   A duplicate is never missed within that window; a new key is
+///   reported as a duplicate with about the configured probability.
+/// @note Not thread-safe
+class DuplicateFilter {
+ public:
+  /// @param capacity Keys per generation
+  /// @param false_positive_rate Target rate of both generations together
+  /// @param window Lifetime of a generation, in the unit of 'now'
+  DuplicateFilter(
+      std::size_t capacity,
+      double false_positive_rate,
+      std::uint64_t window)
+      : m_Capacity(capacity ? capacity : 1),
+        m_Window(window),
+        m_NumHashes(1),
+        m_Seed(std::random_device()()),
+        m_LastRotation(0),
+        m_NumChecks(0),
+        m_NumHits(0),
+        m_ExpectedFalsePositives(0.0) {
+    if (!(false_positive_rate > 0.0 && false_positive_rate < 1.0))
+      false_positive_rate = 0.001;
+    // each generation gets half of the false-positive budget
+    const double ln2 = std::log(2.0);
+    double num_bits =
+      -static_cast<double>(m_Capacity) * std::log(false_positive_rate / 2)
+      / (ln2 * ln2);
+    // round up to a power of two so probes are masked, not divided
+    std::size_t size = 64;
+    while (size < num_bits)
+      size <<= 1;
+    m_Mask = size - 1;
+    m_NumHashes = static_cast<std::size_t>(
+        std::lround(static_cast<double>(size) / m_Capacity * ln2));
+    if (m_NumHashes < 1)
+      m_NumHashes = 1;
+    if (m_NumHashes > 16)
+      m_NumHashes = 16;
+    for (auto& generation : m_Generations) {
+      generation.bits.assign(size / 64, 0);
+      generation.num_keys = 0;
+      generation.num_set_bits = 0;
+    }
+  }
+
+  /// @brief Looks up key and remembers it
+  /// @param now Current time, in the unit of the window
+  /// @return True if key was seen within the window
+  bool IsDuplicate(
+      std::uint64_t key,
+      std::uint64_t now) {
+    m_NumChecks++;
+    if (now >= m_LastRotation + m_Window ||
+        m_Generations[0].num_keys >= m_Capacity) {
+      Rotate();
+      m_LastRotation = now;
+    }
+    std::uint64_t h1 = Mix(key ^ m_Seed), h2 = Mix(h1) | 1;
+    if (Contains(m_Generations[0], h1, h2) ||
+        Contains(m_Generations[1], h1, h2)) {
+      m_NumHits++;
+      return true;
+    }
+    // chance this new key would have been reported as a duplicate
+    double current = GetFillRatio(m_Generations[0]),
+           previous = GetFillRatio(m_Generations[1]);
+    m_ExpectedFalsePositives += 1.0 -
+      (1.0 - std::pow(current, m_NumHashes)) *
+      (1.0 - std::pow(previous, m_NumHashes));
+    Insert(&m_Generations[0], h1, h2);
+    return false;
+  }
+
+  /// @brief Forgets all keys, keeps counters
+  void Clear() {
+    for (auto& generation : m_Generations) {
+      std::fill(generation.bits.begin(), generation.bits.end(), 0);
+      generation.num_keys = 0;
+      generation.num_set_bits = 0;
+    }
+  }
+
+  std::size_t GetCapacity() const {
+    return m_Capacity;
+  }
+
+  /// @return Number of keys looked up
+  std::uint64_t GetNumChecks() const {
+    return m_NumChecks;
+  }
+
+  /// @return Number of keys reported as duplicates
+  std::uint64_t GetNumHits() const {
+    return m_NumHits;
+  }
+
+  /// @return Estimated number of hits that were new keys
+  /// @details Sum of the false-positive probability at each insertion
+  double GetExpectedFalsePositives() const {
+    return m_ExpectedFalsePositives;
+  }
+
+ private:
+  struct Generation {
+    std::vector<std::uint64_t> bits;
+    std::size_t num_keys, num_set_bits;
+  };
+
+  /// @brief SplitMix64 finalizer
+  static std::uint64_t Mix(
+      std::uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+  }
+
+  bool Contains(
+      const Generation& generation,
+      std::uint64_t h1,
+      std::uint64_t h2) const {
+    for (std::size_t i = 0; i < m_NumHashes; i++) {
+      std::uint64_t bit = (h1 + i * h2) & m_Mask;
+      if (!(generation.bits[bit >> 6] & (1ULL << (bit & 63))))
+        return false;
+    }
+    return true;
+  }
+
+  void Insert(
+      Generation* generation,
+      std::uint64_t h1,
+      std::uint64_t h2) {
+    for (std::size_t i = 0; i < m_NumHashes; i++) {
+      std::uint64_t bit = (h1 + i * h2) & m_Mask;
+      std::uint64_t& word = generation->bits[bit >> 6];
+      std::uint64_t flag = 1ULL << (bit & 63);
+      if (!(word & flag)) {
+        word |= flag;
+        generation->num_set_bits++;
+      }
+    }
+    generation->num_keys++;
+  }
+
+  double GetFillRatio(
+      const Generation& generation) const {
+    return static_cast<double>(generation.num_set_bits) / (m_Mask + 1);
+  }
+
+  void Rotate() {
+    std::swap(m_Generations[0], m_Generations[1]);
+    auto& current = m_Generations[0];
+    std::fill(current.bits.begin(), current.bits.end(), 0);
+    current.num_keys = 0;
+    current.num_set_bits = 0;
+  }
+
+ private:
+  std::size_t m_Capacity;
+  std::uint64_t m_Window;
+  std::uint64_t m_Mask;  // number of bits per generation - 1
+  std::size_t m_NumHashes;
+  std::uint64_t m_Seed;
+  std::uint64_t m_LastRotation;
+  Generation m_Generations[2];  // current, previous
+  std::uint64_t m_NumChecks, m_NumHits;
+  double m_ExpectedFalsePositives;
+};
+
+}  // namespace util
+}  // namespace i2p
+
+#endif  // SRC_CORE_UTIL_DUPLICATEFILTER_H_
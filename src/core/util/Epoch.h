@@ -0,0 +1,229 @@
+/**
+ * Copyright (c) 2015-2016, The Kovri I2P Router Project
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ *    conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *    of conditions and the following disclaimer in the documentation and/or other
+ *    materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SRC_CORE_UTIL_EPOCH_H_
+#define SRC_CORE_UTIL_EPOCH_H_
+
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace i2p {
+namespace util {
+
+// Threads that can be in a critical section of a domain at the same time
+// with a slot of their own. Any further threads share a counter which
+// holds back all reclamation while they read.
+const std::size_t EPOCH_MAX_THREADS = 128;
+
+/// @class EpochThreadIndex
+/// @brief Index of the calling thread among live threads, reused once
+///   the thread exits
+class EpochThreadIndex {
+ public:
+  /// @return Index below EPOCH_MAX_THREADS, or EPOCH_MAX_THREADS if
+  ///   all are taken
+  static std::size_t Get() {
+    thread_local EpochThreadIndex index;
+    return index.m_Index;
+  }
+
+ private:
+  EpochThreadIndex()
+      : m_Index(EPOCH_MAX_THREADS) {
+    std::unique_lock<std::mutex> l(GetMutex());
+    auto& used = GetUsed();
+    for (std::size_t i = 0; i < EPOCH_MAX_THREADS; i++)
+      if (!used[i]) {
+        used[i] = true;
+        m_Index = i;
+        break;
+      }
+  }
+
+  ~EpochThreadIndex() {
+    if (m_Index == EPOCH_MAX_THREADS)
+      return;
+    std::unique_lock<std::mutex> l(GetMutex());
+    GetUsed()[m_Index] = false;
+  }
+
+  static std::mutex& GetMutex() {
+    static std::mutex mutex;
+    return mutex;
+  }
+
+  static std::bitset<EPOCH_MAX_THREADS>& GetUsed() {
+    static std::bitset<EPOCH_MAX_THREADS> used;
+    return used;
+  }
+
+ private:
+  std::size_t m_Index;
+};
+
+/// @class EpochDomain
+/// @brief Epoch based reclamation of objects read without locks
+/// @details A reader enters a critical section with a Guard, which
+///   publishes the global epoch in the slot of its thread: a load and a
+///   store, so readers never wait. A writer unlinks an object, then
+///   retires it, which tags it with the global epoch and advances it.
+///   The object is destroyed once every reader still in a critical
+///   section entered at a later epoch, so none of them can reach it.
+/// @note Thread-safe
+class EpochDomain {
+ public:
+  /// @class Guard
+  /// @brief Critical section in which retired objects stay alive.
+  ///   Guards of a thread may be nested.
+  class Guard {
+   public:
+    explicit Guard(
+        EpochDomain& domain)
+        : m_Domain(domain),
+          m_Index(EpochThreadIndex::Get()) {
+      m_Domain.Enter(m_Index);
+    }
+
+    ~Guard() {
+      m_Domain.Leave(m_Index);
+    }
+
+    Guard(const Guard&) = delete;
+    Guard& operator=(const Guard&) = delete;
+
+   private:
+    EpochDomain& m_Domain;
+    std::size_t m_Index;
+  };
+
+  EpochDomain()
+      : m_Epoch(1),
+        m_NumUnslotted(0) {
+    for (auto& slot : m_Slots) {
+      slot.epoch = 0;
+      slot.depth = 0;
+    }
+  }
+
+  EpochDomain(const EpochDomain&) = delete;
+  EpochDomain& operator=(const EpochDomain&) = delete;
+
+  /// @brief Hands over an unlinked object, destroyed with its owner
+  ///   once no reader can reach it
+  void Retire(
+      std::shared_ptr<void> object) {
+    std::uint64_t epoch = m_Epoch.fetch_add(1);
+    std::unique_lock<std::mutex> l(m_RetiredMutex);
+    m_Retired.emplace_back(epoch, std::move(object));
+  }
+
+  /// @brief Destroys the retired objects no reader can reach any more
+  void Reclaim() {
+    std::vector<std::shared_ptr<void> > reclaimed;
+    {
+      std::unique_lock<std::mutex> l(m_RetiredMutex);
+      if (m_Retired.empty() || m_NumUnslotted)
+        return;
+      std::uint64_t min_epoch = std::numeric_limits<std::uint64_t>::max();
+      for (const auto& slot : m_Slots) {
+        std::uint64_t epoch = slot.epoch;
+        if (epoch && epoch < min_epoch)
+          min_epoch = epoch;
+      }
+      auto it = std::partition(
+          m_Retired.begin(),
+          m_Retired.end(),
+          [min_epoch](const Retired& retired) {
+            return retired.first >= min_epoch;
+          });
+      for (auto i = it; i != m_Retired.end(); i++)
+        reclaimed.push_back(std::move(i->second));
+      m_Retired.erase(it, m_Retired.end());
+    }
+    // destroyed outside of the lock
+  }
+
+  /// @return Number of objects waiting to be destroyed
+  std::size_t GetNumRetired() const {
+    std::unique_lock<std::mutex> l(m_RetiredMutex);
+    return m_Retired.size();
+  }
+
+ private:
+  void Enter(
+      std::size_t index) {
+    if (index == EPOCH_MAX_THREADS) {
+      m_NumUnslotted++;
+      return;
+    }
+    auto& slot = m_Slots[index];
+    if (!slot.depth++)
+      slot.epoch = m_Epoch.load();
+  }
+
+  void Leave(
+      std::size_t index) {
+    if (index == EPOCH_MAX_THREADS) {
+      m_NumUnslotted--;
+      return;
+    }
+    auto& slot = m_Slots[index];
+    if (!--slot.depth)
+      slot.epoch.store(0, std::memory_order_release);
+  }
+
+ private:
+  typedef std::pair<std::uint64_t, std::shared_ptr<void> > Retired;
+
+  // A line each, readers of different threads don't share them
+  struct alignas(64) Slot {
+    std::atomic<std::uint64_t> epoch;  // 0 outside of critical sections
+    std::size_t depth;  // only used by the owning thread
+  };
+
+  std::atomic<std::uint64_t> m_Epoch;
+  Slot m_Slots[EPOCH_MAX_THREADS];
+  std::atomic<std::size_t> m_NumUnslotted;
+  mutable std::mutex m_RetiredMutex;
+  std::vector<Retired> m_Retired;
+};
+
+}  // namespace util
+}  // namespace i2p
+
+#endif  // SRC_CORE_UTIL_EPOCH_H_
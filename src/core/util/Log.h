@@ -33,6 +33,7 @@
 #ifndef SRC_CORE_UTIL_LOG_H_
 #define SRC_CORE_UTIL_LOG_H_
 
+#include <atomic>
 #include <iostream>
 #include <memory>
 #include <string>
@@ -86,6 +87,37 @@ void SetGlobalLogLevels(
 /// @return Log levels/severity
 const LogLevelsMap& GetGlobalLogLevels();
 
+/// @var g_IsLogLevelEnabled
+/// @brief Per level flags kept in sync with global log levels,
+///   for a lock-free check before a message is formatted
+extern std::atomic<bool> g_IsLogLevelEnabled[eLogLevelError + 1];
+
+/// @return True if messages of given level are logged
+/// @note Debug messages are compiled out when built with WITH_DEBUG_LOG=OFF
+inline bool IsLogLevelEnabled(
+    LogLevel level) {
+#ifdef KOVRI_NO_DEBUG_LOG
+  if (level == eLogLevelDebug)
+    return false;
+#endif
+  return g_IsLogLevelEnabled[level].load(std::memory_order_relaxed);
+}
+
+/// @brief Messages without a level are logged as info
+template<typename Arg>
+bool IsLogLevelEnabled(
+    const Arg&) {
+  return IsLogLevelEnabled(eLogLevelInfo);
+}
+
+/// @return This thread's formatting stream, emptied
+std::ostream& GetLogBuffer();
+
+/// @brief Passes the content of this thread's formatting stream
+///   to the log sink
+void FlushLogBuffer(
+    LogLevel level);
+
 class LogStreamImpl;
 class LogStream : public std::ostream {
  public:
@@ -196,80 +228,53 @@ void DeprecatedStopLog();
 template<typename Arg>
 void DeprecatedLog(
     std::ostream& stream,
-    Arg arg) {
+    const Arg& arg) {
   stream << arg;
 }
 
 template<typename Value, typename... Args>
 void DeprecatedLog(
     std::ostream& stream,
-    Value arg,
-    Args... args) {
+    const Value& arg,
+    const Args&... args) {
   DeprecatedLog(stream, arg);
   DeprecatedLog(stream, args...);
 }
 
-// TODO(unassigned): more efficient way to execute this function.
+/// @brief Formats a message in a per-thread buffer and hands it
+///   to the asynchronous log sink
 template<typename... Args>
 void DeprecatedLogPrint(
     i2p::util::log::LogLevel level,
-    Args... args) {
-  auto logger = i2p::util::log::Log::Get();
-  if (logger == nullptr) {
-    // fallback logging to std::clog
-    std::clog << "!!! ";
-    DeprecatedLog(std::clog, args...);
-    std::clog << std::endl;
-  } else {
-    // Set log implementation
-    auto log = logger->Default();
-    // Get global log levels
-    auto global_levels = i2p::util::log::GetGlobalLogLevels();
-    // Print log after testing arg level against global levels
-    if (level == eLogDebug) {
-      for (auto& current_level : global_levels) {
-        if (current_level.second == eLogDebug) {
-          auto& stream = log->Debug();
-          DeprecatedLog(stream, args...);
-          stream << std::flush;
-        }
-      }
-    } else if (level == eLogInfo) {
-      for (auto& current_level : global_levels) {
-        if (current_level.second == eLogInfo) {
-          auto& stream = log->Info();
-          DeprecatedLog(stream, args...);
-          stream << std::flush;
-        }
-      }
-    } else if (level == eLogWarn) {
-      for (auto& current_level : global_levels) {
-        if (current_level.second == eLogWarn) {
-          auto& stream = log->Warn();
-          DeprecatedLog(stream, args...);
-          stream << std::flush;
-        }
-      }
-    } else if (level == eLogError) {
-      for (auto& current_level : global_levels)  {
-        if (current_level.second == eLogError) {
-          auto& stream = log->Error();
-          DeprecatedLog(stream, args...);
-          stream << std::flush;
-        }
-      }
-    }
-  }
+    const Args&... args) {
+  if (!i2p::util::log::IsLogLevelEnabled(level))
+    return;
+  auto& stream = i2p::util::log::GetLogBuffer();
+  DeprecatedLog(stream, args...);
+  i2p::util::log::FlushLogBuffer(level);
 }
 
 template<typename... Args>
 void DeprecatedLogPrint(
-    Args... args) {
+    const Args&... args) {
   DeprecatedLogPrint(eLogInfo, args...);
 }
 
+#define KOVRI_LOG_FIRST_ARG(...) KOVRI_LOG_FIRST_ARG_(__VA_ARGS__, 0)
+#define KOVRI_LOG_FIRST_ARG_(first, ...) first
+
+/// @brief Logs a message made of all arguments after an optional level
+/// @details The level is checked before the arguments are evaluated,
+///   so expensive arguments cost nothing when their level is off.
+///   The first argument (level or leading message part) is evaluated
+///   twice and must be a constant or a literal.
+#define LogPrint(...) \
+  do { \
+    if (i2p::util::log::IsLogLevelEnabled(KOVRI_LOG_FIRST_ARG(__VA_ARGS__))) \
+      DeprecatedLogPrint(__VA_ARGS__); \
+  } while (false)
+
 #define StartLog DeprecatedStartLog
-#define LogPrint DeprecatedLogPrint
 #define StopLog DeprecatedStopLog
 
 #endif  // SRC_CORE_UTIL_LOG_H_
@@ -0,0 +1,341 @@
+/**
+ * Copyright (c) 2015-2016, The Kovri I2P Router Project
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ *    conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *    of conditions and the following disclaimer in the documentation and/or other
+ *    materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SRC_CORE_UTIL_MPSCQUEUE_H_
+#define SRC_CORE_UTIL_MPSCQUEUE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace i2p {
+namespace util {
+
+const std::size_t MPSC_QUEUE_DEFAULT_CAPACITY = 8192;
+
+/// @class MPSCQueue
+/// @brief Bounded lock-free queue for many producers and one consumer
+/// @details Ring of sequence-numbered cells (after D. Vyukov's bounded queue).
+///   Producers claim a cell with a single CAS and never block; Put fails
+///   and the element is dropped when the ring is full.
+///   The consumer only takes a mutex to sleep: producers check an atomic
+///   waiter count after publishing and signal only if someone sleeps,
+///   which makes the idle wake-up an eventcount rather than a lock per Put.
+/// @param Element Nullable type (pointer, smart pointer). A null element
+///   is returned when the queue is empty.
+template<typename Element>
+class MPSCQueue {
+ public:
+  /// @param capacity Rounded up to a power of two
+  explicit MPSCQueue(
+      std::size_t capacity = MPSC_QUEUE_DEFAULT_CAPACITY)
+      : m_Capacity(RoundUpPow2(capacity)),
+        m_Mask(m_Capacity - 1),
+        m_Cells(new Cell[m_Capacity]),
+        m_EnqueuePos(0),
+        m_DequeuePos(0),
+        m_HighWaterMark(0),
+        m_NumDropped(0),
+        m_NumWaiters(0),
+        m_NumWakeUps(0) {
+    for (std::size_t i = 0; i < m_Capacity; i++)
+      m_Cells[i].sequence.store(i, std::memory_order_relaxed);
+  }
+
+  ~MPSCQueue() {
+    delete[] m_Cells;
+  }
+
+  MPSCQueue(const MPSCQueue&) = delete;
+  MPSCQueue& operator=(const MPSCQueue&) = delete;
+
+  /// @brief Enqueues element, safe from any thread
+  /// @return False if the queue was full and the element dropped
+  bool Put(
+      Element e) {
+    std::size_t pos;
+    if (!Reserve(1, pos)) {
+      m_NumDropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    Publish(pos, std::move(e));
+    OnPut(pos + 1);
+    return true;
+  }
+
+  /// @brief Enqueues all elements with one reservation and one wake-up
+  /// @return False if the queue had no room for all of them.
+  ///   As many as fit are enqueued, the rest are dropped.
+  bool Put(
+      const std::vector<Element>& vec) {
+    if (vec.empty())
+      return true;
+    std::size_t pos;
+    if (Reserve(vec.size(), pos)) {
+      for (std::size_t i = 0; i < vec.size(); i++)
+        Publish(pos + i, vec[i]);
+      OnPut(pos + vec.size());
+      return true;
+    }
+    // Not enough room for all at once
+    bool all = true;
+    for (const auto& e : vec)
+      all &= Put(e);
+    return all;
+  }
+
+  /// @brief Dequeues without blocking. Consumer thread only.
+  /// @return Next element or null if empty
+  Element Get() {
+    const std::size_t pos = m_DequeuePos.load(std::memory_order_relaxed);
+    Cell& cell = m_Cells[pos & m_Mask];
+    const std::size_t seq = cell.sequence.load(std::memory_order_acquire);
+    if (seq != pos + 1)
+      return nullptr;
+    Element el = std::move(cell.data);
+    cell.data = nullptr;
+    cell.sequence.store(pos + m_Capacity, std::memory_order_release);
+    m_DequeuePos.store(pos + 1, std::memory_order_relaxed);
+    return el;
+  }
+
+  /// @brief Dequeues up to max elements without blocking. Consumer only.
+  /// @return Number of elements appended to batch
+  std::size_t GetBatch(
+      std::vector<Element>& batch,
+      std::size_t max) {
+    std::size_t num = 0;
+    while (num < max) {
+      auto el = Get();
+      if (!el)
+        break;
+      batch.push_back(std::move(el));
+      num++;
+    }
+    return num;
+  }
+
+  /// @brief As GetBatch, waiting up to msec if the queue is empty
+  std::size_t GetBatchWithTimeout(
+      std::vector<Element>& batch,
+      std::size_t max,
+      int msec) {
+    auto num = GetBatch(batch, max);
+    if (!num && WaitNonEmpty(std::chrono::milliseconds(msec)))
+      num = GetBatch(batch, max);
+    return num;
+  }
+
+  /// @brief Dequeues, waiting until an element arrives or WakeUp()
+  Element GetNext() {
+    auto el = Get();
+    if (!el) {
+      Wait();
+      el = Get();
+    }
+    return el;
+  }
+
+  /// @brief Dequeues, waiting up to msec if the queue is empty
+  Element GetNextWithTimeout(
+      int msec) {
+    auto el = Get();
+    if (!el && WaitNonEmpty(std::chrono::milliseconds(msec)))
+      el = Get();
+    return el;
+  }
+
+  /// @brief Waits until the queue is non-empty or WakeUp()
+  void Wait() {
+    while (!WaitNonEmpty(std::chrono::hours(24))) {}
+  }
+
+  /// @brief Waits until the queue is non-empty, WakeUp() or timeout
+  /// @return False on timeout
+  bool Wait(
+      int sec,
+      int msec) {
+    return WaitNonEmpty(
+        std::chrono::seconds(sec) + std::chrono::milliseconds(msec));
+  }
+
+  /// @brief Wakes up the consumer even if the queue is empty
+  void WakeUp() {
+    {
+      std::unique_lock<std::mutex> l(m_WaitMutex);
+      m_NumWakeUps++;
+    }
+    m_NonEmpty.notify_all();
+  }
+
+  bool IsEmpty() const {
+    const std::size_t pos = m_DequeuePos.load(std::memory_order_relaxed);
+    return m_Cells[pos & m_Mask].sequence.load(std::memory_order_acquire)
+      != pos + 1;
+  }
+
+  /// @return Approximate number of queued elements
+  std::size_t GetSize() const {
+    const std::size_t tail = m_DequeuePos.load(std::memory_order_relaxed);
+    const std::size_t head = m_EnqueuePos.load(std::memory_order_relaxed);
+    return head > tail ? std::min(head - tail, m_Capacity) : 0;
+  }
+
+  std::size_t GetCapacity() const {
+    return m_Capacity;
+  }
+
+  /// @return Largest (approximate) size seen by a producer
+  std::size_t GetHighWaterMark() const {
+    return m_HighWaterMark.load(std::memory_order_relaxed);
+  }
+
+  /// @return Number of elements dropped because the queue was full
+  std::uint64_t GetNumDropped() const {
+    return m_NumDropped.load(std::memory_order_relaxed);
+  }
+
+ private:
+  struct Cell {
+    std::atomic<std::size_t> sequence;
+    Element data;
+  };
+
+  static std::size_t RoundUpPow2(
+      std::size_t n) {
+    std::size_t pow2 = 2;
+    while (pow2 < n)
+      pow2 <<= 1;
+    return pow2;
+  }
+
+  /// @brief Claims num consecutive cells
+  /// @param pos Set to the position of the first cell
+  /// @return False if fewer than num cells are free
+  bool Reserve(
+      std::size_t num,
+      std::size_t& pos) {
+    if (num > m_Capacity)
+      return false;
+    pos = m_EnqueuePos.load(std::memory_order_relaxed);
+    for (;;) {
+      // The consumer frees cells in order, so the last one being free
+      // means all of them are
+      const std::size_t last = pos + num - 1;
+      const std::size_t seq =
+        m_Cells[last & m_Mask].sequence.load(std::memory_order_acquire);
+      const auto diff =
+        static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(last);
+      if (diff == 0) {
+        if (m_EnqueuePos.compare_exchange_weak(
+                pos, pos + num, std::memory_order_relaxed))
+          return true;
+      } else if (diff < 0) {
+        return false;  // full
+      } else {
+        pos = m_EnqueuePos.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  template<typename T>
+  void Publish(
+      std::size_t pos,
+      T&& e) {
+    Cell& cell = m_Cells[pos & m_Mask];
+    cell.data = std::forward<T>(e);
+    cell.sequence.store(pos + 1, std::memory_order_release);
+  }
+
+  /// @param head Enqueue position after the put
+  void OnPut(
+      std::size_t head) {
+    const std::size_t tail = m_DequeuePos.load(std::memory_order_relaxed);
+    // tail may be stale, so clamp
+    const std::size_t size =
+      head > tail ? std::min(head - tail, m_Capacity) : 0;
+    auto mark = m_HighWaterMark.load(std::memory_order_relaxed);
+    while (size > mark &&
+        !m_HighWaterMark.compare_exchange_weak(
+            mark, size, std::memory_order_relaxed)) {}
+    // Pairs with the fence in WaitNonEmpty: either we see the waiter
+    // or the waiter sees our element
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_NumWaiters.load(std::memory_order_relaxed)) {
+      { std::unique_lock<std::mutex> l(m_WaitMutex); }
+      m_NonEmpty.notify_one();
+    }
+  }
+
+  /// @return False on timeout
+  template<typename Duration>
+  bool WaitNonEmpty(
+      Duration timeout) {
+    std::unique_lock<std::mutex> l(m_WaitMutex);
+    const auto wake_ups = m_NumWakeUps;
+    m_NumWaiters.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    bool woken = m_NonEmpty.wait_for(l, timeout, [this, wake_ups] {
+        return !IsEmpty() || m_NumWakeUps != wake_ups;
+      });
+    m_NumWaiters.fetch_sub(1, std::memory_order_relaxed);
+    return woken;
+  }
+
+  // Padding keeps producer, consumer and waiter state on separate cache
+  // lines, the members in between are read-only after construction
+  static const std::size_t CACHE_LINE_SIZE = 64;
+
+  const std::size_t m_Capacity,
+                    m_Mask;
+  Cell* const m_Cells;
+  char m_Pad0[CACHE_LINE_SIZE];
+  std::atomic<std::size_t> m_EnqueuePos;
+  char m_Pad1[CACHE_LINE_SIZE - sizeof(std::atomic<std::size_t>)];
+  std::atomic<std::size_t> m_DequeuePos;
+  char m_Pad2[CACHE_LINE_SIZE - sizeof(std::atomic<std::size_t>)];
+  std::atomic<std::size_t> m_HighWaterMark;
+  std::atomic<std::uint64_t> m_NumDropped;
+  std::atomic<int> m_NumWaiters;
+  char m_Pad3[CACHE_LINE_SIZE];
+  std::mutex m_WaitMutex;
+  std::condition_variable m_NonEmpty;
+  std::uint64_t m_NumWakeUps;  // guarded by m_WaitMutex
+};
+
+}  // namespace util
+}  // namespace i2p
+
+#endif  // SRC_CORE_UTIL_MPSCQUEUE_H_
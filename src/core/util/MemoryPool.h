@@ -0,0 +1,165 @@
+/**
+ * Copyright (c) 2015-2016, The Kovri I2P Router Project
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ *    conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *    of conditions and the following disclaimer in the documentation and/or other
+ *    materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SRC_CORE_UTIL_MEMORYPOOL_H_
+#define SRC_CORE_UTIL_MEMORYPOOL_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+namespace i2p {
+namespace util {
+
+/// @class MemoryPool
+/// @brief Recycles objects of a single type through per-thread free lists
+///   backed by one central, mutex protected free list
+/// @details Objects released on one thread may be acquired on another.
+///   A thread only touches the central list when its own cache runs empty
+///   or overflows, and then moves half a cache worth of objects at once.
+///   The pool is never destroyed, and a thread whose cache is already
+///   gone uses the central list directly, so objects may still be
+///   released by destructors of other static or thread_local objects.
+/// @param Object Default constructible type with a Reset() member
+/// @param CacheSize Max number of free objects kept per thread
+/// @param CentralSize Max number of free objects kept in the central list
+template<class Object, std::size_t CacheSize = 64, std::size_t CentralSize = 1024>
+class MemoryPool {
+ public:
+  /// @return The process wide pool for this object type
+  /// @note Intentionally leaked: globals such as the tunnels, NetDb and
+  ///   transports are constructed before it and still release objects
+  ///   in their destructors
+  static MemoryPool& Instance() {
+    static auto* pool = new MemoryPool();
+    return *pool;
+  }
+
+  /// @return A recycled object if one is available, otherwise a new one
+  Object* Acquire() {
+    if (IsCacheDestroyed()) {
+      std::vector<Object*> objects;
+      Refill(&objects, 1);
+      return objects.empty() ? new Object() : objects.back();
+    }
+    auto& cache = GetCache();
+    if (cache.objects.empty())
+      Refill(&cache.objects, CacheSize / 2);
+    if (cache.objects.empty())
+      return new Object();
+    auto object = cache.objects.back();
+    cache.objects.pop_back();
+    return object;
+  }
+
+  /// @brief Resets given object and keeps it for reuse
+  void Release(
+      Object* object) {
+    object->Reset();
+    if (IsCacheDestroyed()) {
+      std::vector<Object*> objects { object };
+      Drain(&objects, 1);
+      return;
+    }
+    auto& cache = GetCache();
+    if (cache.objects.size() >= CacheSize)
+      Drain(&cache.objects, CacheSize / 2);
+    cache.objects.push_back(object);
+  }
+
+  /// @return Number of free objects in the central list
+  std::size_t GetCentralSize() {
+    std::unique_lock<std::mutex> l(m_ObjectsMutex);
+    return m_Objects.size();
+  }
+
+ private:
+  MemoryPool() {}
+  MemoryPool(const MemoryPool&) = delete;
+  MemoryPool& operator=(const MemoryPool&) = delete;
+
+  /// @brief Thread's own free list, handed back to the central list
+  ///   when the thread exits
+  struct Cache {
+    Cache() {
+      objects.reserve(CacheSize);
+    }
+    ~Cache() {
+      MemoryPool::Instance().Drain(&objects, objects.size());
+      IsCacheDestroyed() = true;
+    }
+    std::vector<Object*> objects;
+  };
+
+  static Cache& GetCache() {
+    static thread_local Cache cache;
+    return cache;
+  }
+
+  /// @return True once the thread's cache was destroyed at thread exit.
+  ///   Trivially destructible, so still usable after the cache is gone
+  static bool& IsCacheDestroyed() {
+    static thread_local bool is_destroyed = false;
+    return is_destroyed;
+  }
+
+  void Refill(
+      std::vector<Object*>* objects,
+      std::size_t max) {
+    std::unique_lock<std::mutex> l(m_ObjectsMutex);
+    std::size_t num = std::min(m_Objects.size(), max);
+    objects->insert(objects->end(), m_Objects.end() - num, m_Objects.end());
+    m_Objects.resize(m_Objects.size() - num);
+  }
+
+  void Drain(
+      std::vector<Object*>* objects,
+      std::size_t num) {
+    std::unique_lock<std::mutex> l(m_ObjectsMutex);
+    for (std::size_t i = 0; i < num; i++) {
+      auto object = objects->back();
+      objects->pop_back();
+      if (m_Objects.size() < CentralSize)
+        m_Objects.push_back(object);
+      else
+        delete object;
+    }
+  }
+
+ private:
+  std::vector<Object*> m_Objects;
+  std::mutex m_ObjectsMutex;
+};
+
+}  // namespace util
+}  // namespace i2p
+
+#endif  // SRC_CORE_UTIL_MEMORYPOOL_H_
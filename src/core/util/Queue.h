@@ -40,6 +40,8 @@
 #include <thread>
 #include <vector>
 
+#include "util/MPSCQueue.h"
+
 namespace i2p {
 namespace util {
 
@@ -140,8 +142,11 @@ class Queue {
   std::condition_variable m_NonEmpty;
 };
 
+/// @class MsgQueue
+/// @brief Runs Process() of posted messages on its own thread
+/// @note Messages are owned by the queue, dropped ones are deleted
 template<class Msg>
-class MsgQueue : public Queue<Msg *> {
+class MsgQueue : public MPSCQueue<Msg *> {
  public:
   typedef std::function<void()> OnEmpty;
 
@@ -155,10 +160,19 @@ class MsgQueue : public Queue<Msg *> {
     Stop();
   }
 
+  bool Put(
+      Msg* msg) {
+    if (!MPSCQueue<Msg *>::Put(msg)) {
+      delete msg;
+      return false;
+    }
+    return true;
+  }
+
   void Stop() {
     if (m_IsRunning) {
       m_IsRunning = false;
-      Queue<Msg *>::WakeUp();
+      MPSCQueue<Msg *>::WakeUp();
       m_Thread.join();
     }
   }
@@ -171,14 +185,14 @@ class MsgQueue : public Queue<Msg *> {
  private:
   void Run() {
     while (m_IsRunning) {
-      while (auto msg = Queue<Msg *>::Get()) {
+      while (auto msg = MPSCQueue<Msg *>::Get()) {
         msg->Process();
         delete msg;
       }
       if (m_OnEmpty != nullptr)
         m_OnEmpty();
       if (m_IsRunning)
-        Queue<Msg *>::Wait();
+        MPSCQueue<Msg *>::Wait(1, 0);
     }
   }
 
@@ -0,0 +1,216 @@
+/**
+ * Copyright (c) 2015-2016, The Kovri I2P Router Project
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ *    conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *    of conditions and the following disclaimer in the documentation and/or other
+ *    materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SRC_CORE_UTIL_RANDOMINDEX_H_
+#define SRC_CORE_UTIL_RANDOMINDEX_H_
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace i2p {
+namespace util {
+
+/// @brief Random picks tried before a RandomIndex falls back to a scan
+const std::size_t RANDOM_INDEX_MAX_ATTEMPTS = 32;
+
+/// @class RandomIndex
+/// @brief Set of elements kept in a contiguous array for uniform sampling
+/// @details Writers append and swap-remove under a mutex and only mark
+///   the index as changed. Readers sample an immutable copy of the array,
+///   which the first reader after a change publishes if no writer holds
+///   the mutex, so any number of writes in between cost one copy and
+///   sampling never waits on a writer. A reader may thus briefly see
+///   elements that were just removed, which stay valid as it owns them.
+/// @param Element Nullable, hashable type (e.g., std::shared_ptr).
+///   A null element is returned when nothing matches.
+template<typename Element>
+class RandomIndex {
+  typedef std::vector<Element> Elements;
+
+ public:
+  RandomIndex()
+      : m_IsChanged(false),
+        m_Snapshot(std::make_shared<const Elements>()) {}
+
+  /// @return False if element is already in the index
+  bool Add(
+      const Element& element) {
+    std::unique_lock<std::mutex> l(m_Mutex);
+    if (!m_Positions.emplace(element, m_Elements.size()).second)
+      return false;
+    m_Elements.push_back(element);
+    m_IsChanged = true;
+    return true;
+  }
+
+  /// @return False if element was not in the index
+  bool Remove(
+      const Element& element) {
+    std::unique_lock<std::mutex> l(m_Mutex);
+    if (!Erase(element))
+      return false;
+    m_IsChanged = true;
+    return true;
+  }
+
+  /// @brief Removes all elements matching predicate
+  /// @return Number of removed elements
+  template<typename Predicate>
+  std::size_t RemoveIf(
+      Predicate predicate) {
+    std::unique_lock<std::mutex> l(m_Mutex);
+    std::size_t num = 0;
+    for (std::size_t i = 0; i < m_Elements.size();) {
+      if (predicate(m_Elements[i])) {
+        Erase(Element(m_Elements[i]));
+        num++;
+      } else {
+        i++;  // the swapped in element is checked at the same position
+      }
+    }
+    if (num)
+      m_IsChanged = true;
+    return num;
+  }
+
+  /// @brief Replaces the content of the index
+  template<typename Iterator>
+  void Assign(
+      Iterator begin,
+      Iterator end) {
+    std::unique_lock<std::mutex> l(m_Mutex);
+    m_Elements.clear();
+    m_Positions.clear();
+    for (auto it = begin; it != end; ++it)
+      if (m_Positions.emplace(*it, m_Elements.size()).second)
+        m_Elements.push_back(*it);
+    m_IsChanged = true;
+  }
+
+  void Clear() {
+    std::unique_lock<std::mutex> l(m_Mutex);
+    m_Elements.clear();
+    m_Positions.clear();
+    m_IsChanged = true;
+  }
+
+  /// @brief Makes pending changes visible to readers, waiting for writers
+  void Publish() {
+    std::unique_lock<std::mutex> l(m_Mutex);
+    if (m_IsChanged)
+      PublishLocked();
+  }
+
+  std::size_t GetSize() const {
+    return GetSnapshot()->size();
+  }
+
+  /// @brief Picks a uniformly random element accepted by filter
+  /// @details Rejection sampling: expected O(1) as long as a fair share
+  ///   of the elements is accepted. After RANDOM_INDEX_MAX_ATTEMPTS misses
+  ///   the array is scanned from a random position, so a matching element
+  ///   is always found if there is one.
+  /// @param random Callable returning a random unsigned integer
+  /// @param filter Callable returning true for acceptable elements
+  template<typename Random, typename Filter>
+  Element GetRandom(
+      Random&& random,
+      Filter filter) const {
+    auto snapshot = GetSnapshot();
+    const Elements& elements = *snapshot;
+    std::size_t size = elements.size();
+    if (!size)
+      return Element();
+    for (std::size_t i = 0; i < RANDOM_INDEX_MAX_ATTEMPTS; i++) {
+      const Element& element = elements[random() % size];
+      if (filter(element))
+        return element;
+    }
+    std::size_t start = random() % size;
+    for (std::size_t i = 0; i < size; i++) {
+      const Element& element = elements[(start + i) % size];
+      if (filter(element))
+        return element;
+    }
+    return Element();
+  }
+
+ private:
+  /// @brief Swap-removes element, caller holds the mutex
+  bool Erase(
+      const Element& element) {
+    auto it = m_Positions.find(element);
+    if (it == m_Positions.end())
+      return false;
+    std::size_t pos = it->second;
+    m_Positions.erase(it);
+    if (pos != m_Elements.size() - 1) {
+      m_Elements[pos] = std::move(m_Elements.back());
+      m_Positions[m_Elements[pos]] = pos;
+    }
+    m_Elements.pop_back();
+    return true;
+  }
+
+  /// @brief Copies the array for readers, caller holds the mutex
+  void PublishLocked() const {
+    m_IsChanged = false;
+    std::shared_ptr<const Elements> snapshot =
+      std::make_shared<const Elements>(m_Elements);
+    std::atomic_store(&m_Snapshot, snapshot);
+  }
+
+  /// @return Published array, first publishing pending changes unless
+  ///   a writer holds the mutex
+  std::shared_ptr<const Elements> GetSnapshot() const {
+    if (m_IsChanged) {
+      std::unique_lock<std::mutex> l(m_Mutex, std::try_to_lock);
+      if (l.owns_lock() && m_IsChanged)
+        PublishLocked();
+    }
+    return std::atomic_load(&m_Snapshot);
+  }
+
+ private:
+  mutable std::mutex m_Mutex;
+  Elements m_Elements;
+  std::unordered_map<Element, std::size_t> m_Positions;
+  mutable std::atomic<bool> m_IsChanged;
+  mutable std::shared_ptr<const Elements> m_Snapshot;
+};
+
+}  // namespace util
+}  // namespace i2p
+
+#endif  // SRC_CORE_UTIL_RANDOMINDEX_H_
@@ -0,0 +1,178 @@
+/**
+ * Copyright (c) 2015-2016, The Kovri I2P Router Project
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ *    conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *    of conditions and the following disclaimer in the documentation and/or other
+ *    materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SRC_CORE_UTIL_TIMERWHEEL_H_
+#define SRC_CORE_UTIL_TIMERWHEEL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace i2p {
+namespace util {
+
+/// @class TimerWheel
+/// @brief Hierarchical timing wheel of deadlines
+/// @details Four levels of 64 slots, the slots of level L spanning 64^L
+///   ticks. Elements go to the lowest level that reaches their deadline
+///   and move down a level when the wheel turns past their slot, so
+///   scheduling is constant time and advancing costs a slot per tick
+///   plus at most one move per level per element: work is proportional
+///   to what expires, not to what is scheduled.
+///   Elements can't be cancelled, the owner checks on expiry whether an
+///   element still matters.
+/// @param Element Copyable type, for example an ID or a weak_ptr
+/// @note Not thread-safe
+template<typename Element>
+class TimerWheel {
+ public:
+  /// @param now Current time in ticks
+  explicit TimerWheel(
+      std::uint64_t now = 0)
+      : m_Current(now),
+        m_Size(0) {}
+
+  /// @brief Schedules the element to expire once time reaches deadline.
+  ///   Deadlines already passed expire on the next tick.
+  void Schedule(
+      std::uint64_t deadline,
+      const Element& element) {
+    if (deadline <= m_Current)
+      deadline = m_Current + 1;
+    Insert(deadline, element);
+    m_Size++;
+  }
+
+  /// @brief Turns the wheel to now
+  /// @param expired Elements whose deadline is reached are appended to it
+  void Advance(
+      std::uint64_t now,
+      std::vector<Element>& expired) {
+    if (now > m_Current + HORIZON) {
+      // a long jump (clock change, suspend), cheaper to sort everything
+      // again than to turn slot by slot
+      Reschedule(now, expired);
+      return;
+    }
+    while (m_Current < now) {
+      m_Current++;
+      // cascade highest level first, so elements drop down level by level
+      for (std::size_t level = LEVELS - 1; level > 0; level--)
+        if (!(m_Current & ((std::uint64_t(1) << (level * BITS)) - 1)))
+          Cascade(level);
+      std::vector<Entry> entries;
+      entries.swap(m_Slots[0][m_Current & MASK]);
+      for (auto& entry : entries) {
+        if (entry.first <= m_Current) {
+          expired.push_back(entry.second);
+          m_Size--;
+        } else {
+          Insert(entry.first, entry.second);  // was beyond the horizon
+        }
+      }
+    }
+  }
+
+  /// @return Number of scheduled elements
+  std::size_t GetSize() const {
+    return m_Size;
+  }
+
+  /// @return Time the wheel was last turned to
+  std::uint64_t GetTime() const {
+    return m_Current;
+  }
+
+ private:
+  typedef std::pair<std::uint64_t, Element> Entry;
+
+  static const std::size_t BITS = 6,
+                           SLOTS = 1 << BITS,
+                           MASK = SLOTS - 1,
+                           LEVELS = 4;
+  static const std::uint64_t HORIZON =
+    std::uint64_t(1) << (LEVELS * BITS);
+
+  void Insert(
+      std::uint64_t deadline,
+      const Element& element) {
+    std::uint64_t delta = deadline - m_Current;
+    // beyond the horizon, parked in the last slot the wheel reaches
+    std::uint64_t slot_time =
+      delta < HORIZON ? deadline : m_Current + HORIZON - 1;
+    std::size_t level = 0;
+    while (level < LEVELS - 1 &&
+           slot_time - m_Current >=
+             (std::uint64_t(1) << ((level + 1) * BITS)))
+      level++;
+    m_Slots[level][(slot_time >> (level * BITS)) & MASK].emplace_back(
+        deadline,
+        element);
+  }
+
+  void Cascade(
+      std::size_t level) {
+    std::vector<Entry> entries;
+    entries.swap(m_Slots[level][(m_Current >> (level * BITS)) & MASK]);
+    for (auto& entry : entries)
+      Insert(entry.first, entry.second);
+  }
+
+  void Reschedule(
+      std::uint64_t now,
+      std::vector<Element>& expired) {
+    std::vector<Entry> entries;
+    for (auto& level : m_Slots)
+      for (auto& slot : level) {
+        entries.insert(entries.end(), slot.begin(), slot.end());
+        slot.clear();
+      }
+    m_Current = now;
+    for (auto& entry : entries) {
+      if (entry.first <= now) {
+        expired.push_back(entry.second);
+        m_Size--;
+      } else {
+        Insert(entry.first, entry.second);
+      }
+    }
+  }
+
+ private:
+  std::vector<Entry> m_Slots[LEVELS][SLOTS];
+  std::uint64_t m_Current;
+  std::size_t m_Size;
+};
+
+}  // namespace util
+}  // namespace i2p
+
+#endif  // SRC_CORE_UTIL_TIMERWHEEL_H_
@@ -0,0 +1,125 @@
+/**
+ * Copyright (c) 2015-2016, The Kovri I2P Router Project
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ *    conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *    of conditions and the following disclaimer in the documentation and/or other
+ *    materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SRC_CORE_UTIL_TOKENBUCKET_H_
+#define SRC_CORE_UTIL_TOKENBUCKET_H_
+
+#include <cstdint>
+
+namespace i2p {
+namespace util {
+
+/// @class TokenBucket
+/// @brief Rate limiter refilled at a fixed rate up to a burst size
+/// @details Time is passed in by the caller, in milliseconds, so the
+///   bucket can be driven by a simulated clock.
+/// @note Not thread-safe
+class TokenBucket {
+ public:
+  /// @param rate Tokens per second, 0 for no limit
+  /// @param burst Most tokens the bucket holds
+  TokenBucket(
+      std::uint64_t rate,
+      std::uint64_t burst)
+      : m_Rate(rate),
+        m_Burst(burst),
+        m_Tokens(static_cast<double>(burst)),
+        m_LastUpdate(0) {}
+
+  void SetRate(
+      std::uint64_t rate) {
+    m_Rate = rate;
+  }
+
+  std::uint64_t GetRate() const {
+    return m_Rate;
+  }
+
+  void SetBurst(
+      std::uint64_t burst) {
+    m_Burst = burst;
+    if (m_Tokens > m_Burst)
+      m_Tokens = static_cast<double>(m_Burst);
+  }
+
+  /// @brief Takes num tokens if the bucket holds them
+  bool TryConsume(
+      std::uint64_t num,
+      std::uint64_t now) {
+    Refill(now);
+    if (m_Rate && m_Tokens < num)
+      return false;
+    m_Tokens -= num;
+    return true;
+  }
+
+  /// @brief Takes num tokens, leaving the bucket in debt if needed
+  void Consume(
+      std::uint64_t num,
+      std::uint64_t now) {
+    Refill(now);
+    m_Tokens -= num;
+  }
+
+  /// @return Milliseconds until num tokens are available
+  std::uint64_t GetWaitTime(
+      std::uint64_t num,
+      std::uint64_t now) {
+    Refill(now);
+    if (!m_Rate || m_Tokens >= num)
+      return 0;
+    return static_cast<std::uint64_t>(
+        (num - m_Tokens) * 1000 / m_Rate) + 1;
+  }
+
+ private:
+  void Refill(
+      std::uint64_t now) {
+    if (!m_Rate) {
+      m_Tokens = static_cast<double>(m_Burst);
+    } else if (now > m_LastUpdate) {
+      m_Tokens += static_cast<double>(m_Rate) * (now - m_LastUpdate) / 1000;
+      if (m_Tokens > m_Burst)
+        m_Tokens = static_cast<double>(m_Burst);
+    }
+    if (now > m_LastUpdate)
+      m_LastUpdate = now;
+  }
+
+ private:
+  std::uint64_t m_Rate, m_Burst;
+  double m_Tokens;
+  std::uint64_t m_LastUpdate;  // in milliseconds
+};
+
+}  // namespace util
+}  // namespace i2p
+
+#endif  // SRC_CORE_UTIL_TOKENBUCKET_H_
@@ -62,6 +62,7 @@ struct null_deleter {
 #include <boost/log/sources/severity_channel_logger.hpp>
 #include <boost/log/sources/severity_feature.hpp>
 
+#include <atomic>
 #include <iostream>
 #include <memory>
 #include <mutex>
@@ -81,6 +82,12 @@ LogLevelsMap g_LogLevels {
   { "debug", eLogDebug },
 };
 
+/// @var g_IsLogLevelEnabled
+/// @brief All levels are logged until global log levels are set
+std::atomic<bool> g_IsLogLevelEnabled[eLogLevelError + 1] {
+  { true }, { true }, { true }, { true }
+};
+
 /// @brief Sets global log levels with sanitized user input
 /// @param levels String vector of user-supplied log levels
 void SetGlobalLogLevels(
@@ -93,6 +100,11 @@ void SetGlobalLogLevels(
     if (key != g_LogLevels.end())
       new_levels.insert({v, g_LogLevels[v]});
   }
+  // Update level flags
+  for (auto& enabled : g_IsLogLevelEnabled)
+    enabled = false;
+  for (auto& level : new_levels)
+    g_IsLogLevelEnabled[level.second] = true;
   // Set new global map
   g_LogLevels.swap(new_levels);
 }
@@ -134,6 +146,79 @@ static std::shared_ptr<Log> g_Log = nullptr;
 /// @brief Log level/severity channel
 typedef boost::log::sources::severity_channel_logger_mt<LogLevel, std::string> log_t;
 
+/**
+ *
+ * Per-thread formatting buffer
+ *
+ */
+
+/// @class LogBuffer
+/// @brief Stream buffer appending to a string which keeps its capacity
+///   from one message to the next
+class LogBuffer : public std::streambuf {
+ public:
+  LogBuffer() {
+    m_Message.reserve(1024);
+  }
+
+  void Clear() {
+    m_Message.clear();
+  }
+
+  const std::string& GetMessage() const {
+    return m_Message;
+  }
+
+ protected:
+  int_type overflow(
+      int_type ch) {
+    if (!traits_type::eq_int_type(ch, traits_type::eof()))
+      m_Message.push_back(traits_type::to_char_type(ch));
+    return traits_type::not_eof(ch);
+  }
+
+  std::streamsize xsputn(
+      const char_type* s,
+      std::streamsize count) {
+    m_Message.append(s, count);
+    return count;
+  }
+
+ private:
+  std::string m_Message;
+};
+
+/// @brief This thread's formatting buffer and its stream
+struct LogBufferStream {
+  LogBufferStream() : stream(&buffer) {}
+  LogBuffer buffer;
+  std::ostream stream;
+};
+
+static LogBufferStream& GetLogBufferStream() {
+  static thread_local LogBufferStream buffer_stream;
+  return buffer_stream;
+}
+
+std::ostream& GetLogBuffer() {
+  auto& buffer_stream = GetLogBufferStream();
+  buffer_stream.buffer.Clear();
+  buffer_stream.stream.clear();
+  return buffer_stream.stream;
+}
+
+void FlushLogBuffer(
+    LogLevel level) {
+  auto log = Log::Get();
+  if (log->Silent())
+    return;
+  static log_t logger(boost::log::keywords::channel = "default");
+  BOOST_LOG_SEV(logger, level) << GetLogBufferStream().buffer.GetMessage();
+  // Only errors wait for the asynchronous sink, in case we are going down
+  if (level == eLogError)
+    g_LogSink->flush();
+}
+
 /**
  *
  * LogStream implementation and definitions
@@ -341,7 +426,10 @@ class LogImpl {
  public:
   LogImpl() : LogImpl(eLogDebug, &std::clog) {}
 
-  ~LogImpl() {}
+  ~LogImpl() {
+    // Write out what the asynchronous sink still holds
+    g_LogSink->flush();
+  }
 
   LogImpl(
       LogLevel min_level,
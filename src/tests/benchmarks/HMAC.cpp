@@ -0,0 +1,98 @@
+/**
+ * Copyright (c) 2015-2016, The Kovri I2P Router Project
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ *    conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *    of conditions and the following disclaimer in the documentation and/or other
+ *    materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Benchmarks.h"
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "crypto/HMAC.h"
+#include "crypto/Rand.h"
+
+namespace {
+
+typedef std::chrono::high_resolution_clock Clock;
+
+/// @brief Runs f count times and prints the mean cost per call
+template<class Function>
+void Measure(
+    const char* name,
+    std::size_t count,
+    Function f) {
+  auto begin = Clock::now();
+  for (std::size_t i = 0; i < count; ++i)
+    f();
+  auto duration =
+    std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin);
+  std::cout << name << ": " << duration.count() / count
+    << " ns/packet" << std::endl;
+}
+
+}  // namespace
+
+void BenchmarkHMAC() {
+  const std::size_t count = 100000;
+  const std::size_t sizes[] = { 64, 576, 1456 };
+  i2p::crypto::MACKey keys[3];
+  for (auto& key : keys)
+    i2p::crypto::RandBytes(key(), 32);
+  i2p::crypto::HMACMD5 macs[3];
+  for (int i = 0; i < 3; i++)
+    macs[i].SetKey(keys[i]);
+  const i2p::crypto::HMACMD5* candidates[3] = { &macs[0], &macs[1], &macs[2] };
+  uint8_t digest[16];
+  volatile int sink = 0;
+  for (auto size : sizes) {
+    std::vector<uint8_t> packet(size);
+    i2p::crypto::RandBytes(packet.data(), size);
+    std::cout << "-----HMAC-MD5 " << size << " bytes-----" << std::endl;
+    Measure("Key set per packet", count, [&]() {
+      i2p::crypto::HMACMD5Digest(packet.data(), size, keys[0], digest);
+    });
+    Measure("Cached key", count, [&]() {
+      macs[0].CalculateDigest(packet.data(), size, digest);
+    });
+    // the worst case for a packet: only the last candidate matches
+    macs[2].CalculateDigest(packet.data(), size, digest);
+    Measure("3 keys, one at a time", count, [&]() {
+      for (int i = 0; i < 3; i++)
+        if (macs[i].VerifyDigest(packet.data(), size, digest)) {
+          sink = i;
+          break;
+        }
+    });
+    Measure("3 keys, one pass", count, [&]() {
+      sink = i2p::crypto::HMACMD5::VerifyAny(
+          candidates, 3, packet.data(), size, digest);
+    });
+  }
+}
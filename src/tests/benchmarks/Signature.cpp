@@ -30,6 +30,8 @@
  * Parts of the project are originally copyright (c) 2013-2015 The PurpleI2P Project
  */
 
+#include "Benchmarks.h"
+
 #include <chrono>
 #include <iostream>
 
@@ -82,7 +84,7 @@ void benchmark(
         verify_duration).count() << std::endl;
 }
 
-int main() {
+void BenchmarkSignatures() {
   const size_t benchmark_count = 1000;
   std::cout << "--------DSA---------" << std::endl;
   benchmark<i2p::crypto::DSAVerifier, i2p::crypto::DSASigner>(
@@ -0,0 +1,157 @@
+/**
+ * Copyright (c) 2015-2016, The Kovri I2P Router Project
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ *    conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *    of conditions and the following disclaimer in the documentation and/or other
+ *    materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "KademliaIndex.h"
+
+struct Peer {
+  explicit Peer(
+      const i2p::data::IdentHash& ident)
+      : hash(ident) {}
+  const i2p::data::IdentHash& GetIdentHash() const {
+    return hash;
+  }
+  i2p::data::IdentHash hash;
+};
+
+typedef std::shared_ptr<const Peer> PeerPtr;
+
+struct KademliaIndexFixture {
+  KademliaIndexFixture()
+      : random(1) {
+    for (int i = 0; i < 500; i++)
+      peers.push_back(std::make_shared<const Peer>(RandomHash()));
+  }
+
+  i2p::data::IdentHash RandomHash() {
+    std::uint8_t buf[32];
+    for (auto& b : buf)
+      b = random();
+    return i2p::data::IdentHash(buf);
+  }
+
+  /// @brief Reference result by computing every distance
+  std::vector<PeerPtr> SortByDistance(
+      const i2p::data::IdentHash& key) {
+    auto distance = [&key](const PeerPtr& peer) {
+      std::vector<std::uint8_t> d(32);
+      for (int i = 0; i < 32; i++)
+        d[i] = key()[i] ^ peer->GetIdentHash()()[i];
+      return d;
+    };
+    std::vector<PeerPtr> sorted(peers);
+    std::sort(
+        sorted.begin(),
+        sorted.end(),
+        [&distance](const PeerPtr& p1, const PeerPtr& p2) {
+          return distance(p1) < distance(p2);
+        });
+    return sorted;
+  }
+
+  std::mt19937 random;
+  std::vector<PeerPtr> peers;
+};
+
+BOOST_FIXTURE_TEST_SUITE(KademliaIndexTests, KademliaIndexFixture)
+
+BOOST_AUTO_TEST_CASE(EmptyIndex) {
+  i2p::data::KademliaIndex<PeerPtr> index;
+  BOOST_CHECK(!index.GetClosest(RandomHash(), [](const PeerPtr&) {
+    return true;
+  }));
+}
+
+BOOST_AUTO_TEST_CASE(ClosestMatchesFullScan) {
+  i2p::data::KademliaIndex<PeerPtr> index;
+  index.Assign(peers.begin(), peers.end());
+  BOOST_CHECK_EQUAL(index.GetSize(), peers.size());
+  for (int i = 0; i < 50; i++) {
+    auto key = RandomHash();
+    auto expected = SortByDistance(key);
+    auto closest = index.GetClosest(key, 20, [](const PeerPtr&) {
+      return true;
+    });
+    BOOST_REQUIRE_EQUAL(closest.size(), 20);
+    for (std::size_t j = 0; j < closest.size(); j++)
+      BOOST_CHECK_EQUAL(closest[j], expected[j]);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(FilterSkipsExcluded) {
+  i2p::data::KademliaIndex<PeerPtr> index;
+  for (auto& peer : peers)
+    BOOST_CHECK(index.Add(peer));
+  BOOST_CHECK(!index.Add(peers[0]));
+  auto key = RandomHash();
+  auto expected = SortByDistance(key);
+  // exclude the three nearest
+  auto excluded = [&expected](const PeerPtr& peer) {
+    return peer != expected[0] && peer != expected[1] && peer != expected[2];
+  };
+  auto closest = index.GetClosest(key, 3, excluded);
+  BOOST_REQUIRE_EQUAL(closest.size(), 3);
+  for (std::size_t j = 0; j < closest.size(); j++)
+    BOOST_CHECK_EQUAL(closest[j], expected[j + 3]);
+  BOOST_CHECK_EQUAL(index.GetClosest(key, excluded), expected[3]);
+}
+
+BOOST_AUTO_TEST_CASE(RemoveElements) {
+  i2p::data::KademliaIndex<PeerPtr> index;
+  index.Assign(peers.begin(), peers.end());
+  auto key = peers[0]->GetIdentHash();
+  BOOST_CHECK_EQUAL(
+      index.GetClosest(key, [](const PeerPtr&) { return true; }),
+      peers[0]);
+  BOOST_CHECK(index.Remove(peers[0]));
+  BOOST_CHECK(!index.Remove(peers[0]));
+  BOOST_CHECK(
+      index.GetClosest(key, [](const PeerPtr&) { return true; }) != peers[0]);
+  auto last = peers.back();
+  BOOST_CHECK_EQUAL(
+      index.RemoveIf([&last](const PeerPtr& peer) { return peer != last; }),
+      peers.size() - 2);
+  BOOST_CHECK_EQUAL(index.GetSize(), 1);
+  BOOST_CHECK_EQUAL(
+      index.GetClosest(key, [](const PeerPtr&) { return true; }),
+      last);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
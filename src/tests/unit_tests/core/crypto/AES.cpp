@@ -34,7 +34,11 @@
 
 #include <boost/test/unit_test.hpp>
 
+#include <string>
+#include <vector>
+
 #include "crypto/AES.h"
+#include "crypto/util/Checksum.h"
 
 BOOST_AUTO_TEST_SUITE(AESTests)
 
@@ -218,4 +222,111 @@ BOOST_FIXTURE_TEST_CASE(AesCbcDecrypt, AesCbcFixture) {
   }
 }
 
+BOOST_FIXTURE_TEST_CASE(AesCbcMultiBlockDecrypt, AesCbcFixture) {
+  // Block counts around each kernel width and a full tunnel message
+  const int counts[] = { 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 63 };
+  // Every backend this CPU supports must give the same result
+  const std::string backends[] = {
+    "generic", "aesni", "aesni-interleaved", "vaes-avx2", "vaes-avx512"
+  };
+  for (const auto& backend : backends) {
+    if (!i2p::crypto::SetAESBackend(backend))
+      continue;
+    for (const int num_blocks : counts) {
+      std::vector<i2p::crypto::CipherBlock> plain(num_blocks);
+      for (int i = 0; i < num_blocks; ++i) {
+        for (int j = 0; j < 16; ++j)
+          plain[i].buf[j] = static_cast<uint8_t>(i * 16 + j);
+      }
+      std::vector<i2p::crypto::CipherBlock> cipher(num_blocks);
+      i2p::crypto::CBCEncryption encryption(i2p::crypto::AESKey(key), iv);
+      encryption.Encrypt(num_blocks, plain.data(), cipher.data());
+      // Out of place
+      std::vector<i2p::crypto::CipherBlock> output(num_blocks);
+      i2p::crypto::CBCDecryption decryption(i2p::crypto::AESKey(key), iv);
+      decryption.Decrypt(num_blocks, cipher.data(), output.data());
+      BOOST_CHECK_EQUAL_COLLECTIONS(
+          output.front().buf, output.back().buf + 16,
+          plain.front().buf, plain.back().buf + 16);
+      // In place
+      output = cipher;
+      decryption.SetIV(iv);
+      decryption.Decrypt(num_blocks, output.data(), output.data());
+      BOOST_CHECK_EQUAL_COLLECTIONS(
+          output.front().buf, output.back().buf + 16,
+          plain.front().buf, plain.back().buf + 16);
+    }
+  }
+  BOOST_CHECK(i2p::crypto::SetAESBackend("auto"));
+}
+
+BOOST_AUTO_TEST_CASE(AesBackendNames) {
+  BOOST_CHECK(!i2p::crypto::SetAESBackend("unknown"));
+  BOOST_CHECK(i2p::crypto::SetAESBackend("auto"));
+  BOOST_CHECK(i2p::crypto::GetAESBackend() <= i2p::crypto::DetectAESBackend());
+  BOOST_CHECK(
+      i2p::crypto::GetAESBackend() != i2p::crypto::e_AESBackendVAESAVX512);
+}
+
+BOOST_FIXTURE_TEST_CASE(AesCbcChainedDecrypt, AesCbcFixture) {
+  // IV must carry over between calls regardless of the block count
+  const int num_blocks = 11;
+  i2p::crypto::CipherBlock plain[num_blocks] = {};
+  for (int i = 0; i < num_blocks; ++i)
+    plain[i].buf[0] = static_cast<uint8_t>(i);
+  i2p::crypto::CipherBlock cipher[num_blocks] = {};
+  cbc_encrypt.Encrypt(num_blocks, plain, cipher);
+  i2p::crypto::CipherBlock output[num_blocks] = {};
+  cbc_decrypt.Decrypt(5, cipher, output);
+  cbc_decrypt.Decrypt(cipher[5].buf, output[5].buf);
+  cbc_decrypt.Decrypt(5, cipher + 6, output + 6);
+  BOOST_CHECK_EQUAL_COLLECTIONS(
+      output[0].buf, output[num_blocks - 1].buf + 16,
+      plain[0].buf, plain[num_blocks - 1].buf + 16);
+}
+
+BOOST_FIXTURE_TEST_CASE(AesCbcEncryptWithAdler32, AesCbcFixture) {
+  // Spans more than one checksum chunk
+  std::vector<uint8_t> frame(1040), expected(1040);
+  for (std::size_t i = 0; i < frame.size(); ++i)
+    frame[i] = static_cast<uint8_t>(i * 7);
+  i2p::crypto::util::Adler32().CalculateDigest(
+      &frame[frame.size() - 4], frame.data(), frame.size() - 4);
+  i2p::crypto::CBCEncryption separate(i2p::crypto::AESKey(key), iv);
+  separate.Encrypt(frame.data(), frame.size(), expected.data());
+  // The checksum is overwritten by the fused pass
+  frame[frame.size() - 1] ^= 0xFF;
+  cbc_encrypt.EncryptWithAdler32(frame.data(), frame.size());
+  BOOST_CHECK_EQUAL_COLLECTIONS(
+      frame.begin(), frame.end(),
+      expected.begin(), expected.end());
+}
+
+BOOST_FIXTURE_TEST_CASE(AesCbcDecryptWithAdler32, AesCbcFixture) {
+  std::vector<uint8_t> plain(2064), cipher(2064), output(2064);
+  for (std::size_t i = 0; i < plain.size(); ++i)
+    plain[i] = static_cast<uint8_t>(i * 13 + 5);
+  cbc_encrypt.Encrypt(plain.data(), plain.size(), cipher.data());
+  // Decrypted in pieces, checksumming all but the last 4 bytes
+  const std::size_t adler_len = plain.size() - 4;
+  std::uint32_t adler = i2p::crypto::util::ADLER32_INITIAL;
+  std::size_t offset = 0;
+  for (std::size_t len : { 16, 1200, 848 }) {
+    adler = cbc_decrypt.DecryptWithAdler32(
+        cipher.data() + offset,
+        len,
+        output.data() + offset,
+        adler,
+        adler_len - offset);
+    offset += len;
+  }
+  BOOST_CHECK_EQUAL_COLLECTIONS(
+      output.begin(), output.end(),
+      plain.begin(), plain.end());
+  BOOST_CHECK_EQUAL(
+      adler,
+      i2p::crypto::util::UpdateAdler32(
+          i2p::crypto::util::ADLER32_INITIAL, plain.data(), adler_len));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
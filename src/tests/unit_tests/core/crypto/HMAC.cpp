@@ -0,0 +1,120 @@
+/**
+ * Copyright (c) 2015-2016, The Kovri I2P Router Project
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ *    conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *    of conditions and the following disclaimer in the documentation and/or other
+ *    materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "crypto/HMAC.h"
+
+struct HMACMD5Fixture {
+  HMACMD5Fixture() {
+    for (std::size_t i = 0; i < 32; i++)
+      key[i] = i;
+  }
+
+  std::vector<std::uint8_t> Message(
+      std::size_t len) {
+    std::vector<std::uint8_t> msg(len + 1);  // data() is never null
+    for (std::size_t i = 0; i < len; i++)
+      msg[i] = i * 7 + 3;
+    return msg;
+  }
+
+  void CheckDigest(
+      std::size_t len,
+      const std::uint8_t* expected) {
+    auto msg = Message(len);
+    std::uint8_t digest[16];
+    i2p::crypto::HMACMD5(key).CalculateDigest(msg.data(), len, digest);
+    BOOST_CHECK_EQUAL_COLLECTIONS(digest, digest + 16, expected, expected + 16);
+  }
+
+  i2p::crypto::MACKey key;
+};
+
+BOOST_FIXTURE_TEST_SUITE(HMACMD5Tests, HMACMD5Fixture)
+
+// MD5(key ^ opad || MD5(key ^ ipad || msg) || 16 zero bytes)
+BOOST_AUTO_TEST_CASE(EmptyMessage) {
+  const std::uint8_t expected[] = {
+    0x4f, 0x6a, 0x3f, 0x05, 0x35, 0x4c, 0x2e, 0x0f,
+    0x28, 0x66, 0x44, 0x2c, 0x35, 0x86, 0x9f, 0x71 };
+  CheckDigest(0, expected);
+}
+
+BOOST_AUTO_TEST_CASE(PaddingInOneBlock) {
+  const std::uint8_t expected[] = {
+    0xcb, 0xe7, 0x57, 0xe8, 0xba, 0x2d, 0x14, 0x76,
+    0x70, 0x97, 0xce, 0xf4, 0x05, 0xf4, 0x78, 0x6c };
+  CheckDigest(55, expected);
+}
+
+BOOST_AUTO_TEST_CASE(PaddingInTwoBlocks) {
+  const std::uint8_t expected[] = {
+    0xa1, 0xe2, 0x1b, 0x52, 0xed, 0xec, 0x49, 0x75,
+    0x4c, 0x7a, 0xb8, 0x7b, 0x66, 0xd7, 0xa9, 0xa8 };
+  CheckDigest(56, expected);
+}
+
+BOOST_AUTO_TEST_CASE(WholeBlock) {
+  const std::uint8_t expected[] = {
+    0x1c, 0xb2, 0x35, 0x07, 0x07, 0xc9, 0xae, 0x19,
+    0x5b, 0x63, 0xf2, 0x31, 0x1e, 0x6f, 0xd7, 0xd0 };
+  CheckDigest(64, expected);
+}
+
+BOOST_AUTO_TEST_CASE(LongMessage) {
+  const std::uint8_t expected[] = {
+    0x52, 0x60, 0xfa, 0xf7, 0xa9, 0xc1, 0x29, 0xf8,
+    0x25, 0x68, 0xcb, 0xf3, 0xdf, 0xe2, 0x55, 0x27 };
+  CheckDigest(1000, expected);
+}
+
+BOOST_AUTO_TEST_CASE(VerifyAnyFindsKey) {
+  auto msg = Message(1000);
+  i2p::crypto::MACKey other_key(key);
+  other_key[0] ^= 1;
+  i2p::crypto::HMACMD5 mac(key), other_mac(other_key);
+  std::uint8_t digest[16];
+  mac.CalculateDigest(msg.data(), 1000, digest);
+  BOOST_CHECK(mac.VerifyDigest(msg.data(), 1000, digest));
+  BOOST_CHECK(!other_mac.VerifyDigest(msg.data(), 1000, digest));
+  const i2p::crypto::HMACMD5* keys[] = { &other_mac, &other_mac, &mac };
+  BOOST_CHECK_EQUAL(
+      i2p::crypto::HMACMD5::VerifyAny(keys, 3, msg.data(), 1000, digest), 2);
+  BOOST_CHECK_EQUAL(
+      i2p::crypto::HMACMD5::VerifyAny(keys, 2, msg.data(), 1000, digest), -1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
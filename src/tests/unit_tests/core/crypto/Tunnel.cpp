@@ -0,0 +1,152 @@
+/**
+ * Copyright (c) 2015-2016, The Kovri I2P Router Project
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ *    conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *    of conditions and the following disclaimer in the documentation and/or other
+ *    materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "crypto/AES.h"
+#include "crypto/Tunnel.h"
+
+struct TunnelCryptoFixture {
+  TunnelCryptoFixture() {
+    for (std::size_t i = 0; i < sizeof(message); ++i)
+      message[i] = static_cast<std::uint8_t>(i * 7 + 3);
+    encryption.SetKeys(
+        i2p::crypto::AESKey(layer_key),
+        i2p::crypto::AESKey(iv_key));
+    decryption.SetKeys(
+        i2p::crypto::AESKey(layer_key),
+        i2p::crypto::AESKey(iv_key));
+  }
+  std::uint8_t layer_key[32] = {
+    0x60, 0x3d, 0xeb, 0x10, 0x15, 0xca, 0x71, 0xbe, 0x2b, 0x73,
+    0xae, 0xf0, 0x85, 0x7d, 0x77, 0x81, 0x1f, 0x35, 0x2c, 0x07,
+    0x3b, 0x61, 0x08, 0xd7, 0x2d, 0x98, 0x10, 0xa3, 0x09, 0x14,
+    0xdf, 0xf4
+  };
+  std::uint8_t iv_key[32] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09,
+    0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x10, 0x11, 0x12, 0x13,
+    0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d,
+    0x1e, 0x1f
+  };
+  std::uint8_t message[1024];  // 16 IV + 1008 data
+  i2p::crypto::TunnelEncryption encryption;
+  i2p::crypto::TunnelDecryption decryption;
+};
+
+BOOST_FIXTURE_TEST_SUITE(TunnelCryptoTests, TunnelCryptoFixture)
+
+BOOST_AUTO_TEST_CASE(DecryptMatchesBlockwise) {
+  std::uint8_t output[1024] = {};
+  decryption.Decrypt(message, output);
+  // Layer IV is the IV decrypted once, returned IV is decrypted twice
+  i2p::crypto::ECBDecryption iv_decryption;
+  iv_decryption.SetKey(i2p::crypto::AESKey(iv_key));
+  i2p::crypto::CipherBlock iv;
+  iv_decryption.Decrypt(
+      reinterpret_cast<const i2p::crypto::CipherBlock *>(message),
+      &iv);
+  i2p::crypto::CBCDecryption layer_decryption(
+      i2p::crypto::AESKey(layer_key),
+      iv.buf);
+  std::uint8_t expected[1024] = {};
+  for (std::size_t i = 16; i < sizeof(message); i += 16)
+    layer_decryption.Decrypt(message + i, expected + i);
+  iv_decryption.Decrypt(
+      &iv,
+      reinterpret_cast<i2p::crypto::CipherBlock *>(expected));
+  BOOST_CHECK_EQUAL_COLLECTIONS(
+      output, output + sizeof(output),
+      expected, expected + sizeof(expected));
+}
+
+BOOST_AUTO_TEST_CASE(EncryptDecrypt) {
+  std::uint8_t encrypted[1024] = {};
+  std::uint8_t decrypted[1024] = {};
+  encryption.Encrypt(message, encrypted);
+  decryption.Decrypt(encrypted, decrypted);
+  BOOST_CHECK_EQUAL_COLLECTIONS(
+      decrypted, decrypted + sizeof(decrypted),
+      message, message + sizeof(message));
+}
+
+BOOST_AUTO_TEST_CASE(EncryptDecryptInPlace) {
+  std::uint8_t buf[1024];
+  std::copy(message, message + sizeof(message), buf);
+  encryption.Encrypt(buf, buf);
+  decryption.Decrypt(buf, buf);
+  BOOST_CHECK_EQUAL_COLLECTIONS(
+      buf, buf + sizeof(buf),
+      message, message + sizeof(message));
+}
+
+BOOST_AUTO_TEST_CASE(EncryptBatchMatchesSingle) {
+  // One interleaved group of four plus a remainder
+  const std::size_t num = 7;
+  std::vector<std::uint8_t> messages(num * 1024), expected(num * 1024);
+  std::vector<const std::uint8_t*> in(num);
+  std::vector<std::uint8_t*> out(num);
+  for (std::size_t i = 0; i < num; i++) {
+    std::copy(message, message + sizeof(message), &messages[i * 1024]);
+    messages[i * 1024 + i] ^= 0xFF;  // make each message differ
+    encryption.Encrypt(&messages[i * 1024], &expected[i * 1024]);
+    in[i] = out[i] = &messages[i * 1024];
+  }
+  encryption.EncryptBatch(num, in.data(), out.data());
+  BOOST_CHECK_EQUAL_COLLECTIONS(
+      messages.begin(), messages.end(),
+      expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE(EncryptDecryptBatch) {
+  const std::size_t num = 5;
+  std::vector<std::uint8_t> messages(num * 1024), encrypted(num * 1024);
+  std::vector<const std::uint8_t*> in(num), encrypted_in(num);
+  std::vector<std::uint8_t*> out(num);
+  for (std::size_t i = 0; i < num; i++) {
+    std::copy(message, message + sizeof(message), &messages[i * 1024]);
+    messages[i * 1024 + 100 + i] ^= 0xFF;
+    in[i] = &messages[i * 1024];
+    encrypted_in[i] = out[i] = &encrypted[i * 1024];
+  }
+  encryption.EncryptBatch(num, in.data(), out.data());
+  decryption.DecryptBatch(num, encrypted_in.data(), out.data());
+  BOOST_CHECK_EQUAL_COLLECTIONS(
+      encrypted.begin(), encrypted.end(),
+      messages.begin(), messages.end());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
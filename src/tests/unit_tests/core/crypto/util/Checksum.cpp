@@ -0,0 +1,108 @@
+/**
+ * Copyright (c) 2015-2016, The Kovri I2P Router Project
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ *    conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *    of conditions and the following disclaimer in the documentation and/or other
+ *    materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "crypto/util/Checksum.h"
+
+std::uint32_t ReferenceAdler32(
+    const std::uint8_t* input,
+    std::size_t length) {
+  std::uint32_t s1 = 1, s2 = 0;
+  for (std::size_t i = 0; i < length; i++) {
+    s1 = (s1 + input[i]) % 65521;
+    s2 = (s2 + s1) % 65521;
+  }
+  return (s2 << 16) | s1;
+}
+
+BOOST_AUTO_TEST_SUITE(ChecksumTests)
+
+BOOST_AUTO_TEST_CASE(Adler32KnownDigest) {
+  const std::string input("Wikipedia");
+  const std::uint8_t expected[] = { 0x11, 0xE6, 0x03, 0x98 };
+  std::uint8_t digest[4] = {};
+  i2p::crypto::util::Adler32().CalculateDigest(
+      digest,
+      reinterpret_cast<const std::uint8_t *>(input.data()),
+      input.size());
+  BOOST_CHECK_EQUAL_COLLECTIONS(digest, digest + 4, expected, expected + 4);
+  BOOST_CHECK(
+      i2p::crypto::util::Adler32().VerifyDigest(
+          digest,
+          reinterpret_cast<const std::uint8_t *>(input.data()),
+          input.size()));
+  digest[3] ^= 1;
+  BOOST_CHECK(
+      !i2p::crypto::util::Adler32().VerifyDigest(
+          digest,
+          reinterpret_cast<const std::uint8_t *>(input.data()),
+          input.size()));
+}
+
+BOOST_AUTO_TEST_CASE(Adler32MatchesReference) {
+  // All 0xFF is the worst case for overflow between reductions
+  std::vector<std::uint8_t> input(20000, 0xFF);
+  for (std::size_t i = 0; i < 1000; i++)
+    input[i] = static_cast<std::uint8_t>(i * 131 + 7);
+  for (std::size_t length : { 0, 1, 15, 16, 17, 1000, 5552, 5553, 20000 })
+    BOOST_CHECK_EQUAL(
+        i2p::crypto::util::UpdateAdler32(
+            i2p::crypto::util::ADLER32_INITIAL,
+            input.data(),
+            length),
+        ReferenceAdler32(input.data(), length));
+}
+
+BOOST_AUTO_TEST_CASE(Adler32InPieces) {
+  std::vector<std::uint8_t> input(4099);
+  for (std::size_t i = 0; i < input.size(); i++)
+    input[i] = static_cast<std::uint8_t>(i ^ (i >> 3));
+  std::uint32_t adler = i2p::crypto::util::ADLER32_INITIAL;
+  std::size_t offset = 0, length = 1;
+  while (offset < input.size()) {
+    length = std::min(length * 3, input.size() - offset);
+    adler = i2p::crypto::util::UpdateAdler32(
+        adler,
+        input.data() + offset,
+        length);
+    offset += length;
+  }
+  BOOST_CHECK_EQUAL(adler, ReferenceAdler32(input.data(), input.size()));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
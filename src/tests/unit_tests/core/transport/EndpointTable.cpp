@@ -0,0 +1,101 @@
+/**
+ * Copyright (c) 2015-2016, The Kovri I2P Router Project
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ *    conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *    of conditions and the following disclaimer in the documentation and/or other
+ *    materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/asio.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <random>
+#include <vector>
+
+#include "transport/EndpointTable.h"
+
+typedef boost::asio::ip::udp::endpoint Endpoint;
+
+BOOST_AUTO_TEST_SUITE(EndpointTableTests)
+
+BOOST_AUTO_TEST_CASE(FindsInsertedEndpoints) {
+  i2p::transport::EndpointTable<int> table;
+  Endpoint v4(boost::asio::ip::address::from_string("10.0.0.1"), 1234);
+  Endpoint v6(boost::asio::ip::address::from_string("2001:db8::1"), 1234);
+  Endpoint mapped(
+      boost::asio::ip::address::from_string("::ffff:10.0.0.1"), 1234);
+  BOOST_CHECK(table.Insert(v4, 1));
+  BOOST_CHECK(table.Insert(v6, 2));
+  BOOST_CHECK(table.Insert(mapped, 3));
+  BOOST_CHECK(!table.Insert(v4, 4));  // existing value is kept
+  BOOST_CHECK_EQUAL(table.Find(v4), 1);
+  BOOST_CHECK_EQUAL(table.Find(v6), 2);
+  BOOST_CHECK_EQUAL(table.Find(mapped), 3);
+  BOOST_CHECK_EQUAL(table.Find(Endpoint(v4.address(), 1235)), 0);
+  BOOST_CHECK_EQUAL(table.GetSize(), 3);
+  BOOST_CHECK(table.Erase(v6));
+  BOOST_CHECK(!table.Erase(v6));
+  BOOST_CHECK_EQUAL(table.Find(v6), 0);
+  BOOST_CHECK_EQUAL(table.Find(mapped), 3);
+  table.Clear();
+  BOOST_CHECK(table.IsEmpty());
+  BOOST_CHECK_EQUAL(table.Find(v4), 0);
+}
+
+BOOST_AUTO_TEST_CASE(MatchesMapUnderChurn) {
+  i2p::transport::EndpointTable<int> table;
+  std::map<Endpoint, int> model;
+  std::mt19937 random(1);
+  // few addresses and ports so probe chains collide and wrap
+  std::uniform_int_distribution<std::uint32_t> address(1, 64);
+  std::uniform_int_distribution<unsigned short> port(1000, 1015);
+  for (int i = 0; i < 20000; i++) {
+    Endpoint ep(boost::asio::ip::address_v4(address(random)), port(random));
+    if (random() % 3) {
+      BOOST_REQUIRE_EQUAL(table.Insert(ep, i + 1), !model.count(ep));
+      model.insert({ ep, i + 1 });
+    } else {
+      BOOST_REQUIRE_EQUAL(table.Erase(ep), model.erase(ep) == 1);
+    }
+  }
+  BOOST_CHECK_EQUAL(table.GetSize(), model.size());
+  for (const auto& it : model)
+    BOOST_CHECK_EQUAL(table.Find(it.first), it.second);
+  std::vector<int> values, expected;
+  table.ForEach([&values](int value) { values.push_back(value); });
+  for (const auto& it : model)
+    expected.push_back(it.second);
+  std::sort(values.begin(), values.end());
+  std::sort(expected.begin(), expected.end());
+  BOOST_CHECK_EQUAL_COLLECTIONS(
+      values.begin(), values.end(), expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
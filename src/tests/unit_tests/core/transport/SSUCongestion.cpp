@@ -0,0 +1,222 @@
+/**
+ * Copyright (c) 2015-2016, The Kovri I2P Router Project
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ *    conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *    of conditions and the following disclaimer in the documentation and/or other
+ *    materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <random>
+
+#include "transport/SSUCongestion.h"
+
+/// @class LinkEmulator
+/// @brief In-process bottleneck link with a drop-tail queue and random
+///   loss, driving a congestion controller with a 1 ms clock
+class LinkEmulator {
+ public:
+  /// @param bandwidth Bytes per millisecond
+  /// @param delay One-way propagation delay, in milliseconds
+  /// @param queue_size Bytes queued at the bottleneck before drops
+  /// @param loss_rate Probability a packet is lost on the link
+  LinkEmulator(
+      std::size_t bandwidth,
+      std::uint64_t delay,
+      std::size_t queue_size,
+      double loss_rate)
+      : m_Bandwidth(bandwidth),
+        m_Delay(delay),
+        m_QueueSize(queue_size),
+        m_LossRate(loss_rate),
+        m_Random(1),
+        m_Now(0),
+        m_LinkFreeTime(0),
+        m_BytesInFlight(0),
+        m_DeliveredBytes(0),
+        m_MaxQueuingDelay(0) {}
+
+  /// @brief Sends packets of packet_size as the controller allows
+  void Run(
+      i2p::transport::SSUCongestionControl* control,
+      std::size_t packet_size,
+      std::uint64_t duration) {
+    std::uniform_real_distribution<double> loss(0.0, 1.0);
+    double tokens = 0;
+    for (std::uint64_t end = m_Now + duration; m_Now < end; m_Now++) {
+      // ACKs and losses due now
+      bool isLost = false;
+      while (!m_Packets.empty() && m_Packets.front().ack_time <= m_Now) {
+        auto packet = m_Packets.front();
+        m_Packets.pop_front();
+        m_BytesInFlight -= packet_size;
+        if (packet.is_lost) {
+          isLost = true;
+        } else {
+          m_DeliveredBytes += packet_size;
+          control->OnAck(packet_size, m_Now - packet.send_time, m_Now);
+        }
+      }
+      if (isLost)
+        control->OnLoss(m_Now);
+      // paced sending
+      std::uint64_t rate = control->GetPacingRate();
+      tokens = rate ? tokens + rate / 1000.0 : 4.0 * packet_size;
+      if (tokens > 4.0 * packet_size)
+        tokens = 4.0 * packet_size;
+      while (m_BytesInFlight + packet_size <= control->GetWindow() &&
+          tokens >= packet_size) {
+        tokens -= packet_size;
+        Send(packet_size, loss(m_Random) < m_LossRate);
+      }
+    }
+  }
+
+  std::uint64_t GetDeliveredBytes() const {
+    return m_DeliveredBytes;
+  }
+
+  std::uint64_t GetMaxQueuingDelay() const {
+    return m_MaxQueuingDelay;
+  }
+
+ private:
+  struct Packet {
+    std::uint64_t send_time, ack_time;
+    bool is_lost;
+  };
+
+  void Send(
+      std::size_t size,
+      bool is_lost) {
+    Packet packet;
+    packet.send_time = m_Now;
+    std::uint64_t start = m_LinkFreeTime > m_Now ? m_LinkFreeTime : m_Now;
+    std::uint64_t queuing_delay = start - m_Now;
+    if (queuing_delay * m_Bandwidth > m_QueueSize) {
+      // dropped at the bottleneck, noticed after an RTT
+      packet.is_lost = true;
+      packet.ack_time = m_Now + 2 * m_Delay;
+    } else {
+      if (queuing_delay > m_MaxQueuingDelay)
+        m_MaxQueuingDelay = queuing_delay;
+      m_LinkFreeTime = start + (size + m_Bandwidth - 1) / m_Bandwidth;
+      packet.is_lost = is_lost;
+      packet.ack_time = m_LinkFreeTime + 2 * m_Delay;
+    }
+    // ACKs come back in order
+    if (!m_Packets.empty() && packet.ack_time < m_Packets.back().ack_time)
+      packet.ack_time = m_Packets.back().ack_time;
+    m_Packets.push_back(packet);
+    m_BytesInFlight += size;
+  }
+
+ private:
+  std::size_t m_Bandwidth;
+  std::uint64_t m_Delay;
+  std::size_t m_QueueSize;
+  double m_LossRate;
+  std::mt19937 m_Random;
+  std::uint64_t m_Now, m_LinkFreeTime;
+  std::size_t m_BytesInFlight;
+  std::deque<Packet> m_Packets;
+  std::uint64_t m_DeliveredBytes, m_MaxQueuingDelay;
+};
+
+const std::size_t PACKET_SIZE = 1000;
+
+BOOST_AUTO_TEST_SUITE(SSUCongestionTests)
+
+BOOST_AUTO_TEST_CASE(FillsLinkWithoutBuildingQueue) {
+  // 1 MB/s with a 100 ms RTT and a queue of 500 ms
+  LinkEmulator link(1000, 50, 500000, 0.0);
+  i2p::transport::SSUDelayBasedCongestionControl control(PACKET_SIZE);
+  link.Run(&control, PACKET_SIZE, 20000);
+  BOOST_CHECK(link.GetDeliveredBytes() > 20000 * 1000 * 8 / 10);
+  // a loss-based controller would fill the whole queue
+  BOOST_CHECK(link.GetMaxQueuingDelay() < 250);
+}
+
+BOOST_AUTO_TEST_CASE(ProgressesOverLossyLink) {
+  LinkEmulator link(1000, 50, 500000, 0.01);
+  i2p::transport::SSUDelayBasedCongestionControl control(PACKET_SIZE);
+  link.Run(&control, PACKET_SIZE, 20000);
+  BOOST_CHECK(link.GetDeliveredBytes() > 20000 * 1000 / 4);
+}
+
+BOOST_AUTO_TEST_CASE(EstimatesRTO) {
+  i2p::transport::SSUDelayBasedCongestionControl control(PACKET_SIZE);
+  BOOST_CHECK_EQUAL(control.GetRTO(), i2p::transport::SSU_INITIAL_RTO);
+  BOOST_CHECK_EQUAL(control.GetPacingRate(), 0);
+  for (std::uint64_t now = 0; now < 100; now++)
+    control.OnAck(PACKET_SIZE, 300, now);
+  BOOST_CHECK_EQUAL(control.GetSmoothedRTT(), 300);
+  BOOST_CHECK(control.GetRTO() >= 300);
+  BOOST_CHECK(control.GetRTO() < 400);
+  BOOST_CHECK(control.GetPacingRate() > 0);
+}
+
+BOOST_AUTO_TEST_CASE(BacksOffOnCongestion) {
+  i2p::transport::SSUDelayBasedCongestionControl control(PACKET_SIZE);
+  control.OnAck(PACKET_SIZE, 100, 0);
+  std::size_t window = control.GetWindow();
+  control.OnCongestionNotification(1);
+  BOOST_CHECK_EQUAL(control.GetWindow(), window / 2);
+  // once per RTT
+  control.OnLoss(2);
+  BOOST_CHECK_EQUAL(control.GetWindow(), window / 2);
+  std::uint64_t rto = control.GetRTO();
+  control.OnTimeout(1000);
+  BOOST_CHECK_EQUAL(
+      control.GetWindow(), i2p::transport::SSU_MIN_WINDOW * PACKET_SIZE);
+  BOOST_CHECK_EQUAL(control.GetRTO(), 2 * rto);
+}
+
+BOOST_AUTO_TEST_CASE(KeepsBaseDelayOverHistory) {
+  i2p::transport::SSUDelayBasedCongestionControl control(PACKET_SIZE);
+  control.OnAck(PACKET_SIZE, 100, 0);
+  // a standing queue must not become the base delay
+  std::uint64_t now = 0;
+  for (; now < 5 * i2p::transport::SSU_BASE_DELAY_INTERVAL; now += 1000)
+    control.OnAck(PACKET_SIZE, 300, now);
+  BOOST_CHECK_EQUAL(control.GetBaseDelay(), 100);
+  // but a route change is followed once the history is over
+  std::uint64_t end = i2p::transport::SSU_BASE_DELAY_HISTORY *
+    i2p::transport::SSU_BASE_DELAY_INTERVAL;
+  for (; now <= end; now += 1000)
+    control.OnAck(PACKET_SIZE, 300, now);
+  BOOST_CHECK_EQUAL(control.GetBaseDelay(), 300);
+  // and so is a shorter route at once
+  control.OnAck(PACKET_SIZE, 80, now);
+  BOOST_CHECK_EQUAL(control.GetBaseDelay(), 80);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
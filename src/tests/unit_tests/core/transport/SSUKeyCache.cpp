@@ -0,0 +1,95 @@
+/**
+ * Copyright (c) 2015-2016, The Kovri I2P Router Project
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ *    conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *    of conditions and the following disclaimer in the documentation and/or other
+ *    materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include <cstdint>
+
+#include "crypto/AES.h"
+#include "transport/SSUKeyCache.h"
+
+struct SSUKeyCacheFixture {
+  SSUKeyCacheFixture()
+      : cache(2) {
+    for (int i = 0; i < 3; i++)
+      for (int j = 0; j < 32; j++)
+        keys[i]()[j] = static_cast<std::uint8_t>(i * 32 + j);
+    for (int i = 0; i < 16; i++)
+      iv[i] = static_cast<std::uint8_t>(0xA0 + i);
+    for (int i = 0; i < 64; i++)
+      plain[i] = static_cast<std::uint8_t>(i * 7 + 3);
+  }
+
+  i2p::transport::SSUKeyCache cache;
+  i2p::crypto::AESKey keys[3];
+  std::uint8_t iv[16];
+  std::uint8_t plain[64];
+};
+
+BOOST_FIXTURE_TEST_SUITE(SSUKeyCacheTests, SSUKeyCacheFixture)
+
+BOOST_AUTO_TEST_CASE(MatchesFreshKeySchedule) {
+  std::uint8_t expected[64], out[64];
+  i2p::crypto::CBCEncryption encryption(keys[0], iv);
+  encryption.Encrypt(plain, 64, expected);
+  // second call must reuse the schedule and still restart the chain
+  for (int i = 0; i < 2; i++) {
+    cache.Encrypt(keys[0], iv, plain, 64, out);
+    BOOST_CHECK_EQUAL_COLLECTIONS(out, out + 64, expected, expected + 64);
+  }
+  BOOST_CHECK_EQUAL(cache.GetNumMisses(), 1);
+  BOOST_CHECK_EQUAL(cache.GetNumHits(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(DecryptsInPlace) {
+  std::uint8_t buf[64];
+  cache.Encrypt(keys[1], iv, plain, 64, buf);
+  cache.Decrypt(keys[1], iv, buf, 64, buf);
+  BOOST_CHECK_EQUAL_COLLECTIONS(buf, buf + 64, plain, plain + 64);
+  BOOST_CHECK_EQUAL(cache.GetSize(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(EvictsLeastRecentlyUsed) {
+  std::uint8_t out[16];
+  cache.Encrypt(keys[0], iv, plain, 16, out);
+  cache.Encrypt(keys[1], iv, plain, 16, out);
+  cache.Encrypt(keys[0], iv, plain, 16, out);  // keys[1] is now oldest
+  cache.Encrypt(keys[2], iv, plain, 16, out);  // evicts keys[1]
+  BOOST_CHECK_EQUAL(cache.GetSize(), 2);
+  BOOST_CHECK_EQUAL(cache.GetNumMisses(), 3);
+  cache.Encrypt(keys[0], iv, plain, 16, out);
+  BOOST_CHECK_EQUAL(cache.GetNumMisses(), 3);
+  cache.Encrypt(keys[1], iv, plain, 16, out);
+  BOOST_CHECK_EQUAL(cache.GetNumMisses(), 4);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,143 @@
+/**
+ * Copyright (c) 2015-2016, The Kovri I2P Router Project
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ *    conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *    of conditions and the following disclaimer in the documentation and/or other
+ *    materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include <cstdint>
+
+#include "tunnel/TransitAdmission.h"
+
+using namespace i2p::tunnel;
+
+struct TransitAdmissionFixture {
+  TransitAdmissionFixture()
+      : now(1000000) {
+    load.maxNumTransitTunnels = 2500;
+    load.bandwidthLimit = 32 * 1024;
+  }
+
+  i2p::data::IdentHash Hop(
+      std::uint8_t id) {
+    std::uint8_t buf[32] = {};
+    buf[0] = id;
+    return i2p::data::IdentHash(buf);
+  }
+
+  TransitAdmission admission;
+  TransitLoad load;
+  std::uint64_t now;
+};
+
+BOOST_FIXTURE_TEST_SUITE(TransitAdmissionTests, TransitAdmissionFixture)
+
+BOOST_AUTO_TEST_CASE(AcceptsWhenIdle) {
+  BOOST_CHECK_EQUAL(admission.Admit(Hop(1), load, now), e_TransitAccepted);
+  BOOST_CHECK_EQUAL(admission.GetNumDecisions(e_TransitAccepted), 1);
+  BOOST_CHECK_EQUAL(admission.GetNumPeers(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(RejectsAtLimits) {
+  load.acceptsTunnels = false;
+  BOOST_CHECK_EQUAL(
+      admission.Admit(Hop(1), load, now), e_TransitRejectedNotAccepting);
+  load.acceptsTunnels = true;
+  load.numTransitTunnels = load.maxNumTransitTunnels;
+  BOOST_CHECK_EQUAL(
+      admission.Admit(Hop(2), load, now), e_TransitRejectedTunnelLimit);
+  load.numTransitTunnels = 0;
+  load.queueLoad = 1.0;
+  BOOST_CHECK_EQUAL(
+      admission.Admit(Hop(3), load, now), e_TransitRejectedQueue);
+  load.queueLoad = 0.0;
+  load.bandwidth = load.bandwidthLimit;
+  BOOST_CHECK_EQUAL(
+      admission.Admit(Hop(4), load, now), e_TransitRejectedBandwidth);
+  BOOST_CHECK_EQUAL(admission.GetNumDecisions(e_TransitAccepted), 0);
+}
+
+BOOST_AUTO_TEST_CASE(RejectsSomeNearLimit) {
+  load.bandwidth = load.bandwidthLimit * 0.9;
+  std::uint64_t num_accepted = 0;
+  for (std::uint64_t i = 0; i < TRANSIT_ADMISSION_ACCEPT_BURST; i++)
+    if (admission.Admit(Hop(0), load, now) == e_TransitAccepted)
+      num_accepted++;
+  BOOST_CHECK(num_accepted > 0);
+  BOOST_CHECK(num_accepted < TRANSIT_ADMISSION_ACCEPT_BURST);
+}
+
+BOOST_AUTO_TEST_CASE(LimitsPreviousHopRate) {
+  for (std::uint64_t i = 0; i < TRANSIT_ADMISSION_PEER_BURST; i++)
+    BOOST_CHECK_EQUAL(admission.Admit(Hop(1), load, now), e_TransitAccepted);
+  BOOST_CHECK_EQUAL(
+      admission.Admit(Hop(1), load, now), e_TransitRejectedPeerRate);
+  // other hops are not affected
+  BOOST_CHECK_EQUAL(admission.Admit(Hop(2), load, now), e_TransitAccepted);
+  // one more request a while later
+  now += 60000 / TRANSIT_ADMISSION_PEER_RATE;
+  BOOST_CHECK_EQUAL(admission.Admit(Hop(1), load, now), e_TransitAccepted);
+  BOOST_CHECK_EQUAL(
+      admission.Admit(Hop(1), load, now), e_TransitRejectedPeerRate);
+}
+
+BOOST_AUTO_TEST_CASE(ScalesPreviousHopRateWithBandwidth) {
+  load.bandwidthLimit = 256 * 1024;
+  std::uint64_t scale = TransitAdmission::GetPeerRateScale(
+      load.bandwidthLimit);
+  BOOST_CHECK_EQUAL(scale, 8);
+  // overall accepts are paced too, only the previous hop limit matters
+  for (std::uint64_t i = 0; i < TRANSIT_ADMISSION_PEER_BURST * scale; i++)
+    BOOST_CHECK(
+        admission.Admit(Hop(1), load, now) != e_TransitRejectedPeerRate);
+  BOOST_CHECK_EQUAL(
+      admission.Admit(Hop(1), load, now), e_TransitRejectedPeerRate);
+}
+
+BOOST_AUTO_TEST_CASE(PacesAccepts) {
+  // unknown previous hop is not rate limited on its own
+  i2p::data::IdentHash unknown = Hop(0);
+  for (std::uint64_t i = 0; i < TRANSIT_ADMISSION_ACCEPT_BURST; i++)
+    BOOST_CHECK_EQUAL(admission.Admit(unknown, load, now), e_TransitAccepted);
+  BOOST_CHECK_EQUAL(
+      admission.Admit(unknown, load, now), e_TransitRejectedAcceptRate);
+  now += 1000;
+  BOOST_CHECK_EQUAL(admission.Admit(unknown, load, now), e_TransitAccepted);
+  BOOST_CHECK_EQUAL(admission.GetNumPeers(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(ForgetsIdlePeers) {
+  admission.Admit(Hop(1), load, now);
+  admission.Admit(Hop(2), load, now + TRANSIT_ADMISSION_PEER_TIMEOUT);
+  admission.CleanupPeers(now + TRANSIT_ADMISSION_PEER_TIMEOUT + 1);
+  BOOST_CHECK_EQUAL(admission.GetNumPeers(), 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,128 @@
+/**
+ * Copyright (c) 2015-2016, The Kovri I2P Router Project
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ *    conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *    of conditions and the following disclaimer in the documentation and/or other
+ *    materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "I2NPProtocol.h"
+#include "tunnel/TunnelBuildPipeline.h"
+
+using i2p::tunnel::TunnelBuildPipeline;
+
+std::shared_ptr<i2p::I2NPMessage> CreateRequest(
+    std::uint32_t msg_id) {
+  auto msg = std::make_shared<i2p::I2NPMessageBuffer<1024> >();
+  msg->SetMsgID(msg_id);
+  return msg;
+}
+
+// Waits until the pipeline has answered the given number of requests
+bool WaitForAnswers(
+    const TunnelBuildPipeline& pipeline,
+    std::uint64_t num) {
+  for (int i = 0; i < 500; i++) {
+    if (pipeline.GetNumAccepted() + pipeline.GetNumRejected() >= num)
+      return true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  return false;
+}
+
+BOOST_AUTO_TEST_SUITE(TunnelBuildPipelineTests)
+
+BOOST_AUTO_TEST_CASE(CountsReplies) {
+  TunnelBuildPipeline pipeline(
+      [](std::shared_ptr<i2p::I2NPMessage> msg) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        return msg->GetMsgID() % 2 ? 30 : 0;
+      });
+  pipeline.SetNumThreads(2);
+  pipeline.Start();
+  for (std::uint32_t i = 0; i < 10; i++)
+    BOOST_CHECK(pipeline.Put(CreateRequest(i)));
+  BOOST_REQUIRE(WaitForAnswers(pipeline, 10));
+  pipeline.Stop();
+  BOOST_CHECK_EQUAL(pipeline.GetNumAccepted(), 5);
+  BOOST_CHECK_EQUAL(pipeline.GetNumRejected(), 5);
+  BOOST_CHECK_EQUAL(pipeline.GetNumDropped(), 0);
+  BOOST_CHECK_EQUAL(pipeline.GetQueueSize(), 0);
+  BOOST_CHECK(pipeline.GetProcessingTime() > 0.0);
+}
+
+BOOST_AUTO_TEST_CASE(DropsWhenBacklogged) {
+  TunnelBuildPipeline pipeline(
+      [](std::shared_ptr<i2p::I2NPMessage>) { return 0; });
+  // not started, so nothing leaves the queue
+  std::size_t num_queued = 0;
+  for (std::uint32_t i = 0; i < 2 * i2p::tunnel::TUNNEL_BUILD_QUEUE_SIZE; i++)
+    if (pipeline.Put(CreateRequest(i)))
+      num_queued++;
+  BOOST_CHECK_EQUAL(pipeline.GetQueueSize(), num_queued);
+  BOOST_CHECK(num_queued >= i2p::tunnel::TUNNEL_BUILD_QUEUE_EARLY_DROP);
+  BOOST_CHECK(num_queued <= i2p::tunnel::TUNNEL_BUILD_QUEUE_SIZE);
+  BOOST_CHECK_EQUAL(
+      pipeline.GetNumDropped(),
+      2 * i2p::tunnel::TUNNEL_BUILD_QUEUE_SIZE - num_queued);
+}
+
+BOOST_AUTO_TEST_CASE(ServesNewestFirstWhenBacklogged) {
+  std::mutex order_mutex;
+  std::vector<std::uint32_t> order;
+  TunnelBuildPipeline pipeline(
+      [&order_mutex, &order](std::shared_ptr<i2p::I2NPMessage> msg) {
+        std::unique_lock<std::mutex> l(order_mutex);
+        order.push_back(msg->GetMsgID());
+        return 0;
+      });
+  std::uint32_t newest = 0;
+  for (std::uint32_t i = 0; i < 2 * i2p::tunnel::TUNNEL_BUILD_QUEUE_SIZE; i++)
+    if (pipeline.Put(CreateRequest(i)))
+      newest = i;
+  auto num_queued = pipeline.GetQueueSize();
+  BOOST_REQUIRE(num_queued > i2p::tunnel::TUNNEL_BUILD_QUEUE_EARLY_DROP);
+  pipeline.SetNumThreads(1);
+  pipeline.Start();
+  BOOST_REQUIRE(WaitForAnswers(pipeline, num_queued));
+  pipeline.Stop();
+  BOOST_REQUIRE_EQUAL(order.size(), num_queued);
+  BOOST_CHECK_EQUAL(order.front(), newest);
+  // oldest requests are served in arrival order once the backlog clears
+  BOOST_CHECK_EQUAL(
+      order.at(num_queued - i2p::tunnel::TUNNEL_BUILD_QUEUE_EARLY_DROP), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
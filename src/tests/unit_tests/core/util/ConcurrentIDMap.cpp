@@ -0,0 +1,165 @@
+/**
+ * Copyright (c) 2015-2016, The Kovri I2P Router Project
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ *    conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *    of conditions and the following disclaimer in the documentation and/or other
+ *    materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "util/ConcurrentIDMap.h"
+#include "util/Epoch.h"
+
+struct MappedObject : public std::enable_shared_from_this<MappedObject> {
+  explicit MappedObject(std::uint32_t id) : id(id) {}
+  std::uint32_t id;
+};
+
+typedef i2p::util::ConcurrentIDMap<MappedObject> TestMap;
+
+struct ConcurrentIDMapFixture {
+  ConcurrentIDMapFixture() : map(epoch) {}
+  i2p::util::EpochDomain epoch;
+  TestMap map;
+};
+
+BOOST_FIXTURE_TEST_SUITE(ConcurrentIDMapTests, ConcurrentIDMapFixture)
+
+BOOST_AUTO_TEST_CASE(InsertsFindsAndRemoves) {
+  BOOST_CHECK(map.Insert(0, std::make_shared<MappedObject>(0)));
+  BOOST_CHECK(map.Insert(42, std::make_shared<MappedObject>(42)));
+  BOOST_CHECK(!map.Insert(42, std::make_shared<MappedObject>(43)));
+  BOOST_CHECK_EQUAL(map.GetSize(), 2);
+  BOOST_CHECK_EQUAL(map.Get(0)->id, 0);
+  BOOST_CHECK_EQUAL(map.Get(42)->id, 42);
+  BOOST_CHECK(!map.Get(7));
+  BOOST_CHECK(map.Remove(42));
+  BOOST_CHECK(!map.Remove(42));
+  BOOST_CHECK(!map.Get(42));
+  BOOST_CHECK_EQUAL(map.GetSize(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(RemovesOnlyExpectedObject) {
+  auto object = std::make_shared<MappedObject>(1);
+  map.Set(1, object);
+  map.Set(1, std::make_shared<MappedObject>(1));
+  BOOST_CHECK(!map.Remove(1, object.get()));
+  BOOST_CHECK_EQUAL(map.GetSize(), 1);
+  BOOST_CHECK(map.Remove(1, map.Get(1).get()));
+  BOOST_CHECK(map.IsEmpty());
+}
+
+BOOST_AUTO_TEST_CASE(GrowsAndReusesRemovedSlots) {
+  for (std::uint32_t id = 0; id < 1000; id++)
+    map.Insert(id * 7919, std::make_shared<MappedObject>(id));
+  BOOST_CHECK_EQUAL(map.GetSize(), 1000);
+  BOOST_CHECK(map.GetCapacity() >= 2000);
+  for (std::uint32_t id = 0; id < 1000; id++)
+    BOOST_CHECK_EQUAL(map.Get(id * 7919)->id, id);
+  std::size_t capacity = map.GetCapacity();
+  // churn must not grow the table
+  for (std::uint32_t id = 1000; id < 100000; id++) {
+    map.Insert(id * 7919, std::make_shared<MappedObject>(id));
+    map.Remove((id - 1000) * 7919);
+  }
+  BOOST_CHECK_EQUAL(map.GetSize(), 1000);
+  BOOST_CHECK_EQUAL(map.GetCapacity(), capacity);
+  BOOST_CHECK_EQUAL(map.GetValues().size(), 1000);
+}
+
+BOOST_AUTO_TEST_CASE(KeepsRemovedObjectWhileGuarded) {
+  auto object = std::make_shared<MappedObject>(5);
+  std::weak_ptr<MappedObject> weak = object;
+  map.Insert(5, std::move(object));
+  {
+    i2p::util::EpochDomain::Guard guard(epoch);
+    MappedObject* found = map.Find(5);
+    BOOST_REQUIRE(found);
+    map.Remove(5);
+    epoch.Reclaim();
+    BOOST_CHECK(!weak.expired());
+    BOOST_CHECK_EQUAL(found->id, 5);
+  }
+  epoch.Reclaim();
+  BOOST_CHECK(weak.expired());
+  BOOST_CHECK_EQUAL(epoch.GetNumRetired(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(ClearsAllObjects) {
+  std::vector<std::weak_ptr<MappedObject> > weak;
+  for (std::uint32_t id = 0; id < 100; id++) {
+    auto object = std::make_shared<MappedObject>(id);
+    weak.push_back(object);
+    map.Insert(id, std::move(object));
+  }
+  map.Clear();
+  epoch.Reclaim();
+  BOOST_CHECK(map.IsEmpty());
+  BOOST_CHECK(!map.Get(1));
+  for (const auto& object : weak)
+    BOOST_CHECK(object.expired());
+}
+
+BOOST_AUTO_TEST_CASE(ReadsWhileWriting) {
+  const std::uint32_t num_ids = 256;
+  std::atomic<bool> stop(false);
+  std::atomic<std::size_t> num_errors(0);
+  std::vector<std::thread> readers;
+  for (int i = 0; i < 4; i++)
+    readers.emplace_back([this, &stop, &num_errors, num_ids]() {
+      while (!stop) {
+        i2p::util::EpochDomain::Guard guard(epoch);
+        for (std::uint32_t id = 0; id < num_ids; id++) {
+          MappedObject* found = map.Find(id);
+          if (found && found->id != id)
+            num_errors++;
+        }
+      }
+    });
+  for (int round = 0; round < 200; round++) {
+    for (std::uint32_t id = 0; id < num_ids; id++)
+      map.Set(id, std::make_shared<MappedObject>(id));
+    for (std::uint32_t id = 0; id < num_ids; id += 2)
+      map.Remove(id);
+  }
+  stop = true;
+  for (auto& reader : readers)
+    reader.join();
+  BOOST_CHECK_EQUAL(num_errors, 0);
+  map.Clear();
+  epoch.Reclaim();
+  BOOST_CHECK_EQUAL(epoch.GetNumRetired(), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,82 @@
+/**
+ * Copyright (c) 2015-2016, The Kovri I2P Router Project
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ *    conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *    of conditions and the following disclaimer in the documentation and/or other
+ *    materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include <cstdint>
+
+#include "util/DuplicateFilter.h"
+
+BOOST_AUTO_TEST_SUITE(DuplicateFilterTests)
+
+BOOST_AUTO_TEST_CASE(DetectsDuplicate) {
+  i2p::util::DuplicateFilter filter(100, 0.001, 10);
+  BOOST_CHECK(!filter.IsDuplicate(42, 0));
+  BOOST_CHECK(filter.IsDuplicate(42, 1));
+  BOOST_CHECK_EQUAL(filter.GetNumChecks(), 2);
+  BOOST_CHECK_EQUAL(filter.GetNumHits(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(RemembersForOneWindow) {
+  i2p::util::DuplicateFilter filter(100, 0.001, 10);
+  BOOST_CHECK(!filter.IsDuplicate(42, 100));
+  // key moves to the previous generation
+  BOOST_CHECK(filter.IsDuplicate(42, 110));
+  BOOST_CHECK(!filter.IsDuplicate(7, 115));
+  // previous generation is dropped
+  BOOST_CHECK(!filter.IsDuplicate(42, 120));
+}
+
+BOOST_AUTO_TEST_CASE(RemembersLastCapacityKeys) {
+  const std::uint64_t capacity = 1000;
+  i2p::util::DuplicateFilter filter(capacity, 0.001, 10);
+  for (std::uint64_t key = 0; key < 10 * capacity; key++)
+    filter.IsDuplicate(key, 0);
+  for (std::uint64_t key = 9 * capacity; key < 10 * capacity; key++)
+    BOOST_CHECK(filter.IsDuplicate(key, 0));
+}
+
+BOOST_AUTO_TEST_CASE(FalsePositiveRateIsBounded) {
+  const std::uint64_t capacity = 10000;
+  i2p::util::DuplicateFilter filter(capacity, 0.01, 10);
+  for (std::uint64_t key = 0; key < 2 * capacity; key++)
+    filter.IsDuplicate(key, 0);
+  std::uint64_t hits = filter.GetNumHits();
+  for (std::uint64_t key = 0; key < capacity; key++)
+    filter.IsDuplicate(key + (1ULL << 40), 0);
+  hits = filter.GetNumHits() - hits;
+  BOOST_CHECK(hits < capacity * 0.02);
+  BOOST_CHECK(filter.GetExpectedFalsePositives() > 0.0);
+  BOOST_CHECK(filter.GetExpectedFalsePositives() < capacity * 0.02 * 3);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
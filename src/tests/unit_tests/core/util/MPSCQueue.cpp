@@ -0,0 +1,152 @@
+/**
+ * Copyright (c) 2015-2016, The Kovri I2P Router Project
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ *    conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *    of conditions and the following disclaimer in the documentation and/or other
+ *    materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "util/MPSCQueue.h"
+
+typedef i2p::util::MPSCQueue<std::shared_ptr<int> > IntQueue;
+
+BOOST_AUTO_TEST_SUITE(MPSCQueueTests)
+
+BOOST_AUTO_TEST_CASE(PutGetInOrder) {
+  IntQueue queue(8);
+  BOOST_CHECK(queue.IsEmpty());
+  BOOST_CHECK(!queue.Get());
+  for (int i = 0; i < 5; i++)
+    BOOST_CHECK(queue.Put(std::make_shared<int>(i)));
+  BOOST_CHECK_EQUAL(queue.GetSize(), 5);
+  for (int i = 0; i < 5; i++)
+    BOOST_CHECK_EQUAL(*queue.Get(), i);
+  BOOST_CHECK(queue.IsEmpty());
+}
+
+BOOST_AUTO_TEST_CASE(DropsWhenFull) {
+  IntQueue queue(4);
+  BOOST_CHECK_EQUAL(queue.GetCapacity(), 4);
+  for (int i = 0; i < 4; i++)
+    BOOST_CHECK(queue.Put(std::make_shared<int>(i)));
+  BOOST_CHECK(!queue.Put(std::make_shared<int>(4)));
+  BOOST_CHECK_EQUAL(queue.GetNumDropped(), 1);
+  BOOST_CHECK_EQUAL(queue.GetHighWaterMark(), 4);
+  // Room again after a Get, and the ring wraps around
+  BOOST_CHECK_EQUAL(*queue.Get(), 0);
+  BOOST_CHECK(queue.Put(std::make_shared<int>(5)));
+  std::vector<std::shared_ptr<int> > batch;
+  BOOST_CHECK_EQUAL(queue.GetBatch(batch, 10), 4);
+  BOOST_CHECK_EQUAL(*batch.front(), 1);
+  BOOST_CHECK_EQUAL(*batch.back(), 5);
+}
+
+BOOST_AUTO_TEST_CASE(PutBatch) {
+  IntQueue queue(8);
+  std::vector<std::shared_ptr<int> > vec;
+  for (int i = 0; i < 6; i++)
+    vec.push_back(std::make_shared<int>(i));
+  BOOST_CHECK(queue.Put(vec));
+  // Only two fit
+  BOOST_CHECK(!queue.Put(vec));
+  BOOST_CHECK_EQUAL(queue.GetNumDropped(), 4);
+  std::vector<std::shared_ptr<int> > batch;
+  BOOST_CHECK_EQUAL(queue.GetBatch(batch, 3), 3);
+  BOOST_CHECK_EQUAL(queue.GetBatch(batch, 10), 5);
+  BOOST_CHECK_EQUAL(*batch[5], 5);
+  BOOST_CHECK_EQUAL(*batch[6], 0);
+  BOOST_CHECK_EQUAL(*batch[7], 1);
+}
+
+BOOST_AUTO_TEST_CASE(ManyProducers) {
+  IntQueue queue(1024);
+  const int num_threads = 4,
+            num_per_thread = 10000;
+  std::vector<std::thread> producers;
+  for (int t = 0; t < num_threads; t++) {
+    producers.emplace_back([&queue, t]() {
+      for (int i = 0; i < num_per_thread; i++) {
+        auto e = std::make_shared<int>(t * num_per_thread + i);
+        while (!queue.Put(e))
+          std::this_thread::yield();
+      }
+    });
+  }
+  // Elements of each producer must arrive in the order it put them
+  std::vector<int> last(num_threads, -1);
+  std::vector<std::shared_ptr<int> > batch;
+  int received = 0;
+  while (received < num_threads * num_per_thread) {
+    batch.clear();
+    received += queue.GetBatchWithTimeout(batch, 64, 1000);
+    for (const auto& e : batch) {
+      const int t = *e / num_per_thread;
+      BOOST_REQUIRE(*e > last[t]);
+      last[t] = *e;
+    }
+  }
+  for (auto& producer : producers)
+    producer.join();
+  BOOST_CHECK(queue.IsEmpty());
+  BOOST_CHECK(queue.GetHighWaterMark() <= 1024);
+}
+
+BOOST_AUTO_TEST_CASE(WaitsForPut) {
+  IntQueue queue;
+  std::thread producer([&queue]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    queue.Put(std::make_shared<int>(42));
+  });
+  auto e = queue.GetNextWithTimeout(10000);
+  producer.join();
+  BOOST_REQUIRE(e);
+  BOOST_CHECK_EQUAL(*e, 42);
+}
+
+BOOST_AUTO_TEST_CASE(WakeUpWithoutPut) {
+  IntQueue queue;
+  std::thread waker([&queue]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    queue.WakeUp();
+  });
+  const auto start = std::chrono::steady_clock::now();
+  BOOST_CHECK(!queue.GetNext());
+  waker.join();
+  BOOST_CHECK(
+      std::chrono::steady_clock::now() - start < std::chrono::seconds(10));
+  BOOST_CHECK(!queue.Wait(0, 10));  // times out
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,112 @@
+/**
+ * Copyright (c) 2015-2016, The Kovri I2P Router Project
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ *    conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *    of conditions and the following disclaimer in the documentation and/or other
+ *    materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include <thread>
+#include <vector>
+
+#include "util/MemoryPool.h"
+
+struct PooledObject {
+  PooledObject() : value(0) {}
+  void Reset() {
+    value = 0;
+  }
+  int value;
+};
+
+typedef i2p::util::MemoryPool<PooledObject, 4, 8> TestPool;
+
+BOOST_AUTO_TEST_SUITE(MemoryPoolTests)
+
+BOOST_AUTO_TEST_CASE(ReusesReleasedObject) {
+  auto& pool = TestPool::Instance();
+  auto object = pool.Acquire();
+  object->value = 42;
+  pool.Release(object);
+  auto reused = pool.Acquire();
+  BOOST_CHECK_EQUAL(reused, object);
+  BOOST_CHECK_EQUAL(reused->value, 0);
+  pool.Release(reused);
+}
+
+BOOST_AUTO_TEST_CASE(CentralListIsBounded) {
+  auto& pool = TestPool::Instance();
+  std::vector<PooledObject*> objects;
+  for (int i = 0; i < 64; i++)
+    objects.push_back(pool.Acquire());
+  for (auto object : objects)
+    pool.Release(object);
+  BOOST_CHECK(pool.GetCentralSize() <= 8);
+}
+
+BOOST_AUTO_TEST_CASE(ReleasedOnOtherThread) {
+  auto& pool = TestPool::Instance();
+  std::vector<PooledObject*> objects;
+  for (int i = 0; i < 4; i++)
+    objects.push_back(pool.Acquire());
+  std::thread thread([&pool, &objects]() {
+    for (auto object : objects)
+      pool.Release(object);
+  });
+  thread.join();
+  // exiting thread hands its cache back to the central list
+  BOOST_CHECK(pool.GetCentralSize() >= objects.size());
+}
+
+BOOST_AUTO_TEST_CASE(ReleasedAfterThreadCacheIsGone) {
+  auto& pool = TestPool::Instance();
+  // destroyed at thread exit after the pool's cache, which is created
+  // later, like a global releasing messages at shutdown
+  struct LateReleaser {
+    ~LateReleaser() {
+      TestPool::Instance().Release(object);
+    }
+    PooledObject* object = nullptr;
+  };
+  std::vector<PooledObject*> objects;
+  while (pool.GetCentralSize())
+    objects.push_back(pool.Acquire());
+  std::thread thread([&pool]() {
+    static thread_local LateReleaser releaser;
+    releaser.object = new PooledObject();
+    pool.Release(pool.Acquire());
+  });
+  thread.join();
+  // one from the exiting cache, one released after it
+  BOOST_CHECK_EQUAL(pool.GetCentralSize(), 2);
+  for (auto object : objects)
+    pool.Release(object);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
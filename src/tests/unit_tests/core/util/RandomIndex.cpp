@@ -0,0 +1,153 @@
+/**
+ * Copyright (c) 2015-2016, The Kovri I2P Router Project
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ *    conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *    of conditions and the following disclaimer in the documentation and/or other
+ *    materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include <memory>
+#include <random>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "util/RandomIndex.h"
+
+typedef i2p::util::RandomIndex<std::shared_ptr<int>> TestIndex;
+
+struct RandomIndexFixture {
+  RandomIndexFixture()
+      : random(1) {
+    for (int i = 0; i < 100; i++)
+      elements.push_back(std::make_shared<int>(i));
+  }
+  std::mt19937 random;
+  std::vector<std::shared_ptr<int>> elements;
+};
+
+BOOST_FIXTURE_TEST_SUITE(RandomIndexTests, RandomIndexFixture)
+
+BOOST_AUTO_TEST_CASE(EmptyIndex) {
+  TestIndex index;
+  BOOST_CHECK_EQUAL(index.GetSize(), 0);
+  BOOST_CHECK(!index.GetRandom(random, [](std::shared_ptr<int>) {
+    return true;
+  }));
+}
+
+BOOST_AUTO_TEST_CASE(AddRemove) {
+  TestIndex index;
+  for (auto& element : elements)
+    BOOST_CHECK(index.Add(element));
+  BOOST_CHECK(!index.Add(elements[0]));
+  BOOST_CHECK_EQUAL(index.GetSize(), elements.size());
+  for (std::size_t i = 0; i < elements.size(); i += 2)
+    BOOST_CHECK(index.Remove(elements[i]));
+  BOOST_CHECK(!index.Remove(elements[0]));
+  BOOST_CHECK_EQUAL(index.GetSize(), elements.size() / 2);
+  // only odd elements remain
+  std::set<int> seen;
+  for (int i = 0; i < 1000; i++) {
+    auto element = index.GetRandom(random, [](std::shared_ptr<int>) {
+      return true;
+    });
+    BOOST_REQUIRE(element);
+    BOOST_CHECK(*element % 2);
+    seen.insert(*element);
+  }
+  BOOST_CHECK_EQUAL(seen.size(), elements.size() / 2);
+}
+
+BOOST_AUTO_TEST_CASE(RareMatchIsFound) {
+  TestIndex index;
+  index.Assign(elements.begin(), elements.end());
+  for (int i = 0; i < 100; i++) {
+    auto element = index.GetRandom(random, [](std::shared_ptr<int> e) {
+      return *e == 42;
+    });
+    BOOST_REQUIRE(element);
+    BOOST_CHECK_EQUAL(*element, 42);
+  }
+  BOOST_CHECK(!index.GetRandom(random, [](std::shared_ptr<int>) {
+    return false;
+  }));
+}
+
+BOOST_AUTO_TEST_CASE(RemoveIf) {
+  TestIndex index;
+  index.Assign(elements.begin(), elements.end());
+  BOOST_CHECK_EQUAL(
+      index.RemoveIf([](std::shared_ptr<int> e) { return *e < 90; }),
+      90);
+  BOOST_CHECK_EQUAL(index.GetSize(), 10);
+  // positions of swapped elements stay valid
+  for (int i = 90; i < 100; i++)
+    BOOST_CHECK(index.Remove(elements[i]));
+  BOOST_CHECK_EQUAL(index.GetSize(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(ReaderKeepsSnapshot) {
+  TestIndex index;
+  index.Add(elements[0]);
+  std::weak_ptr<int> weak = elements[0];
+  auto element = index.GetRandom(random, [](std::shared_ptr<int>) {
+    return true;
+  });
+  index.Clear();
+  elements.clear();
+  // a sampled element stays valid after it left the index
+  BOOST_CHECK(!weak.expired());
+  BOOST_CHECK_EQUAL(*element, 0);
+}
+
+BOOST_AUTO_TEST_CASE(ReadsWhileWriting) {
+  TestIndex index;
+  std::thread writer([this, &index]() {
+    for (int round = 0; round < 100; round++) {
+      for (auto& element : elements)
+        index.Add(element);
+      for (std::size_t i = 0; i < elements.size(); i += 2)
+        index.Remove(elements[i]);
+    }
+  });
+  std::mt19937 reader_random(2);
+  for (int i = 0; i < 10000; i++)
+    index.GetRandom(reader_random, [](std::shared_ptr<int>) {
+      return true;
+    });
+  writer.join();
+  // changes of the last write are published to the next reader
+  BOOST_CHECK_EQUAL(index.GetSize(), elements.size() / 2);
+  index.Add(elements[0]);
+  index.Publish();
+  BOOST_CHECK_EQUAL(index.GetSize(), elements.size() / 2 + 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,126 @@
+/**
+ * Copyright (c) 2015-2016, The Kovri I2P Router Project
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ *    conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *    of conditions and the following disclaimer in the documentation and/or other
+ *    materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <random>
+#include <vector>
+
+#include "util/TimerWheel.h"
+
+typedef i2p::util::TimerWheel<int> TestWheel;
+
+BOOST_AUTO_TEST_SUITE(TimerWheelTests)
+
+BOOST_AUTO_TEST_CASE(ExpiresAtDeadline) {
+  TestWheel wheel(1000);
+  wheel.Schedule(1010, 1);
+  std::vector<int> expired;
+  wheel.Advance(1009, expired);
+  BOOST_CHECK(expired.empty());
+  wheel.Advance(1010, expired);
+  BOOST_REQUIRE_EQUAL(expired.size(), 1);
+  BOOST_CHECK_EQUAL(expired[0], 1);
+  BOOST_CHECK_EQUAL(wheel.GetSize(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(OverdueExpiresOnNextTick) {
+  TestWheel wheel(1000);
+  wheel.Schedule(900, 1);
+  std::vector<int> expired;
+  wheel.Advance(1000, expired);
+  BOOST_CHECK(expired.empty());
+  wheel.Advance(1001, expired);
+  BOOST_CHECK_EQUAL(expired.size(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(ExpiresAcrossLevels) {
+  TestWheel wheel(12345);
+  // tunnel lifetimes, and deadlines beyond the top level
+  std::vector<std::uint64_t> delays {
+    1, 63, 64, 65, 660, 4095, 4096, 4097, 262143, 262144, 20000000 };
+  for (std::size_t i = 0; i < delays.size(); i++)
+    wheel.Schedule(12345 + delays[i], i);
+  for (std::size_t i = 0; i < delays.size(); i++) {
+    std::vector<int> expired;
+    wheel.Advance(12345 + delays[i] - 1, expired);
+    BOOST_CHECK(expired.empty());
+    wheel.Advance(12345 + delays[i], expired);
+    BOOST_REQUIRE_EQUAL(expired.size(), 1);
+    BOOST_CHECK_EQUAL(expired[0], i);
+  }
+  BOOST_CHECK_EQUAL(wheel.GetSize(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(MatchesSortedDeadlines) {
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<std::uint64_t> delay(0, 20000);
+  std::uniform_int_distribution<std::uint64_t> step(1, 300);
+  std::uint64_t now = 1470000000;
+  TestWheel wheel(now);
+  std::multimap<std::uint64_t, int> deadlines;
+  for (int i = 0; i < 10000; i++) {
+    auto deadline = now + 1 + delay(gen);
+    wheel.Schedule(deadline, i);
+    deadlines.insert(std::make_pair(deadline, i));
+    if (i % 10)
+      continue;
+    now += step(gen);
+    std::vector<int> expired, expected;
+    wheel.Advance(now, expired);
+    auto end = deadlines.upper_bound(now);
+    for (auto it = deadlines.begin(); it != end; it++)
+      expected.push_back(it->second);
+    deadlines.erase(deadlines.begin(), end);
+    std::sort(expired.begin(), expired.end());
+    std::sort(expected.begin(), expected.end());
+    BOOST_REQUIRE(expired == expected);
+  }
+  BOOST_CHECK_EQUAL(wheel.GetSize(), deadlines.size());
+}
+
+BOOST_AUTO_TEST_CASE(JumpsFarAhead) {
+  TestWheel wheel(1000);
+  wheel.Schedule(2000, 1);
+  wheel.Schedule(1000 + 50000000, 2);
+  std::vector<int> expired;
+  wheel.Advance(1000 + 40000000, expired);
+  BOOST_REQUIRE_EQUAL(expired.size(), 1);
+  BOOST_CHECK_EQUAL(expired[0], 1);
+  wheel.Advance(1000 + 50000000, expired);
+  BOOST_CHECK_EQUAL(expired.size(), 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()